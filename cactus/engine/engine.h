@@ -2,10 +2,15 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <list>
 
 #include "../graph/graph.h"
 
@@ -57,6 +62,12 @@ struct Config {
     uint32_t num_top_experts = 0;
     uint32_t moe_every_n_layers = 0;
     bool tie_word_embeddings = true;
+    // Load q/k/v and gate/up as one concatenated weight per layer. Off by default: the fused
+    // copy lives on the heap, so it adds its size to resident memory instead of sharing the
+    // page cache with the mapped files.
+    bool fuse_projections = false;
+    // Keep single-token decode graphs alive and replay them with patched per-step parameters.
+    bool decode_graph_replay = true;
 
     uint32_t vision_hidden_dim = 0;
     uint32_t vision_num_layers = 0;
@@ -106,6 +117,9 @@ struct Config {
     enum class Backend {CPU = 0, NPU = 1};
     Backend default_backend = Backend::CPU;
 
+    enum class Threading {INTRA_OP = 0, INTER_OP = 1, AUTO = 2};
+    Threading threading = Threading::AUTO;
+
     enum class Precision {INT8 = 0, FP16 = 1, FP32 = 2};
     Precision precision = Precision::FP32;
 
@@ -134,6 +148,14 @@ struct MergeRule {
 };
 
 
+// Splits text into words with the GPT-style pattern Qwen and LFM2 tokenizers pre-tokenize with;
+// max_digits is the longest run of numbers kept in one word.
+void split_words(std::string_view text, size_t max_digits, std::vector<std::string_view>& words);
+
+// Replaces each SentencePiece metaspace (U+2581) in a vocab entry with a plain space.
+std::string replace_metaspace(std::string_view token);
+
+
 struct ChatMessage {
     std::string role;
     std::string content;
@@ -150,6 +172,12 @@ public:
     virtual std::vector<uint32_t> encode(const std::string& text) const = 0;
     virtual std::string decode(const std::vector<uint32_t>& tokens) const = 0;
 
+    // Encodes each text on its own across the shared thread pool; encode must be safe to call concurrently.
+    std::vector<std::vector<uint32_t>> encode_batch(const std::vector<std::string>& texts) const;
+
+    // What decode gives for this token alone, precomputed at load; empty for unknown ids.
+    const std::string& token_bytes(uint32_t token) const;
+
     virtual std::vector<uint32_t> apply_chat_template(const std::vector<ChatMessage>& messages, bool add_generation_prompt = true) const;
     virtual std::string format_chat_prompt(const std::vector<ChatMessage>& messages, bool add_generation_prompt = true, const std::string& tools_json = "") const;
 
@@ -173,6 +201,7 @@ protected:
     ModelVariant model_variant_ = ModelVariant::DEFAULT;
     bool has_chat_template_ = false;
     std::string chat_template_;
+    std::vector<std::string> token_bytes_;
     
     uint32_t image_token_id_ = 396;
     uint32_t fake_token_id_ = 49189;
@@ -185,6 +214,22 @@ protected:
     std::string format_lfm2_vl_style(const std::vector<ChatMessage>& messages, bool add_generation_prompt, const std::string& tools_json) const;
 };
 
+// Turns generated tokens into text one at a time. The bytes of a UTF-8 character split across
+// tokens are held back until the character completes, so no piece ends mid-character.
+class StreamingDetokenizer {
+public:
+    explicit StreamingDetokenizer(const Tokenizer& tokenizer) : tokenizer_(tokenizer) {}
+
+    // The text this token completes; empty while a character is still partial.
+    std::string push(uint32_t token);
+    // Bytes still held back when generation ends, returned as they are; the stream is empty after.
+    std::string flush();
+
+private:
+    const Tokenizer& tokenizer_;
+    std::string pending_;
+};
+
 class BPETokenizer : public Tokenizer {
 public:
     BPETokenizer();
@@ -202,10 +247,17 @@ public:
     uint32_t get_eos_token() const override { return eos_token_id_; }
 
 private:
+    // Open-addressed (left id, right id) -> (rank, merged id) table; rank is the line in merges.txt.
+    struct MergeEntry {
+        uint64_t pair;
+        uint32_t rank;
+        uint32_t merged_id;
+    };
+
     std::unordered_map<std::string, uint32_t> token_to_id_;
     std::vector<std::string> id_to_token_;
-    std::vector<MergeRule> merge_rules_;
-    std::unordered_map<std::string, uint32_t> merge_map_;  
+    std::vector<MergeEntry> merge_table_;
+    uint32_t byte_token_ids_[256];
 
     uint32_t vocab_size_;
     uint32_t unk_token_id_;
@@ -218,12 +270,25 @@ private:
     void* merges_mmap_ptr_;
     size_t merges_mmap_size_;
 
-    std::vector<std::string> apply_bpe(const std::vector<std::string>& tokens) const;
-    std::pair<int, uint32_t> find_best_merge_fast(const std::vector<std::string>& tokens) const;
-    
+    const MergeEntry* find_merge(uint32_t left, uint32_t right) const;
+    void apply_bpe(std::vector<uint32_t>& symbols) const;
+    void encode_word(std::string_view word, std::vector<uint32_t>& token_ids) const;
+
+    // Set only when tokenizer.json pre-tokenizes with exactly one of the split patterns split_words implements.
+    bool pre_tokenize_ = false;
+    size_t max_digit_run_ = 1;
+
+    // Recently encoded words, most recent first, sharded by hash so encode_batch threads rarely share a lock.
+    struct WordCacheShard {
+        std::mutex mutex;
+        std::list<std::pair<std::string, std::vector<uint32_t>>> entries;
+        std::unordered_map<std::string, std::list<std::pair<std::string, std::vector<uint32_t>>>::iterator> index;
+    };
+    static constexpr size_t WORD_CACHE_SHARDS = 16;
+    mutable WordCacheShard word_cache_[WORD_CACHE_SHARDS];
+
     std::string bytes_to_unicode(const std::string& text) const;
     std::string unicode_to_bytes(const std::string& text) const;
-    std::vector<std::string> byte_level_split(const std::string& text) const;
 
     void cleanup_mmap();
     
@@ -243,6 +308,42 @@ private:
     void load_tokenizer_config(const std::string& config_file);
 };
 
+// Byte-level double-array trie from token strings to ids. The units are either built in memory
+// or mapped from a cache file saved next to the vocabulary.
+class DoubleArrayTrie {
+public:
+    struct Unit {
+        int32_t base;
+        int32_t check;
+        int32_t value;
+    };
+
+    DoubleArrayTrie() = default;
+    ~DoubleArrayTrie();
+    DoubleArrayTrie(const DoubleArrayTrie&) = delete;
+    DoubleArrayTrie& operator=(const DoubleArrayTrie&) = delete;
+
+    // keys[id] maps to id; empty keys are skipped and a repeated key keeps its last id.
+    void build(const std::vector<std::string>& keys);
+    // Maps a trie saved for the same fingerprint and key count; returns false if the file is stale.
+    bool load(const std::string& path, uint64_t fingerprint, size_t num_keys);
+    bool save(const std::string& path, uint64_t fingerprint) const;
+
+    // Byte length and id of the longest key that prefixes text, or {0, -1}.
+    std::pair<size_t, int32_t> longest_prefix(const char* text, size_t length) const;
+    size_t num_units() const { return size_; }
+
+private:
+    std::vector<Unit> units_;
+    const Unit* data_ = nullptr;
+    size_t size_ = 0;
+    size_t num_keys_ = 0;
+    void* mmap_ptr_ = nullptr;
+    size_t mmap_size_ = 0;
+
+    void release();
+};
+
 class SPTokenizer : public Tokenizer {
 public:
     SPTokenizer();
@@ -259,13 +360,7 @@ public:
     uint32_t get_eos_token() const override { return eos_token_id_; }
 
 private:
-    struct TrieNode {
-        std::unordered_map<char32_t, std::unique_ptr<TrieNode>> children;
-        int32_t token_id = -1;
-        float score = 0.0f;
-    };
-    
-    std::unique_ptr<TrieNode> trie_root_;
+    DoubleArrayTrie trie_;
     std::unordered_map<std::string, uint32_t> token_to_id_;
     std::vector<std::string> id_to_token_;
     std::vector<float> token_scores_;
@@ -279,8 +374,8 @@ private:
     void* vocab_mmap_ptr_;
     size_t vocab_mmap_size_;
     
-    void build_trie();
-    std::vector<std::pair<std::string, uint32_t>> tokenize_with_trie(const std::string& text) const;
+    void load_trie(const std::string& vocab_file);
+    void tokenize_with_trie(const std::string& text, std::vector<uint32_t>& token_ids) const;
     std::string preprocess_text(const std::string& text) const;
     std::string postprocess_text(const std::string& text) const;
     std::vector<std::string> split_by_unicode_spaces(const std::string& text) const;
@@ -296,6 +391,9 @@ private:
 
 class ConvCache {
 public:
+    // Rows kept beyond the window so the newest tokens can be rolled back.
+    static constexpr size_t ROLLBACK_ROWS = 16;
+
     struct CircularView {
         const void* ptr1;
         size_t len1;
@@ -309,6 +407,16 @@ public:
     void update(CactusGraph* gb, size_t layer, const size_t latest_token);
     void reset();
 
+    using Snapshot = std::vector<std::vector<uint8_t>>;
+    Snapshot snapshot() const;
+    // Whether restore takes the snapshot as is; restore throws, untouched, when it does not.
+    bool can_restore(const Snapshot& snapshot) const;
+    void restore(const Snapshot& snapshot);
+
+    // Drops the newest rows; fails when the window would need rows older than the kept history.
+    bool can_truncate(size_t tokens) const;
+    void truncate(size_t tokens);
+
     bool is_empty() const { return num_layers == 0; }
 
     size_t num_layers = 0;
@@ -320,25 +428,89 @@ public:
 private:
     struct LayerState {
         std::vector<uint8_t> data;  
-        size_t head = 0; 
         size_t count = 0; 
+        size_t total = 0;
     };
 
     std::vector<LayerState> layer_states;
 };
 
+// Fixed-size blocks of quantized KV rows carved out of one reserved mapping, shared by all
+// layers. Pages are only committed once a block is written, and released blocks are reused.
+class KVBlockPool {
+public:
+    KVBlockPool() = default;
+    ~KVBlockPool();
+    KVBlockPool(const KVBlockPool&) = delete;
+    KVBlockPool& operator=(const KVBlockPool&) = delete;
+    KVBlockPool(KVBlockPool&& other) noexcept { swap(other); }
+    KVBlockPool& operator=(KVBlockPool&& other) noexcept { swap(other); return *this; }
+
+    // Starts with num_blocks committed and grows on demand up to max_blocks.
+    void init(size_t block_tokens, size_t num_blocks, size_t max_blocks, size_t elements_per_token, size_t scales_per_token);
+    uint32_t allocate();
+    void release(uint32_t block) { free_blocks_.push_back(block); }
+    void release_all();
+
+    bool is_initialized() const { return mapping_ != nullptr; }
+    size_t block_tokens() const { return block_tokens_; }
+    size_t free_count() const { return free_blocks_.size(); }
+    size_t num_blocks() const { return num_blocks_; }
+    size_t max_blocks() const { return max_blocks_; }
+
+    int8_t* keys() const { return keys_; }
+    int8_t* values() const { return values_; }
+    float* key_scales() const { return key_scales_; }
+    float* value_scales() const { return value_scales_; }
+
+private:
+    void unmap();
+    void swap(KVBlockPool& other) noexcept;
+    void commit(size_t num_blocks);
+
+    void* mapping_ = nullptr;
+    size_t mapping_bytes_ = 0;
+    size_t row_region_bytes_ = 0;
+    size_t scale_region_bytes_ = 0;
+    size_t block_tokens_ = 0;
+    size_t num_blocks_ = 0;
+    size_t max_blocks_ = 0;
+    size_t elements_per_token_ = 0;
+    size_t scales_per_token_ = 0;
+    int8_t* keys_ = nullptr;
+    int8_t* values_ = nullptr;
+    float* key_scales_ = nullptr;
+    float* value_scales_ = nullptr;
+    std::vector<uint32_t> free_blocks_;
+};
+
 struct KVCache {
     static constexpr size_t DEFAULT_WINDOW_SIZE = 1024;
     static constexpr size_t DEFAULT_SINK_SIZE = 4;
+    static constexpr size_t DEFAULT_BLOCK_TOKENS = 32;
+    // Tokens per layer an unwindowed cache's block pool reserves address space for.
+    static constexpr size_t MAX_UNWINDOWED_TOKENS = 131072;
+    // Batched sequences that may share the block pool besides its owner; a windowed pool
+    // reserves one window per layer for each of them.
+    static constexpr size_t MAX_SHARED_SEQUENCES = 8;
+    // Rows slid out of the window that stay allocated, so a rollback can slide them back in.
+    static constexpr size_t ROLLBACK_ROWS = 16;
 
     struct LayerCache {
         std::vector<uint8_t> keys;
         std::vector<uint8_t> values;
         std::vector<float> key_scales;   
         std::vector<float> value_scales; 
+
+        std::vector<uint32_t> block_table;
+        size_t seq_len = 0;
+        size_t rows_used = 0;
+        size_t gap_rows = 0;
     };
 
     std::vector<LayerCache> layer_caches;
+    // Shared with the caches of batched sequences (init_shared), which draw blocks from it too.
+    std::shared_ptr<KVBlockPool> block_pool = std::make_shared<KVBlockPool>();
 
     size_t window_size = DEFAULT_WINDOW_SIZE;  
     size_t sink_size = DEFAULT_SINK_SIZE;    
@@ -355,7 +527,15 @@ struct KVCache {
     size_t get_effective_seq_len() const { return current_seq_len; }
     size_t get_total_seq_len() const { return total_seq_len; }
 
+    KVCache() = default;
+    KVCache(const KVCache&) = delete;
+    KVCache& operator=(const KVCache&) = delete;
+    KVCache(KVCache&&) = default;
+    KVCache& operator=(KVCache&&) = default;
+
     void init(size_t num_layers, size_t max_seq, size_t num_kv_heads, size_t head_dim, Precision model_precision);
+    // Same layout as owner, drawing blocks from owner's pool instead of reserving its own.
+    void init_shared(const KVCache& owner);
     void reset();
     void update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_nodes,
                           const std::vector<size_t>& v_nodes, size_t seq_len,
@@ -366,6 +546,7 @@ struct KVCache {
 
     bool is_empty() const { return current_seq_len == 0; }
     bool is_int8() const { return precision == Precision::INT8; }
+    bool is_paged() const { return is_int8(); }
     void* get_key_ptr(size_t layer);
     void* get_value_ptr(size_t layer);
 
@@ -384,6 +565,60 @@ struct KVCache {
     const int8_t* get_values_int8(size_t layer) const;
     const float* get_key_scales(size_t layer) const;
     const float* get_value_scales(size_t layer) const;
+    CactusKVBlocks get_blocks(size_t layer) const;
+
+    // Cached rows of each layer in position order, copied out of the block pool (paged caches only).
+    struct Snapshot {
+        size_t seq_len = 0;
+        size_t total_seq_len = 0;
+        std::vector<std::vector<int8_t>> keys;
+        std::vector<std::vector<int8_t>> values;
+        std::vector<std::vector<float>> key_scales;
+        std::vector<std::vector<float>> value_scales;
+
+        size_t byte_size() const;
+    };
+
+    Snapshot snapshot() const;
+    // Whether restore takes the snapshot as is: this cache's layout and a length it could have
+    // reached itself. restore throws, untouched, when it does not.
+    bool can_restore(const Snapshot& snapshot) const;
+    void restore(const Snapshot& snapshot);
+
+    // Drops the newest tokens from every layer (paged caches only) and slides the rows they evicted
+    // back into the window, leaving the cache as if they had never been appended. Fails once that
+    // would need rows older than the retained ROLLBACK_ROWS, or would reach into the sink rows.
+    bool can_truncate(size_t tokens) const;
+    void truncate(size_t tokens);
+
+private:
+    void init_block_pool();
+    void clear_layer_blocks(LayerCache& cache);
+    void append_paged(size_t layer, const __fp16* k_data, const __fp16* v_data, size_t num_tokens);
+    size_t claim_paged_rows(LayerCache& cache, size_t num_tokens, size_t& pool_row);
+    void write_paged_rows(LayerCache& cache, const __fp16* k_data, const __fp16* v_data, size_t num_tokens);
+    size_t paged_sink_rows() const { return window_size > 0 ? std::min(sink_size, window_size) : 0; }
+};
+
+// One sequence of a batched decode step: its own caches, the token it feeds next and its
+// sampling settings (negative or zero picks the model defaults, as in Model::decode).
+struct SequenceState {
+    SequenceState() = default;
+    SequenceState(const SequenceState&) = delete;
+    SequenceState& operator=(const SequenceState&) = delete;
+    // Hands the blocks back to the pool the sequence shares with its model.
+    ~SequenceState() { kv_cache.reset(); }
+
+    KVCache kv_cache;
+    ConvCache conv_cache;
+    uint32_t next_token = 0;
+    float temperature = -1.0f;
+    float top_p = -1.0f;
+    size_t top_k = 0;
+
+    std::vector<size_t> cache_k_nodes;
+    std::vector<size_t> cache_v_nodes;
+    std::vector<size_t> conv_bx_nodes;
 };
 
 class ToolCallConstrainer {
@@ -500,6 +735,14 @@ public:
 
     virtual uint32_t decode(const std::vector<uint32_t>& tokens, float temperature = -1.0f, float top_p = -1.0f,
                       size_t top_k = 0, const std::string& profile_file = "", float* out_entropy = nullptr);
+    // decode without the config defaults, so top_k == 0 and temperature == 0 stay greedy.
+    uint32_t decode_step(const std::vector<uint32_t>& tokens, float temperature, float top_p, size_t top_k,
+                         const std::string& profile_file = "", float* out_entropy = nullptr);
+    // Appends tokens to the caches and returns FP32 logits for every position, [tokens x vocab].
+    // Single tokens replay a captured logits graph like decode does.
+    std::vector<float> forward_logits(const std::vector<uint32_t>& tokens);
+    // Whether a captured single-token graph is waiting to be replayed by the next step.
+    bool has_decode_graph() const { return decode_graph_.valid; }
 
     virtual void prefill(const std::vector<uint32_t>& tokens, size_t chunk_size = 256, const std::string& profile_file = "");
 
@@ -524,6 +767,61 @@ public:
 
     void set_cache_window(size_t window_size, size_t sink_size = 4) { kv_cache_.set_window_size(window_size, sink_size); }
 
+    struct CacheState {
+        KVCache::Snapshot kv;
+        ConvCache::Snapshot conv;
+
+        size_t byte_size() const;
+    };
+
+    // Copies out everything the next forward pass reads from earlier tokens; false when the
+    // model keeps state that cannot be captured this way.
+    virtual bool save_cache_state(CacheState& state) const;
+    virtual bool restore_cache_state(const CacheState& state);
+    // Whether restore_cache_state would take state; checked before anything is reset.
+    virtual bool can_restore_cache_state(const CacheState& state) const;
+
+    // Session files hold the cache state, the tokens it covers and a fingerprint of the model's
+    // config and embeddings. read_session maps the file, copies each section out and checks all
+    // of it against this model without touching the caches; load_session then restores it.
+    // They return false when the model cannot capture or take the state, and throw on I/O
+    // errors, a damaged file or one saved by another model or cache layout.
+    bool save_session(const std::string& path, const std::vector<uint32_t>& tokens) const;
+    bool read_session(const std::string& path, CacheState& state, std::vector<uint32_t>& tokens) const;
+    bool load_session(const std::string& path, std::vector<uint32_t>& tokens);
+
+    // Batched decode: each sequence keeps its own caches, and decode_batch runs the next token of
+    // every sequence as one row of a single forward pass, so weights are read once per step.
+    virtual bool supports_batched_decode() const { return false; }
+    virtual void init_sequence(SequenceState& sequence) const;
+    virtual void prefill_sequence(SequenceState& sequence, const std::vector<uint32_t>& tokens);
+    virtual std::vector<uint32_t> decode_batch(const std::vector<SequenceState*>& sequences);
+
+    // Drops the newest tokens from every cache; false when the model cannot roll back that far.
+    virtual bool truncate_cache(size_t tokens);
+    size_t get_cached_tokens() const { return kv_cache_.get_total_seq_len(); }
+
+    // Speculative decoding: the draft proposes up to draft_tokens tokens after last_token, this
+    // model checks them all in one forward pass and both caches are rolled back past the first
+    // rejection. Returns the accepted tokens plus one token sampled by this model; greedy when
+    // temperature is 0, otherwise rejection sampling keeps this model's distribution.
+    static constexpr size_t DEFAULT_DRAFT_TOKENS = 4;
+    static constexpr size_t MAX_DRAFT_TOKENS = ConvCache::ROLLBACK_ROWS;
+    std::vector<uint32_t> decode_speculative(Model& draft, uint32_t last_token, size_t draft_tokens,
+                                             float temperature = -1.0f, float top_p = -1.0f, size_t top_k = 0,
+                                             std::vector<float>* out_entropies = nullptr);
+
+    // Prompt lookup: the tokens that followed the latest earlier occurrence of the context's last
+    // n-gram are proposed and checked the same way, without a draft model. context ends with the
+    // token to feed next; falls back to a single-token decode when nothing matches.
+    static constexpr size_t LOOKUP_NGRAM_SIZE = 3;
+    std::vector<uint32_t> decode_lookup(const std::vector<uint32_t>& context, size_t max_proposals,
+                                        float temperature = -1.0f, float top_p = -1.0f, size_t top_k = 0,
+                                        std::vector<float>* out_entropies = nullptr);
+    // Longest n-gram first, from ngram_size down to 1; empty when no earlier occurrence exists.
+    static std::vector<uint32_t> lookup_proposals(const std::vector<uint32_t>& tokens, size_t ngram_size,
+                                                  size_t max_tokens);
+
     bool load_npu_prefill(const std::string& model_path);
     bool has_npu_prefill() const;
     size_t get_prefill_chunk_size() const;
@@ -549,6 +847,29 @@ protected:
     virtual size_t build_transformer_block(CactusGraph* gb, size_t hidden, uint32_t layer_idx,
                                   ComputeBackend backend, bool use_cache = false, size_t position_offset = 0) = 0;
     void update_kv_cache(CactusGraph* gb, size_t seq_len);
+    static float normalized_entropy(const float* logits, size_t vocab_size);
+    // Feeds last_token and the proposals in one pass and keeps the accepted prefix plus one token
+    // sampled here, rolling this model's cache back to the last accepted proposal. draft_probs
+    // holds one distribution per proposal, or is empty when the proposals have none.
+    std::vector<uint32_t> verify_proposals(uint32_t last_token, const std::vector<uint32_t>& proposals,
+                                           const std::vector<float>& draft_probs,
+                                           float temperature, float top_p, size_t top_k,
+                                           std::vector<float>* out_entropies);
+    // Rotary embedding, cache output marking and attention over the layer's KV cache. During a
+    // batched decode step row i of q/k/v belongs to batch_[i] and attends to that sequence's cache.
+    size_t build_cached_attention(CactusGraph* gb, size_t q_4d, size_t k_4d, size_t v_4d, uint32_t layer_idx,
+                                  float rope_theta, bool use_cache, size_t position_offset, size_t window_size = 0);
+    virtual void swap_sequence_state(SequenceState& sequence) { std::swap(kv_cache_, sequence.kv_cache); }
+    virtual void post_execute_batch_updates(CactusGraph*) {}
+    virtual bool can_replay_decode_graph() const { return config_.decode_graph_replay && !kv_cache_.is_empty(); }
+    // Model-specific graph inputs that move between steps: recorded when the decode graph is
+    // captured and re-pointed before each replay.
+    virtual void capture_decode_graph_inputs() {}
+    virtual void patch_decode_graph(CactusGraph*) {}
+    // Load q/k/v and gate/up as one concatenated weight per layer (CPU backend only).
+    bool fuse_projections() const {
+        return config_.fuse_projections && config_.default_backend == Config::Backend::CPU;
+    }
     virtual void post_init() {}
     virtual void post_execute_updates(CactusGraph*, size_t) {}
     Config config_;
@@ -561,6 +882,7 @@ protected:
     KVCache kv_cache_;
     std::vector<size_t> cache_k_output_nodes_;
     std::vector<size_t> cache_v_output_nodes_;
+    std::vector<SequenceState*> batch_;
 
     std::string embedding_file_path_;
     size_t embedding_node_id_;
@@ -581,10 +903,126 @@ protected:
     virtual std::vector<__fp16> get_token_embeddings(const std::vector<uint32_t>& tokens);
 
     ToolCallConstrainer tool_constrainer_;
+
+    // Single-token decode graph kept alive between steps; replay patches only the
+    // per-step parameters (token, rope/attention offsets, KV pointers, sampling). The output
+    // is either the sampled token or, for forward_logits, the marked logits.
+    struct DecodeGraph {
+        bool valid = false;
+        bool logits = false;
+        size_t generation = 0;
+        size_t node_count = 0;
+        size_t position_offset = 0;
+        size_t input_node = 0;
+        size_t output_node = 0;
+        std::vector<GraphNode*> position_nodes;
+        std::vector<std::pair<GraphNode*, uint32_t>> cache_attention_nodes;
+        GraphNode* sample = nullptr;
+    };
+    DecodeGraph decode_graph_;
+
+    void capture_decode_graph(CactusGraph* gb, size_t output_node, bool logits);
+    bool replay_decode_graph(CactusGraph* gb, uint32_t token, bool logits);
 };
 
 std::unique_ptr<Model> create_model(const std::string& model_folder);
 
+// Radix tree over fixed-size token blocks that keeps cache states of prompt prefixes seen
+// before, so requests that resend the same system prompt and tools skip re-prefilling them.
+// States are evicted least recently used first once they exceed the byte budget.
+class PrefixCache {
+public:
+    static constexpr size_t BLOCK_TOKENS = 64;
+    static constexpr size_t DEFAULT_BUDGET_BYTES = 64 * 1024 * 1024;
+
+    struct Match {
+        size_t state_tokens = 0;
+        std::shared_ptr<const Model::CacheState> state;
+        size_t shared_tokens = 0;
+    };
+
+    explicit PrefixCache(size_t budget_bytes = DEFAULT_BUDGET_BYTES) : budget_bytes_(budget_bytes) {}
+
+    // Deepest stored state within the first max_tokens tokens, and how far the tokens follow
+    // a previously inserted path, both in whole blocks.
+    Match lookup(const std::vector<uint32_t>& tokens, size_t max_tokens);
+    void insert(const std::vector<uint32_t>& tokens, size_t num_tokens, Model::CacheState state);
+    void clear();
+
+    size_t size_bytes() const { return total_bytes_; }
+
+private:
+    struct Node {
+        std::vector<uint32_t> block;
+        std::unordered_map<uint64_t, std::unique_ptr<Node>> children;
+        std::shared_ptr<const Model::CacheState> state;
+        size_t state_bytes = 0;
+        uint64_t last_used = 0;
+    };
+
+    static uint64_t hash_block(const uint32_t* tokens);
+    void evict_to_budget();
+
+    Node root_;
+    size_t budget_bytes_;
+    size_t total_bytes_ = 0;
+    uint64_t clock_ = 0;
+    std::mutex mutex_;
+};
+
+// Continuous batching over one model. Submitted requests wait for the next step, are prefilled
+// into their own caches when admitted, and leave the batch on a stop token or after max_tokens;
+// each step decodes one token for every active request in a single forward pass. At most
+// KVCache::MAX_SHARED_SEQUENCES requests are active at once, as their caches share the model's pool.
+class BatchScheduler {
+public:
+    static constexpr size_t DEFAULT_MAX_BATCH = KVCache::MAX_SHARED_SEQUENCES;
+
+    struct Request {
+        std::vector<uint32_t> prompt;
+        size_t max_tokens = 128;
+        float temperature = -1.0f;
+        float top_p = -1.0f;
+        size_t top_k = 0;
+        std::vector<uint32_t> stop_tokens;
+    };
+
+    explicit BatchScheduler(Model& model, size_t max_batch = DEFAULT_MAX_BATCH);
+
+    // Safe to call from other threads while one thread drives step().
+    uint64_t submit(Request request);
+    bool is_finished(uint64_t id) const;
+    // Generated tokens of a finished request, without the stop token; the request is forgotten.
+    std::vector<uint32_t> take_output(uint64_t id);
+
+    // Admits waiting requests up to max_batch, decodes one token for every active request and
+    // retires the finished ones. Returns false once nothing is active or waiting.
+    bool step();
+
+    size_t active_count() const { return active_.size(); }
+    size_t pending_count() const;
+
+private:
+    struct Sequence {
+        uint64_t id = 0;
+        Request request;
+        SequenceState state;
+        std::vector<uint32_t> output;
+    };
+
+    void admit();
+    void finish(Sequence& sequence);
+
+    Model& model_;
+    size_t max_batch_;
+    std::vector<std::unique_ptr<Sequence>> active_;
+
+    mutable std::mutex mutex_;
+    uint64_t next_id_ = 1;
+    std::deque<std::pair<uint64_t, Request>> pending_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> finished_;
+};
+
 class Siglip2Preprocessor {
 public:
     struct Config {
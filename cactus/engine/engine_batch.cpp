@@ -0,0 +1,197 @@
+#include "engine.h"
+#include <stdexcept>
+
+namespace cactus {
+namespace engine {
+
+void Model::init_sequence(SequenceState& sequence) const {
+    sequence.kv_cache.init_shared(kv_cache_);
+    sequence.cache_k_nodes.assign(config_.num_layers, 0);
+    sequence.cache_v_nodes.assign(config_.num_layers, 0);
+}
+
+void Model::prefill_sequence(SequenceState& sequence, const std::vector<uint32_t>& tokens) {
+    // The sequence's caches are swapped in so prefill runs the usual single-sequence path.
+    swap_sequence_state(sequence);
+    try {
+        prefill(tokens, get_prefill_chunk_size());
+    } catch (...) {
+        swap_sequence_state(sequence);
+        decode_graph_.valid = false;
+        throw;
+    }
+    swap_sequence_state(sequence);
+    decode_graph_.valid = false;
+}
+
+std::vector<uint32_t> Model::decode_batch(const std::vector<SequenceState*>& sequences) {
+    if (sequences.empty()) {
+        return {};
+    }
+    if (!supports_batched_decode()) {
+        throw std::runtime_error("Batched decode is not supported for this model");
+    }
+
+    auto* gb = static_cast<CactusGraph*>(graph_handle_);
+    std::vector<uint32_t> tokens;
+    tokens.reserve(sequences.size());
+    for (auto* sequence : sequences) {
+        tokens.push_back(sequence->next_token);
+        sequence->cache_k_nodes.assign(config_.num_layers, 0);
+        sequence->cache_v_nodes.assign(config_.num_layers, 0);
+    }
+
+    decode_graph_.valid = false;
+    batch_ = sequences;
+    std::vector<size_t> sample_nodes;
+    try {
+        auto final_hidden = forward(tokens, true);
+
+        auto backend = config_.default_backend == Config::Backend::CPU
+            ? ComputeBackend::CPU
+            : ComputeBackend::NPU;
+
+        // One row per sequence, so the LM head and every projection run as an M=N GEMM.
+        size_t logits_node_id = gb->matmul(final_hidden, output_weight_node_id_, true, backend);
+        for (size_t i = 0; i < sequences.size(); ++i) {
+            const auto& sequence = *sequences[i];
+            float temperature = sequence.temperature < 0 ? config_.default_temperature : sequence.temperature;
+            float top_p = sequence.top_p < 0 ? config_.default_top_p : sequence.top_p;
+            size_t top_k = sequence.top_k == 0 ? config_.default_top_k : sequence.top_k;
+            sample_nodes.push_back(gb->sample(gb->slice(logits_node_id, 0, i, 1), temperature, top_p, top_k));
+        }
+
+        gb->execute();
+
+        for (auto* sequence : sequences) {
+            sequence->kv_cache.update_from_graph(gb, sequence->cache_k_nodes, sequence->cache_v_nodes, 1,
+                                                 config_.num_layers, config_.attention_kv_heads,
+                                                 config_.attention_head_dim);
+        }
+        post_execute_batch_updates(gb);
+    } catch (...) {
+        batch_.clear();
+        throw;
+    }
+    batch_.clear();
+
+    std::vector<uint32_t> next_tokens(sequences.size());
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        next_tokens[i] = *static_cast<uint32_t*>(gb->get_output(sample_nodes[i]));
+        sequences[i]->next_token = next_tokens[i];
+    }
+    return next_tokens;
+}
+
+BatchScheduler::BatchScheduler(Model& model, size_t max_batch)
+    : model_(model), max_batch_(std::clamp<size_t>(max_batch, 1, KVCache::MAX_SHARED_SEQUENCES)) {
+    if (!model_.supports_batched_decode()) {
+        throw std::runtime_error("Batched decode is not supported for this model");
+    }
+}
+
+uint64_t BatchScheduler::submit(Request request) {
+    if (auto* tokenizer = model_.get_tokenizer()) {
+        request.stop_tokens.push_back(tokenizer->get_eos_token());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t id = next_id_++;
+    pending_.emplace_back(id, std::move(request));
+    return id;
+}
+
+bool BatchScheduler::is_finished(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_.count(id) > 0;
+}
+
+std::vector<uint32_t> BatchScheduler::take_output(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = finished_.find(id);
+    if (it == finished_.end()) {
+        return {};
+    }
+    std::vector<uint32_t> output = std::move(it->second);
+    finished_.erase(it);
+    return output;
+}
+
+size_t BatchScheduler::pending_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+void BatchScheduler::admit() {
+    while (active_.size() < max_batch_) {
+        auto sequence = std::make_unique<Sequence>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_.empty()) {
+                return;
+            }
+            sequence->id = pending_.front().first;
+            sequence->request = std::move(pending_.front().second);
+            pending_.pop_front();
+        }
+
+        const auto& request = sequence->request;
+        if (request.prompt.empty() || request.max_tokens == 0) {
+            finish(*sequence);
+            continue;
+        }
+
+        // The last prompt token is fed by the first batched step, which samples the first output token.
+        auto& state = sequence->state;
+        model_.init_sequence(state);
+        std::vector<uint32_t> prefix(request.prompt.begin(), request.prompt.end() - 1);
+        if (!prefix.empty()) {
+            model_.prefill_sequence(state, prefix);
+        }
+        state.next_token = request.prompt.back();
+        state.temperature = request.temperature;
+        state.top_p = request.top_p;
+        state.top_k = request.top_k;
+        active_.push_back(std::move(sequence));
+    }
+}
+
+void BatchScheduler::finish(Sequence& sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_[sequence.id] = std::move(sequence.output);
+}
+
+bool BatchScheduler::step() {
+    admit();
+    if (active_.empty()) {
+        return false;
+    }
+
+    std::vector<SequenceState*> states;
+    states.reserve(active_.size());
+    for (auto& sequence : active_) {
+        states.push_back(&sequence->state);
+    }
+    std::vector<uint32_t> tokens = model_.decode_batch(states);
+
+    std::vector<std::unique_ptr<Sequence>> still_active;
+    for (size_t i = 0; i < active_.size(); ++i) {
+        auto& sequence = *active_[i];
+        const auto& stops = sequence.request.stop_tokens;
+        bool stopped = std::find(stops.begin(), stops.end(), tokens[i]) != stops.end();
+        if (!stopped) {
+            sequence.output.push_back(tokens[i]);
+        }
+        if (stopped || sequence.output.size() >= sequence.request.max_tokens) {
+            finish(sequence);
+        } else {
+            still_active.push_back(std::move(active_[i]));
+        }
+    }
+    active_ = std::move(still_active);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !active_.empty() || !pending_.empty();
+}
+
+}
+}
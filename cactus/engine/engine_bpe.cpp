@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <functional>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -11,11 +12,59 @@
 namespace cactus {
 namespace engine {
 
+namespace {
+
+constexpr uint64_t EMPTY_MERGE = UINT64_MAX;
+constexpr uint32_t UNKNOWN_SYMBOL = UINT32_MAX;
+constexpr uint32_t MERGED_SYMBOL = UINT32_MAX - 1;
+
+constexpr size_t WORD_CACHE_CAPACITY = 4096;
+constexpr size_t WORD_CACHE_MAX_BYTES = 256;
+
+uint64_t merge_pair(uint32_t left, uint32_t right) {
+    return (static_cast<uint64_t>(left) << 32) | right;
+}
+
+size_t merge_slot(uint64_t pair, size_t mask) {
+    return static_cast<size_t>((pair * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+// The split patterns split_words implements: the Qwen2 pattern splits numbers into single digits,
+// its Llama-3 variant keeps runs of up to three.
+constexpr std::string_view SPLIT_PATTERN_SINGLE_DIGITS =
+    R"re((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)re";
+constexpr std::string_view SPLIT_PATTERN_DIGIT_TRIPLES =
+    R"re((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)re";
+
+// Reads the JSON string that follows the key at key_pos, undoing escapes.
+bool read_json_string(const std::string& content, size_t key_pos, std::string& value) {
+    size_t colon = content.find(':', key_pos);
+    if (colon == std::string::npos) return false;
+    size_t quote = content.find('"', colon + 1);
+    if (quote == std::string::npos) return false;
+    value.clear();
+    for (size_t i = quote + 1; i < content.size(); ++i) {
+        char c = content[i];
+        if (c == '"') return true;
+        if (c == '\\' && i + 1 < content.size()) {
+            c = content[++i];
+            if (c == 'n') c = '\n';
+            else if (c == 'r') c = '\r';
+            else if (c == 't') c = '\t';
+        }
+        value += c;
+    }
+    return false;
+}
+
+}
+
 BPETokenizer::BPETokenizer()
     : vocab_size_(0), unk_token_id_(0), bos_token_id_(1), eos_token_id_(2),
       vocab_mmap_ptr_(nullptr), vocab_mmap_size_(0),
       merges_mmap_ptr_(nullptr), merges_mmap_size_(0) {
     has_chat_template_ = false;
+    std::fill(std::begin(byte_token_ids_), std::end(byte_token_ids_), UNKNOWN_SYMBOL);
 }
 
 BPETokenizer::~BPETokenizer() {
@@ -93,7 +142,7 @@ bool BPETokenizer::load_vocabulary_mmap(const std::string& vocab_file, const std
     std::string merges_content(static_cast<char*>(merges_mmap_ptr_), merges_mmap_size_);
     std::istringstream merges_stream(merges_content);
 
-    merge_rules_.clear();
+    std::vector<MergeEntry> merges;
     uint32_t priority = 0;
 
     while (std::getline(merges_stream, line)) {
@@ -106,23 +155,47 @@ bool BPETokenizer::load_vocabulary_mmap(const std::string& vocab_file, const std
             rtrim_cr(first);
             rtrim_cr(second);
 
-            std::string merged = first + second;
-            merge_rules_.emplace_back(first, second, merged, priority);
-
-            std::string key = first + "\x00" + second;
-            auto it = merge_map_.find(key);
-            if (it == merge_map_.end() || priority < it->second) {
-                merge_map_[key] = priority;
+            // A merge whose parts or result are outside the vocabulary can never apply.
+            auto first_it = token_to_id_.find(first);
+            auto second_it = token_to_id_.find(second);
+            auto merged_it = token_to_id_.find(first + second);
+            if (first_it != token_to_id_.end() && second_it != token_to_id_.end() && merged_it != token_to_id_.end()) {
+                merges.push_back({merge_pair(first_it->second, second_it->second), priority, merged_it->second});
             }
             priority++;
         }
     }
 
-    std::sort(merge_rules_.begin(), merge_rules_.end(),
-              [](const MergeRule& a, const MergeRule& b) {
-                  return a.priority < b.priority;
-              });
+    size_t capacity = 16;
+    while (capacity < merges.size() * 2) capacity <<= 1;
+    merge_table_.assign(capacity, {EMPTY_MERGE, 0, 0});
+    for (const auto& merge : merges) {
+        size_t slot = merge_slot(merge.pair, capacity - 1);
+        while (merge_table_[slot].pair != EMPTY_MERGE && merge_table_[slot].pair != merge.pair) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (merge_table_[slot].pair == EMPTY_MERGE) {
+            merge_table_[slot] = merge;
+        }
+    }
 
+    init_byte_mappings();
+    for (int byte = 0; byte < 256; ++byte) {
+        auto it = token_to_id_.find(byte_to_unicode_.at(static_cast<uint8_t>(byte)));
+        byte_token_ids_[byte] = it != token_to_id_.end() ? it->second : UNKNOWN_SYMBOL;
+    }
+
+    token_bytes_.clear();
+    token_bytes_.reserve(id_to_token_.size());
+    for (const auto& token : id_to_token_) {
+        token_bytes_.push_back(unicode_to_bytes(replace_metaspace(token)));
+    }
+
+    for (auto& shard : word_cache_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.index.clear();
+    }
     return true;
 }
 
@@ -175,6 +248,23 @@ bool BPETokenizer::load_vocabulary_with_config(const std::string& vocab_file, co
         std::ifstream tok_json(dir + "/tokenizer.json");
         if (tok_json.is_open()) {
             std::string content((std::istreambuf_iterator<char>(tok_json)), std::istreambuf_iterator<char>());
+
+            // Any other split pattern keeps whole-segment encoding rather than approximating it.
+            pre_tokenize_ = false;
+            size_t pre_tokenizer = content.find("\"pre_tokenizer\"");
+            size_t regex_key = pre_tokenizer == std::string::npos ? std::string::npos : content.find("\"Regex\"", pre_tokenizer);
+            std::string pattern;
+            if (regex_key != std::string::npos && regex_key < content.find("\"decoder\"", pre_tokenizer) &&
+                read_json_string(content, regex_key + 7, pattern)) {
+                if (pattern == SPLIT_PATTERN_SINGLE_DIGITS) {
+                    pre_tokenize_ = true;
+                    max_digit_run_ = 1;
+                } else if (pattern == SPLIT_PATTERN_DIGIT_TRIPLES) {
+                    pre_tokenize_ = true;
+                    max_digit_run_ = 3;
+                }
+            }
+
             size_t pos = 0;
             while (true) {
                 size_t id_key = content.find("\"id\"", pos);
@@ -411,107 +501,139 @@ std::string BPETokenizer::unicode_to_bytes(const std::string& text) const {
     return result;
 }
 
-std::vector<std::string> BPETokenizer::byte_level_split(const std::string& text) const {
-    std::string unicode_text = bytes_to_unicode(text);
-
-    std::vector<std::string> chars;
-    size_t i = 0;
-    while (i < unicode_text.length()) {
-        size_t char_len = 1;
-
-        if ((unicode_text[i] & 0x80) == 0) {
-            char_len = 1;
-        } else if ((unicode_text[i] & 0xE0) == 0xC0) {
-            char_len = 2;
-        } else if ((unicode_text[i] & 0xF0) == 0xE0) {
-            char_len = 3;
-        } else if ((unicode_text[i] & 0xF8) == 0xF0) {
-            char_len = 4;
-        }
+const BPETokenizer::MergeEntry* BPETokenizer::find_merge(uint32_t left, uint32_t right) const {
+    // No merge involves a byte missing from the vocabulary, and (UNKNOWN, UNKNOWN) packs to EMPTY_MERGE.
+    if (merge_table_.empty() || left == UNKNOWN_SYMBOL || right == UNKNOWN_SYMBOL) return nullptr;
 
-        if (i + char_len <= unicode_text.length()) {
-            chars.push_back(unicode_text.substr(i, char_len));
-        }
-        i += char_len;
+    const uint64_t pair = merge_pair(left, right);
+    const size_t mask = merge_table_.size() - 1;
+    for (size_t slot = merge_slot(pair, mask);; slot = (slot + 1) & mask) {
+        const MergeEntry& entry = merge_table_[slot];
+        if (entry.pair == pair) return &entry;
+        if (entry.pair == EMPTY_MERGE) return nullptr;
     }
-
-    return chars;
 }
 
-
-std::pair<int, uint32_t> BPETokenizer::find_best_merge_fast(const std::vector<std::string>& tokens) const {
-    int best_pos = -1;
-    uint32_t best_priority = UINT32_MAX;
-
-    for (size_t i = 0; i < tokens.size() - 1; ++i) {
-        std::string key = tokens[i] + "\x00" + tokens[i + 1];
-        auto it = merge_map_.find(key);
-        if (it != merge_map_.end()) {
-            if (it->second < best_priority) {
-                best_priority = it->second;
-                best_pos = static_cast<int>(i);
-            }
+void BPETokenizer::apply_bpe(std::vector<uint32_t>& symbols) const {
+    const uint32_t n = static_cast<uint32_t>(symbols.size());
+    if (n <= 1) return;
+
+    // Candidate merges ordered by rank, then by position, so the leftmost of the best pairs merges first.
+    struct Candidate {
+        uint32_t rank;
+        uint32_t pos;
+        uint32_t left;
+        uint32_t right;
+        bool operator>(const Candidate& other) const {
+            return rank != other.rank ? rank > other.rank : pos > other.pos;
         }
-    }
+    };
+    std::vector<Candidate> heap;
+    std::vector<uint32_t> prev(n), next(n);
+
+    auto push = [&](uint32_t pos) {
+        if (next[pos] >= n) return;
+        if (const MergeEntry* merge = find_merge(symbols[pos], symbols[next[pos]])) {
+            heap.push_back({merge->rank, pos, symbols[pos], symbols[next[pos]]});
+            std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+        }
+    };
 
-    return {best_pos, best_priority};
-}
+    for (uint32_t i = 0; i < n; ++i) {
+        prev[i] = i - 1;
+        next[i] = i + 1;
+    }
+    for (uint32_t i = 0; i + 1 < n; ++i) {
+        push(i);
+    }
 
-std::vector<std::string> BPETokenizer::apply_bpe(const std::vector<std::string>& tokens) const {
-    if (tokens.size() <= 1) return tokens;
+    // Entries go stale when either side has merged since they were pushed; the ids no longer match.
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+        const Candidate candidate = heap.back();
+        heap.pop_back();
 
-    std::vector<std::string> current_tokens = tokens;
+        const uint32_t pos = candidate.pos;
+        const uint32_t right = next[pos];
+        if (symbols[pos] != candidate.left || right >= n || symbols[right] != candidate.right) continue;
 
+        symbols[pos] = find_merge(candidate.left, candidate.right)->merged_id;
+        symbols[right] = MERGED_SYMBOL;
+        next[pos] = next[right];
+        if (next[pos] < n) prev[next[pos]] = pos;
 
-    while (true) {
-        auto [merge_pos, priority] = find_best_merge_fast(current_tokens);
-        if (merge_pos == -1) break;
+        if (prev[pos] < n) push(prev[pos]);
+        push(pos);
+    }
 
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < n; i = next[i]) {
+        symbols[out++] = symbols[i];
+    }
+    symbols.resize(out);
+}
 
-        std::vector<std::string> new_tokens;
-        new_tokens.reserve(current_tokens.size() - 1);
+void BPETokenizer::encode_word(std::string_view word, std::vector<uint32_t>& token_ids) const {
+    const bool cacheable = word.size() <= WORD_CACHE_MAX_BYTES;
+    std::string key;
+    WordCacheShard* shard = nullptr;
+    if (cacheable) {
+        key = word;
+        shard = &word_cache_[std::hash<std::string>{}(key) % WORD_CACHE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        auto it = shard->index.find(key);
+        if (it != shard->index.end()) {
+            shard->entries.splice(shard->entries.begin(), shard->entries, it->second);
+            const auto& ids = it->second->second;
+            token_ids.insert(token_ids.end(), ids.begin(), ids.end());
+            return;
+        }
+    }
 
-        for (int i = 0; i < static_cast<int>(current_tokens.size()); ++i) {
-            if (i == merge_pos) {
-                std::string merged = current_tokens[i] + current_tokens[i + 1];
-                new_tokens.push_back(merged);
-                i++;
-            } else {
-                new_tokens.push_back(current_tokens[i]);
+    // Every byte maps to one symbol of the byte-level alphabet, so the initial pieces need no strings.
+    std::vector<uint32_t> symbols(word.size());
+    for (size_t i = 0; i < word.size(); ++i) {
+        symbols[i] = byte_token_ids_[static_cast<uint8_t>(word[i])];
+    }
+    apply_bpe(symbols);
+    for (auto& symbol : symbols) {
+        if (symbol == UNKNOWN_SYMBOL) symbol = unk_token_id_;
+    }
+    token_ids.insert(token_ids.end(), symbols.begin(), symbols.end());
+
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->index.count(key) == 0) {
+            shard->entries.emplace_front(key, std::move(symbols));
+            shard->index[std::move(key)] = shard->entries.begin();
+            if (shard->entries.size() > WORD_CACHE_CAPACITY / WORD_CACHE_SHARDS) {
+                shard->index.erase(shard->entries.back().first);
+                shard->entries.pop_back();
             }
         }
-        current_tokens = std::move(new_tokens);
     }
-
-    return current_tokens;
 }
 
 std::vector<uint32_t> BPETokenizer::encode(const std::string& text) const {
     if (text.empty()) return {};
 
-
     auto text_segments = split_with_special_tokens(text);
 
-
     std::vector<uint32_t> token_ids;
+    std::vector<std::string_view> words;
 
     for (const auto& segment : text_segments) {
         auto special_it = special_tokens_.find(segment);
         if (special_it != special_tokens_.end()) {
             token_ids.push_back(special_it->second);
-        } else {
-            auto chars = byte_level_split(segment);
-            auto bpe_tokens = apply_bpe(chars);
-
-
-            for (const auto& token : bpe_tokens) {
-                auto it = token_to_id_.find(token);
-                if (it != token_to_id_.end()) {
-                    token_ids.push_back(it->second);
-                } else {
-                    token_ids.push_back(unk_token_id_);
-                }
+        } else if (pre_tokenize_) {
+            words.clear();
+            split_words(segment, max_digit_run_, words);
+            for (auto word : words) {
+                encode_word(word, token_ids);
             }
+        } else {
+            encode_word(segment, token_ids);
         }
     }
 
@@ -519,28 +641,11 @@ std::vector<uint32_t> BPETokenizer::encode(const std::string& text) const {
 }
 
 std::string BPETokenizer::decode(const std::vector<uint32_t>& tokens) const {
-    std::string unicode_result;
-    unicode_result.reserve(tokens.size() * 4);
-
+    std::string result;
     for (uint32_t token_id : tokens) {
-        if (token_id >= id_to_token_.size()) continue;
-        const std::string& tok = id_to_token_[token_id];
-
-        size_t pos = 0;
-        while (pos < tok.size()) {
-            if (pos + 3 <= tok.size() &&
-                (unsigned char)tok[pos]   == 0xE2 &&
-                (unsigned char)tok[pos+1] == 0x96 &&
-                (unsigned char)tok[pos+2] == 0x81) {
-                unicode_result.push_back(' ');
-                pos += 3;
-            } else {
-                unicode_result.push_back(tok[pos++]);
-            }
-        }
+        result += token_bytes(token_id);
     }
-
-    return unicode_to_bytes(unicode_result);
+    return result;
 }
 
 
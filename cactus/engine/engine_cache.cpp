@@ -4,10 +4,125 @@
 #include <algorithm>
 #include <cstring>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace cactus {
 namespace engine {
 
+KVBlockPool::~KVBlockPool() {
+    unmap();
+}
+
+void KVBlockPool::unmap() {
+    if (mapping_) {
+        munmap(mapping_, mapping_bytes_);
+        mapping_ = nullptr;
+    }
+    num_blocks_ = 0;
+    max_blocks_ = 0;
+    free_blocks_.clear();
+}
+
+void KVBlockPool::swap(KVBlockPool& other) noexcept {
+    std::swap(mapping_, other.mapping_);
+    std::swap(mapping_bytes_, other.mapping_bytes_);
+    std::swap(row_region_bytes_, other.row_region_bytes_);
+    std::swap(scale_region_bytes_, other.scale_region_bytes_);
+    std::swap(block_tokens_, other.block_tokens_);
+    std::swap(num_blocks_, other.num_blocks_);
+    std::swap(max_blocks_, other.max_blocks_);
+    std::swap(elements_per_token_, other.elements_per_token_);
+    std::swap(scales_per_token_, other.scales_per_token_);
+    std::swap(keys_, other.keys_);
+    std::swap(values_, other.values_);
+    std::swap(key_scales_, other.key_scales_);
+    std::swap(value_scales_, other.value_scales_);
+    free_blocks_.swap(other.free_blocks_);
+}
+
+// Address space for max_blocks is reserved up front, so the four arrays never move and a pool
+// can grow without invalidating pointers held by cached graphs; pages are committed as it grows.
+void KVBlockPool::init(size_t tokens_per_block, size_t num_blocks, size_t max_blocks,
+                       size_t elements_per_token, size_t scales_per_token) {
+    unmap();
+
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto page_align = [page](size_t bytes) { return (bytes + page - 1) / page * page; };
+
+    max_blocks = std::max(max_blocks, num_blocks);
+    const size_t max_rows = tokens_per_block * max_blocks;
+    row_region_bytes_ = page_align(max_rows * elements_per_token);
+    scale_region_bytes_ = page_align(max_rows * scales_per_token * sizeof(float));
+    mapping_bytes_ = 2 * (row_region_bytes_ + scale_region_bytes_);
+
+    void* mapping = mmap(nullptr, mapping_bytes_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to reserve KV cache block pool");
+    }
+    mapping_ = mapping;
+
+    auto* base = static_cast<uint8_t*>(mapping_);
+    keys_ = reinterpret_cast<int8_t*>(base);
+    values_ = reinterpret_cast<int8_t*>(base + row_region_bytes_);
+    key_scales_ = reinterpret_cast<float*>(base + 2 * row_region_bytes_);
+    value_scales_ = reinterpret_cast<float*>(base + 2 * row_region_bytes_ + scale_region_bytes_);
+
+    block_tokens_ = tokens_per_block;
+    max_blocks_ = max_blocks;
+    elements_per_token_ = elements_per_token;
+    scales_per_token_ = scales_per_token;
+    num_blocks_ = 0;
+    commit(num_blocks);
+    release_all();
+}
+
+void KVBlockPool::commit(size_t num_blocks) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto page_align = [page](size_t bytes) { return (bytes + page - 1) / page * page; };
+
+    const size_t rows = block_tokens_ * num_blocks;
+    const size_t row_bytes = std::min(page_align(rows * elements_per_token_), row_region_bytes_);
+    const size_t scale_bytes = std::min(page_align(rows * scales_per_token_ * sizeof(float)), scale_region_bytes_);
+    for (void* region : {static_cast<void*>(keys_), static_cast<void*>(values_)}) {
+        if (row_bytes > 0 && mprotect(region, row_bytes, PROT_READ | PROT_WRITE) != 0) {
+            throw std::runtime_error("Failed to commit KV cache block pool");
+        }
+    }
+    for (void* region : {static_cast<void*>(key_scales_), static_cast<void*>(value_scales_)}) {
+        if (scale_bytes > 0 && mprotect(region, scale_bytes, PROT_READ | PROT_WRITE) != 0) {
+            throw std::runtime_error("Failed to commit KV cache block pool");
+        }
+    }
+    num_blocks_ = num_blocks;
+}
+
+uint32_t KVBlockPool::allocate() {
+    if (free_blocks_.empty()) {
+        if (num_blocks_ >= max_blocks_) {
+            throw std::runtime_error("KV cache block pool exhausted");
+        }
+        const size_t old_blocks = num_blocks_;
+        commit(std::min(max_blocks_, std::max(old_blocks * 2, old_blocks + 1)));
+        for (size_t block = num_blocks_; block-- > old_blocks;) {
+            free_blocks_.push_back(static_cast<uint32_t>(block));
+        }
+    }
+    uint32_t block = free_blocks_.back();
+    free_blocks_.pop_back();
+    return block;
+}
+
+void KVBlockPool::release_all() {
+    free_blocks_.resize(num_blocks_);
+    for (size_t i = 0; i < num_blocks_; i++) {
+        free_blocks_[i] = static_cast<uint32_t>(num_blocks_ - 1 - i);
+    }
+    if (mapping_) {
+        madvise(mapping_, mapping_bytes_, MADV_DONTNEED);
+    }
+}
+
 void KVCache::init(size_t layers, size_t max_seq, size_t kv_heads, size_t dim, Precision model_precision) {
     num_layers = layers;
     max_seq_len = max_seq;
@@ -20,12 +135,78 @@ void KVCache::init(size_t layers, size_t max_seq, size_t kv_heads, size_t dim, P
 
     current_seq_len = 0;
     total_seq_len = 0;
+
+    if (is_paged()) {
+        init_block_pool();
+    }
+}
+
+void KVCache::init_block_pool() {
+    if (num_layers == 0 || num_kv_heads == 0 || head_dim == 0) {
+        return;
+    }
+
+    const size_t block_tokens = std::max(DEFAULT_BLOCK_TOKENS, paged_sink_rows());
+    const size_t max_tokens = window_size > 0 ? window_size : max_seq_len;
+    // Evicted rows are only returned a whole block at a time, after the newest ROLLBACK_ROWS of them,
+    // which can hold three extra blocks per layer.
+    const size_t blocks_per_layer = (max_tokens + ROLLBACK_ROWS + block_tokens - 1) / block_tokens + 2;
+    // Without a window nothing is evicted, so the pool grows past max_seq_len on demand; a
+    // windowed pool reserves one window for itself and for each batched sequence sharing it.
+    const size_t reserved_blocks_per_layer = window_size > 0
+        ? blocks_per_layer * (1 + MAX_SHARED_SEQUENCES)
+        : (std::max(max_seq_len, MAX_UNWINDOWED_TOKENS) + ROLLBACK_ROWS + block_tokens - 1) / block_tokens + 2;
+    const size_t num_groups = (head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE;
+
+    // Batched sequences may still draw from the current pool, so a new layout gets a new pool.
+    if (block_pool.use_count() != 1) {
+        block_pool = std::make_shared<KVBlockPool>();
+    }
+    block_pool->init(block_tokens, blocks_per_layer * num_layers, reserved_blocks_per_layer * num_layers,
+                    num_kv_heads * head_dim, num_kv_heads * num_groups);
+
+    for (auto& cache : layer_caches) {
+        cache.block_table.clear();
+        cache.block_table.reserve(blocks_per_layer);
+        cache.seq_len = 0;
+        cache.rows_used = 0;
+        cache.gap_rows = 0;
+    }
+    current_seq_len = 0;
+    total_seq_len = 0;
+}
+
+void KVCache::init_shared(const KVCache& owner) {
+    window_size = owner.window_size;
+    sink_size = owner.sink_size;
+    if (!owner.is_paged() || !owner.block_pool || !owner.block_pool->is_initialized()) {
+        init(owner.num_layers, owner.max_seq_len, owner.num_kv_heads, owner.head_dim, owner.precision);
+        return;
+    }
+
+    reset();
+    num_layers = owner.num_layers;
+    max_seq_len = owner.max_seq_len;
+    num_kv_heads = owner.num_kv_heads;
+    head_dim = owner.head_dim;
+    precision = owner.precision;
+    element_size = owner.element_size;
+    block_pool = owner.block_pool;
+
+    layer_caches.assign(num_layers, LayerCache{});
+    current_seq_len = 0;
+    total_seq_len = 0;
 }
 
 void KVCache::set_window_size(size_t window, size_t sink) {
     window_size = window;
     sink_size = sink;
 
+    if (is_paged()) {
+        init_block_pool();
+        return;
+    }
+
     if (num_kv_heads > 0 && head_dim > 0 && window_size > 0) {
         size_t cache_bytes = window_size * num_kv_heads * head_dim * element_size;
         size_t num_groups = (head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE;
@@ -48,6 +229,284 @@ void KVCache::set_window_size(size_t window, size_t sink) {
 void KVCache::reset() {
     current_seq_len = 0;
     total_seq_len = 0;
+
+    if (is_paged() && block_pool) {
+        // A pool shared with other caches only gets this cache's blocks back.
+        if (block_pool.use_count() == 1) {
+            for (auto& cache : layer_caches) {
+                cache.block_table.clear();
+                cache.seq_len = 0;
+                cache.rows_used = 0;
+                cache.gap_rows = 0;
+            }
+            block_pool->release_all();
+        } else {
+            for (auto& cache : layer_caches) {
+                clear_layer_blocks(cache);
+            }
+        }
+    }
+}
+
+void KVCache::clear_layer_blocks(LayerCache& cache) {
+    for (uint32_t block : cache.block_table) {
+        block_pool->release(block);
+    }
+    cache.block_table.clear();
+    cache.seq_len = 0;
+    cache.rows_used = 0;
+    cache.gap_rows = 0;
+}
+
+size_t KVCache::claim_paged_rows(LayerCache& cache, size_t num_tokens, size_t& pool_row) {
+    const size_t block_tokens = block_pool->block_tokens();
+    size_t block_offset = cache.rows_used % block_tokens;
+    if (block_offset == 0) {
+        cache.block_table.push_back(block_pool->allocate());
+    }
+    pool_row = cache.block_table.back() * block_tokens + block_offset;
+    size_t count = std::min(num_tokens, block_tokens - block_offset);
+    cache.rows_used += count;
+    return count;
+}
+
+void KVCache::write_paged_rows(LayerCache& cache, const __fp16* k_data, const __fp16* v_data, size_t num_tokens) {
+    const size_t elements_per_token = num_kv_heads * head_dim;
+    const size_t scales_per_token = num_kv_heads * ((head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE);
+
+    size_t written = 0;
+    while (written < num_tokens) {
+        size_t pool_row = 0;
+        size_t count = claim_paged_rows(cache, num_tokens - written, pool_row);
+
+        cactus_quantize_kv_fp16_to_int8(
+            k_data + written * elements_per_token,
+            block_pool->keys() + pool_row * elements_per_token,
+            block_pool->key_scales() + pool_row * scales_per_token,
+            count, num_kv_heads, head_dim);
+
+        cactus_quantize_kv_fp16_to_int8(
+            v_data + written * elements_per_token,
+            block_pool->values() + pool_row * elements_per_token,
+            block_pool->value_scales() + pool_row * scales_per_token,
+            count, num_kv_heads, head_dim);
+
+        written += count;
+    }
+}
+
+// Sink tokens stay in the first rows; tokens that slide out of the window become a gap of
+// dead rows after them, and each block the gap fully covers goes back to the pool once it is
+// older than the ROLLBACK_ROWS newest gap rows, so appending never moves rows that are cached.
+void KVCache::append_paged(size_t layer, const __fp16* k_data, const __fp16* v_data, size_t num_tokens) {
+    auto& cache = layer_caches[layer];
+    const size_t elements_per_token = num_kv_heads * head_dim;
+    const size_t block_tokens = block_pool->block_tokens();
+    const size_t sinks = paged_sink_rows();
+
+    size_t sink_tokens = cache.seq_len < sinks ? std::min(num_tokens, sinks - cache.seq_len) : 0;
+    write_paged_rows(cache, k_data, v_data, sink_tokens);
+    cache.seq_len += sink_tokens;
+    num_tokens -= sink_tokens;
+    if (num_tokens == 0) {
+        return;
+    }
+    k_data += sink_tokens * elements_per_token;
+    v_data += sink_tokens * elements_per_token;
+
+    size_t evicted = 0;
+    if (window_size > 0 && cache.seq_len + num_tokens > window_size) {
+        evicted = cache.seq_len + num_tokens - window_size;
+    }
+    size_t evicted_cached = std::min(evicted, cache.seq_len - sinks);
+    cache.gap_rows += evicted_cached;
+    cache.seq_len -= evicted_cached;
+
+    const size_t first_free_block = (sinks + block_tokens - 1) / block_tokens;
+    while (cache.block_table.size() > first_free_block &&
+           sinks + cache.gap_rows >= (first_free_block + 1) * block_tokens + ROLLBACK_ROWS) {
+        block_pool->release(cache.block_table[first_free_block]);
+        cache.block_table.erase(cache.block_table.begin() + first_free_block);
+        cache.gap_rows -= block_tokens;
+        cache.rows_used -= block_tokens;
+    }
+
+    size_t skipped = evicted - evicted_cached;
+    write_paged_rows(cache, k_data + skipped * elements_per_token, v_data + skipped * elements_per_token,
+                     num_tokens - skipped);
+    cache.seq_len += num_tokens - skipped;
+}
+
+CactusKVBlocks KVCache::get_blocks(size_t layer) const {
+    if (!is_paged() || layer >= num_layers) {
+        return {};
+    }
+    const auto& cache = layer_caches[layer];
+    return {cache.block_table.data(), block_pool->block_tokens(), paged_sink_rows(), cache.gap_rows};
+}
+
+size_t KVCache::Snapshot::byte_size() const {
+    size_t bytes = 0;
+    for (size_t layer = 0; layer < keys.size(); layer++) {
+        bytes += keys[layer].size() + values[layer].size();
+        bytes += (key_scales[layer].size() + value_scales[layer].size()) * sizeof(float);
+    }
+    return bytes;
+}
+
+KVCache::Snapshot KVCache::snapshot() const {
+    Snapshot out;
+    if (!is_paged()) {
+        return out;
+    }
+
+    const size_t elements_per_token = num_kv_heads * head_dim;
+    const size_t scales_per_token = num_kv_heads * ((head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE);
+
+    out.seq_len = current_seq_len;
+    out.total_seq_len = total_seq_len;
+    out.keys.resize(num_layers);
+    out.values.resize(num_layers);
+    out.key_scales.resize(num_layers);
+    out.value_scales.resize(num_layers);
+
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        const auto& cache = layer_caches[layer];
+        const CactusKVBlocks blocks = get_blocks(layer);
+        out.keys[layer].resize(cache.seq_len * elements_per_token);
+        out.values[layer].resize(cache.seq_len * elements_per_token);
+        out.key_scales[layer].resize(cache.seq_len * scales_per_token);
+        out.value_scales[layer].resize(cache.seq_len * scales_per_token);
+
+        for (size_t pos = 0; pos < cache.seq_len; pos++) {
+            size_t row = pos < blocks.gap_start ? pos : pos + blocks.gap_rows;
+            size_t pool_row = blocks.block_table[row / blocks.block_tokens] * blocks.block_tokens + row % blocks.block_tokens;
+
+            std::memcpy(out.keys[layer].data() + pos * elements_per_token,
+                        block_pool->keys() + pool_row * elements_per_token, elements_per_token);
+            std::memcpy(out.values[layer].data() + pos * elements_per_token,
+                        block_pool->values() + pool_row * elements_per_token, elements_per_token);
+            std::memcpy(out.key_scales[layer].data() + pos * scales_per_token,
+                        block_pool->key_scales() + pool_row * scales_per_token, scales_per_token * sizeof(float));
+            std::memcpy(out.value_scales[layer].data() + pos * scales_per_token,
+                        block_pool->value_scales() + pool_row * scales_per_token, scales_per_token * sizeof(float));
+        }
+    }
+    return out;
+}
+
+bool KVCache::can_restore(const Snapshot& snapshot) const {
+    const size_t elements_per_token = num_kv_heads * head_dim;
+    const size_t scales_per_token = num_kv_heads * ((head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE);
+    const size_t capacity = window_size > 0 ? window_size : std::max(max_seq_len, MAX_UNWINDOWED_TOKENS);
+    const size_t seq_len = window_size > 0 ? std::min(snapshot.total_seq_len, window_size) : snapshot.total_seq_len;
+
+    if (!is_paged() || elements_per_token == 0 || snapshot.seq_len != seq_len || seq_len > capacity ||
+        snapshot.keys.size() != num_layers || snapshot.values.size() != num_layers ||
+        snapshot.key_scales.size() != num_layers || snapshot.value_scales.size() != num_layers) {
+        return false;
+    }
+    // Layers without a KV cache (LFM2 conv layers) have no rows; every other layer has all of them.
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        const size_t num_tokens = snapshot.keys[layer].size() / elements_per_token;
+        if ((num_tokens != 0 && num_tokens != seq_len) ||
+            snapshot.keys[layer].size() != num_tokens * elements_per_token ||
+            snapshot.values[layer].size() != num_tokens * elements_per_token ||
+            snapshot.key_scales[layer].size() != num_tokens * scales_per_token ||
+            snapshot.value_scales[layer].size() != num_tokens * scales_per_token) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KVCache::restore(const Snapshot& snapshot) {
+    if (!can_restore(snapshot)) {
+        throw std::runtime_error("KV cache snapshot does not match this cache");
+    }
+    const size_t elements_per_token = num_kv_heads * head_dim;
+    const size_t scales_per_token = num_kv_heads * ((head_dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE);
+
+    reset();
+
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        auto& cache = layer_caches[layer];
+        const size_t num_tokens = snapshot.keys[layer].size() / elements_per_token;
+
+        size_t written = 0;
+        while (written < num_tokens) {
+            size_t pool_row = 0;
+            size_t count = claim_paged_rows(cache, num_tokens - written, pool_row);
+
+            std::memcpy(block_pool->keys() + pool_row * elements_per_token,
+                        snapshot.keys[layer].data() + written * elements_per_token, count * elements_per_token);
+            std::memcpy(block_pool->values() + pool_row * elements_per_token,
+                        snapshot.values[layer].data() + written * elements_per_token, count * elements_per_token);
+            std::memcpy(block_pool->key_scales() + pool_row * scales_per_token,
+                        snapshot.key_scales[layer].data() + written * scales_per_token,
+                        count * scales_per_token * sizeof(float));
+            std::memcpy(block_pool->value_scales() + pool_row * scales_per_token,
+                        snapshot.value_scales[layer].data() + written * scales_per_token,
+                        count * scales_per_token * sizeof(float));
+            written += count;
+        }
+        cache.seq_len = num_tokens;
+    }
+
+    current_seq_len = snapshot.seq_len;
+    total_seq_len = snapshot.total_seq_len;
+}
+
+bool KVCache::can_truncate(size_t tokens) const {
+    if (!is_paged() || tokens > current_seq_len) {
+        return false;
+    }
+    const size_t sinks = paged_sink_rows();
+    const size_t remaining = total_seq_len - tokens;
+    const size_t target = window_size > 0 ? std::min(remaining, window_size) : remaining;
+    for (const auto& cache : layer_caches) {
+        if (cache.block_table.empty()) {
+            continue;
+        }
+        const size_t live = cache.seq_len - std::min(cache.seq_len, sinks);
+        const size_t kept = cache.seq_len - tokens;
+        if ((cache.gap_rows > 0 && tokens > live) || target < kept || target - kept > cache.gap_rows) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The dropped tokens evicted the rows at the end of the gap, which are still allocated; shrinking
+// the gap by as many rows puts them back, exactly where a cache that never saw the tokens has them.
+void KVCache::truncate(size_t tokens) {
+    if (tokens == 0) {
+        return;
+    }
+    if (!can_truncate(tokens)) {
+        throw std::runtime_error("KV cache cannot roll back " + std::to_string(tokens) + " tokens");
+    }
+
+    const size_t block_tokens = block_pool->block_tokens();
+    const size_t remaining = total_seq_len - tokens;
+    const size_t target = window_size > 0 ? std::min(remaining, window_size) : remaining;
+    for (auto& cache : layer_caches) {
+        if (cache.block_table.empty()) {
+            continue;
+        }
+        cache.seq_len -= tokens;
+        cache.rows_used -= tokens;
+        const size_t blocks_needed = (cache.rows_used + block_tokens - 1) / block_tokens;
+        while (cache.block_table.size() > blocks_needed) {
+            block_pool->release(cache.block_table.back());
+            cache.block_table.pop_back();
+        }
+        const size_t restored = target - cache.seq_len;
+        cache.gap_rows -= restored;
+        cache.seq_len += restored;
+    }
+    current_seq_len = target;
+    total_seq_len = remaining;
 }
 
 void* KVCache::get_key_ptr(size_t layer) {
@@ -104,8 +563,6 @@ void KVCache::update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_no
     size_t old_seq_len = current_seq_len;
     size_t new_total_len = old_seq_len + seq_len;
     size_t elements_per_token = kv_heads * dim;
-    size_t num_groups = (dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE;
-    size_t scales_per_token = kv_heads * num_groups;
     size_t bytes_per_token = elements_per_token * element_size;
 
     total_seq_len += seq_len;
@@ -136,31 +593,16 @@ void KVCache::update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_no
             if (k_buffer.total_size == expected_elements && v_buffer.total_size == expected_elements) {
                 any_layer_updated = true;
 
-                if (!use_sliding_window) {
+                if (is_paged()) {
+                    clear_layer_blocks(cache);
+                    append_paged(layer_idx, static_cast<const __fp16*>(k_output),
+                                 static_cast<const __fp16*>(v_output), new_total_len);
+                } else if (!use_sliding_window) {
                     size_t total_bytes = new_total_len * bytes_per_token;
                     cache.keys.resize(total_bytes);
                     cache.values.resize(total_bytes);
-
-                    if (precision == Precision::INT8) {
-                        size_t num_scales = new_total_len * scales_per_token;
-                        cache.key_scales.resize(num_scales);
-                        cache.value_scales.resize(num_scales);
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(k_output),
-                            reinterpret_cast<int8_t*>(cache.keys.data()),
-                            cache.key_scales.data(),
-                            new_total_len, kv_heads, dim);
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(v_output),
-                            reinterpret_cast<int8_t*>(cache.values.data()),
-                            cache.value_scales.data(),
-                            new_total_len, kv_heads, dim);
-                    } else {
-                        std::memcpy(cache.keys.data(), k_output, total_bytes);
-                        std::memcpy(cache.values.data(), v_output, total_bytes);
-                    }
+                    std::memcpy(cache.keys.data(), k_output, total_bytes);
+                    std::memcpy(cache.values.data(), v_output, total_bytes);
                 } else {
                     size_t cache_bytes = window_size * bytes_per_token;
                     size_t remaining_window = window_size - sink_size;
@@ -171,100 +613,38 @@ void KVCache::update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_no
                     if (first_slide) {
                         cache.keys.resize(cache_bytes);
                         cache.values.resize(cache_bytes);
-                    }
 
-                    if (precision == Precision::INT8) {
-                        size_t num_scales = window_size * scales_per_token;
-                        if (first_slide) {
-                            cache.key_scales.resize(num_scales);
-                            cache.value_scales.resize(num_scales);
-                        }
-
-                        const __fp16* k_fp16 = static_cast<const __fp16*>(k_output);
-                        const __fp16* v_fp16 = static_cast<const __fp16*>(v_output);
-
-                        if (first_slide) {
-                            cactus_quantize_kv_fp16_to_int8(
-                                k_fp16,
-                                reinterpret_cast<int8_t*>(cache.keys.data()),
-                                cache.key_scales.data(),
-                                sink_size, kv_heads, dim);
-
-                            cactus_quantize_kv_fp16_to_int8(
-                                v_fp16,
-                                reinterpret_cast<int8_t*>(cache.values.data()),
-                                cache.value_scales.data(),
-                                sink_size, kv_heads, dim);
-                        }
-
-                        size_t src_offset = (sink_size + skip_tokens) * elements_per_token;
-                        size_t dst_offset = sink_size * elements_per_token;
-                        size_t scale_dst_offset = sink_size * scales_per_token;
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            k_fp16 + src_offset,
-                            reinterpret_cast<int8_t*>(cache.keys.data()) + dst_offset,
-                            cache.key_scales.data() + scale_dst_offset,
-                            remaining_window, kv_heads, dim);
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            v_fp16 + src_offset,
-                            reinterpret_cast<int8_t*>(cache.values.data()) + dst_offset,
-                            cache.value_scales.data() + scale_dst_offset,
-                            remaining_window, kv_heads, dim);
-                    } else {
-                        if (first_slide) {
-                            size_t sink_bytes = sink_size * bytes_per_token;
-                            std::memcpy(cache.keys.data(), k_output, sink_bytes);
-                            std::memcpy(cache.values.data(), v_output, sink_bytes);
-                        }
-
-                        const uint8_t* k_src = static_cast<const uint8_t*>(k_output) +
-                                              (sink_size + skip_tokens) * bytes_per_token;
-                        const uint8_t* v_src = static_cast<const uint8_t*>(v_output) +
-                                              (sink_size + skip_tokens) * bytes_per_token;
                         size_t sink_bytes = sink_size * bytes_per_token;
-                        size_t recent_bytes = remaining_window * bytes_per_token;
-
-                        std::memcpy(cache.keys.data() + sink_bytes, k_src, recent_bytes);
-                        std::memcpy(cache.values.data() + sink_bytes, v_src, recent_bytes);
+                        std::memcpy(cache.keys.data(), k_output, sink_bytes);
+                        std::memcpy(cache.values.data(), v_output, sink_bytes);
                     }
+
+                    const uint8_t* k_src = static_cast<const uint8_t*>(k_output) +
+                                          (sink_size + skip_tokens) * bytes_per_token;
+                    const uint8_t* v_src = static_cast<const uint8_t*>(v_output) +
+                                          (sink_size + skip_tokens) * bytes_per_token;
+                    size_t sink_bytes = sink_size * bytes_per_token;
+                    size_t recent_bytes = remaining_window * bytes_per_token;
+
+                    std::memcpy(cache.keys.data() + sink_bytes, k_src, recent_bytes);
+                    std::memcpy(cache.values.data() + sink_bytes, v_src, recent_bytes);
                 }
             }
             else if (seq_len * elements_per_token == k_buffer.total_size &&
                       seq_len * elements_per_token == v_buffer.total_size) {
                 any_layer_updated = true;
 
-                if (!use_sliding_window) {
+                if (is_paged()) {
+                    append_paged(layer_idx, static_cast<const __fp16*>(k_output),
+                                 static_cast<const __fp16*>(v_output), seq_len);
+                } else if (!use_sliding_window) {
                     size_t old_bytes = old_seq_len * bytes_per_token;
                     size_t new_bytes = seq_len * bytes_per_token;
                     size_t total_bytes = old_bytes + new_bytes;
                     cache.keys.resize(total_bytes);
                     cache.values.resize(total_bytes);
-
-                    if (precision == Precision::INT8) {
-                        size_t num_scales = (old_seq_len + seq_len) * scales_per_token;
-                        cache.key_scales.resize(num_scales);
-                        cache.value_scales.resize(num_scales);
-
-                        size_t dst_offset = old_seq_len * elements_per_token;
-                        size_t scale_offset = old_seq_len * scales_per_token;
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(k_output),
-                            reinterpret_cast<int8_t*>(cache.keys.data()) + dst_offset,
-                            cache.key_scales.data() + scale_offset,
-                            seq_len, kv_heads, dim);
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(v_output),
-                            reinterpret_cast<int8_t*>(cache.values.data()) + dst_offset,
-                            cache.value_scales.data() + scale_offset,
-                            seq_len, kv_heads, dim);
-                    } else {
-                        std::memcpy(cache.keys.data() + old_bytes, k_output, new_bytes);
-                        std::memcpy(cache.values.data() + old_bytes, v_output, new_bytes);
-                    }
+                    std::memcpy(cache.keys.data() + old_bytes, k_output, new_bytes);
+                    std::memcpy(cache.values.data() + old_bytes, v_output, new_bytes);
                 } else {
                     size_t cache_bytes = window_size * bytes_per_token;
 
@@ -287,45 +667,13 @@ void KVCache::update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_no
                             std::memmove(cache.values.data() + sink_bytes,
                                        cache.values.data() + shift_src * bytes_per_token,
                                        shift_bytes);
-
-                            if (precision == Precision::INT8) {
-                                size_t sink_scale_offset = sink_size * scales_per_token;
-                                size_t shift_src_scale_offset = shift_src * scales_per_token;
-                                size_t shift_scale_count = tokens_to_shift * scales_per_token;
-
-                                std::memmove(cache.key_scales.data() + sink_scale_offset,
-                                           cache.key_scales.data() + shift_src_scale_offset,
-                                           shift_scale_count * sizeof(float));
-                                std::memmove(cache.value_scales.data() + sink_scale_offset,
-                                           cache.value_scales.data() + shift_src_scale_offset,
-                                           shift_scale_count * sizeof(float));
-                            }
                         }
                     }
 
-                    size_t append_token_offset = window_size - seq_len;
-                    size_t append_bytes_offset = append_token_offset * bytes_per_token;
+                    size_t append_bytes_offset = (window_size - seq_len) * bytes_per_token;
                     size_t new_bytes = seq_len * bytes_per_token;
-
-                    if (precision == Precision::INT8) {
-                        size_t append_offset = append_token_offset * elements_per_token;
-                        size_t scale_offset = append_token_offset * scales_per_token;
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(k_output),
-                            reinterpret_cast<int8_t*>(cache.keys.data()) + append_offset,
-                            cache.key_scales.data() + scale_offset,
-                            seq_len, kv_heads, dim);
-
-                        cactus_quantize_kv_fp16_to_int8(
-                            static_cast<const __fp16*>(v_output),
-                            reinterpret_cast<int8_t*>(cache.values.data()) + append_offset,
-                            cache.value_scales.data() + scale_offset,
-                            seq_len, kv_heads, dim);
-                    } else {
-                        std::memcpy(cache.keys.data() + append_bytes_offset, k_output, new_bytes);
-                        std::memcpy(cache.values.data() + append_bytes_offset, v_output, new_bytes);
-                    }
+                    std::memcpy(cache.keys.data() + append_bytes_offset, k_output, new_bytes);
+                    std::memcpy(cache.values.data() + append_bytes_offset, v_output, new_bytes);
                 }
             }
         }
@@ -337,129 +685,19 @@ void KVCache::update_from_graph(CactusGraph* gb, const std::vector<size_t>& k_no
 }
 
 void KVCache::update_from_npu(size_t layer_idx, const __fp16* k_data, const __fp16* v_data,
-                               size_t num_tokens, size_t kv_heads, size_t dim) {
-    if (layer_idx >= num_layers || !k_data || !v_data || num_tokens == 0) {
+                               size_t num_tokens, size_t /*kv_heads*/, size_t /*dim*/) {
+    if (layer_idx >= num_layers || !k_data || !v_data || num_tokens == 0 || !is_paged()) {
         return;
     }
 
-    auto& cache = layer_caches[layer_idx];
-    size_t old_seq_len = current_seq_len;
-    size_t new_total_len = old_seq_len + num_tokens;
-    size_t elements_per_token = kv_heads * dim;
-    size_t bytes_per_token = elements_per_token * element_size;
-    size_t num_groups = (dim + KV_QUANT_GROUP_SIZE - 1) / KV_QUANT_GROUP_SIZE;
-    size_t scales_per_token = kv_heads * num_groups;
-
     if (layer_idx == 0) {
         total_seq_len += num_tokens;
     }
 
-    bool use_sliding_window = (window_size > 0 && new_total_len > window_size);
-    size_t effective_seq_len = use_sliding_window ? window_size : new_total_len;
-
-    if (!use_sliding_window) {
-        size_t total_bytes = new_total_len * bytes_per_token;
-        cache.keys.resize(total_bytes);
-        cache.values.resize(total_bytes);
-
-        size_t num_scales = new_total_len * scales_per_token;
-        cache.key_scales.resize(num_scales);
-        cache.value_scales.resize(num_scales);
-
-        size_t dst_offset = old_seq_len * elements_per_token;
-        size_t scale_offset = old_seq_len * scales_per_token;
-
-        cactus_quantize_kv_fp16_to_int8(
-            k_data,
-            reinterpret_cast<int8_t*>(cache.keys.data()) + dst_offset,
-            cache.key_scales.data() + scale_offset,
-            num_tokens, kv_heads, dim);
-
-        cactus_quantize_kv_fp16_to_int8(
-            v_data,
-            reinterpret_cast<int8_t*>(cache.values.data()) + dst_offset,
-            cache.value_scales.data() + scale_offset,
-            num_tokens, kv_heads, dim);
-    } else {
-        size_t cache_bytes = window_size * bytes_per_token;
-
-        if (cache.keys.size() != cache_bytes) {
-            cache.keys.resize(cache_bytes);
-            cache.values.resize(cache_bytes);
-
-            size_t num_scales = window_size * scales_per_token;
-            cache.key_scales.resize(num_scales);
-            cache.value_scales.resize(num_scales);
-        }
-
-        size_t remaining_window = window_size - sink_size;
-
-        if (num_tokens >= remaining_window) {
-            size_t skip_tokens = num_tokens - remaining_window;
-            size_t dst_offset = sink_size * elements_per_token;
-            size_t scale_offset = sink_size * scales_per_token;
-
-            cactus_quantize_kv_fp16_to_int8(
-                k_data + skip_tokens * elements_per_token,
-                reinterpret_cast<int8_t*>(cache.keys.data()) + dst_offset,
-                cache.key_scales.data() + scale_offset,
-                remaining_window, kv_heads, dim);
-
-            cactus_quantize_kv_fp16_to_int8(
-                v_data + skip_tokens * elements_per_token,
-                reinterpret_cast<int8_t*>(cache.values.data()) + dst_offset,
-                cache.value_scales.data() + scale_offset,
-                remaining_window, kv_heads, dim);
-        } else {
-            size_t tokens_to_shift = remaining_window - num_tokens;
-
-            if (tokens_to_shift > 0 && old_seq_len > sink_size) {
-                size_t shift_src = old_seq_len - tokens_to_shift;
-                if (shift_src > sink_size) {
-                    size_t sink_offset = sink_size * elements_per_token;
-                    size_t shift_src_offset = shift_src * elements_per_token;
-                    size_t shift_bytes = tokens_to_shift * bytes_per_token;
-
-                    std::memmove(cache.keys.data() + sink_offset,
-                               cache.keys.data() + shift_src_offset,
-                               shift_bytes);
-                    std::memmove(cache.values.data() + sink_offset,
-                               cache.values.data() + shift_src_offset,
-                               shift_bytes);
-
-                    size_t sink_scale_offset = sink_size * scales_per_token;
-                    size_t shift_src_scale_offset = shift_src * scales_per_token;
-                    size_t shift_scale_count = tokens_to_shift * scales_per_token;
-
-                    std::memmove(cache.key_scales.data() + sink_scale_offset,
-                               cache.key_scales.data() + shift_src_scale_offset,
-                               shift_scale_count * sizeof(float));
-                    std::memmove(cache.value_scales.data() + sink_scale_offset,
-                               cache.value_scales.data() + shift_src_scale_offset,
-                               shift_scale_count * sizeof(float));
-                }
-            }
-
-            size_t append_token_offset = window_size - num_tokens;
-            size_t append_offset = append_token_offset * elements_per_token;
-            size_t scale_offset = append_token_offset * scales_per_token;
-
-            cactus_quantize_kv_fp16_to_int8(
-                k_data,
-                reinterpret_cast<int8_t*>(cache.keys.data()) + append_offset,
-                cache.key_scales.data() + scale_offset,
-                num_tokens, kv_heads, dim);
-
-            cactus_quantize_kv_fp16_to_int8(
-                v_data,
-                reinterpret_cast<int8_t*>(cache.values.data()) + append_offset,
-                cache.value_scales.data() + scale_offset,
-                num_tokens, kv_heads, dim);
-        }
-    }
+    append_paged(layer_idx, k_data, v_data, num_tokens);
 
     if (layer_idx == num_layers - 1) {
-        current_seq_len = effective_seq_len;
+        current_seq_len = layer_caches[layer_idx].seq_len;
     }
 }
 
@@ -467,6 +705,9 @@ const int8_t* KVCache::get_keys_int8(size_t layer) const {
     if (layer >= num_layers || current_seq_len == 0) {
         return nullptr;
     }
+    if (is_paged()) {
+        return block_pool->keys();
+    }
     return reinterpret_cast<const int8_t*>(layer_caches[layer].keys.data());
 }
 
@@ -474,6 +715,9 @@ const int8_t* KVCache::get_values_int8(size_t layer) const {
     if (layer >= num_layers || current_seq_len == 0) {
         return nullptr;
     }
+    if (is_paged()) {
+        return block_pool->values();
+    }
     return reinterpret_cast<const int8_t*>(layer_caches[layer].values.data());
 }
 
@@ -481,6 +725,9 @@ const float* KVCache::get_key_scales(size_t layer) const {
     if (layer >= num_layers || current_seq_len == 0) {
         return nullptr;
     }
+    if (is_paged()) {
+        return block_pool->key_scales();
+    }
     return layer_caches[layer].key_scales.data();
 }
 
@@ -488,6 +735,9 @@ const float* KVCache::get_value_scales(size_t layer) const {
     if (layer >= num_layers || current_seq_len == 0) {
         return nullptr;
     }
+    if (is_paged()) {
+        return block_pool->value_scales();
+    }
     return layer_caches[layer].value_scales.data();
 }
 
@@ -498,13 +748,13 @@ void ConvCache::init(size_t layers, size_t hidden_dim, size_t window_len, Precis
     precision = model_precision;
     element_size = PrecisionTraits::size_of(precision);
 
-    size_t state_bytes = window_size * hidden_size * element_size;
+    size_t state_bytes = window_size > 0 ? (window_size + ROLLBACK_ROWS) * hidden_size * element_size : 0;
     layer_states.resize(num_layers);
     for (auto& state : layer_states) {
         state.data.resize(state_bytes);
         std::memset(state.data.data(), 0, state_bytes);
-        state.head = 0;
         state.count = 0;
+        state.total = 0;
     }
 }
 
@@ -529,22 +779,12 @@ ConvCache::CircularView ConvCache::get_window(size_t layer) const {
         return view;
     }
 
-    size_t stride = hidden_size * element_size;
-
-    if (state.count < window_size) {
-        view.ptr1 = state.data.data();
-        view.len1 = state.count;
-        view.ptr2 = nullptr;
-        view.len2 = 0;
-        view.total_len = state.count;
-        return view;
-    }
-
-    view.ptr1 = state.data.data();
-    view.len1 = state.head;
-    view.ptr2 = state.data.data() + state.head * stride;
-    view.len2 = window_size - state.head;
-    view.total_len = window_size;
+    const size_t rows = std::min(state.count, window_size);
+    view.ptr1 = state.data.data() + (state.count - rows) * hidden_size * element_size;
+    view.len1 = rows;
+    view.ptr2 = nullptr;
+    view.len2 = 0;
+    view.total_len = rows;
     return view;
 }
 
@@ -582,25 +822,93 @@ void ConvCache::update(CactusGraph* gb, size_t layer, const size_t bx_node) {
         return;
     }
 
-    size_t copy_rows = std::min(rows, window_size);
-    size_t start_row = rows > window_size ? rows - window_size : 0;
+    const size_t capacity = window_size + ROLLBACK_ROWS;
+    size_t copy_rows = std::min(rows, capacity);
+    size_t start_row = rows > capacity ? rows - capacity : 0;
 
     const uint8_t* src = static_cast<const uint8_t*>(output_ptr) + start_row * stride_bytes;
 
-    for (size_t i = 0; i < copy_rows; ++i) {
-        std::memcpy(state.data.data() + state.head * stride_bytes, src + i * stride_bytes, stride_bytes);
-        state.head = (state.head + 1) % window_size;
-        if (state.count < window_size) {
-            ++state.count;
+    // Rows are kept oldest-first so the window is always one contiguous segment;
+    // the window is only kernel_size - 1 rows, so shifting is cheaper than a split view.
+    size_t keep_rows = std::min(state.count, capacity - copy_rows);
+    uint8_t* base = state.data.data();
+    if (keep_rows > 0) {
+        std::memmove(base, base + (state.count - keep_rows) * stride_bytes, keep_rows * stride_bytes);
+    }
+    std::memcpy(base + keep_rows * stride_bytes, src, copy_rows * stride_bytes);
+    state.count = keep_rows + copy_rows;
+    state.total += rows;
+}
+
+ConvCache::Snapshot ConvCache::snapshot() const {
+    Snapshot out(num_layers);
+    const size_t stride_bytes = hidden_size * element_size;
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        const auto& state = layer_states[layer];
+        const size_t rows = std::min(state.count, window_size);
+        out[layer].assign(state.data.begin() + (state.count - rows) * stride_bytes,
+                          state.data.begin() + state.count * stride_bytes);
+    }
+    return out;
+}
+
+bool ConvCache::can_restore(const Snapshot& snapshot) const {
+    const size_t stride_bytes = hidden_size * element_size;
+    if (snapshot.size() != num_layers) {
+        return false;
+    }
+    for (const auto& rows : snapshot) {
+        if (rows.size() > window_size * stride_bytes || (stride_bytes > 0 && rows.size() % stride_bytes != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ConvCache::restore(const Snapshot& snapshot) {
+    if (!can_restore(snapshot)) {
+        throw std::runtime_error("Conv cache snapshot does not match this cache");
+    }
+    const size_t stride_bytes = hidden_size * element_size;
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        auto& state = layer_states[layer];
+        std::fill(state.data.begin(), state.data.end(), 0);
+        std::copy(snapshot[layer].begin(), snapshot[layer].end(), state.data.begin());
+        state.count = stride_bytes > 0 ? snapshot[layer].size() / stride_bytes : 0;
+        state.total = state.count;
+    }
+}
+
+bool ConvCache::can_truncate(size_t tokens) const {
+    for (const auto& state : layer_states) {
+        if (state.total == 0) {
+            continue;
+        }
+        if (tokens > state.count || state.count - tokens < std::min(state.total - tokens, window_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ConvCache::truncate(size_t tokens) {
+    if (!can_truncate(tokens)) {
+        throw std::runtime_error("Conv cache cannot roll back " + std::to_string(tokens) + " tokens");
+    }
+    for (auto& state : layer_states) {
+        if (state.total == 0) {
+            continue;
         }
+        state.count -= tokens;
+        state.total -= tokens;
     }
 }
 
 void ConvCache::reset() {
     for (auto& state : layer_states) {
         std::fill(state.data.begin(), state.data.end(), 0);
-        state.head = 0;
         state.count = 0;
+        state.total = 0;
     }
 }
 
@@ -717,8 +717,7 @@ void Model::clear_tool_constraints() {
 
 void Model::update_tool_constraints(uint32_t token_id) {
     if (tool_constrainer_.is_active() && tokenizer_) {
-        std::string decoded = tokenizer_->decode({token_id});
-        tool_constrainer_.update(token_id, decoded);
+        tool_constrainer_.update(token_id, tokenizer_->token_bytes(token_id));
     }
 }
 
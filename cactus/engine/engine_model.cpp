@@ -2,6 +2,7 @@
 #include "../models/model.h"
 #include "../graph/graph.h"
 #include "../npu/npu.h"
+#include "../kernel/kernel.h"
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -9,6 +10,7 @@
 #include <cstdlib>
 #include <dirent.h>
 #include <algorithm>
+#include <chrono>
 #include <set>
 #include <sstream>
 #include <stdexcept>
@@ -74,6 +76,7 @@ bool Model::init_internal(CactusGraph* gb, const std::string& model_folder, size
                           const std::string& system_prompt, bool do_warmup) {
 
     CACTUS_LOG_DEBUG("model", "Initializing model from: " << model_folder);
+    CACTUS_LOG_INFO("kernel", "Using " << cactus_kernel_isa() << " kernels");
     model_folder_path_ = model_folder;
     std::string config_path = model_folder + "/config.txt";
 
@@ -112,6 +115,15 @@ bool Model::init_internal(CactusGraph* gb, const std::string& model_folder, size
     }
 
     graph_handle_ = gb;
+    gb->set_release_dead_buffers(true);
+    gb->set_static_memory_plan(true);
+    gb->set_operator_fusion(true);
+    gb->set_parallel_region(true);
+    switch (config_.threading) {
+        case Config::Threading::INTRA_OP: gb->set_threading_policy(ThreadingPolicy::INTRA_OP); break;
+        case Config::Threading::INTER_OP: gb->set_threading_policy(ThreadingPolicy::INTER_OP); break;
+        case Config::Threading::AUTO: gb->set_threading_policy(ThreadingPolicy::AUTO); break;
+    }
 
     if(config_.model_type == Config::ModelType::WHISPER){
         embedding_file_path_ = model_folder+"/decoder_token_embeddings.weights";
@@ -224,70 +236,157 @@ uint32_t Model::decode(const std::vector<uint32_t>& tokens, float temperature, f
     if (top_k == 0) {
         top_k = config_.default_top_k;
     }
-    auto final_hidden = forward(tokens, true);
+    return decode_step(tokens, temperature, top_p, top_k, profile_file, out_entropy);
+}
 
+uint32_t Model::decode_step(const std::vector<uint32_t>& tokens, float temperature, float top_p,
+                            size_t top_k, const std::string& profile_file, float* out_entropy) {
     auto* gb = static_cast<CactusGraph*>(graph_handle_);
-    auto backend = config_.default_backend == Config::Backend::CPU
-        ? ComputeBackend::CPU
-        : ComputeBackend::NPU;
+    size_t sampled_token_id;
+
+    bool replayed = tokens.size() == 1 && replay_decode_graph(gb, tokens[0], false);
+    if (replayed) {
+        sampled_token_id = decode_graph_.output_node;
+        auto& sample_params = decode_graph_.sample->params;
+        sample_params.temperature = temperature;
+        sample_params.top_p = top_p;
+        sample_params.top_k = top_k;
+        sample_params.random_seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        sample_params.sample_entropy = out_entropy != nullptr;
+        sample_params.bias_indices.clear();
+        sample_params.bias_values.clear();
+        for (const auto& [idx, val] : tool_constrainer_.get_bias()) {
+            sample_params.bias_indices.push_back(idx);
+            sample_params.bias_values.push_back(val);
+        }
+    } else {
+        auto final_hidden = forward(tokens, true);
+
+        auto backend = config_.default_backend == Config::Backend::CPU
+            ? ComputeBackend::CPU
+            : ComputeBackend::NPU;
 
-    auto last_hidden = gb->index(final_hidden, tokens.size() - 1, 0);
-    const auto& last_hidden_buf = gb->get_output_buffer(last_hidden);
-    size_t hidden_dim = last_hidden_buf.shape[0];
-    last_hidden = gb->reshape(last_hidden, {1, hidden_dim});
+        auto last_hidden = gb->index(final_hidden, tokens.size() - 1, 0);
+        const auto& last_hidden_buf = gb->get_output_buffer(last_hidden);
+        size_t hidden_dim = last_hidden_buf.shape[0];
+        last_hidden = gb->reshape(last_hidden, {1, hidden_dim});
 
-    auto logits_node_id = gb->matmul(last_hidden, output_weight_node_id_, true, backend);
-    auto sampled_token_id = gb->sample(logits_node_id, temperature, top_p, top_k, tool_constrainer_.get_bias());
+        // The logits are never marked as an output, so the LM head fuses into the sampler and
+        // the entropy comes back alongside the token.
+        size_t logits_node_id = gb->matmul(last_hidden, output_weight_node_id_, true, backend);
+        sampled_token_id = gb->sample(logits_node_id, temperature, top_p, top_k, tool_constrainer_.get_bias(),
+                                      out_entropy != nullptr);
+
+        decode_graph_.valid = false;
+    }
 
     gb->execute(profile_file);
 
+    // Captured after execute so the recorded node count and pointers reflect the fused graph.
+    if (!replayed && tokens.size() == 1 && can_replay_decode_graph()) {
+        capture_decode_graph(gb, sampled_token_id, false);
+    }
+
+    const auto* sampled = static_cast<const uint32_t*>(gb->get_output(sampled_token_id));
+    const uint32_t token = sampled[0];
     if (out_entropy) {
-        const auto& logits_buf = gb->get_output_buffer(logits_node_id);
-        void* logits_ptr = gb->get_output(logits_node_id);
-        size_t vocab_size = logits_buf.shape.back();
-        size_t seq_len = 1;
-        if (logits_buf.shape.size() >= 2) {
-            seq_len = logits_buf.shape[logits_buf.shape.size() - 2];
-        }
-        size_t row_offset = (seq_len > 0 ? (seq_len - 1) * vocab_size : 0);
+        *out_entropy = reinterpret_cast<const float*>(sampled)[1];
+    }
 
-        std::vector<float> logits(vocab_size);
-        if (logits_buf.precision == Precision::FP32) {
-            float* src = static_cast<float*>(logits_ptr) + row_offset;
-            std::copy(src, src + vocab_size, logits.begin());
-        } else if (logits_buf.precision == Precision::FP16) {
-            __fp16* src = static_cast<__fp16*>(logits_ptr) + row_offset;
-            Quantization::fp16_to_fp32(src, logits.data(), vocab_size);
-        } else {
-            int8_t* src = static_cast<int8_t*>(logits_ptr) + row_offset;
-            Quantization::int8_to_fp32(src, logits.data(), vocab_size, 1.0f);
-        }
+    post_execute_updates(gb, tokens.size());
+    update_kv_cache(gb, tokens.size());
 
-        float max_logit = *std::max_element(logits.begin(), logits.end());
-        double sum_exp = 0.0;
-        for (size_t i = 0; i < vocab_size; ++i) {
-            sum_exp += std::exp(static_cast<double>(logits[i] - max_logit));
-        }
-        double log_sum_exp = static_cast<double>(max_logit) + std::log(sum_exp);
-
-        double entropy = 0.0;
-        for (size_t i = 0; i < vocab_size; ++i) {
-            double log_prob = static_cast<double>(logits[i]) - log_sum_exp;
-            double prob = std::exp(log_prob);
-            if (prob > 1e-10) {
-                entropy -= prob * log_prob;
+    return token;
+}
+
+float Model::normalized_entropy(const float* logits, size_t vocab_size) {
+    return cactus_normalized_entropy_f32(logits, vocab_size);
+}
+
+void Model::capture_decode_graph(CactusGraph* gb, size_t output_node, bool logits) {
+    DecodeGraph captured;
+    size_t embedding_count = 0;
+    bool has_output = false;
+
+    for (auto& node : gb->nodes_) {
+        switch (node->op_type) {
+            case OpType::EMBEDDING:
+                if (node->input_ids.size() == 2) {
+                    captured.input_node = node->input_ids[1];
+                    ++embedding_count;
+                }
+                break;
+            case OpType::ROPE:
+            case OpType::ROPE_GPTJ:
+            case OpType::RMS_NORM_ROPE:
+            case OpType::ATTENTION:
+                captured.position_nodes.push_back(node.get());
+                break;
+            case OpType::ATTENTION_INT8_HYBRID: {
+                captured.position_nodes.push_back(node.get());
+                uint32_t layer = 0;
+                while (layer < config_.num_layers && kv_cache_.get_blocks(layer).block_table != node->params.cache_blocks.block_table) {
+                    ++layer;
+                }
+                if (layer == config_.num_layers) {
+                    return;
+                }
+                captured.cache_attention_nodes.emplace_back(node.get(), layer);
+                break;
             }
+            case OpType::SAMPLE:
+            case OpType::MATMUL_SAMPLE:
+                if (!logits && node->id == output_node) {
+                    captured.sample = node.get();
+                }
+                break;
+            default:
+                break;
         }
+        has_output = has_output || node->id == output_node;
+    }
 
-        double max_entropy = std::log(static_cast<double>(vocab_size));
-        *out_entropy = static_cast<float>(entropy / max_entropy);
+    if (embedding_count != 1 || !has_output || (!logits && !captured.sample)) {
+        return;
     }
 
-    post_execute_updates(gb, tokens.size());
-    update_kv_cache(gb, tokens.size());
+    captured.valid = true;
+    captured.generation = gb->generation();
+    captured.node_count = gb->get_node_count();
+    captured.position_offset = kv_cache_.get_total_seq_len();
+    captured.output_node = output_node;
+    captured.logits = logits;
+    decode_graph_ = std::move(captured);
+    capture_decode_graph_inputs();
+}
 
-    auto* output_ptr = gb->get_output(sampled_token_id);
-    return *static_cast<uint32_t*>(output_ptr);
+bool Model::replay_decode_graph(CactusGraph* gb, uint32_t token, bool logits) {
+    if (!decode_graph_.valid || decode_graph_.logits != logits || decode_graph_.generation != gb->generation() ||
+        decode_graph_.node_count != gb->get_node_count() || !can_replay_decode_graph()) {
+        return false;
+    }
+
+    float token_value = static_cast<float>(token);
+    gb->set_input(decode_graph_.input_node, &token_value, Precision::FP32);
+
+    size_t position_offset = kv_cache_.get_total_seq_len();
+    size_t delta = position_offset - decode_graph_.position_offset;
+    for (auto* node : decode_graph_.position_nodes) {
+        node->params.position_offset += delta;
+    }
+    decode_graph_.position_offset = position_offset;
+
+    for (auto& [node, layer] : decode_graph_.cache_attention_nodes) {
+        node->params.cached_keys_int8 = kv_cache_.get_keys_int8(layer);
+        node->params.cached_values_int8 = kv_cache_.get_values_int8(layer);
+        node->params.cached_k_scales = kv_cache_.get_key_scales(layer);
+        node->params.cached_v_scales = kv_cache_.get_value_scales(layer);
+        node->params.cache_seq_len = kv_cache_.current_seq_len;
+        node->params.cache_blocks = kv_cache_.get_blocks(layer);
+    }
+    patch_decode_graph(gb);
+
+    return true;
 }
 
 uint32_t Model::decode_with_audio(const std::vector<uint32_t>& tokens, const std::vector<float>& /*mel_bins*/, float temperature, float top_p, size_t top_k, const std::string& profile_file, float* out_entropy){
@@ -314,6 +413,101 @@ void Model::update_kv_cache(CactusGraph* gb, size_t seq_len) {
                                config_.attention_head_dim);
 }
 
+size_t Model::build_cached_attention(CactusGraph* gb, size_t q_4d, size_t k_4d, size_t v_4d, uint32_t layer_idx,
+                                     float rope_theta, bool use_cache, size_t position_offset, size_t window_size) {
+    const size_t num_heads = config_.attention_heads;
+    const size_t num_kv_heads = config_.attention_kv_heads;
+    const size_t head_dim = config_.attention_head_dim;
+
+    auto attend = [&](size_t q, size_t k, size_t v, const KVCache& cache, size_t position,
+                      std::vector<size_t>& k_nodes, std::vector<size_t>& v_nodes) {
+        if (rope_theta > 0) {
+            q = gb->rope(q, rope_theta, position);
+            k = gb->rope(k, rope_theta, position);
+        }
+        if (use_cache) {
+            k_nodes[layer_idx] = k;
+            v_nodes[layer_idx] = v;
+            gb->mark_output(k);
+            gb->mark_output(v);
+        }
+        if (use_cache && !cache.is_empty()) {
+            return gb->attention_int8_hybrid(
+                q, k, v, attention_scale_, position,
+                cache.get_keys_int8(layer_idx),
+                cache.get_values_int8(layer_idx),
+                cache.get_key_scales(layer_idx),
+                cache.get_value_scales(layer_idx),
+                cache.current_seq_len, num_kv_heads, head_dim, window_size,
+                cache.get_blocks(layer_idx)
+            );
+        }
+        return gb->attention(q, k, v, attention_scale_, position, window_size);
+    };
+
+    if (batch_.empty()) {
+        return attend(q_4d, k_4d, v_4d, kv_cache_, position_offset, cache_k_output_nodes_, cache_v_output_nodes_);
+    }
+
+    // Rows are sliced along the outermost axis so each sequence reads its row in place.
+    const size_t batch_size = batch_.size();
+    size_t q_rows = gb->reshape(q_4d, {batch_size, num_heads * head_dim});
+    size_t k_rows = gb->reshape(k_4d, {batch_size, num_kv_heads * head_dim});
+    size_t v_rows = gb->reshape(v_4d, {batch_size, num_kv_heads * head_dim});
+
+    size_t output = 0;
+    for (size_t i = 0; i < batch_size; ++i) {
+        auto row = [&](size_t rows, size_t heads) {
+            return gb->reshape(gb->slice(rows, 0, i, 1), {1, 1, heads, head_dim});
+        };
+        SequenceState& sequence = *batch_[i];
+        size_t attn = attend(row(q_rows, num_heads), row(k_rows, num_kv_heads), row(v_rows, num_kv_heads),
+                             sequence.kv_cache, sequence.kv_cache.get_total_seq_len(),
+                             sequence.cache_k_nodes, sequence.cache_v_nodes);
+        attn = gb->reshape(attn, {1, num_heads * head_dim});
+        output = i == 0 ? attn : gb->concat(output, attn, 0);
+    }
+    return output;
+}
+
+size_t Model::CacheState::byte_size() const {
+    size_t bytes = kv.byte_size();
+    for (const auto& rows : conv) {
+        bytes += rows.size();
+    }
+    return bytes;
+}
+
+bool Model::save_cache_state(CacheState& state) const {
+    if (!kv_cache_.is_paged()) {
+        return false;
+    }
+    state.kv = kv_cache_.snapshot();
+    state.conv.clear();
+    return true;
+}
+
+bool Model::restore_cache_state(const CacheState& state) {
+    if (!kv_cache_.is_paged()) {
+        return false;
+    }
+    reset_cache();
+    kv_cache_.restore(state.kv);
+    return true;
+}
+
+bool Model::can_restore_cache_state(const CacheState& state) const {
+    return kv_cache_.can_restore(state.kv);
+}
+
+bool Model::truncate_cache(size_t tokens) {
+    if (!kv_cache_.can_truncate(tokens)) {
+        return false;
+    }
+    kv_cache_.truncate(tokens);
+    return true;
+}
+
 
 std::vector<float> Model::get_embeddings(const std::vector<uint32_t>& tokens, bool pooled, bool normalize, const std::string& profile_file) {
     std::vector<float> embeddings;
@@ -401,6 +595,9 @@ bool Config::from_json(const std::string& config_path) {
         return false;
     }
     
+    // Sampling defaults written into config.txt win over the per-model-type ones set below.
+    std::unordered_map<std::string, std::string> sampling_defaults;
+
     std::string line;
     while (std::getline(file, line)) {
         if (line.empty() || line[0] == '#') continue;
@@ -432,6 +629,9 @@ bool Config::from_json(const std::string& config_path) {
         else if (key == "num_top_experts") num_top_experts = static_cast<uint32_t>(std::stoul(value));
         else if (key == "moe_every_n_layers") moe_every_n_layers = static_cast<uint32_t>(std::stoul(value));
         else if (key == "tie_word_embeddings") tie_word_embeddings = (value == "true" || value == "1");
+        else if (key == "fuse_projections") fuse_projections = (value == "true" || value == "1");
+        else if (key == "decode_graph_replay") decode_graph_replay = (value == "true" || value == "1");
+        else if (key == "default_temperature" || key == "default_top_p" || key == "default_top_k") sampling_defaults[key] = value;
         else if (key == "vision_hidden_dim") vision_hidden_dim = static_cast<uint32_t>(std::stoul(value));
         else if (key == "vision_num_layers") vision_num_layers = static_cast<uint32_t>(std::stoul(value));
         else if (key == "vision_attention_heads") vision_attention_heads = static_cast<uint32_t>(std::stoul(value));
@@ -480,6 +680,13 @@ bool Config::from_json(const std::string& config_path) {
             else if (v == "rag") model_variant = ModelVariant::RAG;
             else model_variant = ModelVariant::DEFAULT;
         }
+        else if (key == "threading") {
+            std::string v = value;
+            std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+            if (v == "intra_op") threading = Threading::INTRA_OP;
+            else if (v == "inter_op") threading = Threading::INTER_OP;
+            else threading = Threading::AUTO;
+        }
         else if (key == "conv_L_cache") conv_L_cache = static_cast<size_t>(std::stoul(value));
         else if (key == "layer_types") {
             layer_types.clear();
@@ -535,6 +742,10 @@ bool Config::from_json(const std::string& config_path) {
         default_max_tps = 6.5f;
     }
 
+    if (sampling_defaults.count("default_temperature")) default_temperature = std::stof(sampling_defaults["default_temperature"]);
+    if (sampling_defaults.count("default_top_p")) default_top_p = std::stof(sampling_defaults["default_top_p"]);
+    if (sampling_defaults.count("default_top_k")) default_top_k = std::stoul(sampling_defaults["default_top_k"]);
+
     return true;
 }
 
@@ -0,0 +1,117 @@
+#include "engine.h"
+#include <algorithm>
+
+namespace cactus {
+namespace engine {
+
+uint64_t PrefixCache::hash_block(const uint32_t* tokens) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < BLOCK_TOKENS; i++) {
+        hash ^= tokens[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+PrefixCache::Match PrefixCache::lookup(const std::vector<uint32_t>& tokens, size_t max_tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Match match;
+    max_tokens = std::min(max_tokens, tokens.size());
+    Node* node = &root_;
+
+    for (size_t start = 0; start + BLOCK_TOKENS <= max_tokens; start += BLOCK_TOKENS) {
+        auto it = node->children.find(hash_block(tokens.data() + start));
+        if (it == node->children.end() ||
+            !std::equal(it->second->block.begin(), it->second->block.end(), tokens.begin() + start)) {
+            break;
+        }
+        node = it->second.get();
+        match.shared_tokens = start + BLOCK_TOKENS;
+        if (node->state) {
+            match.state_tokens = match.shared_tokens;
+            match.state = node->state;
+            node->last_used = ++clock_;
+        }
+    }
+    return match;
+}
+
+void PrefixCache::insert(const std::vector<uint32_t>& tokens, size_t num_tokens, Model::CacheState state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    num_tokens = std::min(num_tokens, tokens.size()) / BLOCK_TOKENS * BLOCK_TOKENS;
+    size_t state_bytes = state.byte_size();
+    if (num_tokens == 0 || state_bytes > budget_bytes_) {
+        return;
+    }
+
+    Node* node = &root_;
+    for (size_t start = 0; start < num_tokens; start += BLOCK_TOKENS) {
+        auto& child = node->children[hash_block(tokens.data() + start)];
+        if (!child) {
+            child = std::make_unique<Node>();
+            child->block.assign(tokens.begin() + start, tokens.begin() + start + BLOCK_TOKENS);
+        } else if (!std::equal(child->block.begin(), child->block.end(), tokens.begin() + start)) {
+            return;
+        }
+        node = child.get();
+    }
+
+    total_bytes_ -= node->state_bytes;
+    node->state = std::make_shared<const Model::CacheState>(std::move(state));
+    node->state_bytes = state_bytes;
+    node->last_used = ++clock_;
+    total_bytes_ += state_bytes;
+
+    evict_to_budget();
+}
+
+void PrefixCache::evict_to_budget() {
+    while (total_bytes_ > budget_bytes_) {
+        std::vector<Node*> path;
+        std::vector<Node*> oldest_path;
+        uint64_t oldest = UINT64_MAX;
+
+        auto visit = [&](auto&& self, Node* node) -> void {
+            path.push_back(node);
+            if (node->state && node->last_used < oldest) {
+                oldest = node->last_used;
+                oldest_path = path;
+            }
+            for (auto& [hash, child] : node->children) {
+                self(self, child.get());
+            }
+            path.pop_back();
+        };
+        visit(visit, &root_);
+
+        if (oldest_path.empty()) {
+            break;
+        }
+
+        Node* victim = oldest_path.back();
+        total_bytes_ -= victim->state_bytes;
+        victim->state.reset();
+        victim->state_bytes = 0;
+
+        // Drop the blocks that now lead to no state at all.
+        for (size_t depth = oldest_path.size() - 1; depth > 0; depth--) {
+            Node* node = oldest_path[depth];
+            if (node->state || !node->children.empty()) {
+                break;
+            }
+            Node* parent = oldest_path[depth - 1];
+            parent->children.erase(hash_block(node->block.data()));
+        }
+    }
+}
+
+void PrefixCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    root_.children.clear();
+    total_bytes_ = 0;
+}
+
+}
+}
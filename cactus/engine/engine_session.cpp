@@ -0,0 +1,262 @@
+#include "engine.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cactus {
+namespace engine {
+
+namespace {
+
+constexpr char SESSION_MAGIC[8] = {'C', 'A', 'C', 'T', 'U', 'S', 'K', 'V'};
+constexpr uint32_t SESSION_VERSION = 2;
+constexpr size_t SESSION_ALIGNMENT = 64;
+// Bytes of the embedding file hashed into the model fingerprint; enough to tell fine-tunes apart.
+constexpr size_t FINGERPRINT_EMBEDDING_BYTES = 64 * 1024;
+
+struct SessionHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kv_group_size;
+    uint64_t num_layers;
+    uint64_t num_kv_heads;
+    uint64_t head_dim;
+    uint64_t window_size;
+    uint64_t sink_size;
+    uint64_t seq_len;
+    uint64_t total_seq_len;
+    uint64_t num_tokens;
+    uint64_t num_conv_layers;
+    uint64_t model_fingerprint;
+};
+
+// FNV-1a over the model's config and the start of its embeddings, so a session never loads
+// into another model that only happens to share the cache layout.
+uint64_t model_fingerprint(const std::string& model_folder, const std::string& embedding_file) {
+    uint64_t fingerprint = 1469598103934665603ull;
+    auto hash_file = [&](const std::string& path, size_t max_bytes) {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes(max_bytes);
+        in.read(bytes.data(), static_cast<std::streamsize>(max_bytes));
+        for (std::streamsize i = 0; i < in.gcount(); ++i) {
+            fingerprint = (fingerprint ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ull;
+        }
+    };
+    if (!model_folder.empty()) {
+        hash_file(model_folder + "/config.txt", FINGERPRINT_EMBEDDING_BYTES);
+        hash_file(embedding_file, FINGERPRINT_EMBEDDING_BYTES);
+    }
+    return fingerprint;
+}
+
+class SessionWriter {
+public:
+    explicit SessionWriter(const std::string& path) : out_(path, std::ios::binary | std::ios::trunc) {
+        if (!out_) {
+            throw std::runtime_error("Cannot open session file for writing: " + path);
+        }
+    }
+
+    void write(const void* data, size_t bytes) {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        offset_ += bytes;
+    }
+
+    template <typename T>
+    void section(const std::vector<T>& data) {
+        uint64_t bytes = data.size() * sizeof(T);
+        write(&bytes, sizeof(bytes));
+        static const char padding[SESSION_ALIGNMENT] = {};
+        write(padding, (SESSION_ALIGNMENT - offset_ % SESSION_ALIGNMENT) % SESSION_ALIGNMENT);
+        write(data.data(), bytes);
+    }
+
+    void close(const std::string& path) {
+        out_.close();
+        if (!out_) {
+            throw std::runtime_error("Failed to write session file: " + path);
+        }
+    }
+
+private:
+    std::ofstream out_;
+    size_t offset_ = 0;
+};
+
+class SessionReader {
+public:
+    explicit SessionReader(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open session file: " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SessionHeader))) {
+            ::close(fd);
+            throw std::runtime_error("Session file is truncated: " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Cannot map session file: " + path);
+        }
+        data_ = static_cast<const uint8_t*>(mapped);
+        madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+    }
+
+    ~SessionReader() {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    SessionReader(const SessionReader&) = delete;
+    SessionReader& operator=(const SessionReader&) = delete;
+
+    const SessionHeader& header() {
+        offset_ = sizeof(SessionHeader);
+        return *reinterpret_cast<const SessionHeader*>(data_);
+    }
+
+    template <typename T>
+    void section(std::vector<T>& out) {
+        uint64_t bytes = 0;
+        read(&bytes, sizeof(bytes));
+        offset_ += (SESSION_ALIGNMENT - offset_ % SESSION_ALIGNMENT) % SESSION_ALIGNMENT;
+        if (bytes % sizeof(T) != 0 || offset_ > size_ || bytes > size_ - offset_) {
+            throw std::runtime_error("Session file is truncated");
+        }
+        out.resize(bytes / sizeof(T));
+        std::memcpy(out.data(), data_ + offset_, bytes);
+        offset_ += bytes;
+    }
+
+private:
+    void read(void* dst, size_t bytes) {
+        if (offset_ + bytes > size_) {
+            throw std::runtime_error("Session file is truncated");
+        }
+        std::memcpy(dst, data_ + offset_, bytes);
+        offset_ += bytes;
+    }
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+};
+
+}
+
+bool Model::save_session(const std::string& path, const std::vector<uint32_t>& tokens) const {
+    CacheState state;
+    if (!save_cache_state(state)) {
+        return false;
+    }
+
+    SessionHeader header{};
+    std::memcpy(header.magic, SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    header.version = SESSION_VERSION;
+    header.kv_group_size = KV_QUANT_GROUP_SIZE;
+    header.num_layers = kv_cache_.num_layers;
+    header.num_kv_heads = kv_cache_.num_kv_heads;
+    header.head_dim = kv_cache_.head_dim;
+    header.window_size = kv_cache_.window_size;
+    header.sink_size = kv_cache_.sink_size;
+    header.seq_len = state.kv.seq_len;
+    header.total_seq_len = state.kv.total_seq_len;
+    header.num_tokens = tokens.size();
+    header.num_conv_layers = state.conv.size();
+    header.model_fingerprint = model_fingerprint(model_folder_path_, embedding_file_path_);
+
+    // Written next to the target and renamed, so a crash never leaves a half-written session.
+    const std::string tmp_path = path + ".tmp";
+    SessionWriter writer(tmp_path);
+    writer.write(&header, sizeof(header));
+    writer.section(tokens);
+    for (size_t layer = 0; layer < state.kv.keys.size(); layer++) {
+        writer.section(state.kv.keys[layer]);
+        writer.section(state.kv.values[layer]);
+        writer.section(state.kv.key_scales[layer]);
+        writer.section(state.kv.value_scales[layer]);
+    }
+    for (const auto& rows : state.conv) {
+        writer.section(rows);
+    }
+    writer.close(tmp_path);
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("Failed to write session file: " + path);
+    }
+    return true;
+}
+
+bool Model::read_session(const std::string& path, CacheState& state, std::vector<uint32_t>& tokens) const {
+    SessionReader reader(path);
+    const SessionHeader& header = reader.header();
+
+    if (std::memcmp(header.magic, SESSION_MAGIC, sizeof(SESSION_MAGIC)) != 0 || header.version != SESSION_VERSION) {
+        throw std::runtime_error("Not a session file: " + path);
+    }
+    if (header.model_fingerprint != model_fingerprint(model_folder_path_, embedding_file_path_)) {
+        throw std::runtime_error("Session file was saved by a different model: " + path);
+    }
+    if (header.kv_group_size != KV_QUANT_GROUP_SIZE || header.num_layers != kv_cache_.num_layers ||
+        header.num_kv_heads != kv_cache_.num_kv_heads || header.head_dim != kv_cache_.head_dim ||
+        header.window_size != kv_cache_.window_size || header.sink_size != kv_cache_.sink_size) {
+        throw std::runtime_error("Session file was saved with a different KV cache layout: " + path);
+    }
+
+    state = CacheState{};
+    state.kv.seq_len = header.seq_len;
+    state.kv.total_seq_len = header.total_seq_len;
+
+    std::vector<uint32_t> session_tokens;
+    reader.section(session_tokens);
+    if (session_tokens.size() != header.num_tokens) {
+        throw std::runtime_error("Session file is corrupt: " + path);
+    }
+
+    state.kv.keys.resize(header.num_layers);
+    state.kv.values.resize(header.num_layers);
+    state.kv.key_scales.resize(header.num_layers);
+    state.kv.value_scales.resize(header.num_layers);
+    for (size_t layer = 0; layer < header.num_layers; layer++) {
+        reader.section(state.kv.keys[layer]);
+        reader.section(state.kv.values[layer]);
+        reader.section(state.kv.key_scales[layer]);
+        reader.section(state.kv.value_scales[layer]);
+    }
+
+    // Counted before resizing, so a damaged count cannot ask for a huge allocation.
+    if (header.num_conv_layers > kv_cache_.num_layers) {
+        throw std::runtime_error("Session file is corrupt: " + path);
+    }
+    state.conv.resize(header.num_conv_layers);
+    for (auto& rows : state.conv) {
+        reader.section(rows);
+    }
+
+    if (!can_restore_cache_state(state)) {
+        return false;
+    }
+    tokens = std::move(session_tokens);
+    return true;
+}
+
+bool Model::load_session(const std::string& path, std::vector<uint32_t>& tokens) {
+    CacheState state;
+    std::vector<uint32_t> session_tokens;
+    if (!read_session(path, state, session_tokens) || !restore_cache_state(state)) {
+        return false;
+    }
+    tokens = std::move(session_tokens);
+    return true;
+}
+
+}
+}
@@ -12,8 +12,7 @@ namespace cactus {
 namespace engine {
 
 SPTokenizer::SPTokenizer()
-    : trie_root_(std::make_unique<TrieNode>()),
-      vocab_size_(0),
+    : vocab_size_(0),
       unk_token_id_(3),
       bos_token_id_(2),
       eos_token_id_(1),
@@ -109,7 +108,13 @@ bool SPTokenizer::load_vocabulary_with_config(const std::string& vocab_file, con
 
     vocab_stream.close();
     
-    build_trie();
+    load_trie(vocab_file);
+
+    token_bytes_.clear();
+    token_bytes_.reserve(id_to_token_.size());
+    for (const auto& token : id_to_token_) {
+        token_bytes_.push_back(replace_metaspace(token));
+    }
     
     std::ifstream config_stream(config_file);
     if (config_stream.is_open()) {
@@ -149,60 +154,21 @@ bool SPTokenizer::load_vocabulary_with_config(const std::string& vocab_file, con
     return true;
 }
 
-void SPTokenizer::build_trie() {
-    for (uint32_t id = 0; id < id_to_token_.size(); ++id) {
-        const std::string& token = id_to_token_[id];
-        if (token.empty()) continue;
-        
-        std::u32string u32_token;
-        size_t pos = 0;
-        while (pos < token.length()) {
-            char32_t codepoint = 0;
-            unsigned char byte = token[pos];
-
-            if (byte < 0x80) {
-                codepoint = byte;
-                pos++;
-            } else if ((byte & 0xE0) == 0xC0) {
-                if (pos + 1 < token.length()) {
-                    codepoint = ((byte & 0x1F) << 6) | (token[pos + 1] & 0x3F);
-                    pos += 2;
-                } else break;
-            } else if ((byte & 0xF0) == 0xE0) {
-                if (pos + 2 < token.length()) {
-                    codepoint = ((byte & 0x0F) << 12) |
-                               ((token[pos + 1] & 0x3F) << 6) |
-                               (token[pos + 2] & 0x3F);
-                    pos += 3;
-                } else break;
-            } else if ((byte & 0xF8) == 0xF0) {
-                if (pos + 3 < token.length()) {
-                    codepoint = ((byte & 0x07) << 18) |
-                               ((token[pos + 1] & 0x3F) << 12) |
-                               ((token[pos + 2] & 0x3F) << 6) |
-                               (token[pos + 3] & 0x3F);
-                    pos += 4;
-                } else break;
-            } else {
-                pos++;
-                continue;
-            }
-
-            u32_token.push_back(codepoint);
-        }
+void SPTokenizer::load_trie(const std::string& vocab_file) {
+    // The cached trie is keyed on the vocabulary's bytes, so an edited vocabulary never maps a stale one.
+    std::ifstream vocab_stream(vocab_file, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(vocab_stream)), std::istreambuf_iterator<char>());
+    uint64_t fingerprint = 1469598103934665603ull;
+    for (unsigned char c : content) {
+        fingerprint = (fingerprint ^ c) * 1099511628211ull;
+    }
 
-        if (u32_token.empty()) continue;
-        
-        TrieNode* current = trie_root_.get();
-        for (char32_t ch : u32_token) {
-            if (current->children.find(ch) == current->children.end()) {
-                current->children[ch] = std::make_unique<TrieNode>();
-            }
-            current = current->children[ch].get();
-        }
-        current->token_id = static_cast<int32_t>(id);
-        current->score = token_scores_[id];
+    std::string trie_path = vocab_file.substr(0, vocab_file.find_last_of("/\\") + 1) + "vocab.trie";
+    if (trie_.load(trie_path, fingerprint, id_to_token_.size())) {
+        return;
     }
+    trie_.build(id_to_token_);
+    trie_.save(trie_path, fingerprint);
 }
 
 std::string SPTokenizer::preprocess_text(const std::string& text) const {
@@ -246,116 +212,35 @@ std::string SPTokenizer::postprocess_text(const std::string& text) const {
     return result;
 }
 
-std::vector<std::pair<std::string, uint32_t>> SPTokenizer::tokenize_with_trie(const std::string& text) const {
-    std::vector<std::pair<std::string, uint32_t>> result;
-    
-    std::u32string u32_text;
+void SPTokenizer::tokenize_with_trie(const std::string& text, std::vector<uint32_t>& token_ids) const {
+    // Longest match over UTF-8 bytes; vocabulary tokens are whole characters, so a match never splits one.
+    bool any_char = false;
     size_t pos = 0;
     while (pos < text.length()) {
-        char32_t codepoint = 0;
-        unsigned char byte = text[pos];
+        auto [match_len, token_id] = trie_.longest_prefix(text.data() + pos, text.length() - pos);
+        if (match_len > 0) {
+            token_ids.push_back(static_cast<uint32_t>(token_id));
+            pos += match_len;
+            any_char = true;
+            continue;
+        }
 
-        if (byte < 0x80) {
-            codepoint = byte;
-            pos++;
-        } else if ((byte & 0xE0) == 0xC0) {
-            if (pos + 1 < text.length()) {
-                codepoint = ((byte & 0x1F) << 6) | (text[pos + 1] & 0x3F);
-                pos += 2;
-            } else break;
-        } else if ((byte & 0xF0) == 0xE0) {
-            if (pos + 2 < text.length()) {
-                codepoint = ((byte & 0x0F) << 12) |
-                           ((text[pos + 1] & 0x3F) << 6) |
-                           (text[pos + 2] & 0x3F);
-                pos += 3;
-            } else break;
-        } else if ((byte & 0xF8) == 0xF0) {
-            if (pos + 3 < text.length()) {
-                codepoint = ((byte & 0x07) << 18) |
-                           ((text[pos + 1] & 0x3F) << 12) |
-                           ((text[pos + 2] & 0x3F) << 6) |
-                           (text[pos + 3] & 0x3F);
-                pos += 4;
-            } else break;
-        } else {
+        unsigned char byte = text[pos];
+        size_t char_len = byte < 0x80 ? 1 : (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : (byte & 0xF8) == 0xF0 ? 4 : 0;
+        if (char_len == 0) {
             pos++;
             continue;
         }
+        if (pos + char_len > text.length()) break;
 
-        u32_text.push_back(codepoint);
-    }
-
-    if (u32_text.empty()) {
-        result.push_back({text, unk_token_id_});
-        return result;
+        token_ids.push_back(unk_token_id_);
+        pos += char_len;
+        any_char = true;
     }
 
-    pos = 0;
-    while (pos < u32_text.length()) {
-        TrieNode* current = trie_root_.get();
-        size_t best_match_len = 0;
-        int32_t best_token_id = -1;
-        
-        for (size_t len = 0; pos + len < u32_text.length(); ++len) {
-            char32_t ch = u32_text[pos + len];
-            if (current->children.find(ch) == current->children.end()) {
-                break;
-            }
-            current = current->children[ch].get();
-            if (current->token_id >= 0) {
-                best_match_len = len + 1;
-                best_token_id = current->token_id;
-            }
-        }
-        
-        if (best_match_len > 0) {
-            std::u32string u32_token = u32_text.substr(pos, best_match_len);
-            
-            std::string token;
-            for (char32_t cp : u32_token) {
-                if (cp < 0x80) {
-                    token.push_back(static_cast<char>(cp));
-                } else if (cp < 0x800) {
-                    token.push_back(static_cast<char>(0xC0 | (cp >> 6)));
-                    token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-                } else if (cp < 0x10000) {
-                    token.push_back(static_cast<char>(0xE0 | (cp >> 12)));
-                    token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
-                    token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-                } else {
-                    token.push_back(static_cast<char>(0xF0 | (cp >> 18)));
-                    token.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
-                    token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
-                    token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-                }
-            }
-            result.push_back({token, static_cast<uint32_t>(best_token_id)});
-            pos += best_match_len;
-        } else {
-            char32_t cp = u32_text[pos];
-            std::string char_str;
-            if (cp < 0x80) {
-                char_str.push_back(static_cast<char>(cp));
-            } else if (cp < 0x800) {
-                char_str.push_back(static_cast<char>(0xC0 | (cp >> 6)));
-                char_str.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-            } else if (cp < 0x10000) {
-                char_str.push_back(static_cast<char>(0xE0 | (cp >> 12)));
-                char_str.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
-                char_str.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-            } else {
-                char_str.push_back(static_cast<char>(0xF0 | (cp >> 18)));
-                char_str.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
-                char_str.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
-                char_str.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
-            }
-            result.push_back({char_str, unk_token_id_});
-            pos++;
-        }
+    if (!any_char) {
+        token_ids.push_back(unk_token_id_);
     }
-    
-    return result;
 }
 
 std::vector<std::string> SPTokenizer::split_with_special_tokens(const std::string& text) const {
@@ -405,13 +290,7 @@ std::vector<uint32_t> SPTokenizer::encode(const std::string& text) const {
         if (special_it != special_tokens_.end()) {
             token_ids.push_back(special_it->second);
         } else {
-            std::string processed = preprocess_text(segment);
-
-            auto token_pairs = tokenize_with_trie(processed);
-
-            for (const auto& [token, id] : token_pairs) {
-                token_ids.push_back(id);
-            }
+            tokenize_with_trie(preprocess_text(segment), token_ids);
         }
     }
 
@@ -422,25 +301,7 @@ std::string SPTokenizer::decode(const std::vector<uint32_t>& tokens) const {
     std::string result;
 
     if (tokens.size() == 1) {
-        uint32_t token_id = tokens[0];
-        if (token_id < id_to_token_.size()) {
-            std::string token = id_to_token_[token_id];
-
-            size_t pos = 0;
-            while (pos < token.length()) {
-                if (pos + 2 < token.length() &&
-                    static_cast<unsigned char>(token[pos]) == 0xE2 &&
-                    static_cast<unsigned char>(token[pos+1]) == 0x96 &&
-                    static_cast<unsigned char>(token[pos+2]) == 0x81) {
-                    result += ' ';
-                    pos += 3;
-                } else {
-                    result += token[pos];
-                    pos++;
-                }
-            }
-        }
-        return result;
+        return token_bytes(tokens[0]);
     }
 
     for (size_t i = 0; i < tokens.size(); i++) {
@@ -0,0 +1,252 @@
+#include "engine.h"
+#include "../graph/graph.h"
+#include "../kernel/kernel.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+namespace cactus {
+namespace engine {
+
+namespace {
+
+bool is_greedy(float temperature, float top_p, size_t top_k) {
+    return temperature == 0.0f && top_p <= 0.0f && top_k == 0;
+}
+
+uint32_t argmax(const float* values, size_t count) {
+    return static_cast<uint32_t>(std::max_element(values, values + count) - values);
+}
+
+// The distribution the sample op draws from; one-hot on the argmax when it would be greedy.
+void token_distribution(const float* logits, float* probs, size_t vocab_size,
+                        float temperature, float top_p, size_t top_k) {
+    if (is_greedy(temperature, top_p, top_k) ||
+        !cactus_sample_probs_f32(logits, probs, vocab_size, temperature, top_p, top_k)) {
+        std::fill(probs, probs + vocab_size, 0.0f);
+        probs[argmax(logits, vocab_size)] = 1.0f;
+    }
+}
+
+uint32_t draw(const float* probs, size_t vocab_size, float sample) {
+    float cumulative = 0.0f;
+    for (size_t i = 0; i < vocab_size; ++i) {
+        cumulative += probs[i];
+        if (cumulative >= sample) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    for (size_t i = vocab_size; i > 0; --i) {
+        if (probs[i - 1] > 0.0f) {
+            return static_cast<uint32_t>(i - 1);
+        }
+    }
+    return 0;
+}
+
+}
+
+std::vector<float> Model::forward_logits(const std::vector<uint32_t>& tokens) {
+    auto* gb = static_cast<CactusGraph*>(graph_handle_);
+    size_t logits_node_id;
+
+    bool replayed = tokens.size() == 1 && replay_decode_graph(gb, tokens[0], true);
+    if (replayed) {
+        logits_node_id = decode_graph_.output_node;
+    } else {
+        auto final_hidden = forward(tokens, true);
+
+        auto backend = config_.default_backend == Config::Backend::CPU
+            ? ComputeBackend::CPU
+            : ComputeBackend::NPU;
+
+        logits_node_id = gb->matmul(final_hidden, output_weight_node_id_, true, backend);
+        gb->mark_output(logits_node_id);
+        decode_graph_.valid = false;
+    }
+
+    gb->execute();
+
+    if (!replayed && tokens.size() == 1 && can_replay_decode_graph()) {
+        capture_decode_graph(gb, logits_node_id, true);
+    }
+
+    const auto& logits_buf = gb->get_output_buffer(logits_node_id);
+    const size_t count = tokens.size() * logits_buf.shape.back();
+    void* logits_ptr = gb->get_output(logits_node_id);
+    std::vector<float> logits(count);
+    if (logits_buf.precision == Precision::FP32) {
+        const float* src = static_cast<const float*>(logits_ptr);
+        std::copy(src, src + count, logits.begin());
+    } else if (logits_buf.precision == Precision::FP16) {
+        Quantization::fp16_to_fp32(static_cast<const __fp16*>(logits_ptr), logits.data(), count);
+    } else {
+        Quantization::int8_to_fp32(static_cast<const int8_t*>(logits_ptr), logits.data(), count, 1.0f);
+    }
+
+    post_execute_updates(gb, tokens.size());
+    update_kv_cache(gb, tokens.size());
+    return logits;
+}
+
+std::vector<uint32_t> Model::lookup_proposals(const std::vector<uint32_t>& tokens, size_t ngram_size, size_t max_tokens) {
+    for (size_t n = std::min(ngram_size, tokens.size() > 0 ? tokens.size() - 1 : 0); n > 0; --n) {
+        const auto pattern = tokens.end() - n;
+        for (size_t start = tokens.size() - n; start-- > 0;) {
+            if (std::equal(pattern, tokens.end(), tokens.begin() + start)) {
+                const size_t from = start + n;
+                const size_t count = std::min(max_tokens, tokens.size() - from);
+                return std::vector<uint32_t>(tokens.begin() + from, tokens.begin() + from + count);
+            }
+        }
+    }
+    return {};
+}
+
+std::vector<uint32_t> Model::verify_proposals(uint32_t last_token, const std::vector<uint32_t>& proposals,
+                                              const std::vector<float>& draft_probs,
+                                              float temperature, float top_p, size_t top_k,
+                                              std::vector<float>* out_entropies) {
+    const size_t vocab_size = config_.vocab_size;
+    const size_t k = proposals.size();
+    std::mt19937 gen(std::random_device{}());
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    // Row i of the logits scores proposal i; the last row gives the bonus token.
+    std::vector<uint32_t> verify = {last_token};
+    verify.insert(verify.end(), proposals.begin(), proposals.end());
+    std::vector<float> target_logits = forward_logits(verify);
+
+    std::vector<float> p(vocab_size);
+    std::vector<uint32_t> output;
+    size_t accepted = 0;
+    for (; accepted <= k; ++accepted) {
+        const float* row = target_logits.data() + accepted * vocab_size;
+        token_distribution(row, p.data(), vocab_size, temperature, top_p, top_k);
+        if (out_entropies) {
+            out_entropies->push_back(normalized_entropy(row, vocab_size));
+        }
+        if (accepted == k) {
+            output.push_back(draw(p.data(), vocab_size, uniform(gen)));
+            break;
+        }
+
+        // Proposals made without a distribution count as certain: q is one-hot on the proposal.
+        const uint32_t proposal = proposals[accepted];
+        const float* q = draft_probs.empty() ? nullptr : draft_probs.data() + accepted * vocab_size;
+        const float q_proposal = q ? q[proposal] : 1.0f;
+        if (p[proposal] > 0.0f && uniform(gen) * q_proposal <= p[proposal]) {
+            output.push_back(proposal);
+            continue;
+        }
+
+        // Drawing a rejected position from max(0, p - q) keeps the output distributed as p.
+        float residual_sum = 0.0f;
+        for (size_t i = 0; i < vocab_size; ++i) {
+            p[i] = std::max(0.0f, p[i] - (q ? q[i] : (i == proposal ? 1.0f : 0.0f)));
+            residual_sum += p[i];
+        }
+        output.push_back(residual_sum > 0.0f ? draw(p.data(), vocab_size, uniform(gen) * residual_sum)
+                                             : argmax(row, vocab_size));
+        break;
+    }
+
+    if (!truncate_cache(k - accepted)) {
+        throw std::runtime_error("Failed to roll back rejected draft tokens");
+    }
+    return output;
+}
+
+std::vector<uint32_t> Model::decode_speculative(Model& draft, uint32_t last_token, size_t draft_tokens,
+                                                float temperature, float top_p, size_t top_k,
+                                                std::vector<float>* out_entropies) {
+    if (temperature < 0) {
+        temperature = config_.default_temperature;
+    }
+    if (top_p < 0) {
+        top_p = config_.default_top_p;
+    }
+    if (top_k == 0) {
+        top_k = config_.default_top_k;
+    }
+    if (!truncate_cache(0) || !draft.truncate_cache(0)) {
+        throw std::runtime_error("Speculative decoding needs models whose caches can be rolled back");
+    }
+    if (draft.config_.vocab_size != config_.vocab_size) {
+        throw std::runtime_error("Draft model vocabulary does not match the target model");
+    }
+
+    const size_t vocab_size = config_.vocab_size;
+    const size_t k = std::clamp<size_t>(draft_tokens, 1, MAX_DRAFT_TOKENS);
+    std::mt19937 gen(std::random_device{}());
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    // The draft runs one token at a time through its replayed decode graph. Greedy proposals come
+    // straight from the fused LM-head sampler and are one-hot; otherwise the distribution behind
+    // each proposal is kept for the rejection test.
+    std::vector<uint32_t> proposals;
+    std::vector<float> draft_probs;
+    if (is_greedy(temperature, top_p, top_k)) {
+        for (size_t i = 0; i < k; ++i) {
+            proposals.push_back(draft.decode_step({proposals.empty() ? last_token : proposals.back()},
+                                                  temperature, top_p, top_k));
+        }
+    } else {
+        draft_probs.resize(k * vocab_size);
+    }
+    for (size_t i = proposals.size(); i < k; ++i) {
+        std::vector<float> logits = draft.forward_logits({proposals.empty() ? last_token : proposals.back()});
+        float* q = draft_probs.data() + i * vocab_size;
+        token_distribution(logits.data(), q, vocab_size, temperature, top_p, top_k);
+        proposals.push_back(draw(q, vocab_size, uniform(gen)));
+    }
+
+    std::vector<uint32_t> output = verify_proposals(last_token, proposals, draft_probs,
+                                                    temperature, top_p, top_k, out_entropies);
+
+    // The draft's cache ends at the last accepted proposal too; the returned last token is fed next call.
+    const size_t accepted = output.size() - 1;
+    if (accepted < k) {
+        if (!draft.truncate_cache(k - 1 - accepted)) {
+            throw std::runtime_error("Failed to roll back rejected draft tokens");
+        }
+    } else {
+        draft.prefill({proposals.back()});
+    }
+    return output;
+}
+
+std::vector<uint32_t> Model::decode_lookup(const std::vector<uint32_t>& context, size_t max_proposals,
+                                           float temperature, float top_p, size_t top_k,
+                                           std::vector<float>* out_entropies) {
+    if (context.empty()) {
+        throw std::runtime_error("Cannot decode from an empty context");
+    }
+
+    std::vector<uint32_t> proposals;
+    if (truncate_cache(0)) {
+        proposals = lookup_proposals(context, LOOKUP_NGRAM_SIZE, std::min(max_proposals, MAX_DRAFT_TOKENS));
+    }
+    if (proposals.empty()) {
+        float entropy = 0.0f;
+        uint32_t token = decode({context.back()}, temperature, top_p, top_k, "", out_entropies ? &entropy : nullptr);
+        if (out_entropies) {
+            out_entropies->push_back(entropy);
+        }
+        return {token};
+    }
+
+    if (temperature < 0) {
+        temperature = config_.default_temperature;
+    }
+    if (top_p < 0) {
+        top_p = config_.default_top_p;
+    }
+    if (top_k == 0) {
+        top_k = config_.default_top_k;
+    }
+    return verify_proposals(context.back(), proposals, {}, temperature, top_p, top_k, out_entropies);
+}
+
+}
+}
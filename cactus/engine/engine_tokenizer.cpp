@@ -1,11 +1,83 @@
 #include "engine.h"
+#include "../kernel/kernel_utils.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <exception>
 
 namespace cactus {
 namespace engine {
 
+std::vector<std::vector<uint32_t>> Tokenizer::encode_batch(const std::vector<std::string>& texts) const {
+    std::vector<std::vector<uint32_t>> tokens(texts.size());
+    std::vector<std::exception_ptr> errors(texts.size());
+
+    // Texts vary widely in length, so the batch is cut into as many ranges as the pool will steal from.
+    auto& pool = CactusThreading::get_thread_pool();
+    pool.fork_join(texts.size(), CactusThreading::ThreadPool::MAX_TASKS, [&](size_t start, size_t end) {
+        for (size_t i = start; i < end; ++i) {
+            try {
+                tokens[i] = encode(texts[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    });
+
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    return tokens;
+}
+
+std::string replace_metaspace(std::string_view token) {
+    std::string result;
+    result.reserve(token.size());
+    size_t pos = 0;
+    while (pos < token.size()) {
+        if (pos + 3 <= token.size() &&
+            static_cast<unsigned char>(token[pos]) == 0xE2 &&
+            static_cast<unsigned char>(token[pos + 1]) == 0x96 &&
+            static_cast<unsigned char>(token[pos + 2]) == 0x81) {
+            result.push_back(' ');
+            pos += 3;
+        } else {
+            result.push_back(token[pos++]);
+        }
+    }
+    return result;
+}
+
+const std::string& Tokenizer::token_bytes(uint32_t token) const {
+    static const std::string empty;
+    return token < token_bytes_.size() ? token_bytes_[token] : empty;
+}
+
+std::string StreamingDetokenizer::push(uint32_t token) {
+    pending_ += tokenizer_.token_bytes(token);
+
+    // Only the last character can be cut short: find its lead byte among the final four bytes.
+    size_t complete = pending_.size();
+    const size_t lookback = std::min<size_t>(pending_.size(), 4);
+    for (size_t back = 1; back <= lookback; ++back) {
+        const uint8_t byte = static_cast<uint8_t>(pending_[pending_.size() - back]);
+        if ((byte & 0xC0) == 0x80) continue;
+        const size_t length = (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : (byte & 0xF8) == 0xF0 ? 4 : 1;
+        if (length > back) complete = pending_.size() - back;
+        break;
+    }
+
+    std::string text = pending_.substr(0, complete);
+    pending_.erase(0, complete);
+    return text;
+}
+
+std::string StreamingDetokenizer::flush() {
+    std::string text;
+    text.swap(pending_);
+    return text;
+}
+
 void Tokenizer::detect_model_type(const std::string& config_path) {
     std::ifstream file(config_path);
     if (!file.is_open()) {
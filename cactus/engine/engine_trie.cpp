@@ -0,0 +1,235 @@
+#include "engine.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cactus {
+namespace engine {
+
+namespace {
+
+constexpr char TRIE_MAGIC[8] = {'C', 'A', 'C', 'T', 'U', 'S', 'D', 'A'};
+constexpr uint32_t TRIE_VERSION = 2;
+constexpr int32_t EMPTY_UNIT = -1;
+constexpr int32_t ROOT_UNIT = -2;
+
+struct TrieHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_keys;
+    uint64_t fingerprint;
+    uint64_t num_units;
+};
+
+}
+
+DoubleArrayTrie::~DoubleArrayTrie() {
+    release();
+}
+
+void DoubleArrayTrie::release() {
+    if (mmap_ptr_) {
+        munmap(mmap_ptr_, mmap_size_);
+        mmap_ptr_ = nullptr;
+        mmap_size_ = 0;
+    }
+    units_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    num_keys_ = 0;
+}
+
+void DoubleArrayTrie::build(const std::vector<std::string>& keys) {
+    release();
+
+    // Sorted by bytes, with later duplicates winning, so each node's keys are one contiguous range.
+    std::vector<uint32_t> order;
+    order.reserve(keys.size());
+    for (uint32_t id = 0; id < keys.size(); ++id) {
+        if (!keys[id].empty()) order.push_back(id);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    std::vector<uint32_t> unique;
+    unique.reserve(order.size());
+    for (uint32_t id : order) {
+        if (!unique.empty() && keys[unique.back()] == keys[id]) {
+            unique.back() = id;
+        } else {
+            unique.push_back(id);
+        }
+    }
+
+    // Empty units form a doubly linked list, so placing a node only visits vacant slots.
+    std::vector<int32_t> next_free, prev_free;
+    int32_t free_head = -1, free_tail = -1;
+    auto grow = [&](size_t size) {
+        const size_t old_size = units_.size();
+        units_.resize(size, {0, EMPTY_UNIT, -1});
+        next_free.resize(size, -1);
+        prev_free.resize(size, -1);
+        for (size_t i = std::max<size_t>(old_size, 1); i < size; ++i) {
+            prev_free[i] = free_tail;
+            if (free_tail >= 0) next_free[free_tail] = static_cast<int32_t>(i);
+            else free_head = static_cast<int32_t>(i);
+            free_tail = static_cast<int32_t>(i);
+        }
+    };
+    auto occupy = [&](size_t i, int32_t parent) {
+        units_[i].check = parent;
+        if (prev_free[i] >= 0) next_free[prev_free[i]] = next_free[i];
+        else free_head = next_free[i];
+        if (next_free[i] >= 0) prev_free[next_free[i]] = prev_free[i];
+        else free_tail = prev_free[i];
+    };
+
+    units_.clear();
+    grow(1024);
+    units_[0].check = ROOT_UNIT;
+
+    struct Range {
+        size_t begin;
+        size_t end;
+        size_t depth;
+        int32_t node;
+    };
+    std::vector<Range> pending = {{0, unique.size(), 0, 0}};
+    uint8_t labels[256];
+
+    while (!pending.empty()) {
+        Range range = pending.back();
+        pending.pop_back();
+
+        size_t begin = range.begin;
+        if (begin < range.end && keys[unique[begin]].size() == range.depth) {
+            units_[range.node].value = static_cast<int32_t>(unique[begin]);
+            ++begin;
+        }
+        if (begin == range.end) continue;
+
+        size_t num_labels = 0;
+        for (size_t i = begin; i < range.end; ++i) {
+            uint8_t label = static_cast<uint8_t>(keys[unique[i]][range.depth]);
+            if (num_labels == 0 || labels[num_labels - 1] != label) labels[num_labels++] = label;
+        }
+
+        // First fit: the lowest base that puts the first label on a free unit and finds the rest free too.
+        size_t base = 0;
+        for (int32_t slot = free_head;; slot = next_free[slot]) {
+            if (slot < 0) {
+                int32_t resume = static_cast<int32_t>(units_.size());
+                grow(units_.size() * 2);
+                slot = resume;
+            }
+            if (static_cast<size_t>(slot) <= labels[0]) continue;
+            base = slot - labels[0];
+            if (base + labels[num_labels - 1] >= units_.size()) grow(std::max(units_.size() * 2, base + 256));
+            bool fits = true;
+            for (size_t l = 1; l < num_labels && fits; ++l) {
+                fits = units_[base + labels[l]].check == EMPTY_UNIT;
+            }
+            if (fits) break;
+        }
+
+        units_[range.node].base = static_cast<int32_t>(base);
+        for (size_t l = 0; l < num_labels; ++l) {
+            occupy(base + labels[l], range.node);
+        }
+
+        size_t child_begin = begin;
+        for (size_t l = 0; l < num_labels; ++l) {
+            size_t child_end = child_begin;
+            while (child_end < range.end && static_cast<uint8_t>(keys[unique[child_end]][range.depth]) == labels[l]) ++child_end;
+            pending.push_back({child_begin, child_end, range.depth + 1, static_cast<int32_t>(base + labels[l])});
+            child_begin = child_end;
+        }
+    }
+
+    while (!units_.empty() && units_.back().check == EMPTY_UNIT) units_.pop_back();
+    units_.shrink_to_fit();
+    data_ = units_.data();
+    size_ = units_.size();
+    num_keys_ = keys.size();
+}
+
+bool DoubleArrayTrie::load(const std::string& path, uint64_t fingerprint, size_t num_keys) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TrieHeader))) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const auto* header = static_cast<const TrieHeader*>(mapped);
+    const size_t expected = sizeof(TrieHeader) + header->num_units * sizeof(Unit);
+    if (std::memcmp(header->magic, TRIE_MAGIC, sizeof(TRIE_MAGIC)) != 0 || header->version != TRIE_VERSION ||
+        header->fingerprint != fingerprint || header->num_keys != num_keys || header->num_units == 0 ||
+        expected != static_cast<size_t>(st.st_size)) {
+        munmap(mapped, static_cast<size_t>(st.st_size));
+        return false;
+    }
+
+    release();
+    mmap_ptr_ = mapped;
+    mmap_size_ = static_cast<size_t>(st.st_size);
+    data_ = reinterpret_cast<const Unit*>(static_cast<const uint8_t*>(mapped) + sizeof(TrieHeader));
+    size_ = header->num_units;
+    num_keys_ = num_keys;
+    return true;
+}
+
+bool DoubleArrayTrie::save(const std::string& path, uint64_t fingerprint) const {
+    TrieHeader header{};
+    std::memcpy(header.magic, TRIE_MAGIC, sizeof(TRIE_MAGIC));
+    header.version = TRIE_VERSION;
+    header.num_keys = static_cast<uint32_t>(num_keys_);
+    header.fingerprint = fingerprint;
+    header.num_units = size_;
+
+    // Written next to the target and renamed, so a concurrent load never maps a partial file.
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(data_), static_cast<std::streamsize>(size_ * sizeof(Unit)));
+        if (!out) {
+            out.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::pair<size_t, int32_t> DoubleArrayTrie::longest_prefix(const char* text, size_t length) const {
+    std::pair<size_t, int32_t> best = {0, -1};
+    if (size_ == 0) return best;
+
+    // Units of a mapped file are untrusted: every index is bounds checked, so a damaged file can
+    // shorten matches but never yields an id outside the vocabulary.
+    size_t node = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const size_t next = static_cast<size_t>(data_[node].base) + static_cast<uint8_t>(text[i]);
+        if (next >= size_ || data_[next].check != static_cast<int32_t>(node)) break;
+        node = next;
+        const int32_t value = data_[node].value;
+        if (value >= 0 && static_cast<size_t>(value) < num_keys_) best = {i + 1, value};
+    }
+    return best;
+}
+
+}
+}
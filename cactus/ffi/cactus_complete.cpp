@@ -124,6 +124,70 @@ struct EntropyState {
     }
 };
 
+// Length of the prefix shared by processed_tokens and tokens, at most max_shared long.
+size_t shared_prefix_length(const CactusModelHandle* handle, const std::vector<uint32_t>& tokens, size_t max_shared) {
+    const auto& processed = handle->processed_tokens;
+    const size_t limit = std::min({processed.size(), tokens.size(), max_shared});
+    return std::mismatch(processed.begin(), processed.begin() + limit, tokens.begin()).first - processed.begin();
+}
+
+// Restores the longest cached state for a prefix of the prompt, leaving at least one token to
+// decode, when it covers more than the rollback_tokens the handle's own cache could keep. The
+// cache is shared by every handle on the model path, so a state saved under other cache
+// settings counts as a miss. Returns how many prompt tokens it restored (0 leaves the model's
+// cache untouched), and in snapshot_tokens where a new state is worth capturing: where this
+// prompt stops following an earlier one, or the last whole block of a prompt that shares
+// nothing with earlier ones.
+size_t restore_cached_prefix(CactusModelHandle* handle, const std::vector<uint32_t>& prompt,
+                             size_t rollback_tokens, size_t& snapshot_tokens) {
+    snapshot_tokens = 0;
+    if (!handle->prefix_cache || prompt.size() < 2) {
+        return 0;
+    }
+
+    auto match = handle->prefix_cache->lookup(prompt, prompt.size() - 1);
+    size_t restored = 0;
+    if (match.state && match.state_tokens > rollback_tokens &&
+        handle->model->can_restore_cache_state(*match.state)) {
+        if (handle->model->restore_cache_state(*match.state)) {
+            restored = match.state_tokens;
+        } else {
+            handle->model->reset_cache();
+            handle->processed_tokens.clear();
+        }
+    }
+
+    if (match.shared_tokens > std::max(restored, rollback_tokens)) {
+        snapshot_tokens = match.shared_tokens;
+    } else if (match.shared_tokens == 0) {
+        snapshot_tokens = (prompt.size() - 1) / PrefixCache::BLOCK_TOKENS * PrefixCache::BLOCK_TOKENS;
+    }
+    return restored;
+}
+
+// Rolls the cache back to the first `shared` tokens of processed_tokens, so a regenerated or
+// edited turn only feeds what changed. False when nothing is shared or the model cannot roll
+// back that far.
+bool rollback_to_shared_prefix(CactusModelHandle* handle, size_t shared) {
+    const size_t cached = handle->model->get_cached_tokens();
+    if (shared == 0 || (cached > shared && !handle->model->truncate_cache(cached - shared))) {
+        return false;
+    }
+    handle->processed_tokens.resize(std::min(shared, cached));
+    return true;
+}
+
+void prefill_and_cache_prefix(CactusModelHandle* handle, const std::vector<uint32_t>& prompt,
+                              size_t restored_tokens, size_t snapshot_tokens) {
+    std::vector<uint32_t> prefix(prompt.begin() + restored_tokens, prompt.begin() + snapshot_tokens);
+    handle->model->prefill(prefix, handle->model->get_prefill_chunk_size());
+
+    Model::CacheState state;
+    if (handle->model->save_cache_state(state)) {
+        handle->prefix_cache->insert(prompt, snapshot_tokens, std::move(state));
+    }
+}
+
 uint32_t generate_first_token(
     CactusModelHandle* handle,
     const std::vector<uint32_t>& tokens_to_process,
@@ -154,6 +218,81 @@ uint32_t generate_first_token(
     return handle->model->decode(tokens_to_process, temperature, top_p, top_k, "", first_token_entropy);
 }
 
+// Hands the tokens of one multi-token step to accept_token until it or max_tokens stops
+// generation, and returns how many were left over.
+template <typename AcceptToken>
+size_t emit_step(const std::vector<uint32_t>& step, const std::vector<float>& entropies, size_t& generated,
+                 size_t max_tokens, bool& keep_going, uint32_t& next_token, AcceptToken& accept_token) {
+    size_t used = 0;
+    while (keep_going && used < step.size() && generated < max_tokens) {
+        next_token = step[used];
+        keep_going = accept_token(next_token, entropies[used]);
+        used++;
+        generated++;
+    }
+    return step.size() - used;
+}
+
+// Generates from the first token on with prompt lookup: proposals are copied from earlier in
+// the conversation, so copy-heavy answers emit several tokens per forward pass.
+template <typename AcceptToken>
+void generate_lookup(CactusModelHandle* handle, uint32_t next_token, size_t max_tokens, size_t lookup_tokens,
+                     float temperature, float top_p, size_t top_k, AcceptToken&& accept_token) {
+    std::vector<float> entropies;
+    size_t generated = 1;
+    bool keep_going = true;
+    while (keep_going && generated < max_tokens && !handle->should_stop) {
+        entropies.clear();
+        std::vector<uint32_t> step = handle->model->decode_lookup(handle->processed_tokens, lookup_tokens,
+                                                                  temperature, top_p, top_k, &entropies);
+        size_t unused = emit_step(step, entropies, generated, max_tokens, keep_going, next_token, accept_token);
+        if (unused > 0 && !handle->model->truncate_cache(unused)) {
+            throw std::runtime_error("Failed to roll back unused lookup tokens");
+        }
+    }
+}
+
+// Generates from the first token on with the attached draft model. Both caches hold every
+// processed token but the last; tokens of a step left unused after a stop are rolled back.
+template <typename AcceptToken>
+void generate_speculative(CactusModelHandle* handle, uint32_t next_token, size_t max_tokens,
+                          float temperature, float top_p, size_t top_k, AcceptToken&& accept_token) {
+    CactusModelHandle* draft = handle->draft;
+    std::lock_guard<std::mutex> draft_lock(draft->model_mutex);
+
+    std::vector<uint32_t> context(handle->processed_tokens.begin(), handle->processed_tokens.end() - 1);
+    if (!rollback_to_shared_prefix(draft, shared_prefix_length(draft, context, context.size()))) {
+        draft->model->reset_cache();
+        draft->processed_tokens.clear();
+    }
+
+    try {
+        std::vector<uint32_t> missing(context.begin() + draft->processed_tokens.size(), context.end());
+        draft->model->prefill(missing, draft->model->get_prefill_chunk_size());
+        draft->processed_tokens = std::move(context);
+
+        std::vector<float> entropies;
+        size_t generated = 1;
+        bool keep_going = true;
+        while (keep_going && generated < max_tokens && !handle->should_stop) {
+            entropies.clear();
+            std::vector<uint32_t> step = handle->model->decode_speculative(*draft->model, next_token, handle->draft_tokens,
+                                                                           temperature, top_p, top_k, &entropies);
+            size_t unused = emit_step(step, entropies, generated, max_tokens, keep_going, next_token, accept_token);
+            if (unused > 0 && (!handle->model->truncate_cache(unused) || !draft->model->truncate_cache(unused))) {
+                throw std::runtime_error("Failed to roll back unused speculative tokens");
+            }
+        }
+    } catch (...) {
+        draft->model->reset_cache();
+        draft->processed_tokens.clear();
+        throw;
+    }
+
+    // The draft's cache holds what the target's holds: everything processed but the last token.
+    draft->processed_tokens.assign(handle->processed_tokens.begin(), handle->processed_tokens.end() - 1);
+}
+
 } // anonymous namespace
 
 extern "C" {
@@ -201,11 +340,12 @@ int cactus_complete(
         inject_rag_context(handle, messages);
 
         float temperature, top_p, confidence_threshold;
-        size_t top_k, max_tokens, tool_rag_top_k;
+        size_t top_k, max_tokens, tool_rag_top_k, prompt_lookup_tokens;
         std::vector<std::string> stop_sequences;
         bool force_tools, include_stop_sequences;
         parse_options_json(options_json ? options_json : "",
-                          temperature, top_p, top_k, max_tokens, stop_sequences, force_tools, tool_rag_top_k, confidence_threshold, include_stop_sequences);
+                          temperature, top_p, top_k, max_tokens, stop_sequences, force_tools, tool_rag_top_k, confidence_threshold, include_stop_sequences,
+                          prompt_lookup_tokens);
 
         std::vector<ToolFunction> tools;
         if (tools_json && strlen(tools_json) > 0)
@@ -246,17 +386,34 @@ int cactus_complete(
                          (current_prompt_tokens.size() >= handle->processed_tokens.size()) &&
                          std::equal(handle->processed_tokens.begin(), handle->processed_tokens.end(), current_prompt_tokens.begin());
 
+        size_t restored_tokens = 0;
+        size_t snapshot_tokens = 0;
         if (handle->processed_tokens.empty() || !is_prefix) {
             if (!has_images) {
-                handle->model->reset_cache();
+                // Take whichever keeps more of the prompt: the prefix cache or rolling back this
+                // handle's own cache to where the prompts diverge.
+                const size_t shared = shared_prefix_length(handle, current_prompt_tokens, current_prompt_tokens.size() - 1);
+                restored_tokens = restore_cached_prefix(handle, current_prompt_tokens, shared, snapshot_tokens);
+                if (restored_tokens == 0) {
+                    if (rollback_to_shared_prefix(handle, shared)) {
+                        restored_tokens = handle->processed_tokens.size();
+                    } else {
+                        handle->model->reset_cache();
+                    }
+                }
             }
-            tokens_to_process = current_prompt_tokens;
+            tokens_to_process.assign(current_prompt_tokens.begin() + restored_tokens, current_prompt_tokens.end());
         } else {
             tokens_to_process.assign(current_prompt_tokens.begin() + handle->processed_tokens.size(), current_prompt_tokens.end());
         }
 
         size_t prompt_tokens = tokens_to_process.size();
 
+        if (snapshot_tokens > restored_tokens) {
+            prefill_and_cache_prefix(handle, current_prompt_tokens, restored_tokens, snapshot_tokens);
+            tokens_to_process.erase(tokens_to_process.begin(), tokens_to_process.begin() + (snapshot_tokens - restored_tokens));
+        }
+
         auto stop_token_sequences = build_stop_sequences(tokenizer, stop_sequences, model_type, !tools.empty());
 
         std::vector<uint32_t> generated_tokens;
@@ -295,40 +452,61 @@ int cactus_complete(
         entropy.add(first_token_entropy);
 
         if (!matches_stop_sequence(generated_tokens, stop_token_sequences)) {
+            StreamingDetokenizer detokenizer(*tokenizer);
+            uint32_t streamed_token = next_token;
             if (callback) {
-                std::string new_text = tokenizer->decode({next_token});
+                std::string new_text = detokenizer.push(next_token);
                 callback(new_text.c_str(), next_token, user_data);
             }
 
-            for (size_t i = 1; i < max_tokens; i++) {
-                if (handle->should_stop) break;
-
-                float token_entropy = 0.0f;
-                next_token = handle->model->decode({next_token}, temperature, top_p, top_k, "", &token_entropy);
-                generated_tokens.push_back(next_token);
-                handle->processed_tokens.push_back(next_token);
+            // Records one generated token; false once generation should stop.
+            auto accept_token = [&](uint32_t token, float token_entropy) {
+                generated_tokens.push_back(token);
+                handle->processed_tokens.push_back(token);
 
                 entropy.add(token_entropy);
 
                 if (entropy.rolling_confidence() < confidence_threshold) {
                     entropy.spike_handoff = true;
-                    break;
+                    return false;
                 }
 
                 if (force_tools && !tools.empty()) {
-                    handle->model->update_tool_constraints(next_token);
+                    handle->model->update_tool_constraints(token);
                 }
 
                 if (matches_stop_sequence(generated_tokens, stop_token_sequences)) {
                     trim_stop_suffix(generated_tokens, stop_token_sequences, include_stop_sequences);
-                    break;
+                    return false;
                 }
 
                 if (callback) {
-                    std::string new_text = tokenizer->decode({next_token});
-                    callback(new_text.c_str(), next_token, user_data);
+                    std::string new_text = detokenizer.push(token);
+                    callback(new_text.c_str(), token, user_data);
+                    streamed_token = token;
+                }
+                return true;
+            };
+
+            bool multi_token = !(force_tools && !tools.empty()) && !has_images;
+            if (multi_token && handle->draft) {
+                generate_speculative(handle, next_token, max_tokens, temperature, top_p, top_k, accept_token);
+            } else if (multi_token && prompt_lookup_tokens > 0) {
+                generate_lookup(handle, next_token, max_tokens, prompt_lookup_tokens, temperature, top_p, top_k, accept_token);
+            } else {
+                for (size_t i = 1; i < max_tokens; i++) {
+                    if (handle->should_stop) break;
+
+                    float token_entropy = 0.0f;
+                    next_token = handle->model->decode({next_token}, temperature, top_p, top_k, "", &token_entropy);
+                    if (!accept_token(next_token, token_entropy)) break;
                 }
             }
+
+            if (callback) {
+                std::string rest = detokenizer.flush();
+                if (!rest.empty()) callback(rest.c_str(), streamed_token, user_data);
+            }
         } else {
             trim_stop_suffix(generated_tokens, stop_token_sequences, include_stop_sequences);
         }
@@ -403,6 +581,135 @@ int cactus_tokenize(
     }
 }
 
+int cactus_tokenize_batch(
+    cactus_model_t model,
+    const char* const* texts,
+    size_t num_texts,
+    uint32_t* token_buffer,
+    size_t token_buffer_len,
+    size_t* token_offsets,
+    size_t* out_token_len
+) {
+    if (!model || (!texts && num_texts > 0) || !out_token_len) return -1;
+
+    try {
+        auto* handle = static_cast<CactusModelHandle*>(model);
+        auto* tokenizer = handle->model->get_tokenizer();
+
+        std::vector<std::string> batch;
+        batch.reserve(num_texts);
+        for (size_t i = 0; i < num_texts; ++i) {
+            if (!texts[i]) return -1;
+            batch.emplace_back(texts[i]);
+        }
+        std::vector<std::vector<uint32_t>> toks = tokenizer->encode_batch(batch);
+
+        size_t total = 0;
+        for (size_t i = 0; i < toks.size(); ++i) {
+            if (token_offsets) token_offsets[i] = total;
+            total += toks[i].size();
+        }
+        if (token_offsets) token_offsets[toks.size()] = total;
+        *out_token_len = total;
+
+        if (!token_buffer || token_buffer_len == 0) return 0;
+        if (token_buffer_len < total) return -2;
+
+        for (const auto& text_tokens : toks) {
+            std::memcpy(token_buffer, text_tokens.data(), text_tokens.size() * sizeof(uint32_t));
+            token_buffer += text_tokens.size();
+        }
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cactus_decode_batch(
+    cactus_model_t model,
+    const uint32_t* prompt_tokens,
+    const size_t* prompt_offsets,
+    size_t num_prompts,
+    const char* options_json,
+    uint32_t* token_buffer,
+    size_t token_buffer_len,
+    size_t* token_offsets,
+    size_t* out_token_len
+) {
+    if (!model || !out_token_len || (num_prompts > 0 && (!prompt_tokens || !prompt_offsets))) {
+        last_error_message = "Invalid parameters";
+        return -1;
+    }
+
+    auto* handle = static_cast<CactusModelHandle*>(model);
+    std::lock_guard<std::mutex> lock(handle->model_mutex);
+    try {
+        float temperature, top_p, confidence_threshold;
+        size_t top_k, max_tokens, tool_rag_top_k, prompt_lookup_tokens;
+        std::vector<std::string> stop_sequences;
+        bool force_tools, include_stop_sequences;
+        parse_options_json(options_json ? options_json : "",
+                          temperature, top_p, top_k, max_tokens, stop_sequences, force_tools, tool_rag_top_k, confidence_threshold, include_stop_sequences,
+                          prompt_lookup_tokens);
+
+        for (size_t i = 0; i < num_prompts; ++i) {
+            if (prompt_offsets[i + 1] < prompt_offsets[i]) {
+                last_error_message = "Prompt offsets must not decrease";
+                return -1;
+            }
+        }
+
+        // Outputs live only for this call, so the buffer is checked against the most the batch
+        // can generate before any decoding is done.
+        const size_t capacity = num_prompts * max_tokens;
+        if (!token_buffer || token_buffer_len < capacity) {
+            *out_token_len = capacity;
+            return token_buffer ? -2 : 0;
+        }
+
+        // Every prompt decodes in its own caches, so the handle's conversation is left as it was.
+        BatchScheduler scheduler(*handle->model);
+        std::vector<uint64_t> ids;
+        ids.reserve(num_prompts);
+        for (size_t i = 0; i < num_prompts; ++i) {
+            BatchScheduler::Request request;
+            request.prompt.assign(prompt_tokens + prompt_offsets[i], prompt_tokens + prompt_offsets[i + 1]);
+            request.max_tokens = max_tokens;
+            request.temperature = temperature;
+            request.top_p = top_p;
+            request.top_k = top_k;
+            ids.push_back(scheduler.submit(std::move(request)));
+        }
+
+        handle->should_stop = false;
+        while (!handle->should_stop && scheduler.step()) {
+        }
+
+        std::vector<std::vector<uint32_t>> outputs;
+        outputs.reserve(ids.size());
+        for (uint64_t id : ids) {
+            outputs.push_back(scheduler.take_output(id));
+        }
+
+        size_t total = 0;
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            if (token_offsets) token_offsets[i] = total;
+            total += outputs[i].size();
+        }
+        if (token_offsets) token_offsets[outputs.size()] = total;
+        *out_token_len = total;
+
+        for (const auto& output : outputs) {
+            std::memcpy(token_buffer, output.data(), output.size() * sizeof(uint32_t));
+            token_buffer += output.size();
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        last_error_message = e.what();
+        return -1;
+    }
+}
+
 int cactus_score_window(
     cactus_model_t model,
     const uint32_t* tokens,
@@ -33,6 +33,17 @@ CACTUS_FFI_EXPORT void cactus_destroy(cactus_model_t model);
 CACTUS_FFI_EXPORT void cactus_reset(cactus_model_t model);
 CACTUS_FFI_EXPORT void cactus_stop(cactus_model_t model);
 
+CACTUS_FFI_EXPORT int cactus_session_save(cactus_model_t model, const char* path);
+CACTUS_FFI_EXPORT int cactus_session_load(cactus_model_t model, const char* path);
+
+CACTUS_FFI_EXPORT int cactus_truncate(cactus_model_t model, size_t num_tokens);
+
+CACTUS_FFI_EXPORT int cactus_set_draft_model(
+    cactus_model_t model,
+    cactus_model_t draft_model,             // optional: NULL detaches the draft
+    size_t draft_tokens                     // tokens proposed per step, 0 picks the default
+);
+
 CACTUS_FFI_EXPORT int cactus_complete(
     cactus_model_t model,
     const char* messages_json,
@@ -52,6 +63,28 @@ CACTUS_FFI_EXPORT int cactus_tokenize(
     size_t* out_token_len
 );
 
+CACTUS_FFI_EXPORT int cactus_tokenize_batch(
+    cactus_model_t model,
+    const char* const* texts,
+    size_t num_texts,
+    uint32_t* token_buffer,                 // optional: NULL only reports sizes
+    size_t token_buffer_len,
+    size_t* token_offsets,                  // optional: num_texts + 1 entries, text i is [offsets[i], offsets[i + 1])
+    size_t* out_token_len
+);
+
+CACTUS_FFI_EXPORT int cactus_decode_batch(
+    cactus_model_t model,
+    const uint32_t* prompt_tokens,          // every prompt back to back
+    const size_t* prompt_offsets,           // num_prompts + 1 entries, prompt i is [offsets[i], offsets[i + 1])
+    size_t num_prompts,
+    const char* options_json,               // optional
+    uint32_t* token_buffer,                 // optional: NULL only reports the num_prompts * max_tokens bound
+    size_t token_buffer_len,                // at least num_prompts * max_tokens
+    size_t* token_offsets,                  // optional: num_prompts + 1 entries, output i is [offsets[i], offsets[i + 1])
+    size_t* out_token_len
+);
+
 CACTUS_FFI_EXPORT int cactus_score_window(
     cactus_model_t model,
     const uint32_t* tokens,
@@ -146,12 +146,14 @@ static std::vector<std::pair<std::string, std::string>> chunk_corpus(
         }
 
         auto paragraphs = split_into_paragraphs(content);
+        auto paragraph_tokens = tokenizer->encode_batch(paragraphs);
 
         std::string current_chunk;
         size_t current_tokens = 0;
 
-        for (const auto& para : paragraphs) {
-            std::vector<uint32_t> para_tokens = tokenizer->encode(para);
+        for (size_t p = 0; p < paragraphs.size(); ++p) {
+            const std::string& para = paragraphs[p];
+            const std::vector<uint32_t>& para_tokens = paragraph_tokens[p];
             size_t para_token_count = para_tokens.size();
 
             // If paragraph alone is too large, split it by tokens
@@ -251,11 +253,17 @@ static bool build_corpus_index(CactusModelHandle* handle, const std::string& cor
     std::vector<index::Document> docs;
     docs.reserve(chunks.size());
 
+    std::vector<std::string> chunk_texts;
+    chunk_texts.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        chunk_texts.push_back(chunk.first);
+    }
+    auto chunk_tokens = tokenizer->encode_batch(chunk_texts);
+
     for (size_t i = 0; i < chunks.size(); ++i) {
         const auto& [chunk_text, source_file] = chunks[i];
 
-        std::vector<uint32_t> tokens = tokenizer->encode(chunk_text);
-        std::vector<float> embedding = handle->model->get_embeddings(tokens, true, true);
+        std::vector<float> embedding = handle->model->get_embeddings(chunk_tokens[i], true, true);
 
         if (embedding.size() != embedding_dim) {
             CACTUS_LOG_WARN("init", "Skipping chunk " << i << " - embedding dimension mismatch");
@@ -337,6 +345,34 @@ bool matches_stop_sequence(const std::vector<uint32_t>& generated_tokens,
     return false;
 }
 
+void release_model_handle(CactusModelHandle* handle) {
+    while (handle && handle->references.fetch_sub(1) == 1) {
+        CactusModelHandle* draft = handle->draft;
+        delete handle;
+        handle = draft;
+    }
+}
+
+namespace {
+
+// Handles loaded from the same model folder share one prefix cache, so a system prompt
+// prefilled by one conversation is reused by the others.
+std::shared_ptr<PrefixCache> shared_prefix_cache(const std::string& model_path) {
+    static std::mutex registry_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<PrefixCache>> registry;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto& entry = registry[model_path];
+    auto cache = entry.lock();
+    if (!cache) {
+        cache = std::make_shared<PrefixCache>();
+        entry = cache;
+    }
+    return cache;
+}
+
+}
+
 extern "C" {
 
 const char* cactus_get_last_error() {
@@ -375,6 +411,8 @@ cactus_model_t cactus_init(const char* model_path, const char* corpus_dir, bool
             return nullptr;
         }
 
+        handle->prefix_cache = shared_prefix_cache(model_path_str);
+
         if (corpus_dir != nullptr && strlen(corpus_dir) > 0) {
             handle->corpus_dir = std::string(corpus_dir);
 
@@ -406,7 +444,7 @@ cactus_model_t cactus_init(const char* model_path, const char* corpus_dir, bool
 }
 
 void cactus_destroy(cactus_model_t model) {
-    if (model) delete static_cast<CactusModelHandle*>(model);
+    release_model_handle(static_cast<CactusModelHandle*>(model));
 }
 
 void cactus_reset(cactus_model_t model) {
@@ -422,4 +460,160 @@ void cactus_stop(cactus_model_t model) {
     handle->should_stop = true;
 }
 
+int cactus_session_save(cactus_model_t model, const char* path) {
+    if (!model || !path) {
+        last_error_message = "Invalid parameters: model or path";
+        return -1;
+    }
+
+    auto* handle = static_cast<CactusModelHandle*>(model);
+    std::lock_guard<std::mutex> lock(handle->model_mutex);
+    try {
+        if (!handle->model->save_session(path, handle->processed_tokens)) {
+            last_error_message = "Model does not support session snapshots";
+            CACTUS_LOG_ERROR("session", last_error_message);
+            return -1;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        last_error_message = "Failed to save session: " + std::string(e.what());
+        CACTUS_LOG_ERROR("session", last_error_message);
+        return -1;
+    }
+}
+
+int cactus_session_load(cactus_model_t model, const char* path) {
+    if (!model || !path) {
+        last_error_message = "Invalid parameters: model or path";
+        return -1;
+    }
+
+    auto* handle = static_cast<CactusModelHandle*>(model);
+    std::lock_guard<std::mutex> lock(handle->model_mutex);
+
+    // The whole file is read and checked first, so a bad file leaves the conversation as it was.
+    Model::CacheState state;
+    std::vector<uint32_t> tokens;
+    try {
+        if (!handle->model->read_session(path, state, tokens)) {
+            last_error_message = "Model cannot restore this session";
+            CACTUS_LOG_ERROR("session", last_error_message);
+            return -1;
+        }
+    } catch (const std::exception& e) {
+        last_error_message = "Failed to load session: " + std::string(e.what());
+        CACTUS_LOG_ERROR("session", last_error_message);
+        return -1;
+    }
+
+    try {
+        handle->model->restore_cache_state(state);
+        handle->processed_tokens = std::move(tokens);
+        return 0;
+    } catch (const std::exception& e) {
+        handle->model->reset_cache();
+        handle->processed_tokens.clear();
+        last_error_message = "Failed to load session: " + std::string(e.what());
+        CACTUS_LOG_ERROR("session", last_error_message);
+        return -1;
+    }
+}
+
+
+int cactus_truncate(cactus_model_t model, size_t num_tokens) {
+    if (!model) {
+        last_error_message = "Invalid parameters: model";
+        return -1;
+    }
+
+    auto* handle = static_cast<CactusModelHandle*>(model);
+    std::lock_guard<std::mutex> lock(handle->model_mutex);
+    if (num_tokens > handle->processed_tokens.size()) {
+        last_error_message = "Cannot truncate more tokens than have been processed";
+        return -1;
+    }
+
+    try {
+        // The cache ends up holding exactly the kept tokens, so the next request feeds only what follows them.
+        // A rollback that would need rows the window already evicted refills from the start instead.
+        const size_t keep = handle->processed_tokens.size() - num_tokens;
+        size_t cached = handle->model->get_cached_tokens();
+        if (keep < cached && !handle->model->truncate_cache(cached - keep)) {
+            handle->model->reset_cache();
+            cached = 0;
+        }
+        if (keep > cached) {
+            std::vector<uint32_t> missing(handle->processed_tokens.begin() + cached, handle->processed_tokens.begin() + keep);
+            handle->model->prefill(missing, handle->model->get_prefill_chunk_size());
+        }
+        handle->processed_tokens.resize(keep);
+
+        if (auto* draft = handle->draft) {
+            std::lock_guard<std::mutex> draft_lock(draft->model_mutex);
+            if (draft->processed_tokens.size() > keep) {
+                if (!draft->model->truncate_cache(draft->processed_tokens.size() - keep)) {
+                    draft->model->reset_cache();
+                    draft->processed_tokens.clear();
+                } else {
+                    draft->processed_tokens.resize(keep);
+                }
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        handle->model->reset_cache();
+        handle->processed_tokens.clear();
+        last_error_message = "Failed to truncate: " + std::string(e.what());
+        CACTUS_LOG_ERROR("truncate", last_error_message);
+        return -1;
+    }
+}
+
+int cactus_set_draft_model(cactus_model_t model, cactus_model_t draft_model, size_t draft_tokens) {
+    if (!model || model == draft_model) {
+        last_error_message = "Invalid parameters: model or draft_model";
+        return -1;
+    }
+
+    auto* handle = static_cast<CactusModelHandle*>(model);
+    std::lock_guard<std::mutex> lock(handle->model_mutex);
+    // Links are only changed under this lock, so the chain walked below cannot move.
+    static std::mutex link_mutex;
+    std::lock_guard<std::mutex> link_lock(link_mutex);
+    if (!draft_model) {
+        release_model_handle(handle->draft);
+        handle->draft = nullptr;
+        handle->draft_tokens = 0;
+        return 0;
+    }
+
+    auto* draft = static_cast<CactusModelHandle*>(draft_model);
+    // A generation locks its model and then the draft, so a cycle of drafts could deadlock.
+    for (auto* link = draft->draft; link; link = link->draft) {
+        if (link == handle) {
+            last_error_message = "Draft model would draft for itself through its own draft";
+            CACTUS_LOG_ERROR("speculative", last_error_message);
+            return -1;
+        }
+    }
+    if (!handle->model->truncate_cache(0) || !draft->model->truncate_cache(0)) {
+        last_error_message = "Speculative decoding needs models whose caches can be rolled back";
+        CACTUS_LOG_ERROR("speculative", last_error_message);
+        return -1;
+    }
+    if (handle->model->get_config().vocab_size != draft->model->get_config().vocab_size) {
+        last_error_message = "Draft model vocabulary does not match the target model";
+        CACTUS_LOG_ERROR("speculative", last_error_message);
+        return -1;
+    }
+
+    if (draft != handle->draft) {
+        draft->references.fetch_add(1);
+        release_model_handle(handle->draft);
+        handle->draft = draft;
+    }
+    handle->draft_tokens = draft_tokens == 0 ? cactus::engine::Model::DEFAULT_DRAFT_TOKENS : std::min(draft_tokens, cactus::engine::Model::MAX_DRAFT_TOKENS);
+    return 0;
+}
+
 }
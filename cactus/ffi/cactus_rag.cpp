@@ -257,10 +257,11 @@ std::vector<cactus::ffi::ToolFunction> select_relevant_tools(
         handle->tool_embeddings.reserve(all_tools.size());
 
         for (const auto& tool : all_tools) {
-            std::string text = tool_to_text(tool);
-            handle->tool_texts.push_back(text);
+            handle->tool_texts.push_back(tool_to_text(tool));
+        }
+        auto tool_tokens = tokenizer->encode_batch(handle->tool_texts);
 
-            std::vector<uint32_t> tokens = tokenizer->encode(text);
+        for (const auto& tokens : tool_tokens) {
             if (!tokens.empty()) {
                 std::vector<float> emb = handle->model->get_embeddings(tokens, true, true);
                 handle->tool_embeddings.push_back(std::move(emb));
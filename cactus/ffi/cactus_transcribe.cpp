@@ -92,10 +92,10 @@ int cactus_transcribe(
         handle->should_stop = false;
 
         float temperature, top_p, confidence_threshold;
-        size_t top_k, max_tokens, tool_rag_top_k;
+        size_t top_k, max_tokens, tool_rag_top_k, prompt_lookup_tokens;
         std::vector<std::string> stop_sequences;
         bool force_tools, include_stop_sequences;
-        parse_options_json(options_json ? options_json : "", temperature, top_p, top_k, max_tokens, stop_sequences, force_tools, tool_rag_top_k, confidence_threshold, include_stop_sequences);
+        parse_options_json(options_json ? options_json : "", temperature, top_p, top_k, max_tokens, stop_sequences, force_tools, tool_rag_top_k, confidence_threshold, include_stop_sequences, prompt_lookup_tokens);
 
         std::vector<float> audio_features;
         
@@ -200,7 +200,8 @@ int cactus_transcribe(
         tokens.push_back(next_token);
         completion_tokens++;
 
-        std::string piece = tokenizer->decode({ next_token });
+        StreamingDetokenizer detokenizer(*tokenizer);
+        std::string piece = detokenizer.push(next_token);
         final_text += piece;
         if (callback) callback(piece.c_str(), next_token, user_data);
 
@@ -218,7 +219,7 @@ int cactus_transcribe(
                 tokens.push_back(next_token);
                 completion_tokens++;
 
-                piece = tokenizer->decode({ next_token });
+                piece = detokenizer.push(next_token);
                 final_text += piece;
                 if (callback) callback(piece.c_str(), next_token, user_data);
 
@@ -226,6 +227,12 @@ int cactus_transcribe(
             }
         }
 
+        piece = detokenizer.flush();
+        if (!piece.empty()) {
+            final_text += piece;
+            if (callback) callback(piece.c_str(), next_token, user_data);
+        }
+
         float mean_entropy = total_entropy_count > 0 ? total_entropy_sum / static_cast<float>(total_entropy_count) : 0.0f;
         float confidence = 1.0f - mean_entropy;
 
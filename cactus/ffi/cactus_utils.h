@@ -16,6 +16,7 @@
 #include <atomic>
 #include <mutex>
 #include <random>
+#include <cstring>
 
 #ifdef __APPLE__
 #include <uuid/uuid.h>
@@ -58,6 +59,7 @@ struct CactusModelHandle {
     std::unique_ptr<cactus::engine::Model> model;
     std::atomic<bool> should_stop;
     std::vector<uint32_t> processed_tokens;
+    std::shared_ptr<cactus::engine::PrefixCache> prefix_cache;
     std::mutex model_mutex;
     std::string model_name;
     std::unique_ptr<cactus::engine::index::Index> corpus_index;
@@ -65,10 +67,17 @@ struct CactusModelHandle {
     size_t corpus_embedding_dim = 0;
     std::vector<std::vector<float>> tool_embeddings;
     std::vector<std::string> tool_texts;  
+    // The attached draft holds a reference to its handle, so cactus_destroy on a draft that is
+    // still attached only drops the caller's and the draft goes when it is detached.
+    CactusModelHandle* draft = nullptr;
+    size_t draft_tokens = 0;
+    std::atomic<size_t> references;
 
-    CactusModelHandle() : should_stop(false) {}
+    CactusModelHandle() : should_stop(false), references(1) {}
 };
 
+void release_model_handle(CactusModelHandle* handle);
+
 extern std::string last_error_message;
 
 bool matches_stop_sequence(const std::vector<uint32_t>& generated_tokens,
@@ -113,6 +122,27 @@ inline std::string generateUUID() {
     char uuid_str[37];
     uuid_unparse_lower(uuid, uuid_str);
     return std::string(uuid_str);
+#else
+    std::random_device rd;
+    uint8_t bytes[16];
+    for (size_t i = 0; i < sizeof(bytes); i += 4) {
+        uint32_t word = rd();
+        std::memcpy(bytes + i, &word, 4);
+    }
+    bytes[6] = (bytes[6] & 0x0F) | 0x40;
+    bytes[8] = (bytes[8] & 0x3F) | 0x80;
+
+    static const char hex[] = "0123456789abcdef";
+    std::string uuid_str;
+    uuid_str.reserve(36);
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            uuid_str.push_back('-');
+        }
+        uuid_str.push_back(hex[bytes[i] >> 4]);
+        uuid_str.push_back(hex[bytes[i] & 0x0F]);
+    }
+    return uuid_str;
 #endif
 }
 
@@ -321,7 +351,8 @@ inline void parse_options_json(const std::string& json,
                                bool& force_tools,
                                size_t& tool_rag_top_k,
                                float& confidence_threshold,
-                               bool& include_stop_sequences) {
+                               bool& include_stop_sequences,
+                               size_t& prompt_lookup_tokens) {
     temperature = 0.0f;
     top_p = 0.0f;
     top_k = 0;
@@ -330,6 +361,7 @@ inline void parse_options_json(const std::string& json,
     tool_rag_top_k = 2;  
     confidence_threshold = 0.7f;  
     include_stop_sequences = false;
+    prompt_lookup_tokens = 0;
     stop_sequences.clear();
 
     if (json.empty()) return;
@@ -384,6 +416,12 @@ inline void parse_options_json(const std::string& json,
         include_stop_sequences = (json.substr(pos, 4) == "true");
     }
 
+    pos = json.find("\"prompt_lookup_tokens\"");
+    if (pos != std::string::npos) {
+        pos = json.find(':', pos) + 1;
+        prompt_lookup_tokens = std::stoul(json.substr(pos));
+    }
+
     pos = json.find("\"stop_sequences\"");
     if (pos != std::string::npos) {
         pos = json.find('[', pos);
@@ -12,7 +12,7 @@
 #include <mutex>
 #include <sstream>
 #include <iostream>
-#include <arm_neon.h>
+#include "../kernel/kernel.h"
 
 namespace cactus {
 
@@ -109,6 +109,15 @@ enum class ComputeBackend {
     NPU
 };
 
+// INTRA_OP runs nodes one at a time and parallelises inside each kernel. INTER_OP also runs
+// consecutive independent nodes concurrently, one per thread; AUTO does so only for
+// decode-sized nodes whose kernels are too small to fill the pool on their own.
+enum class ThreadingPolicy {
+    INTRA_OP,
+    INTER_OP,
+    AUTO
+};
+
 enum class OpType {
     INPUT, PRECISION_CAST,
     ADD, ADD_CLIPPED, SUBTRACT, MULTIPLY, DIVIDE,
@@ -123,7 +132,8 @@ enum class OpType {
     TOPK, LAYERNORM, GROUPNORM,
     INDEX,
     PERSISTENT,
-    QUANTIZE_ACTIVATIONS
+    QUANTIZE_ACTIVATIONS,
+    RMS_NORM_ROPE, ADD_RMS_NORM, MATMUL_SWIGLU, FUSED_RESULT, MATMUL_SAMPLE
 };
 
 struct PrecisionTraits {
@@ -241,6 +251,14 @@ struct BufferDesc {
         return precision == Precision::INT8 && group_size > 0;
     }
 
+    bool is_grouped_int4() const {
+        return precision == Precision::INT4 && group_size > 0;
+    }
+
+    bool is_grouped_quantized() const {
+        return is_grouped_int8() || is_grouped_int4();
+    }
+
     void set_grouped_scales(size_t gs, size_t ng, void* scales_ptr) {
         group_size = gs;
         num_groups = ng;
@@ -301,6 +319,7 @@ struct OpParams {
     float top_p = 1.0f;
     size_t top_k = 0;
     size_t random_seed = 0;
+    bool sample_entropy = false;
     
     size_t index_value = 0;  
     size_t num_classes = 0; 
@@ -316,6 +335,7 @@ struct OpParams {
     const float* cached_k_scales = nullptr;
     const float* cached_v_scales = nullptr;
     size_t cache_seq_len = 0;
+    CactusKVBlocks cache_blocks;
     size_t num_kv_heads = 0;
     size_t head_dim = 0;
 };
@@ -350,8 +370,13 @@ void compute_layernorm_node(GraphNode& node, const std::vector<std::unique_ptr<G
 void compute_groupnorm_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 void compute_persistent_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 void compute_index_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+void compute_rms_norm_rope_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+void compute_add_rms_norm_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+void compute_matmul_swiglu_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+void compute_matmul_sample_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 
 void shrink_thread_local_buffers();
+void invalidate_activation_quant_cache();
 
 class BufferPool {
 public:
@@ -378,6 +403,51 @@ private:
     size_t round_up_size(size_t size) const;
 };
 
+// Ahead-of-time placement of graph activations inside one 64-byte aligned block.
+// Each block lives over [first_use, last_use] in execution order; blocks whose
+// lifetimes overlap never share bytes. Offsets are assigned greedy-by-size.
+class ActivationArena {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    struct Block {
+        size_t first_use;
+        size_t last_use;
+        size_t size;
+        size_t offset = 0;
+    };
+
+    ActivationArena() = default;
+    ~ActivationArena() = default;
+
+    ActivationArena(const ActivationArena&) = delete;
+    ActivationArena& operator=(const ActivationArena&) = delete;
+
+    char* plan(std::vector<Block>& blocks);
+    bool owns(const void* ptr) const;
+    void clear();
+
+    size_t arena_bytes() const { return arena_bytes_; }
+    size_t capacity_bytes() const { return capacity_; }
+    size_t peak_live_bytes() const { return peak_live_bytes_; }
+    size_t tensor_bytes() const { return tensor_bytes_; }
+    float fragmentation() const {
+        return arena_bytes_ ? 1.0f - static_cast<float>(peak_live_bytes_) / arena_bytes_ : 0.0f;
+    }
+
+private:
+    std::unique_ptr<char[]> storage_;
+    char* base_ = nullptr;
+    size_t capacity_ = 0;
+    size_t arena_bytes_ = 0;
+    size_t peak_live_bytes_ = 0;
+    size_t tensor_bytes_ = 0;
+    std::vector<Block> last_blocks_;
+
+    void assign_offsets(std::vector<Block>& blocks);
+    void reserve(size_t bytes);
+};
+
 namespace ValidationUtils {
     void validate_tensor_dims(const std::vector<size_t>& shape, size_t required_dims, const std::string& op_name);
     void validate_precision(Precision actual, Precision required, const std::string& op_name);
@@ -437,6 +507,12 @@ public:
     size_t mmap_embeddings(const std::string& filename);
     size_t mmap_weights(const std::string& filename);
     size_t load_weights(const std::string& filename);
+    // Concatenates pretransposed weights that share an input (q/k/v, gate/up) into one owned
+    // [sum(N), K] tensor so a single matmul quantizes and reads the activation once. The copy
+    // is heap memory rather than mapped file pages. Parts that cannot be stacked are mapped as
+    // they are instead, and fused_matmul then runs one matmul per part.
+    size_t mmap_fused_weights(const std::vector<std::string>& filenames);
+    std::vector<size_t> fused_matmul(size_t input, size_t fused_weight, ComputeBackend backend = ComputeBackend::CPU);
     void set_grouped_scales(size_t node_id, size_t group_size, size_t num_groups, void* scales_ptr);
     void set_interleaved(size_t node_id, bool interleaved, size_t original_N);
 
@@ -462,7 +538,8 @@ public:
     size_t attention_int8_hybrid(size_t query, size_t key_new, size_t value_new, float scale, size_t position_offset,
                                  const int8_t* cached_keys, const int8_t* cached_values,
                                  const float* k_scales, const float* v_scales,
-                                 size_t cache_len, size_t num_kv_heads, size_t head_dim, size_t window_size = 0);
+                                 size_t cache_len, size_t num_kv_heads, size_t head_dim, size_t window_size = 0,
+                                 const CactusKVBlocks& cache_blocks = {});
 
     size_t conv1d_causal(size_t input, size_t weight, size_t kernel_size, size_t dilation = 1);
     size_t conv1d_k3(size_t input, size_t weight, size_t stride);
@@ -470,8 +547,10 @@ public:
     size_t conv1d(size_t input, size_t weight, size_t stride);
     size_t conv1d(size_t input, size_t weight, size_t bias, size_t stride);
     
+    // Output is [token, normalized entropy]; the entropy slot is written only while
+    // params.sample_entropy is set.
     size_t sample(size_t logits, float temperature = 0.6f, float top_p = 0.95f, size_t top_k = 20,
-                  const std::unordered_map<uint32_t, float>& logit_bias = {});
+                  const std::unordered_map<uint32_t, float>& logit_bias = {}, bool with_entropy = false);
     
     size_t concat(size_t input1, size_t input2, int axis = 0);
     size_t scatter_topk(size_t indices, size_t values, size_t num_classes);
@@ -485,6 +564,17 @@ public:
     void soft_reset();
     void soft_reset_keep_pool();
     void set_prefill_mode(bool enabled) { prefill_mode_ = enabled; }
+    void set_release_dead_buffers(bool enabled) { release_dead_buffers_ = enabled; }
+    void set_static_memory_plan(bool enabled) { static_memory_plan_ = enabled; }
+    void set_operator_fusion(bool enabled) { operator_fusion_ = enabled; }
+    // Keeps the thread pool in one persistent region across execute(): workers spin between
+    // nodes and each kernel dispatch becomes a barrier-joined (thread_id, num_threads) team job.
+    void set_parallel_region(bool enabled) { parallel_region_ = enabled; }
+    void set_threading_policy(ThreadingPolicy policy) { threading_policy_ = policy; }
+    ThreadingPolicy threading_policy() const { return threading_policy_; }
+    const BufferPool& buffer_pool() const { return buffer_pool_; }
+    const ActivationArena& activation_arena() const { return activation_arena_; }
+    size_t generation() const { return generation_; }
 
     void register_debug_node(uint32_t layer_idx, const std::string& name, size_t node_id);
     void capture_debug_node(uint32_t layer_idx, const std::string& name, size_t node_id);
@@ -500,6 +590,16 @@ public:
     bool is_populated(size_t persistent_node_id) const;
     void invalidate_persistent(size_t persistent_node_id);
 
+    // With set_release_dead_buffers(true), intermediate buffers go back to the pool once
+    // their last consumer has run; nodes read after execute() must be marked as outputs.
+    void mark_output(size_t node_id);
+    bool is_output(size_t node_id) const;
+
+    // Rewrites rms_norm->quantize, add->rms_norm, rms_norm->rope and gate/up matmul->silu->multiply
+    // chains into single fused nodes and drops the intermediates. Runs once per built graph
+    // from execute() when operator fusion is enabled; returns the number of chains fused.
+    size_t fuse_operators();
+
     std::vector<std::unique_ptr<GraphNode>> nodes_;
     std::unordered_map<size_t, size_t> node_index_map_;
 
@@ -508,12 +608,27 @@ private:
     std::vector<std::unique_ptr<GraphFile::MappedFile>> mapped_files_;
     std::unordered_map<std::string, size_t> weight_cache_;
     std::unordered_map<size_t, size_t> node_to_mapped_file_;
+    std::unordered_map<size_t, std::vector<size_t>> fused_weight_widths_;
+    std::unordered_map<size_t, std::vector<size_t>> split_weight_parts_;
     std::vector<DebugNodeEntry> debug_nodes_;
     BufferPool buffer_pool_;
     bool prefill_mode_ = false;
+    bool release_dead_buffers_ = false;
+    bool static_memory_plan_ = false;
+    bool operator_fusion_ = false;
+    bool parallel_region_ = false;
+    ThreadingPolicy threading_policy_ = ThreadingPolicy::INTRA_OP;
+    bool fusion_pending_ = false;
+    size_t generation_ = 0;
+    ActivationArena activation_arena_;
     
     std::unordered_set<size_t> persistent_node_ids_;
     std::unordered_set<size_t> populated_node_ids_;
+    std::unordered_set<size_t> output_node_ids_;
+
+    void plan_activation_arena(const std::vector<size_t>& last_use, const std::vector<bool>& keep_alive);
+    std::vector<size_t> plan_inter_op_waves(std::vector<size_t>& last_use) const;
+    void widen_int4_input(size_t node_id);
 };
 
 
@@ -530,7 +645,9 @@ namespace GraphFile {
     
     class MappedFile {
     public:
-        MappedFile(const std::string& filename);
+        // INT4 files are widened to an INT8 heap copy unless unpack_int4 is false, in which
+        // case data() is the packed mmap for the INT4 matmul kernels.
+        MappedFile(const std::string& filename, bool unpack_int4 = true);
         ~MappedFile();
 
         MappedFile(const MappedFile&) = delete;
@@ -318,7 +318,8 @@ size_t CactusGraph::attention(size_t query, size_t key, size_t value, float scal
 size_t CactusGraph::attention_int8_hybrid(size_t query, size_t key_new, size_t value_new, float scale, size_t position_offset,
                                           const int8_t* cached_keys, const int8_t* cached_values,
                                           const float* k_scales, const float* v_scales,
-                                          size_t cache_len, size_t num_kv_heads, size_t head_dim, size_t window_size) {
+                                          size_t cache_len, size_t num_kv_heads, size_t head_dim, size_t window_size,
+                                          const CactusKVBlocks& cache_blocks) {
     OpParams params;
     params.scale = scale;
     params.position_offset = position_offset;
@@ -328,6 +329,7 @@ size_t CactusGraph::attention_int8_hybrid(size_t query, size_t key_new, size_t v
     params.cached_k_scales = k_scales;
     params.cached_v_scales = v_scales;
     params.cache_seq_len = cache_len;
+    params.cache_blocks = cache_blocks;
     params.num_kv_heads = num_kv_heads;
     params.head_dim = head_dim;
     return add_node(OpType::ATTENTION_INT8_HYBRID, {query, key_new, value_new}, {}, params);
@@ -474,7 +476,7 @@ size_t CactusGraph::scatter_topk(size_t indices, size_t values, size_t num_class
 }
 
 size_t CactusGraph::sample(size_t logits, float temperature, float top_p, size_t top_k,
-                           const std::unordered_map<uint32_t, float>& logit_bias) {
+                           const std::unordered_map<uint32_t, float>& logit_bias, bool with_entropy) {
     const auto& logits_buffer = get_output_buffer(logits);
 
     if (logits_buffer.shape.empty()) {
@@ -486,6 +488,7 @@ size_t CactusGraph::sample(size_t logits, float temperature, float top_p, size_t
     params.top_p = top_p;
     params.top_k = top_k;
     params.random_seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    params.sample_entropy = with_entropy;
     params.output_precision = Precision::FP32;
 
     if (!logit_bias.empty()) {
@@ -497,7 +500,7 @@ size_t CactusGraph::sample(size_t logits, float temperature, float top_p, size_t
         }
     }
 
-    std::vector<size_t> output_shape = {1};
+    std::vector<size_t> output_shape = {2};
     return add_node(OpType::SAMPLE, {logits}, output_shape, params);
 }
 
@@ -663,10 +666,21 @@ size_t CactusGraph::quantize_activations(size_t input) {
     
     OpParams params{};
     params.output_precision = Precision::INT8;
-    return add_node(OpType::QUANTIZE_ACTIVATIONS, {input}, input_buffer.shape, params);
+    size_t node_id = add_node(OpType::QUANTIZE_ACTIVATIONS, {input}, input_buffer.shape, params);
+    // add_node inherits the input precision for INT8 requests; the output really is INT8.
+    nodes_[node_index_map_[node_id]]->output_buffer = BufferDesc(input_buffer.shape, Precision::INT8);
+    return node_id;
 }
 
 size_t CactusGraph::add_node(OpType op_type, const std::vector<size_t>& inputs, const std::vector<size_t>& output_shape, const OpParams& params) {
+    for (size_t slot = 0; slot < inputs.size(); ++slot) {
+        const bool packed_int4_rhs = op_type == OpType::MATMUL && slot == 1 && params.pretransposed_rhs &&
+                                     params.backend == ComputeBackend::CPU;
+        if (!packed_int4_rhs) {
+            widen_int4_input(inputs[slot]);
+        }
+    }
+
     auto node = std::make_unique<GraphNode>(next_node_id_, op_type);
     node->input_ids = inputs;
     node->params = params;
@@ -688,6 +702,7 @@ size_t CactusGraph::add_node(OpType op_type, const std::vector<size_t>& inputs,
     size_t node_id = next_node_id_++;
     node_index_map_[node_id] = nodes_.size();
     nodes_.push_back(std::move(node));
+    fusion_pending_ = true;
 
     return node_id;
 }
@@ -713,3 +728,11 @@ void CactusGraph::invalidate_persistent(size_t persistent_node_id) {
     populated_node_ids_.erase(persistent_node_id);
     persistent_node_ids_.erase(persistent_node_id);
 }
+
+void CactusGraph::mark_output(size_t node_id) {
+    output_node_ids_.insert(node_id);
+}
+
+bool CactusGraph::is_output(size_t node_id) const {
+    return output_node_ids_.count(node_id) > 0;
+}
@@ -1,5 +1,6 @@
 #include "graph.h"
 #include <algorithm>
+#include <cstdint>
 #include <stdexcept>
 #include <cstring>
 
@@ -57,6 +58,117 @@ void BufferPool::clear() {
     pool_bytes_ = 0;
 }
 
+void ActivationArena::assign_offsets(std::vector<Block>& blocks) {
+    std::vector<size_t> order(blocks.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return blocks[a].size > blocks[b].size;
+    });
+
+    std::vector<size_t> placed;
+    std::vector<std::pair<size_t, size_t>> conflicts;
+    placed.reserve(blocks.size());
+    arena_bytes_ = 0;
+
+    for (size_t idx : order) {
+        Block& block = blocks[idx];
+
+        conflicts.clear();
+        for (size_t other_idx : placed) {
+            const Block& other = blocks[other_idx];
+            if (other.first_use <= block.last_use && block.first_use <= other.last_use) {
+                conflicts.emplace_back(other.offset, other.offset + other.size);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end());
+
+        size_t best_offset = SIZE_MAX;
+        size_t best_gap = SIZE_MAX;
+        size_t cursor = 0;
+        for (const auto& range : conflicts) {
+            if (range.first > cursor) {
+                size_t gap = range.first - cursor;
+                if (gap >= block.size && gap < best_gap) {
+                    best_gap = gap;
+                    best_offset = cursor;
+                }
+            }
+            cursor = std::max(cursor, range.second);
+        }
+        block.offset = best_offset != SIZE_MAX ? best_offset : cursor;
+        arena_bytes_ = std::max(arena_bytes_, block.offset + block.size);
+        placed.push_back(idx);
+    }
+}
+
+void ActivationArena::reserve(size_t bytes) {
+    if (bytes <= capacity_ && bytes * 4 >= capacity_) return;
+
+    storage_.reset();
+    base_ = nullptr;
+    capacity_ = 0;
+    if (bytes == 0) return;
+
+    storage_ = std::make_unique<char[]>(bytes + ALIGNMENT);
+    auto addr = reinterpret_cast<uintptr_t>(storage_.get());
+    base_ = reinterpret_cast<char*>((addr + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+    capacity_ = bytes;
+}
+
+char* ActivationArena::plan(std::vector<Block>& blocks) {
+    for (auto& block : blocks) {
+        block.size = (block.size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    bool same_plan = blocks.size() == last_blocks_.size();
+    for (size_t i = 0; same_plan && i < blocks.size(); ++i) {
+        same_plan = blocks[i].first_use == last_blocks_[i].first_use &&
+                    blocks[i].last_use == last_blocks_[i].last_use &&
+                    blocks[i].size == last_blocks_[i].size;
+    }
+
+    if (same_plan) {
+        blocks = last_blocks_;
+    } else {
+        assign_offsets(blocks);
+
+        std::vector<std::pair<size_t, long long>> events;
+        events.reserve(blocks.size() * 2);
+        tensor_bytes_ = 0;
+        for (const auto& block : blocks) {
+            events.emplace_back(block.first_use * 2, static_cast<long long>(block.size));
+            events.emplace_back(block.last_use * 2 + 1, -static_cast<long long>(block.size));
+            tensor_bytes_ += block.size;
+        }
+        std::sort(events.begin(), events.end());
+        long long live = 0;
+        peak_live_bytes_ = 0;
+        for (const auto& event : events) {
+            live += event.second;
+            peak_live_bytes_ = std::max(peak_live_bytes_, static_cast<size_t>(live));
+        }
+        last_blocks_ = blocks;
+    }
+
+    reserve(arena_bytes_);
+    return base_;
+}
+
+bool ActivationArena::owns(const void* ptr) const {
+    auto* p = static_cast<const char*>(ptr);
+    return base_ && p >= base_ && p < base_ + capacity_;
+}
+
+void ActivationArena::clear() {
+    storage_.reset();
+    base_ = nullptr;
+    capacity_ = 0;
+    arena_bytes_ = 0;
+    peak_live_bytes_ = 0;
+    tensor_bytes_ = 0;
+    last_blocks_.clear();
+}
+
 BufferDesc::BufferDesc()
     : total_size(0), byte_size(0), external_data(nullptr), pooled_data(nullptr),
       precision(Precision::FP16) {}
@@ -65,7 +177,7 @@ BufferDesc::BufferDesc(const std::vector<size_t>& s, Precision prec)
     : shape(s), external_data(nullptr), pooled_data(nullptr), precision(prec) {
     total_size = 1;
     for (size_t dim : shape) total_size *= dim;
-    byte_size = total_size * PrecisionTraits::size_of(prec);
+    byte_size = PrecisionTraits::packed_size_of(prec, total_size);
 }
 
 BufferDesc::~BufferDesc() {
@@ -1,4 +1,5 @@
 #include "graph.h"
+#include "../kernel/kernel_utils.h"
 #include <algorithm>
 #include <chrono>
 #include <cmath>
@@ -11,6 +12,8 @@
 #include <set>
 #include <sstream>
 #include <system_error>
+#include <exception>
+#include <unordered_set>
 
 extern void compute_binary_op_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void compute_unary_op_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
@@ -33,6 +36,7 @@ extern void compute_conv1d_node(GraphNode& node, const std::vector<std::unique_p
 extern void compute_groupnorm_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void compute_rope_gptj_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void shrink_thread_local_buffers();
+extern void invalidate_activation_quant_cache();
 
 extern void compute_transpose_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void compute_gather_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
@@ -47,6 +51,10 @@ extern void compute_topk_node(GraphNode& node, const std::vector<std::unique_ptr
 extern void compute_scatter_topk_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void compute_persistent_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 extern void compute_quantize_activations_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+extern void compute_rms_norm_rope_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+extern void compute_add_rms_norm_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+extern void compute_matmul_swiglu_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
+extern void compute_matmul_sample_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map);
 
 static const char* op_type_names[] = {
     "INPUT", "PRECISION_CAST",
@@ -63,7 +71,8 @@ static const char* op_type_names[] = {
     "TOPK", "LAYERNORM", "GROUPNORM",
     "INDEX",
     "PERSISTENT",
-    "QUANTIZE_ACTIVATIONS"
+    "QUANTIZE_ACTIVATIONS",
+    "RMS_NORM_ROPE", "ADD_RMS_NORM", "MATMUL_SWIGLU", "FUSED_RESULT", "MATMUL_SAMPLE"
 };
 
 static const char* get_op_name(OpType op) {
@@ -217,6 +226,25 @@ void compute_node_optimized(GraphNode& node, const std::vector<std::unique_ptr<G
             compute_quantize_activations_node(node, nodes, node_index_map);
             break;
 
+        case OpType::RMS_NORM_ROPE:
+            compute_rms_norm_rope_node(node, nodes, node_index_map);
+            break;
+
+        case OpType::ADD_RMS_NORM:
+            compute_add_rms_norm_node(node, nodes, node_index_map);
+            break;
+
+        case OpType::MATMUL_SWIGLU:
+            compute_matmul_swiglu_node(node, nodes, node_index_map);
+            break;
+
+        case OpType::FUSED_RESULT:
+            break;
+
+        case OpType::MATMUL_SAMPLE:
+            compute_matmul_sample_node(node, nodes, node_index_map);
+            break;
+
         default:
             throw std::runtime_error("Unknown operation type: " + std::to_string(static_cast<int>(node.op_type)));
     }
@@ -252,7 +280,147 @@ void* CactusGraph::get_output(size_t node_id) {
     return buffer.get_data();
 }
 
+void CactusGraph::plan_activation_arena(const std::vector<size_t>& last_use, const std::vector<bool>& keep_alive) {
+    const size_t num_nodes = nodes_.size();
+    std::vector<size_t> alias_root(num_nodes);
+    std::vector<size_t> end_use(num_nodes);
+    std::vector<bool> pinned = keep_alive;
+
+    for (size_t i = 0; i < num_nodes; ++i) {
+        alias_root[i] = i;
+        end_use[i] = last_use[i] > i ? last_use[i] : num_nodes;
+
+        const auto& node = nodes_[i];
+        bool is_view = (node->op_type == OpType::SLICE || node->op_type == OpType::INDEX) && node->params.axis == 0;
+        if (is_view && !node->input_ids.empty()) {
+            auto it = node_index_map_.find(node->input_ids[0]);
+            if (it != node_index_map_.end()) {
+                alias_root[i] = alias_root[it->second];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_nodes; ++i) {
+        size_t root = alias_root[i];
+        if (root != i) {
+            end_use[root] = std::max(end_use[root], end_use[i]);
+            pinned[root] = pinned[root] || pinned[i];
+        }
+    }
+
+    std::vector<ActivationArena::Block> blocks;
+    std::vector<size_t> block_nodes;
+    for (size_t i = 0; i < num_nodes; ++i) {
+        auto& node = nodes_[i];
+        auto& buffer = node->output_buffer;
+        if (node->op_type == OpType::INPUT || node->op_type == OpType::PERSISTENT ||
+            node->op_type == OpType::SLICE || alias_root[i] != i || buffer.byte_size == 0) {
+            continue;
+        }
+        if (buffer.external_data && activation_arena_.owns(buffer.external_data)) {
+            buffer.external_data = nullptr;
+        }
+        if (buffer.data || buffer.external_data || buffer.pooled_data) {
+            continue;
+        }
+        blocks.push_back({i, pinned[i] ? num_nodes : end_use[i], buffer.byte_size});
+        block_nodes.push_back(i);
+    }
+
+    char* base = activation_arena_.plan(blocks);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        nodes_[block_nodes[b]]->output_buffer.set_external(base + blocks[b].offset);
+    }
+}
+
+namespace {
+
+constexpr size_t INTER_OP_AUTO_MAX_ROWS = 4;
+
+bool is_inter_op_candidate(const GraphNode& node, ThreadingPolicy policy) {
+    switch (node.op_type) {
+        case OpType::ADD: case OpType::ADD_CLIPPED: case OpType::SUBTRACT:
+        case OpType::MULTIPLY: case OpType::DIVIDE:
+        case OpType::SCALAR_ADD: case OpType::SCALAR_SUBTRACT: case OpType::SCALAR_MULTIPLY:
+        case OpType::SCALAR_DIVIDE: case OpType::SCALAR_EXP: case OpType::SCALAR_SQRT:
+        case OpType::SCALAR_COS: case OpType::SCALAR_SIN:
+        case OpType::SILU: case OpType::GELU: case OpType::GELU_ERF: case OpType::TANH:
+        case OpType::MATMUL: case OpType::MATMUL_SWIGLU:
+        case OpType::RMS_NORM: case OpType::RMS_NORM_ROPE: case OpType::LAYERNORM:
+        case OpType::ROPE: case OpType::ROPE_GPTJ: case OpType::SOFTMAX:
+        case OpType::ATTENTION: case OpType::ATTENTION_INT8_HYBRID:
+            break;
+        default:
+            return false;
+    }
+
+    if (node.params.backend != ComputeBackend::CPU) return false;
+
+    if (policy == ThreadingPolicy::AUTO) {
+        const auto& shape = node.output_buffer.shape;
+        size_t rows = 1;
+        for (size_t i = 0; i + 1 < shape.size(); ++i) rows *= shape[i];
+        return rows <= INTER_OP_AUTO_MAX_ROWS;
+    }
+    return true;
+}
+
+}
+
+// Groups maximal runs of consecutive nodes that do not consume one another into waves that
+// may run concurrently. Returns the exclusive end of the wave starting at each index (0 where
+// no wave starts) and stretches the liveness of every wave input to the end of its wave, so
+// neither the arena planner nor buffer release can hand an input's memory to a sibling.
+std::vector<size_t> CactusGraph::plan_inter_op_waves(std::vector<size_t>& last_use) const {
+    std::vector<size_t> wave_end(nodes_.size(), 0);
+    if (threading_policy_ == ThreadingPolicy::INTRA_OP) return wave_end;
+
+    std::unordered_set<size_t> wave_ids;
+    size_t i = 0;
+    while (i < nodes_.size()) {
+        if (!is_inter_op_candidate(*nodes_[i], threading_policy_)) {
+            ++i;
+            continue;
+        }
+
+        wave_ids.clear();
+        wave_ids.insert(nodes_[i]->id);
+        size_t j = i + 1;
+        while (j < nodes_.size() && is_inter_op_candidate(*nodes_[j], threading_policy_)) {
+            bool depends = false;
+            for (size_t input_id : nodes_[j]->input_ids) {
+                if (wave_ids.count(input_id)) {
+                    depends = true;
+                    break;
+                }
+            }
+            if (depends) break;
+            wave_ids.insert(nodes_[j]->id);
+            ++j;
+        }
+
+        if (j - i >= 2) {
+            wave_end[i] = j;
+            for (size_t k = i; k < j; ++k) {
+                for (size_t input_id : nodes_[k]->input_ids) {
+                    auto it = node_index_map_.find(input_id);
+                    if (it != node_index_map_.end()) {
+                        last_use[it->second] = std::max(last_use[it->second], j - 1);
+                    }
+                }
+            }
+        }
+        i = j;
+    }
+    return wave_end;
+}
+
 void CactusGraph::execute(const std::string& profile_file) {
+    if (operator_fusion_ && fusion_pending_) {
+        fuse_operators();
+    }
+    fusion_pending_ = false;
+
     std::vector<size_t> last_use(nodes_.size(), 0);
     for (size_t i = 0; i < nodes_.size(); ++i) {
         for (size_t input_id : nodes_[i]->input_ids) {
@@ -263,8 +431,62 @@ void CactusGraph::execute(const std::string& profile_file) {
         }
     }
 
+    std::vector<size_t> wave_end = plan_inter_op_waves(last_use);
+
     BufferPool& pool = buffer_pool_;
 
+    std::vector<bool> keep_alive(nodes_.size(), false);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        const auto& n = nodes_[i];
+        keep_alive[i] = n->op_type == OpType::INPUT || n->op_type == OpType::PERSISTENT ||
+                        output_node_ids_.count(n->id) > 0;
+    }
+    for (const auto& entry : debug_nodes_) {
+        auto it = node_index_map_.find(entry.node_id);
+        if (it != node_index_map_.end()) {
+            keep_alive[it->second] = true;
+        }
+    }
+
+    if (static_memory_plan_) {
+        plan_activation_arena(last_use, keep_alive);
+    }
+
+    // Views (slice/index along the outermost axis) point into their input's buffer,
+    // so the owning node must outlive every consumer of the view.
+    std::vector<size_t> alias_root(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        alias_root[i] = i;
+    }
+
+    auto release_dead_inputs = [&](size_t node_idx) {
+        auto& node = nodes_[node_idx];
+        const char* view_ptr = static_cast<const char*>(node->output_buffer.external_data);
+
+        for (size_t input_id : node->input_ids) {
+            auto it = node_index_map_.find(input_id);
+            if (it == node_index_map_.end()) continue;
+            size_t root = alias_root[it->second];
+            const auto& root_buffer = nodes_[root]->output_buffer;
+            const char* root_ptr = static_cast<const char*>(root_buffer.get_data());
+
+            if (view_ptr && root_ptr && view_ptr >= root_ptr && view_ptr < root_ptr + root_buffer.byte_size) {
+                alias_root[node_idx] = root;
+                last_use[root] = std::max(last_use[root], last_use[node_idx]);
+                keep_alive[root] = keep_alive[root] || keep_alive[node_idx];
+            }
+        }
+
+        for (size_t input_id : node->input_ids) {
+            auto it = node_index_map_.find(input_id);
+            if (it == node_index_map_.end()) continue;
+            size_t root = alias_root[it->second];
+            if (last_use[root] == node_idx && !keep_alive[root] && alias_root[node_idx] != root) {
+                nodes_[root]->output_buffer.release_to_pool(pool);
+            }
+        }
+    };
+
     auto get_env_int = [](const char* name, int fallback) -> int {
         const char* val = std::getenv(name);
         return val ? std::atoi(val) : fallback;
@@ -321,11 +543,62 @@ void CactusGraph::execute(const std::string& profile_file) {
         *out << std::string(60, '-') << std::endl;
     }
 
+    invalidate_activation_quant_cache();
+
+    CactusThreading::ParallelRegion parallel_region(parallel_region_);
+
+    auto run_wave = [&](size_t begin, size_t end) {
+        std::vector<char*> acquired(end - begin, nullptr);
+        for (size_t i = begin; i < end; ++i) {
+            nodes_[i]->output_buffer.allocate_from_pool(pool);
+            acquired[i - begin] = nodes_[i]->output_buffer.pooled_data;
+        }
+
+        std::vector<std::exception_ptr> errors(end - begin);
+        CactusThreading::get_thread_pool().fork_join(end - begin, end - begin, [&](size_t first, size_t last) {
+            for (size_t i = begin + first; i < begin + last; ++i) {
+                try {
+                    invalidate_activation_quant_cache();
+                    compute_node_optimized(*nodes_[i], nodes_, node_index_map_);
+                } catch (...) {
+                    errors[i - begin] = std::current_exception();
+                }
+            }
+        });
+        invalidate_activation_quant_cache();
+
+        for (const auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            char* data = acquired[i - begin];
+            if (data && !nodes_[i]->output_buffer.pooled_data) {
+                pool.release(data, nodes_[i]->output_buffer.byte_size);
+            }
+            if (release_dead_buffers_) {
+                release_dead_inputs(i);
+            }
+        }
+    };
+
     for (size_t node_idx = 0; node_idx < nodes_.size(); ++node_idx) {
+        if (!enable_profiling && wave_end[node_idx] > node_idx + 1) {
+            run_wave(node_idx, wave_end[node_idx]);
+            node_idx = wave_end[node_idx] - 1;
+            continue;
+        }
+
         auto& node = nodes_[node_idx];
 
+        if (node->op_type != OpType::MATMUL && node->op_type != OpType::MATMUL_SWIGLU) {
+            invalidate_activation_quant_cache();
+        }
+
+        char* acquired = nullptr;
         if (node->op_type != OpType::INPUT) {
             node->output_buffer.allocate_from_pool(pool);
+            acquired = node->output_buffer.pooled_data;
         }
 
         if (enable_profiling && node->op_type != OpType::INPUT) {
@@ -354,7 +627,7 @@ void CactusGraph::execute(const std::string& profile_file) {
                 values_str = " values=[";
 
                 if (node->output_buffer.precision == Precision::FP32) {
-                    if (node->op_type == OpType::SAMPLE) {
+                    if (node->op_type == OpType::SAMPLE || node->op_type == OpType::MATMUL_SAMPLE) {
                         uint32_t* uint32_data = reinterpret_cast<uint32_t*>(node->output_buffer.get_data());
                         for (size_t i = 0; i < num_values; ++i) {
                             if (i > 0) values_str += ",";
@@ -435,6 +708,13 @@ void CactusGraph::execute(const std::string& profile_file) {
                 populated_node_ids_.insert(node->id);
             }
         }
+
+        if (acquired && !node->output_buffer.pooled_data) {
+            pool.release(acquired, node->output_buffer.byte_size);
+        }
+        if (release_dead_buffers_) {
+            release_dead_inputs(node_idx);
+        }
     }
 
     std::unique_ptr<std::ofstream> capture_file_stream;
@@ -694,9 +974,14 @@ void CactusGraph::hard_reset() {
     node_index_map_.clear();
     mapped_files_.clear();
     weight_cache_.clear();
+    fused_weight_widths_.clear();
+    split_weight_parts_.clear();
     next_node_id_ = 0;
     debug_nodes_.clear();
+    output_node_ids_.clear();
     buffer_pool_.clear();
+    activation_arena_.clear();
+    ++generation_;
 }
 
 void CactusGraph::soft_reset() {
@@ -734,6 +1019,8 @@ void CactusGraph::soft_reset() {
 
     next_node_id_ = max_preserved_id + 1;
     debug_nodes_.clear();
+    output_node_ids_.clear();
+    ++generation_;
     if (!prefill_mode_) {
         buffer_pool_.clear();
         shrink_thread_local_buffers();
@@ -774,4 +1061,6 @@ void CactusGraph::soft_reset_keep_pool() {
 
     next_node_id_ = max_preserved_id + 1;
     debug_nodes_.clear();
+    output_node_ids_.clear();
+    ++generation_;
 }
@@ -0,0 +1,332 @@
+#include "graph.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+struct FusionState {
+    std::vector<std::unique_ptr<GraphNode>>& nodes;
+    std::unordered_map<size_t, size_t>& index;
+    std::vector<bool> pinned;
+    std::vector<bool> dead;
+    std::vector<std::vector<size_t>> consumers;
+
+    FusionState(std::vector<std::unique_ptr<GraphNode>>& n, std::unordered_map<size_t, size_t>& m)
+        : nodes(n), index(m), pinned(n.size(), false), dead(n.size(), false), consumers(n.size()) {}
+
+    void rebuild_consumers() {
+        for (auto& list : consumers) {
+            list.clear();
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (dead[i]) continue;
+            for (size_t input_id : nodes[i]->input_ids) {
+                auto it = index.find(input_id);
+                if (it != index.end()) {
+                    consumers[it->second].push_back(i);
+                }
+            }
+        }
+    }
+
+    size_t input_index(size_t node_idx, size_t slot) const {
+        return index.at(nodes[node_idx]->input_ids[slot]);
+    }
+
+    bool is_private(size_t node_idx) const {
+        return !pinned[node_idx] && consumers[node_idx].size() == 1;
+    }
+
+    const BufferDesc& buffer(size_t node_idx) const {
+        return nodes[node_idx]->output_buffer;
+    }
+};
+
+// reshape -> rms_norm -> reshape(s) -> rope, the per-head q/k norm used by Qwen3-style attention.
+size_t fuse_rms_norm_rope(FusionState& s) {
+    size_t fused = 0;
+    for (size_t i = 0; i < s.nodes.size(); ++i) {
+        auto& rope = *s.nodes[i];
+        if (s.dead[i] || rope.op_type != OpType::ROPE || rope.params.backend != ComputeBackend::CPU) continue;
+        if (rope.output_buffer.shape.size() != 4 || rope.output_buffer.precision != Precision::FP16) continue;
+
+        std::vector<size_t> chain;
+        size_t cur = s.input_index(i, 0);
+        while (s.nodes[cur]->op_type == OpType::RESHAPE && s.is_private(cur)) {
+            chain.push_back(cur);
+            cur = s.input_index(cur, 0);
+        }
+
+        size_t rms = cur;
+        if (s.nodes[rms]->op_type != OpType::RMS_NORM || !s.is_private(rms)) continue;
+        chain.push_back(rms);
+
+        cur = s.input_index(rms, 0);
+        while (s.nodes[cur]->op_type == OpType::RESHAPE && s.is_private(cur)) {
+            chain.push_back(cur);
+            cur = s.input_index(cur, 0);
+        }
+
+        const size_t head_dim = rope.output_buffer.shape[3];
+        const auto& source = s.buffer(cur);
+        const auto& weight = s.buffer(s.input_index(rms, 1));
+        const auto& normed = s.buffer(rms);
+        if (source.precision != Precision::FP16 || source.total_size != rope.output_buffer.total_size ||
+            normed.shape.size() != 2 || normed.shape[1] != head_dim || weight.total_size != head_dim ||
+            weight.precision != Precision::FP16 || head_dim % 2 != 0) {
+            continue;
+        }
+
+        size_t weight_id = s.nodes[rms]->input_ids[1];
+        rope.op_type = OpType::RMS_NORM_ROPE;
+        rope.params.epsilon = s.nodes[rms]->params.epsilon;
+        rope.input_ids = {s.nodes[cur]->id, weight_id};
+        for (size_t idx : chain) {
+            s.dead[idx] = true;
+        }
+        ++fused;
+    }
+    return fused;
+}
+
+bool is_column_half(const FusionState& s, size_t slice_idx, size_t start) {
+    const auto& slice = *s.nodes[slice_idx];
+    const auto& shape = slice.output_buffer.shape;
+    return slice.op_type == OpType::SLICE && shape.size() == 2 && slice.params.axis == 1 &&
+           slice.params.slice_start == start && s.is_private(slice_idx);
+}
+
+// Same chain when gate and up were loaded as one fused [2I, K] weight and split by column slices.
+bool fuse_fused_weight_swiglu(FusionState& s, size_t mul_idx, size_t silu, size_t up) {
+    size_t gate = s.input_index(silu, 0);
+    auto& mul = *s.nodes[mul_idx];
+    const size_t width = mul.output_buffer.shape.size() == 2 ? mul.output_buffer.shape[1] : 0;
+    if (width == 0 || !is_column_half(s, gate, 0) || !is_column_half(s, up, width)) return false;
+
+    size_t projected = s.input_index(gate, 0);
+    if (projected != s.input_index(up, 0) || s.pinned[projected] || s.consumers[projected].size() != 2) return false;
+
+    const auto& mm = *s.nodes[projected];
+    if (mm.op_type != OpType::MATMUL || !mm.params.pretransposed_rhs || mm.params.backend != ComputeBackend::CPU) return false;
+    if (s.buffer(gate).shape != mul.output_buffer.shape || s.buffer(up).shape != mul.output_buffer.shape) return false;
+    if (mm.output_buffer.shape.size() != 2 || mm.output_buffer.shape[1] != 2 * width) return false;
+
+    mul.op_type = OpType::MATMUL_SWIGLU;
+    mul.input_ids = {mm.input_ids[0], mm.input_ids[1]};
+    mul.params.pretransposed_rhs = true;
+    mul.params.backend = ComputeBackend::CPU;
+    s.dead[silu] = true;
+    s.dead[gate] = true;
+    s.dead[up] = true;
+    s.dead[projected] = true;
+    return true;
+}
+
+// multiply(silu(matmul(x, Wg)), matmul(x, Wu)), the SwiGLU feed-forward gate.
+size_t fuse_matmul_swiglu(FusionState& s) {
+    size_t fused = 0;
+    for (size_t i = 0; i < s.nodes.size(); ++i) {
+        auto& mul = *s.nodes[i];
+        if (s.dead[i] || mul.op_type != OpType::MULTIPLY || mul.input_ids.size() != 2) continue;
+        if (mul.output_buffer.precision != Precision::FP16) continue;
+
+        size_t a = s.input_index(i, 0);
+        size_t b = s.input_index(i, 1);
+        size_t silu = s.nodes[a]->op_type == OpType::SILU ? a : b;
+        size_t up = silu == a ? b : a;
+        if (s.nodes[silu]->op_type != OpType::SILU || !s.is_private(silu) || !s.is_private(up)) continue;
+
+        if (s.nodes[up]->op_type == OpType::SLICE) {
+            if (fuse_fused_weight_swiglu(s, i, silu, up)) ++fused;
+            continue;
+        }
+
+        size_t gate = s.input_index(silu, 0);
+        if (gate == up || !s.is_private(gate)) continue;
+
+        const auto& g = *s.nodes[gate];
+        const auto& u = *s.nodes[up];
+        if (g.op_type != OpType::MATMUL || u.op_type != OpType::MATMUL) continue;
+        if (g.input_ids[0] != u.input_ids[0]) continue;
+        if (!g.params.pretransposed_rhs || !u.params.pretransposed_rhs) continue;
+        if (g.params.backend != ComputeBackend::CPU || u.params.backend != ComputeBackend::CPU) continue;
+
+        const auto& g_rhs = s.buffer(s.input_index(gate, 1));
+        const auto& u_rhs = s.buffer(s.input_index(up, 1));
+        if (g_rhs.precision != u_rhs.precision || g_rhs.is_grouped_quantized() != u_rhs.is_grouped_quantized()) continue;
+        if (g.output_buffer.shape != mul.output_buffer.shape || u.output_buffer.shape != mul.output_buffer.shape) continue;
+
+        std::vector<size_t> inputs = {g.input_ids[0], g.input_ids[1], u.input_ids[1]};
+        mul.op_type = OpType::MATMUL_SWIGLU;
+        mul.input_ids = std::move(inputs);
+        mul.params.pretransposed_rhs = true;
+        mul.params.backend = ComputeBackend::CPU;
+        s.dead[silu] = true;
+        s.dead[gate] = true;
+        s.dead[up] = true;
+        ++fused;
+    }
+    return fused;
+}
+
+// add -> rms_norm, the residual update feeding the next norm. The add node stays as a
+// placeholder buffer that the fused node writes, so later residual consumers still see it.
+size_t fuse_add_rms_norm(FusionState& s) {
+    size_t fused = 0;
+    for (size_t i = 0; i < s.nodes.size(); ++i) {
+        auto& rms = *s.nodes[i];
+        if (s.dead[i] || rms.op_type != OpType::RMS_NORM) continue;
+
+        size_t add = s.input_index(i, 0);
+        auto& add_node = *s.nodes[add];
+        if (add_node.op_type != OpType::ADD || s.pinned[add]) continue;
+
+        const auto& sum = add_node.output_buffer;
+        const auto& lhs = s.buffer(s.input_index(add, 0));
+        const auto& rhs = s.buffer(s.input_index(add, 1));
+        if (sum.precision != Precision::FP16 || sum.shape.size() != 2 ||
+            lhs.precision != Precision::FP16 || rhs.precision != Precision::FP16 ||
+            lhs.shape != sum.shape || rhs.shape != sum.shape) {
+            continue;
+        }
+
+        const auto& users = s.consumers[add];
+        if (std::any_of(users.begin(), users.end(), [i](size_t user) { return user < i; })) continue;
+
+        rms.op_type = OpType::ADD_RMS_NORM;
+        rms.input_ids = {add_node.input_ids[0], add_node.input_ids[1], rms.input_ids[1], add_node.id};
+        add_node.op_type = OpType::FUSED_RESULT;
+        add_node.input_ids.clear();
+        ++fused;
+    }
+    return fused;
+}
+
+// sample(matmul(x, W)) over a single row, the LM head of a decode step. The sample node takes
+// over the matmul's inputs and computes the logits tile by tile itself.
+size_t fuse_matmul_sample(FusionState& s) {
+    size_t fused = 0;
+    for (size_t i = 0; i < s.nodes.size(); ++i) {
+        auto& sample = *s.nodes[i];
+        if (s.dead[i] || sample.op_type != OpType::SAMPLE) continue;
+
+        size_t head = s.input_index(i, 0);
+        const auto& mm = *s.nodes[head];
+        if (mm.op_type != OpType::MATMUL || !s.is_private(head)) continue;
+        if (!mm.params.pretransposed_rhs || mm.params.backend != ComputeBackend::CPU) continue;
+        if (mm.output_buffer.precision != Precision::FP16 || mm.output_buffer.shape.size() != 2 ||
+            mm.output_buffer.shape[0] != 1) {
+            continue;
+        }
+
+        const auto& weight = s.buffer(s.input_index(head, 1));
+        if (!weight.is_grouped_quantized() && weight.precision != Precision::FP16) continue;
+
+        sample.op_type = OpType::MATMUL_SAMPLE;
+        sample.input_ids = {mm.input_ids[0], mm.input_ids[1]};
+        sample.params.pretransposed_rhs = true;
+        sample.params.backend = ComputeBackend::CPU;
+        s.dead[head] = true;
+        ++fused;
+    }
+    return fused;
+}
+
+bool reads_as_prequantized_lhs(const FusionState& s, const GraphNode& user, size_t id) {
+    if (user.input_ids.empty() || user.input_ids[0] != id) return false;
+    for (size_t slot = 1; slot < user.input_ids.size(); ++slot) {
+        if (user.input_ids[slot] == id) return false;
+        if (!s.buffer(s.index.at(user.input_ids[slot])).is_grouped_quantized()) return false;
+    }
+    if (!user.params.pretransposed_rhs || user.params.backend != ComputeBackend::CPU) return false;
+    return user.op_type == OpType::MATMUL || user.op_type == OpType::MATMUL_SWIGLU ||
+           user.op_type == OpType::MATMUL_SAMPLE;
+}
+
+// rms_norm -> quantize: when every consumer is an INT8/INT4 matmul (or an explicit
+// quantize_activations), the norm writes INT8 rows and per-row scales directly.
+size_t fuse_rms_norm_quantize(FusionState& s) {
+    size_t fused = 0;
+    for (size_t i = 0; i < s.nodes.size(); ++i) {
+        auto& norm = *s.nodes[i];
+        if (s.dead[i] || s.pinned[i]) continue;
+        if (norm.op_type != OpType::RMS_NORM && norm.op_type != OpType::ADD_RMS_NORM) continue;
+        if (norm.output_buffer.precision != Precision::FP16 || norm.output_buffer.shape.size() != 2) continue;
+
+        const auto& users = s.consumers[i];
+        if (users.empty()) continue;
+
+        bool eligible = true;
+        for (size_t user : users) {
+            const auto& node = *s.nodes[user];
+            if (node.op_type == OpType::QUANTIZE_ACTIVATIONS) {
+                eligible = !s.pinned[user];
+            } else {
+                eligible = reads_as_prequantized_lhs(s, node, norm.id);
+            }
+            if (!eligible) break;
+        }
+        if (!eligible) continue;
+
+        norm.output_buffer = BufferDesc(norm.output_buffer.shape, Precision::INT8);
+
+        for (size_t user : users) {
+            if (s.nodes[user]->op_type != OpType::QUANTIZE_ACTIVATIONS) continue;
+            size_t quant_id = s.nodes[user]->id;
+            for (size_t reader : s.consumers[user]) {
+                auto& ids = s.nodes[reader]->input_ids;
+                std::replace(ids.begin(), ids.end(), quant_id, norm.id);
+            }
+            s.dead[user] = true;
+        }
+        ++fused;
+    }
+    return fused;
+}
+
+}
+
+size_t CactusGraph::fuse_operators() {
+    FusionState state(nodes_, node_index_map_);
+
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        size_t id = nodes_[i]->id;
+        state.pinned[i] = output_node_ids_.count(id) > 0 || persistent_node_ids_.count(id) > 0;
+    }
+    for (const auto& entry : debug_nodes_) {
+        auto it = node_index_map_.find(entry.node_id);
+        if (it != node_index_map_.end()) {
+            state.pinned[it->second] = true;
+        }
+    }
+
+    size_t fused = 0;
+    state.rebuild_consumers();
+    fused += fuse_rms_norm_rope(state);
+    state.rebuild_consumers();
+    fused += fuse_matmul_swiglu(state);
+    state.rebuild_consumers();
+    fused += fuse_matmul_sample(state);
+    state.rebuild_consumers();
+    fused += fuse_add_rms_norm(state);
+    state.rebuild_consumers();
+    fused += fuse_rms_norm_quantize(state);
+
+    if (fused == 0) {
+        return 0;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!state.dead[i]) {
+            nodes_[kept++] = std::move(nodes_[i]);
+        }
+    }
+    nodes_.resize(kept);
+
+    node_index_map_.clear();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        node_index_map_[nodes_[i]->id] = i;
+    }
+    return fused;
+}
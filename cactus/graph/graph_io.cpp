@@ -73,7 +73,7 @@ size_t CactusGraph::mmap_weights(const std::string& filename) {
         return it->second;
     }
 
-    auto mapped_file = std::make_unique<GraphFile::MappedFile>(filename);
+    auto mapped_file = std::make_unique<GraphFile::MappedFile>(filename, false);
 
     const auto& shape = mapped_file->shape();
     Precision precision = mapped_file->precision();
@@ -81,7 +81,7 @@ size_t CactusGraph::mmap_weights(const std::string& filename) {
     size_t node_id = input(shape, precision);
     set_external_input(node_id, const_cast<void*>(mapped_file->data()), precision);
 
-    if (precision == Precision::INT8 && mapped_file->group_size() > 0) {
+    if ((precision == Precision::INT8 || precision == Precision::INT4) && mapped_file->group_size() > 0) {
         set_grouped_scales(node_id, mapped_file->group_size(), mapped_file->num_groups(),
                           const_cast<void*>(mapped_file->scales_data()));
 
@@ -98,6 +98,120 @@ size_t CactusGraph::mmap_weights(const std::string& filename) {
     return node_id;
 }
 
+size_t CactusGraph::mmap_fused_weights(const std::vector<std::string>& filenames) {
+    if (filenames.empty()) {
+        throw std::runtime_error("Fused weights need at least one tensor file");
+    }
+
+    std::string cache_key;
+    for (const auto& filename : filenames) {
+        cache_key += filename + "|";
+    }
+    auto it = weight_cache_.find(cache_key);
+    if (it != weight_cache_.end()) {
+        return it->second;
+    }
+
+    std::vector<std::unique_ptr<GraphFile::MappedFile>> parts;
+    for (const auto& filename : filenames) {
+        parts.push_back(std::make_unique<GraphFile::MappedFile>(filename, false));
+    }
+
+    const auto& first = *parts.front();
+    if (first.shape().size() != 2) {
+        throw std::runtime_error("Fused weights must be 2D pretransposed [N, K]: " + filenames.front());
+    }
+    const size_t K = first.shape()[1];
+    const bool grouped = (first.precision() == Precision::INT8 || first.precision() == Precision::INT4) &&
+                         first.group_size() > 0;
+
+    std::vector<size_t> widths;
+    size_t total_N = 0;
+    size_t total_bytes = 0;
+    size_t total_scale_bytes = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        const auto& part = *parts[i];
+        size_t rows = part.shape().size() == 2 ? part.shape()[0] : 0;
+        // Parts whose rows cannot simply be stacked (another layout, or interleaved with padding)
+        // stay separate mapped weights, and fused_matmul runs one matmul per part.
+        if (part.shape().size() != 2 || part.shape()[1] != K || part.precision() != first.precision() ||
+            part.group_size() != first.group_size() || part.is_interleaved() != first.is_interleaved() ||
+            (part.is_interleaved() && (part.original_N() != rows || rows % 4 != 0))) {
+            parts.clear();
+            std::vector<size_t> nodes;
+            for (const auto& filename : filenames) {
+                nodes.push_back(mmap_weights(filename));
+            }
+            split_weight_parts_[nodes.front()] = nodes;
+            weight_cache_[cache_key] = nodes.front();
+            return nodes.front();
+        }
+
+        widths.push_back(rows);
+        total_N += rows;
+        total_bytes += part.byte_size();
+        if (grouped) {
+            total_scale_bytes += rows * part.num_groups() * sizeof(__fp16);
+        }
+    }
+
+    size_t node_id = input({total_N, K}, first.precision());
+    auto& buffer = nodes_[node_index_map_.at(node_id)]->output_buffer;
+    if (buffer.byte_size != total_bytes) {
+        throw std::runtime_error("Fused weight size mismatch for " + filenames.front());
+    }
+    buffer.allocate();
+
+    char* dst = static_cast<char*>(buffer.get_data());
+    for (const auto& part : parts) {
+        std::memcpy(dst, part->data(), part->byte_size());
+        dst += part->byte_size();
+    }
+
+    if (grouped) {
+        buffer.owned_scales = std::make_unique<char[]>(total_scale_bytes);
+        char* scales_dst = buffer.owned_scales.get();
+        for (size_t i = 0; i < parts.size(); ++i) {
+            size_t bytes = widths[i] * parts[i]->num_groups() * sizeof(__fp16);
+            std::memcpy(scales_dst, parts[i]->scales_data(), bytes);
+            scales_dst += bytes;
+        }
+        buffer.set_grouped_scales(first.group_size(), first.num_groups(), buffer.owned_scales.get());
+        if (first.is_interleaved()) {
+            buffer.set_interleaved(true, total_N);
+        }
+    }
+
+    fused_weight_widths_[node_id] = std::move(widths);
+    weight_cache_[cache_key] = node_id;
+    return node_id;
+}
+
+std::vector<size_t> CactusGraph::fused_matmul(size_t input, size_t fused_weight, ComputeBackend backend) {
+    auto split = split_weight_parts_.find(fused_weight);
+    if (split != split_weight_parts_.end()) {
+        std::vector<size_t> outputs;
+        for (size_t part : split->second) {
+            outputs.push_back(matmul(input, part, true, backend));
+        }
+        return outputs;
+    }
+
+    auto it = fused_weight_widths_.find(fused_weight);
+    if (it == fused_weight_widths_.end()) {
+        throw std::runtime_error("fused_matmul requires a weight created by mmap_fused_weights");
+    }
+
+    size_t projected = matmul(input, fused_weight, true, backend);
+    std::vector<size_t> outputs;
+    size_t offset = 0;
+    for (size_t width : it->second) {
+        outputs.push_back(slice(projected, 1, offset, width));
+        offset += width;
+    }
+    return outputs;
+}
+
 void CactusGraph::release_weight_pages(size_t node_id) {
     auto it = node_to_mapped_file_.find(node_id);
     if (it != node_to_mapped_file_.end() && it->second < mapped_files_.size()) {
@@ -129,6 +243,22 @@ size_t CactusGraph::load_weights(const std::string& filename) {
     return loaded.node_id;
 }
 
+// INT4 weights stay packed for pretransposed CPU matmuls; any other reader gets the
+// tensor widened once to an owned INT8 copy, which is what every INT4 file used to cost.
+void CactusGraph::widen_int4_input(size_t node_id) {
+    auto& buffer = nodes_[node_index_map_.at(node_id)]->output_buffer;
+    if (buffer.precision != Precision::INT4) return;
+
+    auto unpacked = std::make_unique<char[]>(buffer.total_size);
+    cactus_unpack_int4_to_int8(buffer.data_as<uint8_t>(), reinterpret_cast<int8_t*>(unpacked.get()),
+                               buffer.total_size);
+
+    buffer.external_data = nullptr;
+    buffer.data = std::move(unpacked);
+    buffer.precision = Precision::INT8;
+    buffer.byte_size = buffer.total_size;
+}
+
 void CactusGraph::set_grouped_scales(size_t node_id, size_t group_size, size_t num_groups, void* scales_ptr) {
     auto it = node_index_map_.find(node_id);
     if (it != node_index_map_.end()) {
@@ -394,7 +524,7 @@ MappedFile mmap_load(const std::string& filename) {
 
 // MappedFile implementation
 
-MappedFile::MappedFile(const std::string& filename)
+MappedFile::MappedFile(const std::string& filename, bool unpack_int4)
     : fd_(-1), mapped_data_(nullptr), file_size_(0), data_offset_(0) {
     fd_ = open(filename.c_str(), O_RDONLY);
     if (fd_ == -1) {
@@ -419,6 +549,10 @@ MappedFile::MappedFile(const std::string& filename)
 
     parse_header();
     apply_madvise_hints();
+
+    if (unpack_int4 && precision_ == Precision::INT4) {
+        unpack_int4_data();
+    }
 }
 
 MappedFile::~MappedFile() {
@@ -523,7 +657,7 @@ LoadedNode MappedFile::load_into_graph(CactusGraph& graph) const {
     size_t node_id = graph.input(shape_, precision_);
     graph.set_external_input(node_id, const_cast<void*>(data()), precision_);
 
-    if (precision_ == Precision::INT8 && group_size_ > 0) {
+    if ((precision_ == Precision::INT8 || precision_ == Precision::INT4) && group_size_ > 0) {
         graph.set_grouped_scales(node_id, group_size_, num_groups_,
                                  const_cast<void*>(scales_data()));
 
@@ -603,10 +737,6 @@ void MappedFile::parse_header() {
     if (data_offset_ + byte_size_ > file_size_) {
         throw std::runtime_error("File corrupted: data extends beyond file size");
     }
-
-    if (precision_ == Precision::INT4) {
-        unpack_int4_data();
-    }
 }
 
 void MappedFile::unpack_int4_data() {
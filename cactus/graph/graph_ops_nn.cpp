@@ -2,6 +2,7 @@
 #include "../kernel/kernel.h"
 #include "../kernel/kernel_utils.h"
 #include <cstring>
+#include <functional>
 #include <vector>
 #include <stdexcept>
 #include <cmath>
@@ -11,6 +12,8 @@ namespace {
     thread_local std::vector<__fp16> transpose_buffer_fp16;
     thread_local std::vector<int8_t> quant_activation_buffer;
     thread_local std::vector<float> quant_scales_buffer;
+    thread_local std::vector<__fp16> swiglu_gate_buffer;
+    thread_local std::vector<CactusSamplePartial> sample_partials;
 
     thread_local const __fp16* cached_quant_src = nullptr;
     thread_local size_t cached_quant_M = 0;
@@ -70,6 +73,17 @@ void shrink_thread_local_buffers() {
     std::vector<__fp16>().swap(transpose_buffer_fp16);
     std::vector<int8_t>().swap(quant_activation_buffer);
     std::vector<float>().swap(quant_scales_buffer);
+    std::vector<__fp16>().swap(swiglu_gate_buffer);
+    std::vector<CactusSamplePartial>().swap(sample_partials);
+    cached_quant_src = nullptr;
+    cached_quant_M = 0;
+    cached_quant_K = 0;
+}
+
+// The quantized-lhs cache is keyed on the source address, which the buffer pool and
+// activation arena hand out again once a tensor is dead; any node that writes a
+// buffer must drop it so a recycled address cannot hit stale activations.
+void invalidate_activation_quant_cache() {
     cached_quant_src = nullptr;
     cached_quant_M = 0;
     cached_quant_K = 0;
@@ -126,82 +140,274 @@ void compute_quantize_activations_node(GraphNode& node, const std::vector<std::u
     }
 }
 
-void compute_matmul_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
-    const auto& lhs_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
-    const auto& rhs_buffer = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
-    const auto& lhs_shape = lhs_buffer.shape;
-    const auto& rhs_shape = rhs_buffer.shape;
+namespace {
+    void matmul_into(const BufferDesc& lhs_buffer, const BufferDesc& rhs_buffer, bool pretransposed_rhs, __fp16* output) {
+        const auto& lhs_shape = lhs_buffer.shape;
+        const auto& rhs_shape = rhs_buffer.shape;
+
+        size_t M = lhs_shape[lhs_shape.size() - 2];
+        size_t K = lhs_shape[lhs_shape.size() - 1];
+        size_t N;
+        if (rhs_buffer.is_interleaved && rhs_buffer.original_N > 0) {
+            N = rhs_buffer.original_N;
+        } else {
+            N = pretransposed_rhs ?
+                rhs_shape[rhs_shape.size() - 2] : rhs_shape[rhs_shape.size() - 1];
+        }
 
-    size_t M = lhs_shape[lhs_shape.size() - 2];
-    size_t K = lhs_shape[lhs_shape.size() - 1];
-    size_t N;
-    if (rhs_buffer.is_interleaved && rhs_buffer.original_N > 0) {
-        N = rhs_buffer.original_N;
-    } else {
-        N = node.params.pretransposed_rhs ?
-            rhs_shape[rhs_shape.size() - 2] : rhs_shape[rhs_shape.size() - 1];
-    }
+        const bool lhs_is_prequantized_int8 = (lhs_buffer.precision == Precision::INT8 &&
+                                                lhs_buffer.has_activation_scales());
 
-    bool pretransposed_rhs = node.params.pretransposed_rhs;
+        if (rhs_buffer.is_grouped_quantized()) {
+            const __fp16* rhs_scales = rhs_buffer.scales_as_fp16();
 
-    ComputeBackend backend = node.params.backend;
+            if (!pretransposed_rhs) {
+                throw std::runtime_error("Group-wise INT8/INT4 matmul requires pretransposed weights");
+            }
 
-    if (backend == ComputeBackend::NPU) {
-        throw std::runtime_error("NPU matrix multiplication not yet implemented");
-    }
+            const int8_t* lhs_int8;
+            const float* lhs_scales;
+
+            if (lhs_is_prequantized_int8) {
+                lhs_int8 = lhs_buffer.data_as<int8_t>();
+                lhs_scales = lhs_buffer.activation_scales_as_float();
+            } else if (lhs_buffer.precision == Precision::FP16) {
+                const __fp16* lhs = lhs_buffer.data_as<__fp16>();
+                ensure_quant_buffers(M, K);
+                quantize_activations_fp16_to_int8(lhs, quant_activation_buffer.data(),
+                                                  quant_scales_buffer.data(), M, K);
+                lhs_int8 = quant_activation_buffer.data();
+                lhs_scales = quant_scales_buffer.data();
+            } else {
+                throw std::runtime_error("INT8 matmul requires INT8 (pre-quantized) or FP16 activations");
+            }
 
-    const bool lhs_is_prequantized_int8 = (lhs_buffer.precision == Precision::INT8 &&
-                                            lhs_buffer.has_activation_scales());
+            if (rhs_buffer.precision == Precision::INT4) {
+                cactus_matmul_int4(lhs_int8, lhs_scales,
+                                   rhs_buffer.data_as<uint8_t>(), rhs_scales, output,
+                                   M, K, N, rhs_buffer.group_size);
+            } else {
+                cactus_matmul_int8(lhs_int8, lhs_scales,
+                                   rhs_buffer.data_as<int8_t>(), rhs_scales, output,
+                                   M, K, N, rhs_buffer.group_size);
+            }
 
-    if (rhs_buffer.is_grouped_int8()) {
-        const int8_t* rhs = rhs_buffer.data_as<int8_t>();
-        const __fp16* rhs_scales = rhs_buffer.scales_as_fp16();
-        __fp16* output = node.output_buffer.data_as<__fp16>();
+        } else {
+            if (lhs_buffer.precision != Precision::FP16) {
+                throw std::runtime_error("FP16 matmul requires FP16 activations");
+            }
 
-        if (!pretransposed_rhs) {
-            throw std::runtime_error("Group-wise INT8 matmul requires pretransposed weights");
-        }
+            const __fp16* lhs = lhs_buffer.data_as<__fp16>();
+            const __fp16* rhs = rhs_buffer.data_as<__fp16>();
 
-        const int8_t* lhs_int8;
-        const float* lhs_scales;
+            if (pretransposed_rhs) {
+                cactus_matmul_f16(lhs, rhs, output, M, K, N);
+            } else {
+                size_t transpose_size = rhs_shape[0] * rhs_shape[1];
+                ensure_transpose_buffer_fp16(transpose_size);
 
-        if (lhs_is_prequantized_int8) {
-            lhs_int8 = lhs_buffer.data_as<int8_t>();
-            lhs_scales = lhs_buffer.activation_scales_as_float();
-        } else if (lhs_buffer.precision == Precision::FP16) {
-            const __fp16* lhs = lhs_buffer.data_as<__fp16>();
-            ensure_quant_buffers(M, K);
-            quantize_activations_fp16_to_int8(lhs, quant_activation_buffer.data(),
-                                              quant_scales_buffer.data(), M, K);
-            lhs_int8 = quant_activation_buffer.data();
-            lhs_scales = quant_scales_buffer.data();
-        } else {
-            throw std::runtime_error("INT8 matmul requires INT8 (pre-quantized) or FP16 activations");
+                cactus_transpose_2d_f16(rhs, transpose_buffer_fp16.data(),
+                                        rhs_shape[0], rhs_shape[1], 0, rhs_shape[0]);
+                cactus_matmul_f16(lhs, transpose_buffer_fp16.data(), output, M, K, N);
+            }
         }
+    }
 
-        cactus_matmul_int8(lhs_int8, lhs_scales,
-                           rhs, rhs_scales, output,
-                           M, K, N, rhs_buffer.group_size);
+    using RowTileFn = std::function<void(size_t, size_t, __fp16*)>;
+
+    // Projects a single [1, K] row against `count` output columns of a pretransposed weight
+    // starting at `n_start` (a multiple of 4). Tiles are sliced out of the weight in place:
+    // grouped weights store each block of 4 columns (and its scales) contiguously, FP16
+    // weights are plain [N, K] rows.
+    RowTileFn row_tiles(const BufferDesc& lhs_buffer, const BufferDesc& rhs_buffer) {
+        const size_t K = lhs_buffer.shape.back();
+        if (rhs_buffer.is_grouped_quantized()) {
+            const int8_t* lhs_int8;
+            float lhs_scale;
+            if (lhs_buffer.precision == Precision::INT8 && lhs_buffer.has_activation_scales()) {
+                lhs_int8 = lhs_buffer.data_as<int8_t>();
+                lhs_scale = lhs_buffer.activation_scales_as_float()[0];
+            } else if (lhs_buffer.precision == Precision::FP16) {
+                ensure_quant_buffers(1, K);
+                quantize_activations_fp16_to_int8(lhs_buffer.data_as<__fp16>(), quant_activation_buffer.data(),
+                                                  quant_scales_buffer.data(), 1, K);
+                lhs_int8 = quant_activation_buffer.data();
+                lhs_scale = quant_scales_buffer[0];
+            } else {
+                throw std::runtime_error("INT8 matmul requires INT8 (pre-quantized) or FP16 activations");
+            }
+
+            const size_t group_size = rhs_buffer.group_size;
+            const size_t block_scales = K / group_size * 4;
+            const __fp16* scales = rhs_buffer.scales_as_fp16();
+            if (rhs_buffer.precision == Precision::INT4) {
+                const uint8_t* weights = rhs_buffer.data_as<uint8_t>();
+                return [=](size_t n_start, size_t count, __fp16* out) {
+                    cactus_gemv_int4(lhs_int8, lhs_scale, weights + n_start / 4 * K * 2,
+                                     scales + n_start / 4 * block_scales, out, K, count, group_size);
+                };
+            }
+            const int8_t* weights = rhs_buffer.data_as<int8_t>();
+            return [=](size_t n_start, size_t count, __fp16* out) {
+                cactus_gemv_int8(lhs_int8, lhs_scale, weights + n_start / 4 * K * 4,
+                                 scales + n_start / 4 * block_scales, out, K, count, group_size);
+            };
+        }
 
-    } else {
         if (lhs_buffer.precision != Precision::FP16) {
             throw std::runtime_error("FP16 matmul requires FP16 activations");
         }
-
         const __fp16* lhs = lhs_buffer.data_as<__fp16>();
-        const __fp16* rhs = rhs_buffer.data_as<__fp16>();
-        __fp16* output = node.output_buffer.data_as<__fp16>();
+        const __fp16* weights = rhs_buffer.data_as<__fp16>();
+        return [=](size_t n_start, size_t count, __fp16* out) {
+            cactus_matmul_f16(lhs, weights + n_start * K, out, 1, K, count);
+        };
+    }
+
+    // Threads for `tiles` column tiles covering `n` output columns, capped by the gemv split.
+    size_t row_tile_threads(size_t tiles, size_t n) {
+        auto& pool = CactusThreading::get_thread_pool();
+        return std::max<size_t>(1, std::min(tiles,
+            CactusThreading::GemmThreading::get_gemv_threads((n + 3) / 4, pool.num_workers())));
+    }
+}
+
+void compute_matmul_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
+    if (node.params.backend == ComputeBackend::NPU) {
+        throw std::runtime_error("NPU matrix multiplication not yet implemented");
+    }
+
+    const auto& lhs_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
+    const auto& rhs_buffer = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
+    matmul_into(lhs_buffer, rhs_buffer, node.params.pretransposed_rhs, node.output_buffer.data_as<__fp16>());
+}
 
-        if (pretransposed_rhs) {
-            cactus_matmul_f16(lhs, rhs, output, M, K, N);
+// For a single decode row the SiLU(gate) * up epilogue runs per column tile: each thread
+// projects a tile of gate and the matching tile of up into stack scratch and writes the
+// product straight to the output, so no [rows, 2 * width] intermediate is materialized.
+// Prefill rows keep the full matmul, whose GEMM tiling the per-row gemv cannot match.
+void compute_matmul_swiglu_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
+    constexpr size_t TILE_N = 256;
+
+    const auto& lhs_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
+    const auto& gate_weight = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
+    __fp16* output = node.output_buffer.data_as<__fp16>();
+    const bool fused_weight = node.input_ids.size() == 2;
+    const size_t width = node.output_buffer.shape.back();
+    const size_t rows = node.output_buffer.total_size / width;
+
+    // A fused gate/up weight projects each row to [gate | up].
+    if (rows == 1 && node.params.pretransposed_rhs && width % 4 == 0) {
+        RowTileFn gate_tile = row_tiles(lhs_buffer, gate_weight);
+        RowTileFn up_tile = fused_weight
+            ? RowTileFn([gate_tile, width](size_t n_start, size_t count, __fp16* out) {
+                  gate_tile(width + n_start, count, out);
+              })
+            : row_tiles(lhs_buffer, nodes[node_index_map.at(node.input_ids[2])]->output_buffer);
+
+        const size_t num_tiles = (width + TILE_N - 1) / TILE_N;
+        const size_t num_threads = row_tile_threads(num_tiles, width);
+        const size_t tiles_per_thread = (num_tiles + num_threads - 1) / num_threads;
+        auto run = [&](size_t thread_start, size_t thread_end) {
+            __fp16 gate[TILE_N];
+            for (size_t t = thread_start; t < thread_end; ++t) {
+                const size_t tile_end = std::min(num_tiles, (t + 1) * tiles_per_thread);
+                for (size_t tile = t * tiles_per_thread; tile < tile_end; ++tile) {
+                    const size_t n_start = tile * TILE_N;
+                    const size_t count = std::min(TILE_N, width - n_start);
+                    gate_tile(n_start, count, gate);
+                    up_tile(n_start, count, output + n_start);
+                    cactus_silu_mul_f16(gate, output + n_start, output + n_start, count);
+                }
+            }
+        };
+        if (num_threads == 1) {
+            run(0, 1);
         } else {
-            size_t transpose_size = rhs_shape[0] * rhs_shape[1];
-            ensure_transpose_buffer_fp16(transpose_size);
+            CactusThreading::get_thread_pool().fork_join(num_threads, num_threads, run);
+        }
+        return;
+    }
 
-            cactus_transpose_2d_f16(rhs, transpose_buffer_fp16.data(),
-                                    rhs_shape[0], rhs_shape[1], 0, rhs_shape[0]);
-            cactus_matmul_f16(lhs, transpose_buffer_fp16.data(), output, M, K, N);
+    if (fused_weight) {
+        if (swiglu_gate_buffer.size() < rows * 2 * width) {
+            swiglu_gate_buffer.resize(rows * 2 * width);
         }
+        matmul_into(lhs_buffer, gate_weight, node.params.pretransposed_rhs, swiglu_gate_buffer.data());
+        for (size_t r = 0; r < rows; ++r) {
+            const __fp16* row = swiglu_gate_buffer.data() + r * 2 * width;
+            cactus_silu_mul_f16(row, row + width, output + r * width, width);
+        }
+        return;
+    }
+
+    const auto& up_weight = nodes[node_index_map.at(node.input_ids[2])]->output_buffer;
+    size_t count = node.output_buffer.total_size;
+    if (swiglu_gate_buffer.size() < count) {
+        swiglu_gate_buffer.resize(count);
+    }
+
+    matmul_into(lhs_buffer, gate_weight, node.params.pretransposed_rhs, swiglu_gate_buffer.data());
+    matmul_into(lhs_buffer, up_weight, node.params.pretransposed_rhs, output);
+    cactus_silu_mul_f16(swiglu_gate_buffer.data(), output, output, count);
+}
+
+// LM head and sampler in one pass: the [1, K] row is multiplied against column tiles of the
+// head weight and each tile of logits goes straight into a per-thread sampling partial, so
+// the vocab-sized logits row is never written out and scanned again.
+void compute_matmul_sample_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
+    constexpr size_t TILE_N = 256;
+
+    const auto& lhs_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
+    const auto& rhs_buffer = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
+    const auto& rhs_shape = rhs_buffer.shape;
+    const size_t N = rhs_buffer.is_interleaved && rhs_buffer.original_N > 0
+        ? rhs_buffer.original_N
+        : rhs_shape[rhs_shape.size() - 2];
+
+    RowTileFn tile_logits = row_tiles(lhs_buffer, rhs_buffer);
+
+    const auto& params = node.params;
+    const float* bias_values = params.bias_values.empty() ? nullptr : params.bias_values.data();
+    const uint32_t* bias_indices = params.bias_indices.empty() ? nullptr : params.bias_indices.data();
+    const size_t bias_count = params.bias_values.size();
+
+    const size_t num_tiles = (N + TILE_N - 1) / TILE_N;
+    const size_t num_threads = row_tile_threads(num_tiles, N);
+    const size_t tiles_per_thread = (num_tiles + num_threads - 1) / num_threads;
+    if (sample_partials.size() < num_threads) {
+        sample_partials.resize(num_threads);
+    }
+
+    // Each thread owns a contiguous run of tiles, so the partials cover increasing ranges.
+    auto run = [&](size_t thread_start, size_t thread_end) {
+        __fp16 logits[TILE_N];
+        for (size_t t = thread_start; t < thread_end; ++t) {
+            auto& partial = sample_partials[t];
+            partial.reset();
+            const size_t tile_end = std::min(num_tiles, (t + 1) * tiles_per_thread);
+            for (size_t tile = t * tiles_per_thread; tile < tile_end; ++tile) {
+                const size_t n_start = tile * TILE_N;
+                const size_t count = std::min(TILE_N, N - n_start);
+                tile_logits(n_start, count, logits);
+                cactus_sample_tile_f16(logits, n_start, count, partial,
+                                       params.temperature, params.top_p, params.top_k,
+                                       bias_values, bias_indices, bias_count, params.sample_entropy);
+            }
+        }
+    };
+    if (num_threads == 1) {
+        run(0, 1);
+    } else {
+        CactusThreading::get_thread_pool().fork_join(num_threads, num_threads, run);
+    }
+
+    float entropy = 0.0f;
+    node.output_buffer.data_as<uint32_t>()[0] = cactus_sample_partials_f16(
+        sample_partials.data(), num_threads, N, params.temperature, params.top_p, params.top_k,
+        params.random_seed, params.sample_entropy ? &entropy : nullptr);
+    if (params.sample_entropy) {
+        node.output_buffer.data_as<float>()[1] = entropy;
     }
 }
 
@@ -221,10 +427,52 @@ void compute_rms_norm_node(GraphNode& node, const std::vector<std::unique_ptr<Gr
         throw std::runtime_error("RMS normalization only supports FP16 precision");
     }
 
+    if (node.output_buffer.precision == Precision::INT8) {
+        if (!node.output_buffer.has_activation_scales() ||
+            node.output_buffer.num_rows_for_activation_scales != batch_size) {
+            node.output_buffer.allocate_activation_scales(batch_size);
+        }
+        cactus_rms_norm_quantize_f16(input_buffer.data_as<__fp16>(), weight_buffer.data_as<__fp16>(),
+            node.output_buffer.data_as<int8_t>(), node.output_buffer.activation_scales_as_float(),
+            batch_size, dims, node.params.epsilon);
+        return;
+    }
+
     cactus_rms_norm_f16(input_buffer.data_as<__fp16>(), weight_buffer.data_as<__fp16>(),
        node.output_buffer.data_as<__fp16>(), batch_size, dims, node.params.epsilon);
 }
 
+void compute_add_rms_norm_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
+    const auto& lhs_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
+    const auto& rhs_buffer = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
+    const auto& weight_buffer = nodes[node_index_map.at(node.input_ids[2])]->output_buffer;
+    auto& sum_buffer = nodes[node_index_map.at(node.input_ids[3])]->output_buffer;
+
+    if (sum_buffer.shape.size() != 2) {
+        throw std::runtime_error("Fused add + RMS normalization requires 2D input tensor [batch_size, dims], got " +
+                                std::to_string(sum_buffer.shape.size()) + "D tensor");
+    }
+
+    size_t batch_size = sum_buffer.shape[0];
+    size_t dims = sum_buffer.shape[1];
+
+    if (node.output_buffer.precision == Precision::INT8) {
+        if (!node.output_buffer.has_activation_scales() ||
+            node.output_buffer.num_rows_for_activation_scales != batch_size) {
+            node.output_buffer.allocate_activation_scales(batch_size);
+        }
+        cactus_add_rms_norm_quantize_f16(lhs_buffer.data_as<__fp16>(), rhs_buffer.data_as<__fp16>(),
+            weight_buffer.data_as<__fp16>(), sum_buffer.data_as<__fp16>(),
+            node.output_buffer.data_as<int8_t>(), node.output_buffer.activation_scales_as_float(),
+            batch_size, dims, node.params.epsilon);
+        return;
+    }
+
+    cactus_add_rms_norm_f16(lhs_buffer.data_as<__fp16>(), rhs_buffer.data_as<__fp16>(),
+        weight_buffer.data_as<__fp16>(), sum_buffer.data_as<__fp16>(),
+        node.output_buffer.data_as<__fp16>(), batch_size, dims, node.params.epsilon);
+}
+
 void compute_rope_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
     if (node.params.backend == ComputeBackend::NPU) {
         throw std::runtime_error("NPU RoPE operation not yet implemented");
@@ -251,6 +499,20 @@ void compute_rope_node(GraphNode& node, const std::vector<std::unique_ptr<GraphN
                    batch_size, seq_len, num_heads, head_dim, node.params.position_offset, node.params.theta);
 }
 
+void compute_rms_norm_rope_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
+    const auto& input_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
+    const auto& weight_buffer = nodes[node_index_map.at(node.input_ids[1])]->output_buffer;
+    const auto& shape = node.output_buffer.shape;
+
+    if (input_buffer.precision != Precision::FP16 || input_buffer.total_size != node.output_buffer.total_size) {
+        throw std::runtime_error("Fused RMS norm + RoPE requires an FP16 input with the output's element count");
+    }
+
+    cactus_rms_norm_rope_f16(input_buffer.data_as<__fp16>(), weight_buffer.data_as<__fp16>(),
+                             node.output_buffer.data_as<__fp16>(), shape[0], shape[1], shape[2], shape[3],
+                             node.params.position_offset, node.params.theta, node.params.epsilon);
+}
+
 void compute_softmax_node(GraphNode& node, const std::vector<std::unique_ptr<GraphNode>>& nodes, const std::unordered_map<size_t, size_t>& node_index_map) {
     const auto& input_buffer = nodes[node_index_map.at(node.input_ids[0])]->output_buffer;
     const auto& shape = input_buffer.shape;
@@ -342,7 +604,7 @@ void compute_attention_int8_hybrid_node(GraphNode& node, const std::vector<std::
         batch_size, seq_len, cache_len, new_len,
         num_q_heads, num_kv_heads, head_dim,
         node.params.scale, node.params.position_offset, true,
-        node.params.window_size
+        node.params.window_size, KV_QUANT_GROUP_SIZE, node.params.cache_blocks
     );
 }
 
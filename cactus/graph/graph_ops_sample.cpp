@@ -25,16 +25,23 @@ void compute_sample_node(GraphNode& node, const std::vector<std::unique_ptr<Grap
     size_t vocab_size = logits_buffer.shape[1];
     size_t last_token_offset = (seq_len - 1) * vocab_size;
 
+    float* entropy = node.output_buffer.data_as<float>() + 1;
     if (logits_buffer.precision == Precision::FP16) {
         const __fp16* logits_fp16 = logits_buffer.data_as<__fp16>();
         cactus_sample_f16(logits_fp16 + last_token_offset, node.output_buffer.data_as<uint32_t>(),
                          vocab_size, temperature, top_p, top_k, random_seed,
                          bias_values, bias_indices, bias_count);
+        if (node.params.sample_entropy) {
+            *entropy = cactus_normalized_entropy_f16(logits_fp16 + last_token_offset, vocab_size);
+        }
     } else {
         const float* logits_fp32 = logits_buffer.data_as<float>();
         cactus_sample_f32(logits_fp32 + last_token_offset, node.output_buffer.data_as<uint32_t>(),
                          vocab_size, temperature, top_p, top_k, random_seed,
                          bias_values, bias_indices, bias_count);
+        if (node.params.sample_entropy) {
+            *entropy = cactus_normalized_entropy_f32(logits_fp32 + last_token_offset, vocab_size);
+        }
     }
 }
 
@@ -2,7 +2,10 @@
 #define KERNEL_H
 
 #include <cstddef>
-#include <arm_neon.h>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "kernel_simd.h"
 
 enum class ScalarOpType {
     ADD,
@@ -38,6 +41,9 @@ void cactus_divide_broadcast_f16(const __fp16* a, const __fp16* b, __fp16* outpu
 
 void cactus_scalar_op_f16(const __fp16* input, __fp16* output, size_t num_elements, float scalar_value, ScalarOpType op_type);
 
+// Name of the kernel ISA tier picked for this CPU at startup (e.g. "neon", "dotprod", "i8mm").
+const char* cactus_kernel_isa();
+
 void cactus_gemv_int8(const int8_t* A, float A_scale,
                       const int8_t* B, const __fp16* B_scales,
                       __fp16* C, size_t K, size_t N, size_t group_size);
@@ -50,6 +56,20 @@ void cactus_matmul_int8(const int8_t* A, const float* A_scales,
                         const int8_t* B, const __fp16* B_scales,
                         __fp16* C, size_t M, size_t K, size_t N, size_t group_size);
 
+// INT4 weights use the INT8 interleaved layout packed two per byte (low nibble first)
+// and stay packed; nibbles are widened in registers.
+void cactus_gemv_int4(const int8_t* A, float A_scale,
+                      const uint8_t* B_packed, const __fp16* B_scales,
+                      __fp16* C, size_t K, size_t N, size_t group_size);
+
+void cactus_gemm_int4(const int8_t* A, const float* A_scales,
+                      const uint8_t* B_packed, const __fp16* B_scales,
+                      __fp16* C, size_t M, size_t K, size_t N, size_t group_size);
+
+void cactus_matmul_int4(const int8_t* A, const float* A_scales,
+                        const uint8_t* B_packed, const __fp16* B_scales,
+                        __fp16* C, size_t M, size_t K, size_t N, size_t group_size);
+
 void cactus_matmul_f16(const __fp16* a, const __fp16* b_transposed, __fp16* c,
                        size_t M, size_t K, size_t N);
 
@@ -76,9 +96,21 @@ void cactus_max_axis_f16(const __fp16* input, __fp16* output, size_t outer_size,
 void cactus_rms_norm_f16(const __fp16* input, const __fp16* weight, __fp16* output,
                           size_t batch_size, size_t dims, float eps);
 
+void cactus_rms_norm_quantize_f16(const __fp16* input, const __fp16* weight, int8_t* output, float* scales,
+                                  size_t batch_size, size_t dims, float eps);
+
+void cactus_add_rms_norm_f16(const __fp16* a, const __fp16* b, const __fp16* weight, __fp16* sum_output,
+                             __fp16* output, size_t batch_size, size_t dims, float eps);
+
+void cactus_add_rms_norm_quantize_f16(const __fp16* a, const __fp16* b, const __fp16* weight, __fp16* sum_output,
+                                      int8_t* output, float* scales, size_t batch_size, size_t dims, float eps);
+
 void cactus_rope_f16(const __fp16* input, __fp16* output, size_t batch_size, size_t seq_len,
                       size_t num_heads, size_t head_dim, size_t start_pos, float theta);
 
+void cactus_rms_norm_rope_f16(const __fp16* input, const __fp16* weight, __fp16* output, size_t batch_size, size_t seq_len,
+                              size_t num_heads, size_t head_dim, size_t start_pos, float theta, float eps);
+
 void cactus_gpt_j_rope_f16(const __fp16* input, __fp16* output, size_t batch_size, size_t seq_len,
                            size_t num_heads, size_t head_dim, size_t rot_dim, size_t start_pos, float theta);
 
@@ -87,6 +119,8 @@ void cactus_softmax_f16(const __fp16* input, __fp16* output, size_t batch_size,
 
 void cactus_silu_f16(const __fp16* input, __fp16* output, size_t num_elements);
 
+void cactus_silu_mul_f16(const __fp16* gate, const __fp16* up, __fp16* output, size_t num_elements);
+
 void cactus_gelu_f16(const __fp16* input, __fp16* output, size_t num_elements);
 
 void cactus_gelu_f16_erf(const __fp16* input, __fp16* output, size_t num_elements);
@@ -98,6 +132,17 @@ void cactus_attention_f16(const __fp16* queries, const __fp16* keys, const __fp1
                           size_t head_dim, float scale, const __fp16* mask, size_t position_offset = 0, size_t window_size = 0,
                           bool is_causal = true);
 
+// Block-table view of a paged INT8 KV cache. Cached token p lives in row
+// r = (p < gap_start ? p : p + gap_rows) of the concatenated blocks, which is pool row
+// block_table[r / block_tokens] * block_tokens + r % block_tokens. Without a block table
+// the cached rows are one contiguous run.
+struct CactusKVBlocks {
+    const uint32_t* block_table = nullptr;
+    size_t block_tokens = 0;
+    size_t gap_start = 0;
+    size_t gap_rows = 0;
+};
+
 void cactus_attention_hybrid_int8_fp16(
     const __fp16* queries,        
     const int8_t* keys_cached, 
@@ -110,7 +155,7 @@ void cactus_attention_hybrid_int8_fp16(
     size_t batch_size, size_t seq_len, size_t cache_len, size_t new_len,
     size_t num_q_heads, size_t num_kv_heads, size_t head_dim,
     float scale, size_t position_offset = 0, bool is_causal = true, size_t window_size = 0,
-    size_t group_size = KV_QUANT_GROUP_SIZE);
+    size_t group_size = KV_QUANT_GROUP_SIZE, CactusKVBlocks cache_blocks = {});
 
 void cactus_conv1d_causal_depthwise_f16(
     const __fp16* input,
@@ -160,6 +205,12 @@ void cactus_conv1d_f16_k7s3_oc8(
 void cactus_bilinear_interpolation_f16(const __fp16* input, __fp16* output, size_t src_height, size_t src_width, size_t embed_dim,
                                        size_t dst_height, size_t dst_width);
 
+// Distribution cactus_sample_f32 draws from: logit bias, temperature, top-k, min-p and top-p
+// applied to one row of logits. Returns false when no token survives the filters.
+bool cactus_sample_probs_f32(const float* logits, float* probs, size_t vocab_size,
+                             float temperature, float top_p, size_t top_k,
+                             const float* bias_values = nullptr, const uint32_t* bias_indices = nullptr,
+                             size_t bias_count = 0);
 void cactus_sample_f32(const float* logits, uint32_t* output, size_t vocab_size,
                        float temperature, float top_p, size_t top_k, size_t random_seed,
                        const float* bias_values = nullptr, const uint32_t* bias_indices = nullptr,
@@ -169,6 +220,44 @@ void cactus_sample_f16(const __fp16* logits, uint32_t* output, size_t vocab_size
                        const float* bias_values = nullptr, const uint32_t* bias_indices = nullptr,
                        size_t bias_count = 0);
 
+// Normalized entropy (entropy / log(vocab_size)) of the softmax of one row of raw logits.
+float cactus_normalized_entropy_f32(const float* logits, size_t vocab_size);
+float cactus_normalized_entropy_f16(const __fp16* logits, size_t vocab_size);
+
+// One thread's share of a logits row that is sampled while it is produced, e.g. tile by tile
+// out of the LM head, so the full row is never stored. It keeps the running log-sum-exp terms
+// of the raw logits (for the entropy) and every token that can still pass the filters.
+struct CactusSamplePartial {
+    float raw_max = -std::numeric_limits<float>::infinity();
+    double raw_sum_exp = 0.0;
+    double raw_sum_exp_logit = 0.0;
+    float best = -std::numeric_limits<float>::infinity();
+    size_t prune_at = 0;
+    std::vector<uint32_t> tokens;
+    std::vector<float> logits;
+
+    void reset() {
+        raw_max = best = -std::numeric_limits<float>::infinity();
+        raw_sum_exp = raw_sum_exp_logit = 0.0;
+        prune_at = 0;
+        tokens.clear();
+        logits.clear();
+    }
+};
+
+// Folds logits of vocabulary entries [start, start + count) into partial, filtered the way
+// cactus_sample_f16 filters them. Tiles fed to one partial must come in increasing order.
+void cactus_sample_tile_f16(const __fp16* logits, size_t start, size_t count, CactusSamplePartial& partial,
+                            float temperature, float top_p, size_t top_k,
+                            const float* bias_values, const uint32_t* bias_indices, size_t bias_count,
+                            bool with_entropy);
+// Merges partials that cover increasing vocabulary ranges and draws the token cactus_sample_f16
+// would draw from the whole row with the same seed. out_entropy, when set, receives
+// cactus_normalized_entropy_f16 of the row.
+uint32_t cactus_sample_partials_f16(const CactusSamplePartial* partials, size_t num_partials, size_t vocab_size,
+                                    float temperature, float top_p, size_t top_k, size_t random_seed,
+                                    float* out_entropy = nullptr);
+
 void cactus_concat_f16(const __fp16* input1, const __fp16* input2, __fp16* output,
                        const size_t* shape1, const size_t* shape2, const size_t* output_shape,
                        size_t ndims, int axis);
@@ -0,0 +1,196 @@
+#include "kernel.h"
+#include "kernel_isa.h"
+#include "kernel_utils.h"
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__ANDROID__) || (defined(__linux__) && defined(__aarch64__))
+#ifndef HWCAP_ASIMDDP
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+#ifndef HWCAP2_I8MM
+#define HWCAP2_I8MM (1 << 13)
+#endif
+#endif
+
+namespace {
+
+struct KernelTable {
+    const char* name;
+    decltype(&cactus_gemv_int8) gemv_int8;
+    decltype(&cactus_gemm_int8) gemm_int8;
+    decltype(&cactus_gemv_int4) gemv_int4;
+    decltype(&cactus_gemm_int4) gemm_int4;
+    decltype(&cactus_attention_f16) attention_f16;
+    decltype(&cactus_attention_hybrid_int8_fp16) attention_hybrid_int8_fp16;
+};
+
+#define CACTUS_KERNEL_TABLE(isa) \
+    KernelTable{#isa, &CactusISA::isa::gemv_int8, &CactusISA::isa::gemm_int8, \
+                &CactusISA::isa::gemv_int4, &CactusISA::isa::gemm_int4, \
+                &CactusISA::isa::attention_f16, &CactusISA::isa::attention_hybrid_int8_fp16}
+
+#if !defined(CACTUS_SIMD_PORTABLE)
+
+#if defined(__APPLE__)
+bool sysctl_flag(const char* name) {
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname(name, &value, &size, nullptr, 0) == 0 && value != 0;
+}
+#endif
+
+bool cpu_has_dotprod() {
+#if defined(__APPLE__)
+    return sysctl_flag("hw.optional.arm.FEAT_DotProd");
+#elif defined(__ANDROID__) || defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_has_i8mm() {
+#if defined(__APPLE__)
+    return sysctl_flag("hw.optional.arm.FEAT_I8MM");
+#elif defined(__ANDROID__) || defined(__linux__)
+    return (getauxval(AT_HWCAP2) & HWCAP2_I8MM) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
+
+// Tiers the CPU can run, best first. CACTUS_KERNEL_ISA can pin a lower tier for A/B runs;
+// a tier the CPU lacks is ignored rather than allowed to fault.
+KernelTable select_kernels() {
+    std::vector<KernelTable> supported;
+#if defined(CACTUS_SIMD_PORTABLE)
+    supported.push_back(CACTUS_KERNEL_TABLE(portable));
+#else
+    const bool dotprod = cpu_has_dotprod();
+    if (dotprod && cpu_has_i8mm()) supported.push_back(CACTUS_KERNEL_TABLE(i8mm));
+    if (dotprod) supported.push_back(CACTUS_KERNEL_TABLE(dotprod));
+    supported.push_back(CACTUS_KERNEL_TABLE(neon));
+#endif
+
+    if (const char* requested = std::getenv("CACTUS_KERNEL_ISA")) {
+        for (const auto& table : supported) {
+            if (std::strcmp(table.name, requested) == 0) return table;
+        }
+    }
+    return supported.front();
+}
+
+const KernelTable& kernels() {
+    static const KernelTable table = select_kernels();
+    return table;
+}
+
+}
+
+const char* cactus_kernel_isa() {
+    return kernels().name;
+}
+
+void cactus_gemv_int8(
+    const int8_t* A,
+    const float A_scale,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t K, size_t N,
+    size_t group_size
+) {
+    kernels().gemv_int8(A, A_scale, B, B_scales, C, K, N, group_size);
+}
+
+void cactus_gemm_int8(
+    const int8_t* A,
+    const float* A_scales,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t M, size_t K, size_t N,
+    size_t group_size
+) {
+    kernels().gemm_int8(A, A_scales, B, B_scales, C, M, K, N, group_size);
+}
+
+void cactus_gemv_int4(
+    const int8_t* A,
+    const float A_scale,
+    const uint8_t* B_packed,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t K, size_t N,
+    size_t group_size
+) {
+    kernels().gemv_int4(A, A_scale, B_packed, B_scales, C, K, N, group_size);
+}
+
+void cactus_gemm_int4(
+    const int8_t* A,
+    const float* A_scales,
+    const uint8_t* B_packed,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t M, size_t K, size_t N,
+    size_t group_size
+) {
+    kernels().gemm_int4(A, A_scales, B_packed, B_scales, C, M, K, N, group_size);
+}
+
+void cactus_attention_f16(
+    const __fp16* queries,
+    const __fp16* keys,
+    const __fp16* values,
+    __fp16* output,
+    size_t batch_size,
+    size_t seq_len,
+    size_t kv_seq_len,
+    size_t num_q_heads,
+    size_t num_kv_heads,
+    size_t head_dim,
+    float scale,
+    const __fp16* mask,
+    size_t position_offset,
+    size_t window_size,
+    bool is_causal
+) {
+    kernels().attention_f16(queries, keys, values, output, batch_size, seq_len, kv_seq_len,
+                            num_q_heads, num_kv_heads, head_dim, scale, mask,
+                            position_offset, window_size, is_causal);
+}
+
+void cactus_attention_hybrid_int8_fp16(
+    const __fp16* queries,
+    const int8_t* keys_cached,
+    const int8_t* values_cached,
+    const float* k_scales,
+    const float* v_scales,
+    const __fp16* keys_new,
+    const __fp16* values_new,
+    __fp16* output,
+    size_t batch_size,
+    size_t seq_len,
+    size_t cache_len,
+    size_t new_len,
+    size_t num_q_heads,
+    size_t num_kv_heads,
+    size_t head_dim,
+    float scale,
+    size_t position_offset,
+    bool is_causal,
+    size_t window_size,
+    size_t quant_group_size,
+    CactusKVBlocks cache_blocks
+) {
+    kernels().attention_hybrid_int8_fp16(queries, keys_cached, values_cached, k_scales, v_scales,
+                                         keys_new, values_new, output, batch_size, seq_len,
+                                         cache_len, new_len, num_q_heads, num_kv_heads, head_dim,
+                                         scale, position_offset, is_causal, window_size,
+                                         quant_group_size, cache_blocks);
+}
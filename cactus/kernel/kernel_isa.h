@@ -0,0 +1,48 @@
+#ifndef KERNEL_ISA_H
+#define KERNEL_ISA_H
+
+#include "kernel.h"
+
+// Kernels in kernel/*_isa.cpp are compiled once per ISA tier, each build with its own -march
+// and CACTUS_KERNEL_ISA naming the tier, so every tier lands in its own namespace below.
+// kernel_dispatch.cpp picks one tier at startup and the public cactus_* entry points forward to it.
+// Keep these files free of non-static inline helpers with integer dot-product loops: the linker
+// keeps one copy of an inline function, and it may be the copy built for a higher tier.
+
+#define CACTUS_DECLARE_ISA_KERNELS(isa)                                                            \
+    namespace CactusISA { namespace isa {                                                          \
+        void gemv_int8(const int8_t* A, float A_scale, const int8_t* B, const __fp16* B_scales,   \
+                       __fp16* C, size_t K, size_t N, size_t group_size);                         \
+        void gemm_int8(const int8_t* A, const float* A_scales, const int8_t* B,                   \
+                       const __fp16* B_scales, __fp16* C, size_t M, size_t K, size_t N,           \
+                       size_t group_size);                                                        \
+        void gemv_int4(const int8_t* A, float A_scale, const uint8_t* B_packed,                   \
+                       const __fp16* B_scales, __fp16* C, size_t K, size_t N, size_t group_size); \
+        void gemm_int4(const int8_t* A, const float* A_scales, const uint8_t* B_packed,           \
+                       const __fp16* B_scales, __fp16* C, size_t M, size_t K, size_t N,           \
+                       size_t group_size);                                                        \
+        void attention_f16(const __fp16* queries, const __fp16* keys, const __fp16* values,       \
+                           __fp16* output, size_t batch_size, size_t seq_len, size_t kv_seq_len,  \
+                           size_t num_q_heads, size_t num_kv_heads, size_t head_dim, float scale, \
+                           const __fp16* mask, size_t position_offset, size_t window_size,        \
+                           bool is_causal);                                                       \
+        void attention_hybrid_int8_fp16(const __fp16* queries, const int8_t* keys_cached,         \
+                                        const int8_t* values_cached, const float* k_scales,       \
+                                        const float* v_scales, const __fp16* keys_new,            \
+                                        const __fp16* values_new, __fp16* output,                 \
+                                        size_t batch_size, size_t seq_len, size_t cache_len,      \
+                                        size_t new_len, size_t num_q_heads, size_t num_kv_heads,  \
+                                        size_t head_dim, float scale, size_t position_offset,     \
+                                        bool is_causal, size_t window_size, size_t group_size,    \
+                                        CactusKVBlocks cache_blocks);                             \
+    } }
+
+#if defined(CACTUS_SIMD_PORTABLE)
+CACTUS_DECLARE_ISA_KERNELS(portable)
+#else
+CACTUS_DECLARE_ISA_KERNELS(neon)
+CACTUS_DECLARE_ISA_KERNELS(dotprod)
+CACTUS_DECLARE_ISA_KERNELS(i8mm)
+#endif
+
+#endif // KERNEL_ISA_H
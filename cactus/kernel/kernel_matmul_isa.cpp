@@ -0,0 +1,370 @@
+#include "kernel_isa.h"
+#include "kernel_utils.h"
+#include "kernel_simd.h"
+#include <algorithm>
+
+#if !defined(CACTUS_KERNEL_ISA)
+#error "kernel_matmul_isa.cpp is built once per ISA tier with CACTUS_KERNEL_ISA set (see CMakeLists.txt)"
+#endif
+
+// Do NOT Remove: Uncomment for testing on various paths
+// -----
+// TEMPORARY: Force fallback path for testing on DOTPROD devices
+// #undef __ARM_FEATURE_DOTPROD
+
+#if defined(__ARM_FEATURE_DOTPROD) || defined(CACTUS_SIMD_PORTABLE)
+    #define CACTUS_DOTQ_LANE(acc, b, a, lane) vdotq_laneq_s32(acc, b, a, lane)
+#else
+    static inline int32x4_t cactus_dotq_with_pattern(int32x4_t acc, int8x16_t b, int8x8_t a_pattern) {
+        int8x8_t b_lo = vget_low_s8(b);
+        int8x8_t b_hi = vget_high_s8(b);
+
+        int16x8_t prod_lo = vmull_s8(b_lo, a_pattern);
+        int16x8_t prod_hi = vmull_s8(b_hi, a_pattern);
+
+        int32x4_t sum_lo = vpaddlq_s16(prod_lo);
+        int32x4_t sum_hi = vpaddlq_s16(prod_hi);
+
+        int32x2_t final_lo = vpadd_s32(vget_low_s32(sum_lo), vget_high_s32(sum_lo));
+        int32x2_t final_hi = vpadd_s32(vget_low_s32(sum_hi), vget_high_s32(sum_hi));
+
+        return vaddq_s32(acc, vcombine_s32(final_lo, final_hi));
+    }
+
+    static inline int32x4_t cactus_dotq_lane0(int32x4_t acc, int8x16_t b, int8x16_t a) {
+        int8x8_t a_lo = vget_low_s8(a);
+        int8x8_t a_pattern = vreinterpret_s8_s32(vdup_lane_s32(vreinterpret_s32_s8(a_lo), 0));
+        return cactus_dotq_with_pattern(acc, b, a_pattern);
+    }
+
+    static inline int32x4_t cactus_dotq_lane1(int32x4_t acc, int8x16_t b, int8x16_t a) {
+        int8x8_t a_lo = vget_low_s8(a);
+        int8x8_t a_pattern = vreinterpret_s8_s32(vdup_lane_s32(vreinterpret_s32_s8(a_lo), 1));
+        return cactus_dotq_with_pattern(acc, b, a_pattern);
+    }
+
+    static inline int32x4_t cactus_dotq_lane2(int32x4_t acc, int8x16_t b, int8x16_t a) {
+        int8x8_t a_hi = vget_high_s8(a);
+        int8x8_t a_pattern = vreinterpret_s8_s32(vdup_lane_s32(vreinterpret_s32_s8(a_hi), 0));
+        return cactus_dotq_with_pattern(acc, b, a_pattern);
+    }
+
+    static inline int32x4_t cactus_dotq_lane3(int32x4_t acc, int8x16_t b, int8x16_t a) {
+        int8x8_t a_hi = vget_high_s8(a);
+        int8x8_t a_pattern = vreinterpret_s8_s32(vdup_lane_s32(vreinterpret_s32_s8(a_hi), 1));
+        return cactus_dotq_with_pattern(acc, b, a_pattern);
+    }
+
+    #define CACTUS_DOTQ_LANE(acc, b, a, lane) cactus_dotq_lane##lane(acc, b, a)
+#endif
+
+namespace CactusISA {
+namespace CACTUS_KERNEL_ISA {
+
+namespace {
+
+// A group is 32 k of one 4-column block, handed to the dot products as eight 16-byte
+// chunks: chunk i holds k 4i..4i+3 for each of the 4 columns.
+struct Int8Weights {
+    static constexpr size_t bytes_per_k = 4;
+
+    static inline void load_group(const int8_t* b, int8x16_t (&chunks)[8]) {
+        for (size_t i = 0; i < 8; i++) {
+            chunks[i] = vld1q_s8(b + i * 16);
+        }
+    }
+};
+
+// INT4 packs the same interleaved byte stream two values per byte, low nibble first,
+// so every 16 packed bytes widen in registers to two consecutive INT8 chunks.
+struct Int4Weights {
+    static constexpr size_t bytes_per_k = 2;
+
+    static inline void load_group(const int8_t* b, int8x16_t (&chunks)[8]) {
+        for (size_t i = 0; i < 4; i++) {
+            int8x16_t packed = vld1q_s8(b + i * 16);
+            int8x16_t low = vshrq_n_s8(vshlq_n_s8(packed, 4), 4);
+            int8x16_t high = vshrq_n_s8(packed, 4);
+            int8x16x2_t unpacked = vzipq_s8(low, high);
+            chunks[2 * i] = unpacked.val[0];
+            chunks[2 * i + 1] = unpacked.val[1];
+        }
+    }
+};
+
+inline int32x4_t dot_group(int32x4_t acc, const int8_t* a_ptr, const int8x16_t (&b)[8]) {
+    int8x16_t a_vec = vld1q_s8(a_ptr);
+    acc = CACTUS_DOTQ_LANE(acc, b[0], a_vec, 0);
+    acc = CACTUS_DOTQ_LANE(acc, b[1], a_vec, 1);
+    acc = CACTUS_DOTQ_LANE(acc, b[2], a_vec, 2);
+    acc = CACTUS_DOTQ_LANE(acc, b[3], a_vec, 3);
+
+    a_vec = vld1q_s8(a_ptr + 16);
+    acc = CACTUS_DOTQ_LANE(acc, b[4], a_vec, 0);
+    acc = CACTUS_DOTQ_LANE(acc, b[5], a_vec, 1);
+    acc = CACTUS_DOTQ_LANE(acc, b[6], a_vec, 2);
+    acc = CACTUS_DOTQ_LANE(acc, b[7], a_vec, 3);
+    return acc;
+}
+
+template <typename Weights>
+void gemv_grouped(
+    const int8_t* A,
+    const float A_scale,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t K, size_t N,
+    size_t group_size
+) {
+    if (K == 0 || N == 0) return;
+
+    const size_t num_groups = K / group_size;
+    const size_t N_blocks = (N + 3) / 4;
+    const size_t group_bytes = group_size * Weights::bytes_per_k;
+
+    auto process_blocks = [=](size_t block_start, size_t block_end) {
+        for (size_t n_block = block_start; n_block < block_end; ++n_block) {
+            const size_t n_start = n_block * 4;
+            const size_t actual_n = std::min(size_t(4), N - n_start);
+
+            float32x4_t running_sum = vdupq_n_f32(0.0f);
+
+            size_t g = 0;
+            for (; g + 1 < num_groups; g += 2) {
+                const size_t k_base0 = g * group_size;
+                const size_t k_base1 = (g + 1) * group_size;
+
+                const int8_t* b_base0 = B + (n_block * K + k_base0) * Weights::bytes_per_k;
+                const int8_t* b_base1 = B + (n_block * K + k_base1) * Weights::bytes_per_k;
+
+                __builtin_prefetch(b_base0 + group_bytes * 2, 0, 3);
+
+                int8x16_t b0[8];
+                int8x16_t b1[8];
+                Weights::load_group(b_base0, b0);
+                Weights::load_group(b_base1, b1);
+
+                int32x4_t acc0 = dot_group(vdupq_n_s32(0), A + k_base0, b0);
+                int32x4_t acc1 = dot_group(vdupq_n_s32(0), A + k_base1, b1);
+
+                const __fp16* scale_ptr0 = B_scales + (n_block * num_groups + g) * 4;
+                const __fp16* scale_ptr1 = B_scales + (n_block * num_groups + g + 1) * 4;
+
+                float16x4_t scales0_f16 = vld1_f16(scale_ptr0);
+                float16x4_t scales1_f16 = vld1_f16(scale_ptr1);
+                float32x4_t scales0 = vcvt_f32_f16(scales0_f16);
+                float32x4_t scales1 = vcvt_f32_f16(scales1_f16);
+
+                running_sum = vmlaq_f32(running_sum, vcvtq_f32_s32(acc0), scales0);
+                running_sum = vmlaq_f32(running_sum, vcvtq_f32_s32(acc1), scales1);
+            }
+
+            for (; g < num_groups; g++) {
+                const size_t k_base = g * group_size;
+                const int8_t* b_base = B + (n_block * K + k_base) * Weights::bytes_per_k;
+
+                int8x16_t b[8];
+                Weights::load_group(b_base, b);
+                int32x4_t acc = dot_group(vdupq_n_s32(0), A + k_base, b);
+
+                const __fp16* scale_ptr = B_scales + (n_block * num_groups + g) * 4;
+                float16x4_t scales_f16 = vld1_f16(scale_ptr);
+                float32x4_t scales = vcvt_f32_f16(scales_f16);
+
+                running_sum = vmlaq_f32(running_sum, vcvtq_f32_s32(acc), scales);
+            }
+
+            float32x4_t result = vmulq_n_f32(running_sum, A_scale);
+            float16x4_t result_f16 = vcvt_f16_f32(result);
+
+            if (actual_n == 4) {
+                vst1_f16(C + n_start, result_f16);
+            } else {
+                for (size_t ni = 0; ni < actual_n; ni++) {
+                    C[n_start + ni] = vget_lane_f16(result_f16, 0);
+                    result_f16 = vext_f16(result_f16, result_f16, 1);
+                }
+            }
+        }
+    };
+
+    auto& pool = CactusThreading::get_thread_pool();
+    size_t num_threads = CactusThreading::GemmThreading::get_gemv_threads(N_blocks, pool.num_workers());
+    num_threads = std::min(num_threads, N_blocks);
+
+    if (num_threads <= 1) {
+        process_blocks(0, N_blocks);
+    } else {
+        pool.fork_join(N_blocks, num_threads, process_blocks);
+    }
+}
+
+template <typename Weights>
+void gemm_grouped(
+    const int8_t* A,
+    const float* A_scales,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t M, size_t K, size_t N,
+    size_t group_size
+) {
+    if (M == 0 || K == 0 || N == 0) return;
+
+    constexpr size_t TILE_M = 4;
+    constexpr size_t TILE_N = 4;
+
+    const size_t num_groups = K / group_size;
+    const size_t N_blocks = (N + TILE_N - 1) / TILE_N;
+    const size_t num_row_tiles = (M + TILE_M - 1) / TILE_M;
+    const size_t total_tiles = num_row_tiles * N_blocks;
+    const size_t group_bytes = group_size * Weights::bytes_per_k;
+
+    CactusThreading::parallel_gemm_tiles(M, total_tiles,
+        [=](size_t tile_start, size_t tile_end) {
+            for (size_t tile_idx = tile_start; tile_idx < tile_end; ++tile_idx) {
+                const size_t tile_row = tile_idx / N_blocks;
+                const size_t n_block = tile_idx % N_blocks;
+                const size_t m_start = tile_row * TILE_M;
+                const size_t m_end = std::min(m_start + TILE_M, M);
+                const size_t n_start = n_block * TILE_N;
+                const size_t n_end = std::min(n_start + TILE_N, N);
+                const size_t actual_m = m_end - m_start;
+                const size_t actual_n = n_end - n_start;
+
+                float32x4_t running_sum[TILE_M] = {
+                    vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                    vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)
+                };
+
+                for (size_t g = 0; g < num_groups; g++) {
+                    const size_t k_base = g * group_size;
+                    const int8_t* b_base = B + (n_block * K + k_base) * Weights::bytes_per_k;
+
+                    __builtin_prefetch(b_base + group_bytes, 0, 3);
+
+                    int8x16_t b_chunks[8];
+                    Weights::load_group(b_base, b_chunks);
+
+                    const __fp16* scale_ptr = B_scales + (n_block * num_groups + g) * 4;
+                    float16x4_t scales_f16 = vld1_f16(scale_ptr);
+                    float32x4_t scales = vcvt_f32_f16(scales_f16);
+
+#if defined(__ARM_FEATURE_MATMUL_INT8)
+                    // SMMLA takes two rows of 8 consecutive k from A and from B. A 16-byte B chunk
+                    // holds 4 k for each of the 4 columns, so zipping the 32-bit lanes of two
+                    // consecutive chunks gives the 8-k rows of columns {0,1} and {2,3}.
+                    int8x16_t b_cols01[4];
+                    int8x16_t b_cols23[4];
+                    for (size_t s = 0; s < 4; s++) {
+                        int32x4_t k_lo = vreinterpretq_s32_s8(b_chunks[2 * s]);
+                        int32x4_t k_hi = vreinterpretq_s32_s8(b_chunks[2 * s + 1]);
+                        b_cols01[s] = vreinterpretq_s8_s32(vzip1q_s32(k_lo, k_hi));
+                        b_cols23[s] = vreinterpretq_s8_s32(vzip2q_s32(k_lo, k_hi));
+                    }
+
+                    for (size_t mi = 0; mi < actual_m; mi += 2) {
+                        const int8_t* a_row0 = A + (m_start + mi) * K + k_base;
+                        const int8_t* a_row1 = (mi + 1 < actual_m) ? a_row0 + K : a_row0;
+
+                        int32x4_t acc01 = vdupq_n_s32(0);
+                        int32x4_t acc23 = vdupq_n_s32(0);
+
+                        for (size_t s = 0; s < 4; s++) {
+                            int8x16_t a_rows = vcombine_s8(vld1_s8(a_row0 + s * 8), vld1_s8(a_row1 + s * 8));
+                            acc01 = vmmlaq_s32(acc01, a_rows, b_cols01[s]);
+                            acc23 = vmmlaq_s32(acc23, a_rows, b_cols23[s]);
+                        }
+
+                        int64x2_t tile01 = vreinterpretq_s64_s32(acc01);
+                        int64x2_t tile23 = vreinterpretq_s64_s32(acc23);
+                        int32x4_t row0 = vreinterpretq_s32_s64(vzip1q_s64(tile01, tile23));
+                        running_sum[mi] = vmlaq_f32(running_sum[mi], vcvtq_f32_s32(row0), scales);
+
+                        if (mi + 1 < actual_m) {
+                            int32x4_t row1 = vreinterpretq_s32_s64(vzip2q_s64(tile01, tile23));
+                            running_sum[mi + 1] = vmlaq_f32(running_sum[mi + 1], vcvtq_f32_s32(row1), scales);
+                        }
+                    }
+#else
+                    for (size_t mi = 0; mi < actual_m; mi++) {
+                        const int8_t* a_ptr = A + (m_start + mi) * K + k_base;
+                        int32x4_t acc = dot_group(vdupq_n_s32(0), a_ptr, b_chunks);
+                        running_sum[mi] = vmlaq_f32(running_sum[mi], vcvtq_f32_s32(acc), scales);
+                    }
+#endif
+                }
+
+                for (size_t mi = 0; mi < actual_m; mi++) {
+                    const float a_scale = A_scales[m_start + mi];
+                    float32x4_t result = vmulq_n_f32(running_sum[mi], a_scale);
+                    float16x4_t result_f16 = vcvt_f16_f32(result);
+
+                    if (actual_n == 4) {
+                        vst1_f16(C + (m_start + mi) * N + n_start, result_f16);
+                    } else {
+                        for (size_t ni = 0; ni < actual_n; ni++) {
+                            C[(m_start + mi) * N + n_start + ni] = vget_lane_f16(result_f16, 0);
+                            result_f16 = vext_f16(result_f16, result_f16, 1);
+                        }
+                    }
+                }
+            }
+        });
+}
+
+}
+
+void gemv_int8(
+    const int8_t* A,
+    const float A_scale,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t K, size_t N,
+    size_t group_size
+) {
+    gemv_grouped<Int8Weights>(A, A_scale, B, B_scales, C, K, N, group_size);
+}
+
+void gemm_int8(
+    const int8_t* A,
+    const float* A_scales,
+    const int8_t* B,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t M, size_t K, size_t N,
+    size_t group_size
+) {
+    gemm_grouped<Int8Weights>(A, A_scales, B, B_scales, C, M, K, N, group_size);
+}
+
+void gemv_int4(
+    const int8_t* A,
+    const float A_scale,
+    const uint8_t* B_packed,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t K, size_t N,
+    size_t group_size
+) {
+    gemv_grouped<Int4Weights>(A, A_scale, reinterpret_cast<const int8_t*>(B_packed),
+                              B_scales, C, K, N, group_size);
+}
+
+void gemm_int4(
+    const int8_t* A,
+    const float* A_scales,
+    const uint8_t* B_packed,
+    const __fp16* B_scales,
+    __fp16* C,
+    size_t M, size_t K, size_t N,
+    size_t group_size
+) {
+    gemm_grouped<Int4Weights>(A, A_scales, reinterpret_cast<const int8_t*>(B_packed),
+                              B_scales, C, M, K, N, group_size);
+}
+
+}
+}
@@ -1,8 +1,9 @@
 #include "kernel.h"
 #include "kernel_utils.h"
-#include <arm_neon.h>
+#include "kernel_simd.h"
 #include <cmath>
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <cstring>
 #include <limits>
@@ -43,6 +44,37 @@ void cactus_silu_f16(const __fp16* input, __fp16* output, size_t num_elements) {
         });
 }
 
+void cactus_silu_mul_f16(const __fp16* gate, const __fp16* up, __fp16* output, size_t num_elements) {
+    CactusThreading::parallel_for(num_elements, CactusThreading::Thresholds::SCALAR_EXPENSIVE,
+        [&](size_t start_idx, size_t end_idx) {
+            constexpr size_t SIMD_WIDTH = 8;
+            const size_t vectorized_end = start_idx + ((end_idx - start_idx) / SIMD_WIDTH) * SIMD_WIDTH;
+            const float32x4_t one_f32 = vdupq_n_f32(1.0f);
+
+            for (size_t i = start_idx; i < vectorized_end; i += SIMD_WIDTH) {
+                float16x8_t g = vld1q_f16(&gate[i]);
+                float16x8_t u = vld1q_f16(&up[i]);
+
+                float32x4_t g_low = vcvt_f32_f16(vget_low_f16(g));
+                float32x4_t g_high = vcvt_f32_f16(vget_high_f16(g));
+
+                float32x4_t sigmoid_low = vdivq_f32(one_f32, vaddq_f32(one_f32, fast_exp_f32x4(vnegq_f32(g_low))));
+                float32x4_t sigmoid_high = vdivq_f32(one_f32, vaddq_f32(one_f32, fast_exp_f32x4(vnegq_f32(g_high))));
+
+                float32x4_t out_low = vmulq_f32(vmulq_f32(g_low, sigmoid_low), vcvt_f32_f16(vget_low_f16(u)));
+                float32x4_t out_high = vmulq_f32(vmulq_f32(g_high, sigmoid_high), vcvt_f32_f16(vget_high_f16(u)));
+
+                vst1q_f16(&output[i], vcombine_f16(vcvt_f16_f32(out_low), vcvt_f16_f32(out_high)));
+            }
+
+            for (size_t i = vectorized_end; i < end_idx; ++i) {
+                float g_f32 = static_cast<float>(gate[i]);
+                float sigmoid = 1.0f / (1.0f + expf(-g_f32));
+                output[i] = static_cast<__fp16>(g_f32 * sigmoid * static_cast<float>(up[i]));
+            }
+        });
+}
+
 void cactus_gelu_f16(const __fp16* input, __fp16* output, size_t num_elements) {
     const float sqrt_2_over_pi = 0.7978845608028654f;
     const float coeff = 0.044715f;
@@ -276,402 +308,516 @@ void cactus_softmax_f16(
         });
 }
 
-void cactus_sample_f32(const float* logits, uint32_t* output, size_t vocab_size,
-                       float temperature, float top_p, size_t top_k, size_t random_seed,
-                       const float* bias_values, const uint32_t* bias_indices,
-                       size_t bias_count) {
+namespace {
+
+constexpr float SAMPLE_MIN_P = 0.15f;
+// Without min-p, tokens this far below the best logit are dropped before any sorting: each
+// carries under 1e-13 of the best token's probability.
+constexpr float SAMPLE_LOGIT_FLOOR = 30.0f;
+constexpr size_t SAMPLE_HISTORY = 128;
+constexpr float SAMPLE_REPETITION_PENALTY = 1.1f;
+constexpr size_t SAMPLE_TILE = 256;
+constexpr size_t SAMPLE_PRUNE_CANDIDATES = 1024;
+
+// Per-thread buffers reused across calls, so sampling a token does not touch the heap.
+struct SamplerScratch {
+    std::vector<float> logits;
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> candidates;
+    std::vector<float> weights;
+};
+
+SamplerScratch& sampler_scratch(size_t vocab_size) {
+    static thread_local SamplerScratch scratch;
+    if (scratch.logits.size() < vocab_size) {
+        scratch.logits.resize(vocab_size);
+        scratch.candidates.reserve(vocab_size);
+        scratch.weights.reserve(vocab_size);
+    }
+    scratch.candidates.clear();
+    scratch.weights.clear();
+    return scratch;
+}
 
-    if (temperature == 0.0f && top_p <= 0.0f && top_k == 0) {
-        if (vocab_size == 0) {
-            output[0] = 0;
-            return;
-        }
-        size_t best_idx = 0;
-        float best_val = logits[0];
-        for (size_t i = 1; i < vocab_size; ++i) {
-            float val = logits[i];
-            if (val > best_val) {
-                best_val = val;
-                best_idx = i;
-            }
-        }
-        output[0] = static_cast<uint32_t>(best_idx);
+// logits holds vocabulary entries [start, start + count).
+void add_logit_bias(float* logits, size_t start, size_t count, const float* bias_values,
+                    const uint32_t* bias_indices, size_t bias_count) {
+    if (!bias_values || !bias_indices) {
         return;
     }
-
-    std::vector<float> filtered_logits(vocab_size);
-
-    for (size_t i = 0; i < vocab_size; ++i) {
-        filtered_logits[i] = logits[i];
-    }
-
-    if (bias_values && bias_indices && bias_count > 0) {
-        for (size_t i = 0; i < bias_count; ++i) {
-            uint32_t idx = bias_indices[i];
-            if (idx < vocab_size) {
-                filtered_logits[idx] += bias_values[i];
-            }
+    for (size_t i = 0; i < bias_count; ++i) {
+        if (bias_indices[i] >= start && bias_indices[i] - start < count) {
+            logits[bias_indices[i] - start] += bias_values[i];
         }
     }
+}
 
-    if (temperature > 0) {
-        for (size_t i = 0; i < vocab_size; ++i) {
-            filtered_logits[i] /= temperature;
-        }
+void scale_logits(float* logits, size_t vocab_size, float temperature) {
+    if (temperature <= 0.0f) {
+        return;
     }
-    
-    if (top_k > 0) {
-        std::vector<std::pair<float, size_t>> logit_pairs;
-        logit_pairs.reserve(vocab_size);
-        for (size_t i = 0; i < vocab_size; ++i) {
-            logit_pairs.emplace_back(filtered_logits[i], i);
-        }
-        std::sort(logit_pairs.begin(), logit_pairs.end(), 
-                  [](const auto& a, const auto& b) { return a.first > b.first; });
-        
-        if (top_k < vocab_size) {
-            float kth_value = logit_pairs[top_k - 1].first;
-            for (size_t i = 0; i < vocab_size; ++i) {
-                if (filtered_logits[i] < kth_value) {
-                    filtered_logits[i] = -std::numeric_limits<float>::infinity();
-                }
-            }
-        }
+    const float inv_temp = 1.0f / temperature;
+    const float32x4_t inv_temp_vec = vdupq_n_f32(inv_temp);
+    size_t i = 0;
+    for (; i + 4 <= vocab_size; i += 4) {
+        vst1q_f32(logits + i, vmulq_f32(vld1q_f32(logits + i), inv_temp_vec));
     }
-    
-    constexpr float min_p = 0.15f;
-    if (min_p > 0.0f) {
-        float max_logit = *std::max_element(filtered_logits.begin(), filtered_logits.end());
-        if (!std::isinf(max_logit)) {
-            std::vector<float> temp_probs(vocab_size);
-            float sum = 0.0f;
-            for (size_t i = 0; i < vocab_size; ++i) {
-                if (!std::isinf(filtered_logits[i])) {
-                    temp_probs[i] = std::exp(filtered_logits[i] - max_logit);
-                    sum += temp_probs[i];
-                } else {
-                    temp_probs[i] = 0.0f;
-                }
-            }
-
-            if (sum > 0.0f) {
-                for (size_t i = 0; i < vocab_size; ++i) {
-                    temp_probs[i] /= sum;
-                }
+    for (; i < vocab_size; ++i) {
+        logits[i] *= inv_temp;
+    }
+}
 
-                float max_prob = *std::max_element(temp_probs.begin(), temp_probs.end());
-                float threshold = max_prob * min_p;
+float max_logit(const float* logits, size_t vocab_size) {
+    float32x4_t max0 = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    float32x4_t max1 = max0, max2 = max0, max3 = max0;
+    size_t i = 0;
+    for (; i + 16 <= vocab_size; i += 16) {
+        max0 = vmaxq_f32(max0, vld1q_f32(logits + i));
+        max1 = vmaxq_f32(max1, vld1q_f32(logits + i + 4));
+        max2 = vmaxq_f32(max2, vld1q_f32(logits + i + 8));
+        max3 = vmaxq_f32(max3, vld1q_f32(logits + i + 12));
+    }
+    float best = vmaxvq_f32(vmaxq_f32(vmaxq_f32(max0, max1), vmaxq_f32(max2, max3)));
+    for (; i < vocab_size; ++i) {
+        best = std::max(best, logits[i]);
+    }
+    return best;
+}
 
-                for (size_t i = 0; i < vocab_size; ++i) {
-                    if (temp_probs[i] < threshold) {
-                        filtered_logits[i] = -std::numeric_limits<float>::infinity();
-                    }
-                }
+// Blocks of 16 whose maximum is under the floor are skipped without looking at each token.
+void collect_candidates(const float* logits, size_t vocab_size, float floor, std::vector<uint32_t>& candidates) {
+    size_t i = 0;
+    for (; i + 16 <= vocab_size; i += 16) {
+        float32x4_t block = vmaxq_f32(vmaxq_f32(vld1q_f32(logits + i), vld1q_f32(logits + i + 4)),
+                                      vmaxq_f32(vld1q_f32(logits + i + 8), vld1q_f32(logits + i + 12)));
+        if (vmaxvq_f32(block) < floor) {
+            continue;
+        }
+        for (size_t j = i; j < i + 16; ++j) {
+            if (logits[j] >= floor) {
+                candidates.push_back(static_cast<uint32_t>(j));
             }
         }
     }
-
-    if (top_p > 0.0f && top_p < 1.0f) {
-        std::vector<std::pair<float, size_t>> sorted_logits;
-        sorted_logits.reserve(vocab_size);
-        for (size_t i = 0; i < vocab_size; ++i) {
-            if (!std::isinf(filtered_logits[i])) {
-                sorted_logits.emplace_back(filtered_logits[i], i);
-            }
-        }
-        std::sort(sorted_logits.begin(), sorted_logits.end(),
-                  [](const auto& a, const auto& b) { return a.first > b.first; });
-
-        float max_logit = sorted_logits.empty() ? 0.0f : sorted_logits[0].first;
-        std::vector<float> temp_probs;
-        temp_probs.reserve(sorted_logits.size());
-        float sum = 0.0f;
-        for (const auto& pair : sorted_logits) {
-            float prob = std::exp(pair.first - max_logit);
-            temp_probs.push_back(prob);
-            sum += prob;
-        }
-
-        for (float& prob : temp_probs) {
-            prob /= sum;
-        }
-
-        float cumulative_prob = 0.0f;
-        std::vector<bool> indices_to_remove(sorted_logits.size(), false);
-        for (size_t i = 0; i < sorted_logits.size(); ++i) {
-            cumulative_prob += temp_probs[i];
-            if (cumulative_prob > top_p) {
-                indices_to_remove[i] = true;
-            }
+    for (; i < vocab_size; ++i) {
+        if (logits[i] >= floor) {
+            candidates.push_back(static_cast<uint32_t>(i));
         }
+    }
+}
 
-        if (!indices_to_remove.empty()) {
-            for (size_t i = 1; i < indices_to_remove.size(); ++i) {
-                indices_to_remove[i] = indices_to_remove[i-1] || indices_to_remove[i];
+// Narrows scratch.candidates to the indices of logits[0, count) the sampler may draw and fills
+// scratch.weights with their normalized probabilities. min-p is a fixed logit offset from the
+// best token, so it becomes the pre-filter; top-k is a selection and top-p sorts only the
+// survivors. Equal logits are ordered by index, so the draw depends only on the values.
+bool select_candidates(SamplerScratch& scratch, const float* logits, size_t count,
+                       float min_p, float top_p, size_t top_k) {
+    const float best = max_logit(logits, count);
+    if (std::isnan(best) || best == -std::numeric_limits<float>::infinity()) {
+        return false;
+    }
+
+    const float floor = min_p > 0.0f ? best + std::log(min_p) : best - SAMPLE_LOGIT_FLOOR;
+    auto& candidates = scratch.candidates;
+    collect_candidates(logits, count, floor, candidates);
+    auto by_logit = [logits](uint32_t a, uint32_t b) {
+        return logits[a] > logits[b] || (logits[a] == logits[b] && a < b);
+    };
+
+    if (top_k > 0 && candidates.size() > top_k) {
+        std::nth_element(candidates.begin(), candidates.begin() + (top_k - 1), candidates.end(), by_logit);
+        const float kth = logits[candidates[top_k - 1]];
+        auto kept = std::partition(candidates.begin() + top_k, candidates.end(),
+                                   [logits, kth](uint32_t token) { return logits[token] >= kth; });
+        candidates.erase(kept, candidates.end());
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    auto& weights = scratch.weights;
+    weights.resize(candidates.size());
+    float sum = 0.0f;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        weights[i] = std::exp(logits[candidates[i]] - best);
+        sum += weights[i];
+    }
+
+    // The token that pushes the mass past top_p is dropped too, but the best token always stays.
+    // Only a growing head of the candidates is ordered, so a flat tail is never fully sorted.
+    if (top_p > 0.0f && top_p < 1.0f && candidates.size() > 1) {
+        float cumulative = 0.0f;
+        size_t kept = candidates.size();
+        size_t sorted = 0;
+        size_t head = std::min<size_t>(256, candidates.size());
+        while (sorted < candidates.size() && kept == candidates.size()) {
+            std::nth_element(candidates.begin() + sorted, candidates.begin() + (head - 1), candidates.end(), by_logit);
+            std::sort(candidates.begin() + sorted, candidates.begin() + head, by_logit);
+            for (size_t i = sorted; i < head; ++i) {
+                weights[i] = std::exp(logits[candidates[i]] - best);
+                cumulative += weights[i] / sum;
+                if (cumulative > top_p && i > 0) {
+                    kept = i;
+                    break;
+                }
             }
-            indices_to_remove[0] = false;
+            sorted = head;
+            head = std::min(head * 2, candidates.size());
         }
-
-        for (size_t i = 0; i < sorted_logits.size(); ++i) {
-            if (indices_to_remove[i]) {
-                filtered_logits[sorted_logits[i].second] = -std::numeric_limits<float>::infinity();
-            }
+        candidates.resize(kept);
+        weights.resize(kept);
+        sum = 0.0f;
+        for (float weight : weights) {
+            sum += weight;
         }
     }
-    
-    float max_logit = *std::max_element(filtered_logits.begin(), filtered_logits.end());
-    if (std::isinf(max_logit)) {
-        output[0] = 0;
-        return;
-    }
-    
-    std::vector<float> probs(vocab_size);
-    float sum = 0.0f;
-    for (size_t i = 0; i < vocab_size; ++i) {
-        if (std::isinf(filtered_logits[i])) {
-            probs[i] = 0.0f;
-        } else {
-            probs[i] = std::exp(filtered_logits[i] - max_logit);
-            sum += probs[i];
-        }
-    }
-    
-    if (sum == 0.0f) {
-        output[0] = 0;
-        return;
+
+    if (candidates.empty() || sum <= 0.0f) {
+        return false;
     }
-    
-    for (size_t i = 0; i < vocab_size; ++i) {
-        probs[i] /= sum;
+    for (float& weight : weights) {
+        weight /= sum;
     }
-    
+    return true;
+}
+
+uint32_t draw_candidate(const SamplerScratch& scratch, size_t random_seed) {
     uint32_t actual_seed = (random_seed == 0) ? std::random_device{}() : random_seed;
     std::mt19937 gen(actual_seed);
     std::uniform_real_distribution<float> dist(0.0f, 1.0f);
     float sample = dist(gen);
-    
+
     float cumulative = 0.0f;
-    for (size_t i = 0; i < vocab_size; ++i) {
-        cumulative += probs[i];
+    for (size_t i = 0; i < scratch.candidates.size(); ++i) {
+        cumulative += scratch.weights[i];
         if (cumulative >= sample) {
-            output[0] = static_cast<uint32_t>(i);
-            return;
+            return scratch.candidates[i];
         }
     }
-    
-    for (size_t i = vocab_size; i > 0; --i) {
-        if (probs[i-1] > 0.0f) {
-            output[0] = static_cast<uint32_t>(i-1);
-            return;
+    return scratch.candidates.back();
+}
+
+template <typename T>
+uint32_t argmax_logit(const T* logits, size_t vocab_size) {
+    size_t best_idx = 0;
+    float best_val = static_cast<float>(logits[0]);
+    for (size_t i = 1; i < vocab_size; ++i) {
+        float val = static_cast<float>(logits[i]);
+        if (val > best_val) {
+            best_val = val;
+            best_idx = i;
         }
     }
-    
-    output[0] = 0;
+    return static_cast<uint32_t>(best_idx);
 }
 
-void cactus_sample_f16(const __fp16* logits, uint32_t* output, size_t vocab_size,
-                       float temperature, float top_p, size_t top_k, size_t random_seed,
-                       const float* bias_values, const uint32_t* bias_indices,
-                       size_t bias_count) {
+bool is_greedy(float temperature, float top_p, size_t top_k) {
+    return temperature == 0.0f && top_p <= 0.0f && top_k == 0;
+}
 
-    if (temperature == 0.0f && top_p <= 0.0f && top_k == 0) {
-        if (vocab_size == 0) {
-            output[0] = 0;
-            return;
-        }
-        size_t best_idx = 0;
-        float best_val = static_cast<float>(logits[0]);
-        for (size_t i = 1; i < vocab_size; ++i) {
-            float val = static_cast<float>(logits[i]);
-            if (val > best_val) {
-                best_val = val;
-                best_idx = i;
-            }
-        }
-        output[0] = static_cast<uint32_t>(best_idx);
-        return;
-    }
+// Tokens recently drawn by the FP16 sampler; each is penalized on the following draws.
+std::vector<uint32_t>& sample_history() {
+    static std::vector<uint32_t> history;
+    return history;
+}
 
-    std::vector<__fp16> filtered_logits(vocab_size);
+void record_sampled_token(uint32_t token) {
+    auto& history = sample_history();
+    history.push_back(token);
+    if (history.size() > SAMPLE_HISTORY) {
+        history.erase(history.begin());
+    }
+}
 
-    std::memcpy(filtered_logits.data(), logits, vocab_size * sizeof(__fp16));
+void widen_logits(const __fp16* src, float* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x8_t logits_vec = vld1q_f16(src + i);
+        vst1q_f32(dst + i, vcvt_f32_f16(vget_low_f16(logits_vec)));
+        vst1q_f32(dst + i + 4, vcvt_f32_f16(vget_high_f16(logits_vec)));
+    }
+    for (; i < count; ++i) {
+        dst[i] = static_cast<float>(src[i]);
+    }
+}
 
-    if (bias_values && bias_indices && bias_count > 0) {
-        for (size_t i = 0; i < bias_count; ++i) {
-            uint32_t idx = bias_indices[i];
-            if (idx < vocab_size) {
-                filtered_logits[idx] = static_cast<__fp16>(static_cast<float>(filtered_logits[idx]) + bias_values[i]);
-            }
+// What the FP16 sampler filters for entries [start, start + count): bias, temperature, then
+// the repetition penalty.
+void adjust_f16_logits(float* logits, size_t start, size_t count, float temperature,
+                       const float* bias_values, const uint32_t* bias_indices, size_t bias_count) {
+    add_logit_bias(logits, start, count, bias_values, bias_indices, bias_count);
+    scale_logits(logits, count, temperature);
+    for (uint32_t token : sample_history()) {
+        if (token >= start && token - start < count) {
+            float& logit = logits[token - start];
+            logit = logit > 0.0f ? logit / SAMPLE_REPETITION_PENALTY : logit * SAMPLE_REPETITION_PENALTY;
         }
     }
+}
 
-    if (temperature > 0) {
-        __fp16 inv_temp = static_cast<__fp16>(1.0f / temperature);
-        float16x8_t inv_temp_vec = vdupq_n_f16(inv_temp);
-        size_t i = 0;
-        for (; i + 8 <= vocab_size; i += 8) {
-            float16x8_t logits_vec = vld1q_f16(&logits[i]);
-            float16x8_t scaled = vmulq_f16(logits_vec, inv_temp_vec);
-            vst1q_f16(&filtered_logits[i], scaled);
+// The entropy terms are kept relative to raw_max: raw_sum_exp = sum(exp(l - max)) and
+// raw_sum_exp_logit = sum(exp(l - max) * (l - max)), rescaled whenever the max moves.
+void accumulate_entropy(const float* logits, size_t count, CactusSamplePartial& partial) {
+    const float tile_max = max_logit(logits, count);
+    if (tile_max > partial.raw_max) {
+        if (partial.raw_sum_exp > 0.0) {
+            const double shift = static_cast<double>(partial.raw_max) - tile_max;
+            const double scale = std::exp(shift);
+            partial.raw_sum_exp_logit = scale * (partial.raw_sum_exp_logit + shift * partial.raw_sum_exp);
+            partial.raw_sum_exp *= scale;
         }
-        for (; i < vocab_size; ++i) {
-            filtered_logits[i] = logits[i] * inv_temp;
-        }
-    } else {
-        std::memcpy(filtered_logits.data(), logits, vocab_size * sizeof(__fp16));
+        partial.raw_max = tile_max;
+    }
+    if (partial.raw_max == -std::numeric_limits<float>::infinity()) {
+        return;
     }
 
-    static std::vector<uint32_t> token_history;
-    static const size_t MAX_HISTORY = 128; 
-    static const float REPETITION_PENALTY = 1.1f;
-
-    if (!token_history.empty() && REPETITION_PENALTY != 1.0f) {
-        const __fp16 penalty_inv = static_cast<__fp16>(1.0f / REPETITION_PENALTY);
-        const __fp16 penalty = static_cast<__fp16>(REPETITION_PENALTY);
+    // Terms below exp(-87) are under float resolution; clamping keeps -inf logits out of the sums.
+    const float32x4_t max_vec = vdupq_n_f32(partial.raw_max);
+    const float32x4_t lowest = vdupq_n_f32(-87.0f);
+    float32x4_t sum_vec = vdupq_n_f32(0.0f);
+    float32x4_t weighted_vec = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t shifted = vmaxq_f32(vsubq_f32(vld1q_f32(logits + i), max_vec), lowest);
+        float32x4_t e = fast_exp_f32x4(shifted);
+        sum_vec = vaddq_f32(sum_vec, e);
+        weighted_vec = vfmaq_f32(weighted_vec, e, shifted);
+    }
+    double sum = vaddvq_f32(sum_vec);
+    double weighted = vaddvq_f32(weighted_vec);
+    for (; i < count; ++i) {
+        float shifted = std::max(logits[i] - partial.raw_max, -87.0f);
+        float e = std::exp(shifted);
+        sum += e;
+        weighted += e * shifted;
+    }
+    partial.raw_sum_exp += sum;
+    partial.raw_sum_exp_logit += weighted;
+}
 
-        for (uint32_t prev_token : token_history) {
-            if (prev_token < vocab_size) {
-                filtered_logits[prev_token] = (filtered_logits[prev_token] > static_cast<__fp16>(0))
-                    ? static_cast<__fp16>(filtered_logits[prev_token] * penalty_inv)
-                    : static_cast<__fp16>(filtered_logits[prev_token] * penalty);
-            }
-        }
+float merged_entropy(const CactusSamplePartial* partials, size_t num_partials, size_t vocab_size) {
+    if (vocab_size < 2) {
+        return 0.0f;
     }
-
-    if (top_k > 0) {
-        std::vector<std::pair<__fp16, size_t>> logit_pairs;
-        logit_pairs.reserve(vocab_size);
-        for (size_t i = 0; i < vocab_size; ++i) {
-            logit_pairs.emplace_back(filtered_logits[i], i);
-        }
-        std::partial_sort(logit_pairs.begin(),
-                         logit_pairs.begin() + std::min(top_k, vocab_size),
-                         logit_pairs.end(),
-                         [](const auto& a, const auto& b) { return a.first > b.first; });
-
-        if (top_k < vocab_size) {
-            __fp16 kth_value = logit_pairs[top_k - 1].first;
-            __fp16 neg_inf = static_cast<__fp16>(-std::numeric_limits<float>::infinity());
-            for (size_t i = 0; i < vocab_size; ++i) {
-                if (filtered_logits[i] < kth_value) {
-                    filtered_logits[i] = neg_inf;
-                }
-            }
+    float max = -std::numeric_limits<float>::infinity();
+    for (size_t p = 0; p < num_partials; ++p) {
+        max = std::max(max, partials[p].raw_max);
+    }
+    double sum = 0.0;
+    double weighted = 0.0;
+    for (size_t p = 0; p < num_partials; ++p) {
+        const auto& partial = partials[p];
+        if (partial.raw_sum_exp <= 0.0) {
+            continue;
         }
+        const double shift = static_cast<double>(partial.raw_max) - max;
+        const double scale = std::exp(shift);
+        sum += scale * partial.raw_sum_exp;
+        weighted += scale * (partial.raw_sum_exp_logit + shift * partial.raw_sum_exp);
+    }
+    if (sum <= 0.0) {
+        return 0.0f;
     }
+    const double entropy = std::log(sum) - weighted / sum;
+    return static_cast<float>(std::max(0.0, entropy) / std::log(static_cast<double>(vocab_size)));
+}
 
-    if (top_p > 0.0f && top_p < 1.0f) {
-        std::vector<std::pair<__fp16, size_t>> sorted_logits;
-        sorted_logits.reserve(vocab_size);
-        __fp16 neg_inf = static_cast<__fp16>(-std::numeric_limits<float>::infinity());
-        for (size_t i = 0; i < vocab_size; ++i) {
-            if (filtered_logits[i] != neg_inf) {
-                sorted_logits.emplace_back(filtered_logits[i], i);
-            }
-        }
-        std::sort(sorted_logits.begin(), sorted_logits.end(),
-                  [](const auto& a, const auto& b) { return a.first > b.first; });
-
-        __fp16 max_logit = sorted_logits.empty() ? static_cast<__fp16>(0.0f) : sorted_logits[0].first;
-        std::vector<float> temp_probs;
-        temp_probs.reserve(sorted_logits.size());
-        float sum = 0.0f;
-        for (const auto& pair : sorted_logits) {
-            float prob = std::exp(static_cast<float>(pair.first - max_logit));
-            temp_probs.push_back(prob);
-            sum += prob;
-        }
+// Drops candidates that can no longer be drawn: those under the floor of the best logit seen
+// so far and, with top-k, those under this partial's k-th logit, which the row's k-th logit
+// can only exceed. Order is kept, so the tokens stay ascending.
+void prune_candidates(CactusSamplePartial& partial, size_t top_k) {
+    float floor = partial.best - SAMPLE_LOGIT_FLOOR;
+    if (top_k > 0 && partial.tokens.size() > top_k) {
+        auto& values = sampler_scratch(0).weights;
+        values.assign(partial.logits.begin(), partial.logits.end());
+        std::nth_element(values.begin(), values.begin() + (top_k - 1), values.end(), std::greater<float>());
+        floor = std::max(floor, values[top_k - 1]);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < partial.tokens.size(); ++i) {
+        if (partial.logits[i] >= floor) {
+            partial.tokens[kept] = partial.tokens[i];
+            partial.logits[kept] = partial.logits[i];
+            ++kept;
+        }
+    }
+    partial.tokens.resize(kept);
+    partial.logits.resize(kept);
+    partial.prune_at = std::max(SAMPLE_PRUNE_CANDIDATES, 2 * std::max(kept, top_k));
+}
 
-        for (float& prob : temp_probs) {
-            prob /= sum;
-        }
+}
 
-        float cumulative_prob = 0.0f;
-        std::vector<bool> indices_to_remove(sorted_logits.size(), false);
-        bool threshold_reached = false;
-        for (size_t i = 0; i < sorted_logits.size(); ++i) {
-            cumulative_prob += temp_probs[i];
-            if (cumulative_prob > top_p && i > 0) { 
-                threshold_reached = true;
-            }
-            if (threshold_reached) {
-                indices_to_remove[i] = true;
-            }
-        }
+bool cactus_sample_probs_f32(const float* logits, float* probs, size_t vocab_size,
+                             float temperature, float top_p, size_t top_k,
+                             const float* bias_values, const uint32_t* bias_indices,
+                             size_t bias_count) {
+    if (vocab_size == 0) {
+        return false;
+    }
 
-        if (!indices_to_remove.empty()) {
-            for (size_t i = 1; i < indices_to_remove.size(); ++i) {
-                indices_to_remove[i] = indices_to_remove[i-1] || indices_to_remove[i];
-            }
-            indices_to_remove[0] = false;
-        }
-        
-        for (size_t i = 0; i < sorted_logits.size(); ++i) {
-            if (indices_to_remove[i]) {
-                filtered_logits[sorted_logits[i].second] = neg_inf;
-            }
-        }
+    auto& scratch = sampler_scratch(vocab_size);
+    std::memcpy(scratch.logits.data(), logits, vocab_size * sizeof(float));
+    add_logit_bias(scratch.logits.data(), 0, vocab_size, bias_values, bias_indices, bias_count);
+    scale_logits(scratch.logits.data(), vocab_size, temperature);
+    if (!select_candidates(scratch, scratch.logits.data(), vocab_size, SAMPLE_MIN_P, top_p, top_k)) {
+        return false;
+    }
+
+    std::memset(probs, 0, vocab_size * sizeof(float));
+    for (size_t i = 0; i < scratch.candidates.size(); ++i) {
+        probs[scratch.candidates[i]] = scratch.weights[i];
     }
-    
-    __fp16 max_logit = *std::max_element(filtered_logits.begin(), filtered_logits.end());
-    __fp16 neg_inf = static_cast<__fp16>(-std::numeric_limits<float>::infinity());
-    if (max_logit == neg_inf) {
+    return true;
+}
+
+void cactus_sample_f32(const float* logits, uint32_t* output, size_t vocab_size,
+                       float temperature, float top_p, size_t top_k, size_t random_seed,
+                       const float* bias_values, const uint32_t* bias_indices,
+                       size_t bias_count) {
+    if (vocab_size == 0) {
         output[0] = 0;
         return;
     }
-    
-    std::vector<float> probs(vocab_size);
-    float sum = 0.0f;
-    for (size_t i = 0; i < vocab_size; ++i) {
-        if (filtered_logits[i] == neg_inf) {
-            probs[i] = 0.0f;
-        } else {
-            probs[i] = std::exp(static_cast<float>(filtered_logits[i] - max_logit));
-            sum += probs[i];
-        }
+    if (temperature == 0.0f && top_p <= 0.0f && top_k == 0) {
+        output[0] = argmax_logit(logits, vocab_size);
+        return;
     }
 
-    if (sum == 0.0f) {
+    auto& scratch = sampler_scratch(vocab_size);
+    std::memcpy(scratch.logits.data(), logits, vocab_size * sizeof(float));
+    add_logit_bias(scratch.logits.data(), 0, vocab_size, bias_values, bias_indices, bias_count);
+    scale_logits(scratch.logits.data(), vocab_size, temperature);
+    if (!select_candidates(scratch, scratch.logits.data(), vocab_size, SAMPLE_MIN_P, top_p, top_k)) {
         output[0] = 0;
         return;
     }
+    output[0] = draw_candidate(scratch, random_seed);
+}
 
-    for (size_t i = 0; i < vocab_size; ++i) {
-        probs[i] /= sum;
+void cactus_sample_f16(const __fp16* logits, uint32_t* output, size_t vocab_size,
+                       float temperature, float top_p, size_t top_k, size_t random_seed,
+                       const float* bias_values, const uint32_t* bias_indices,
+                       size_t bias_count) {
+    if (vocab_size == 0) {
+        output[0] = 0;
+        return;
+    }
+    if (is_greedy(temperature, top_p, top_k)) {
+        output[0] = argmax_logit(logits, vocab_size);
+        return;
     }
 
-    uint32_t actual_seed = (random_seed == 0) ? std::random_device{}() : random_seed;
-    std::mt19937 gen(actual_seed);
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-    float sample = dist(gen);
+    auto& scratch = sampler_scratch(vocab_size);
+    float* scaled = scratch.logits.data();
+    widen_logits(logits, scaled, vocab_size);
+    adjust_f16_logits(scaled, 0, vocab_size, temperature, bias_values, bias_indices, bias_count);
 
-    float cumulative = 0.0f;
-    for (size_t i = 0; i < vocab_size; ++i) {
-        cumulative += probs[i];
-        if (cumulative >= sample) {
-            output[0] = static_cast<uint32_t>(i);
-            token_history.push_back(output[0]);
-            if (token_history.size() > MAX_HISTORY) {
-                token_history.erase(token_history.begin());
+    output[0] = select_candidates(scratch, scaled, vocab_size, 0.0f, top_p, top_k) ? draw_candidate(scratch, random_seed) : 0;
+    record_sampled_token(output[0]);
+}
+
+float cactus_normalized_entropy_f32(const float* logits, size_t vocab_size) {
+    CactusSamplePartial partial;
+    accumulate_entropy(logits, vocab_size, partial);
+    return merged_entropy(&partial, 1, vocab_size);
+}
+
+float cactus_normalized_entropy_f16(const __fp16* logits, size_t vocab_size) {
+    CactusSamplePartial partial;
+    float tile[SAMPLE_TILE];
+    for (size_t start = 0; start < vocab_size; start += SAMPLE_TILE) {
+        const size_t count = std::min(SAMPLE_TILE, vocab_size - start);
+        widen_logits(logits + start, tile, count);
+        accumulate_entropy(tile, count, partial);
+    }
+    return merged_entropy(&partial, 1, vocab_size);
+}
+
+void cactus_sample_tile_f16(const __fp16* logits, size_t start, size_t count, CactusSamplePartial& partial,
+                            float temperature, float top_p, size_t top_k,
+                            const float* bias_values, const uint32_t* bias_indices, size_t bias_count,
+                            bool with_entropy) {
+    const bool greedy = is_greedy(temperature, top_p, top_k);
+    float tile[SAMPLE_TILE];
+    for (size_t offset = 0; offset < count; offset += SAMPLE_TILE) {
+        const size_t n = std::min(SAMPLE_TILE, count - offset);
+        const size_t first = start + offset;
+        widen_logits(logits + offset, tile, n);
+        if (with_entropy) {
+            accumulate_entropy(tile, n, partial);
+        }
+
+        // Greedy keeps only the first maximum of the raw logits, like argmax_logit.
+        if (greedy) {
+            for (size_t i = 0; i < n; ++i) {
+                if (partial.tokens.empty()) {
+                    partial.tokens.push_back(static_cast<uint32_t>(first + i));
+                    partial.logits.push_back(tile[i]);
+                } else if (tile[i] > partial.logits[0]) {
+                    partial.tokens[0] = static_cast<uint32_t>(first + i);
+                    partial.logits[0] = tile[i];
+                }
+            }
+            continue;
+        }
+
+        adjust_f16_logits(tile, first, n, temperature, bias_values, bias_indices, bias_count);
+        partial.best = std::max(partial.best, max_logit(tile, n));
+        const float floor = partial.best - SAMPLE_LOGIT_FLOOR;
+        for (size_t i = 0; i < n; ++i) {
+            if (tile[i] >= floor) {
+                partial.tokens.push_back(static_cast<uint32_t>(first + i));
+                partial.logits.push_back(tile[i]);
             }
-            return;
+        }
+        if (partial.tokens.size() > std::max(partial.prune_at, SAMPLE_PRUNE_CANDIDATES)) {
+            prune_candidates(partial, top_k);
         }
     }
+}
 
-    for (size_t i = vocab_size; i > 0; --i) {
-        if (probs[i-1] > 0.0f) {
-            output[0] = static_cast<uint32_t>(i-1);
-            token_history.push_back(output[0]);
-            if (token_history.size() > MAX_HISTORY) {
-                token_history.erase(token_history.begin());
+uint32_t cactus_sample_partials_f16(const CactusSamplePartial* partials, size_t num_partials, size_t vocab_size,
+                                    float temperature, float top_p, size_t top_k, size_t random_seed,
+                                    float* out_entropy) {
+    if (out_entropy) {
+        *out_entropy = merged_entropy(partials, num_partials, vocab_size);
+    }
+
+    if (is_greedy(temperature, top_p, top_k)) {
+        uint32_t token = 0;
+        float best = 0.0f;
+        bool found = false;
+        for (size_t p = 0; p < num_partials; ++p) {
+            if (!partials[p].tokens.empty() && (!found || partials[p].logits[0] > best)) {
+                token = partials[p].tokens[0];
+                best = partials[p].logits[0];
+                found = true;
             }
-            return;
         }
+        return token;
+    }
+
+    // Partials cover increasing ranges and keep their tokens ascending, so concatenating them
+    // lays the candidates out in vocabulary order, as the full-row sampler sees them.
+    size_t total = 0;
+    for (size_t p = 0; p < num_partials; ++p) {
+        total += partials[p].tokens.size();
+    }
+    auto& scratch = sampler_scratch(total);
+    scratch.tokens.clear();
+    size_t offset = 0;
+    for (size_t p = 0; p < num_partials; ++p) {
+        const auto& partial = partials[p];
+        std::copy(partial.logits.begin(), partial.logits.end(), scratch.logits.begin() + offset);
+        scratch.tokens.insert(scratch.tokens.end(), partial.tokens.begin(), partial.tokens.end());
+        offset += partial.tokens.size();
     }
 
-    output[0] = 0;
-    token_history.push_back(output[0]);
-    if (token_history.size() > MAX_HISTORY) {
-        token_history.erase(token_history.begin());
+    uint32_t token = 0;
+    if (total > 0 && select_candidates(scratch, scratch.logits.data(), total, 0.0f, top_p, top_k)) {
+        token = scratch.tokens[draw_candidate(scratch, random_seed)];
     }
+    record_sampled_token(token);
+    return token;
 }
@@ -1,6 +1,6 @@
 #include "kernel.h"
 #include "kernel_utils.h"
-#include <arm_neon.h>
+#include "kernel_simd.h"
 #include <algorithm>
 #include <cmath>
 #include <limits>
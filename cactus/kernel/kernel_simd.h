@@ -0,0 +1,424 @@
+#ifndef KERNEL_SIMD_H
+#define KERNEL_SIMD_H
+
+// Selects the SIMD backend for the kernels. ARM builds use the NEON intrinsics directly.
+// Other targets (x86-64 servers) get a portable implementation of the NEON subset the
+// kernels use, written over GCC/Clang vector extensions so that -mavx2 -mfma -mf16c
+// (or -mavx512f) lowers each operation to native vector code. __fp16 maps to _Float16
+// there, which keeps the half-precision storage type identical across backends.
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#else
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if !defined(__clang__)
+typedef _Float16 __fp16;
+#endif
+
+#define CACTUS_SIMD_PORTABLE 1
+
+typedef __fp16 float16_t;
+typedef float float32_t;
+
+typedef float float32x4_t __attribute__((vector_size(16)));
+typedef float float32x2_t __attribute__((vector_size(8)));
+typedef _Float16 float16x8_t __attribute__((vector_size(16)));
+typedef _Float16 float16x4_t __attribute__((vector_size(8)));
+typedef int8_t int8x16_t __attribute__((vector_size(16)));
+typedef int8_t int8x8_t __attribute__((vector_size(8)));
+typedef int16_t int16x8_t __attribute__((vector_size(16)));
+typedef int16_t int16x4_t __attribute__((vector_size(8)));
+typedef int32_t int32x4_t __attribute__((vector_size(16)));
+typedef int32_t int32x2_t __attribute__((vector_size(8)));
+typedef uint8_t uint8x16_t __attribute__((vector_size(16)));
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+
+struct float16x8x2_t { float16x8_t val[2]; };
+struct float32x4x2_t { float32x4_t val[2]; };
+struct int8x16x2_t { int8x16_t val[2]; };
+struct int8x16x4_t { int8x16_t val[4]; };
+
+namespace cactus_simd {
+
+template<typename V>
+constexpr int lanes() { return static_cast<int>(sizeof(V) / sizeof(decltype(V{}[0]))); }
+
+template<typename V, typename S>
+inline V splat(S x) {
+    V r;
+    for (int i = 0; i < lanes<V>(); ++i) r[i] = x;
+    return r;
+}
+
+template<typename V, typename P>
+inline V load(const P* p) {
+    V r;
+    std::memcpy(&r, p, sizeof(V));
+    return r;
+}
+
+template<typename P, typename V>
+inline void store(P* p, V v) {
+    std::memcpy(p, &v, sizeof(V));
+}
+
+template<typename To, typename From>
+inline To bitcast(From v) {
+    static_assert(sizeof(To) == sizeof(From), "reinterpret requires equal sizes");
+    To r;
+    std::memcpy(&r, &v, sizeof(To));
+    return r;
+}
+
+template<typename Full, typename Half>
+inline Full combine(Half lo, Half hi) {
+    Full r;
+    std::memcpy(&r, &lo, sizeof(Half));
+    std::memcpy(reinterpret_cast<char*>(&r) + sizeof(Half), &hi, sizeof(Half));
+    return r;
+}
+
+template<typename Half, typename Full>
+inline Half low(Full v) {
+    Half r;
+    std::memcpy(&r, &v, sizeof(Half));
+    return r;
+}
+
+template<typename Half, typename Full>
+inline Half high(Full v) {
+    Half r;
+    std::memcpy(&r, reinterpret_cast<const char*>(&v) + sizeof(Half), sizeof(Half));
+    return r;
+}
+
+template<typename V>
+inline V vmax(V a, V b) {
+    for (int i = 0; i < lanes<V>(); ++i) a[i] = a[i] > b[i] ? a[i] : b[i];
+    return a;
+}
+
+template<typename V>
+inline V vmin(V a, V b) {
+    for (int i = 0; i < lanes<V>(); ++i) a[i] = a[i] < b[i] ? a[i] : b[i];
+    return a;
+}
+
+template<typename Narrow, typename Wide, typename Elem>
+inline Narrow saturate_narrow(Wide v, Elem lo, Elem hi) {
+    Narrow r;
+    for (int i = 0; i < lanes<Wide>(); ++i) {
+        r[i] = static_cast<Elem>(std::min<decltype(v[0] + 0)>(std::max<decltype(v[0] + 0)>(v[i], lo), hi));
+    }
+    return r;
+}
+
+}
+
+// Loads and stores
+
+inline float16x4_t vld1_f16(const __fp16* p) { return cactus_simd::load<float16x4_t>(p); }
+inline float16x8_t vld1q_f16(const __fp16* p) { return cactus_simd::load<float16x8_t>(p); }
+inline float32x4_t vld1q_f32(const float* p) { return cactus_simd::load<float32x4_t>(p); }
+inline int8x8_t vld1_s8(const int8_t* p) { return cactus_simd::load<int8x8_t>(p); }
+inline int8x16_t vld1q_s8(const int8_t* p) { return cactus_simd::load<int8x16_t>(p); }
+inline uint8x16_t vld1q_u8(const uint8_t* p) { return cactus_simd::load<uint8x16_t>(p); }
+
+inline int8x16x4_t vld1q_s8_x4(const int8_t* p) {
+    int8x16x4_t r;
+    for (int i = 0; i < 4; ++i) r.val[i] = vld1q_s8(p + 16 * i);
+    return r;
+}
+
+inline float16x8x2_t vld2q_f16(const __fp16* p) {
+    float16x8x2_t r;
+    for (int i = 0; i < 8; ++i) {
+        r.val[0][i] = p[2 * i];
+        r.val[1][i] = p[2 * i + 1];
+    }
+    return r;
+}
+
+inline void vst1_f16(__fp16* p, float16x4_t v) { cactus_simd::store(p, v); }
+inline void vst1q_f16(__fp16* p, float16x8_t v) { cactus_simd::store(p, v); }
+inline void vst1q_f32(float* p, float32x4_t v) { cactus_simd::store(p, v); }
+inline void vst1_s8(int8_t* p, int8x8_t v) { cactus_simd::store(p, v); }
+inline void vst1q_s8(int8_t* p, int8x16_t v) { cactus_simd::store(p, v); }
+
+inline void vst2q_f16(__fp16* p, float16x8x2_t v) {
+    for (int i = 0; i < 8; ++i) {
+        p[2 * i] = v.val[0][i];
+        p[2 * i + 1] = v.val[1][i];
+    }
+}
+
+// Broadcast, lanes, halves
+
+inline float32x4_t vdupq_n_f32(float x) { return cactus_simd::splat<float32x4_t>(x); }
+inline float16x8_t vdupq_n_f16(__fp16 x) { return cactus_simd::splat<float16x8_t>(x); }
+inline int32x4_t vdupq_n_s32(int32_t x) { return cactus_simd::splat<int32x4_t>(x); }
+inline uint8x16_t vdupq_n_u8(uint8_t x) { return cactus_simd::splat<uint8x16_t>(x); }
+inline int32x2_t vdup_lane_s32(int32x2_t v, int lane) { return cactus_simd::splat<int32x2_t>(v[lane]); }
+
+inline float vget_lane_f32(float32x2_t v, int lane) { return v[lane]; }
+inline __fp16 vget_lane_f16(float16x4_t v, int lane) { return v[lane]; }
+inline __fp16 vgetq_lane_f16(float16x8_t v, int lane) { return v[lane]; }
+inline float16x8_t vsetq_lane_f16(__fp16 x, float16x8_t v, int lane) { v[lane] = x; return v; }
+
+inline float16x4_t vget_low_f16(float16x8_t v) { return cactus_simd::low<float16x4_t>(v); }
+inline float16x4_t vget_high_f16(float16x8_t v) { return cactus_simd::high<float16x4_t>(v); }
+inline float32x2_t vget_low_f32(float32x4_t v) { return cactus_simd::low<float32x2_t>(v); }
+inline float32x2_t vget_high_f32(float32x4_t v) { return cactus_simd::high<float32x2_t>(v); }
+inline int8x8_t vget_low_s8(int8x16_t v) { return cactus_simd::low<int8x8_t>(v); }
+inline int8x8_t vget_high_s8(int8x16_t v) { return cactus_simd::high<int8x8_t>(v); }
+inline int16x4_t vget_low_s16(int16x8_t v) { return cactus_simd::low<int16x4_t>(v); }
+inline int16x4_t vget_high_s16(int16x8_t v) { return cactus_simd::high<int16x4_t>(v); }
+inline int32x2_t vget_low_s32(int32x4_t v) { return cactus_simd::low<int32x2_t>(v); }
+inline int32x2_t vget_high_s32(int32x4_t v) { return cactus_simd::high<int32x2_t>(v); }
+
+inline float16x8_t vcombine_f16(float16x4_t lo, float16x4_t hi) { return cactus_simd::combine<float16x8_t>(lo, hi); }
+inline float32x4_t vcombine_f32(float32x2_t lo, float32x2_t hi) { return cactus_simd::combine<float32x4_t>(lo, hi); }
+inline int8x16_t vcombine_s8(int8x8_t lo, int8x8_t hi) { return cactus_simd::combine<int8x16_t>(lo, hi); }
+inline int16x8_t vcombine_s16(int16x4_t lo, int16x4_t hi) { return cactus_simd::combine<int16x8_t>(lo, hi); }
+inline int32x4_t vcombine_s32(int32x2_t lo, int32x2_t hi) { return cactus_simd::combine<int32x4_t>(lo, hi); }
+
+inline float16x4_t vext_f16(float16x4_t a, float16x4_t b, int n) {
+    float16x4_t r;
+    for (int i = 0; i < 4; ++i) r[i] = (i + n < 4) ? a[i + n] : b[i + n - 4];
+    return r;
+}
+
+// Reinterpretation
+
+inline float16x8_t vreinterpretq_f16_f32(float32x4_t v) { return cactus_simd::bitcast<float16x8_t>(v); }
+inline float32x4_t vreinterpretq_f32_f16(float16x8_t v) { return cactus_simd::bitcast<float32x4_t>(v); }
+inline float32x4_t vreinterpretq_f32_s32(int32x4_t v) { return cactus_simd::bitcast<float32x4_t>(v); }
+inline float32x4_t vreinterpretq_f32_u32(uint32x4_t v) { return cactus_simd::bitcast<float32x4_t>(v); }
+inline uint32x4_t vreinterpretq_u32_f32(float32x4_t v) { return cactus_simd::bitcast<uint32x4_t>(v); }
+inline int32x4_t vreinterpretq_s32_u32(uint32x4_t v) { return cactus_simd::bitcast<int32x4_t>(v); }
+inline int8x16_t vreinterpretq_s8_u8(uint8x16_t v) { return cactus_simd::bitcast<int8x16_t>(v); }
+inline int8x8_t vreinterpret_s8_s32(int32x2_t v) { return cactus_simd::bitcast<int8x8_t>(v); }
+inline int32x2_t vreinterpret_s32_s8(int8x8_t v) { return cactus_simd::bitcast<int32x2_t>(v); }
+
+// Conversions
+
+inline float32x4_t vcvt_f32_f16(float16x4_t v) {
+#if defined(__F16C__)
+    __m128i h;
+    std::memcpy(&h, &v, sizeof(v));
+    return cactus_simd::bitcast<float32x4_t>(_mm_cvtph_ps(h));
+#else
+    return __builtin_convertvector(v, float32x4_t);
+#endif
+}
+
+inline float16x4_t vcvt_f16_f32(float32x4_t v) {
+#if defined(__F16C__)
+    __m128i h = _mm_cvtps_ph(cactus_simd::bitcast<__m128>(v), _MM_FROUND_TO_NEAREST_INT);
+    float16x4_t r;
+    std::memcpy(&r, &h, sizeof(r));
+    return r;
+#else
+    return __builtin_convertvector(v, float16x4_t);
+#endif
+}
+
+inline float32x4_t vcvtq_f32_s32(int32x4_t v) { return __builtin_convertvector(v, float32x4_t); }
+
+inline int32x4_t vcvtq_s32_f32(float32x4_t v) {
+    int32x4_t r;
+    for (int i = 0; i < 4; ++i) {
+        r[i] = static_cast<int32_t>(std::clamp(v[i], -2147483648.0f, 2147483520.0f));
+    }
+    return r;
+}
+
+inline int32x4_t vcvtnq_s32_f32(float32x4_t v) {
+    int32x4_t r;
+    for (int i = 0; i < 4; ++i) {
+        r[i] = static_cast<int32_t>(std::nearbyint(std::clamp(v[i], -2147483648.0f, 2147483520.0f)));
+    }
+    return r;
+}
+
+inline int16x8_t vmovl_s8(int8x8_t v) { return __builtin_convertvector(v, int16x8_t); }
+inline int32x4_t vmovl_s16(int16x4_t v) { return __builtin_convertvector(v, int32x4_t); }
+
+inline int8x8_t vqmovn_s16(int16x8_t v) {
+    return cactus_simd::saturate_narrow<int8x8_t>(v, int16_t(-128), int16_t(127));
+}
+
+inline int16x4_t vqmovn_s32(int32x4_t v) {
+    return cactus_simd::saturate_narrow<int16x4_t>(v, int32_t(-32768), int32_t(32767));
+}
+
+// Arithmetic
+
+inline float16x4_t vadd_f16(float16x4_t a, float16x4_t b) { return a + b; }
+inline float32x2_t vadd_f32(float32x2_t a, float32x2_t b) { return a + b; }
+inline float16x8_t vaddq_f16(float16x8_t a, float16x8_t b) { return a + b; }
+inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b) { return a + b; }
+inline int32x4_t vaddq_s32(int32x4_t a, int32x4_t b) { return a + b; }
+inline float16x8_t vsubq_f16(float16x8_t a, float16x8_t b) { return a - b; }
+inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b) { return a - b; }
+inline int32x4_t vsubq_s32(int32x4_t a, int32x4_t b) { return a - b; }
+inline uint8x16_t vsubq_u8(uint8x16_t a, uint8x16_t b) { return a - b; }
+inline float16x8_t vmulq_f16(float16x8_t a, float16x8_t b) { return a * b; }
+inline float32x4_t vmulq_f32(float32x4_t a, float32x4_t b) { return a * b; }
+inline float32x4_t vmulq_n_f32(float32x4_t a, float b) { return a * b; }
+inline float16x8_t vdivq_f16(float16x8_t a, float16x8_t b) { return a / b; }
+inline float32x4_t vdivq_f32(float32x4_t a, float32x4_t b) { return a / b; }
+inline float32x4_t vnegq_f32(float32x4_t a) { return -a; }
+
+inline float16x8_t vfmaq_f16(float16x8_t a, float16x8_t b, float16x8_t c) { return a + b * c; }
+inline float16x8_t vfmsq_f16(float16x8_t a, float16x8_t b, float16x8_t c) { return a - b * c; }
+inline float32x4_t vfmaq_f32(float32x4_t a, float32x4_t b, float32x4_t c) { return a + b * c; }
+inline float32x4_t vfmaq_n_f32(float32x4_t a, float32x4_t b, float c) { return a + b * c; }
+inline float32x4_t vmlaq_f32(float32x4_t a, float32x4_t b, float32x4_t c) { return a + b * c; }
+
+inline float32x4_t vabsq_f32(float32x4_t a) {
+    return vreinterpretq_f32_u32(vreinterpretq_u32_f32(a) & cactus_simd::splat<uint32x4_t>(0x7fffffffu));
+}
+
+inline float32x4_t vsqrtq_f32(float32x4_t a) {
+    for (int i = 0; i < 4; ++i) a[i] = std::sqrt(a[i]);
+    return a;
+}
+
+inline float32x4_t vrndmq_f32(float32x4_t a) {
+    for (int i = 0; i < 4; ++i) a[i] = std::floor(a[i]);
+    return a;
+}
+
+inline float16x8_t vmaxq_f16(float16x8_t a, float16x8_t b) { return cactus_simd::vmax(a, b); }
+inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b) { return cactus_simd::vmax(a, b); }
+inline float16x8_t vminq_f16(float16x8_t a, float16x8_t b) { return cactus_simd::vmin(a, b); }
+inline float32x4_t vminq_f32(float32x4_t a, float32x4_t b) { return cactus_simd::vmin(a, b); }
+
+inline float vaddvq_f32(float32x4_t a) { return (a[0] + a[1]) + (a[2] + a[3]); }
+inline float vmaxvq_f32(float32x4_t a) { return std::max(std::max(a[0], a[1]), std::max(a[2], a[3])); }
+
+inline uint8_t vmaxvq_u8(uint8x16_t a) {
+    uint8_t r = a[0];
+    for (int i = 1; i < 16; ++i) r = std::max(r, static_cast<uint8_t>(a[i]));
+    return r;
+}
+
+inline int16x8_t vmull_s8(int8x8_t a, int8x8_t b) { return vmovl_s8(a) * vmovl_s8(b); }
+
+inline int32x4_t vpaddlq_s16(int16x8_t a) {
+    int32x4_t r;
+    for (int i = 0; i < 4; ++i) r[i] = int32_t(a[2 * i]) + int32_t(a[2 * i + 1]);
+    return r;
+}
+
+inline int32x2_t vpadd_s32(int32x2_t a, int32x2_t b) {
+    int32x2_t r = {a[0] + a[1], b[0] + b[1]};
+    return r;
+}
+
+// SDOT by lane. VNNI's dpbusd is unsigned x signed, so a is biased to unsigned and
+// 128 * sum(b) is subtracted back out; AVX2 widens to int16 and uses madd, which is exact.
+inline int32x4_t vdotq_laneq_s32(int32x4_t acc, int8x16_t a, int8x16_t b, int lane) {
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    __m128i va = cactus_simd::bitcast<__m128i>(a);
+    __m128i vb = _mm_set1_epi32(cactus_simd::bitcast<int32x4_t>(b)[lane]);
+    __m128i biased = _mm_xor_si128(va, _mm_set1_epi8(static_cast<char>(0x80)));
+    __m128i dot = _mm_dpbusd_epi32(cactus_simd::bitcast<__m128i>(acc), biased, vb);
+    __m128i bsum = _mm_dpbusd_epi32(_mm_setzero_si128(), _mm_set1_epi8(1), vb);
+    return cactus_simd::bitcast<int32x4_t>(_mm_sub_epi32(dot, _mm_slli_epi32(bsum, 7)));
+#elif defined(__AVX2__)
+    __m256i va = _mm256_cvtepi8_epi16(cactus_simd::bitcast<__m128i>(a));
+    __m256i vb = _mm256_cvtepi8_epi16(_mm_set1_epi32(cactus_simd::bitcast<int32x4_t>(b)[lane]));
+    __m256i pairs = _mm256_madd_epi16(va, vb);
+    __m256i quads = _mm256_permute4x64_epi64(_mm256_hadd_epi32(pairs, pairs), 0x08);
+    return acc + cactus_simd::bitcast<int32x4_t>(_mm256_castsi256_si128(quads));
+#else
+    for (int i = 0; i < 4; ++i) {
+        int32_t sum = 0;
+        for (int k = 0; k < 4; ++k) sum += int32_t(a[4 * i + k]) * int32_t(b[4 * lane + k]);
+        acc[i] += sum;
+    }
+    return acc;
+#endif
+}
+
+// Bitwise, shifts, compares, selects
+
+inline int32x4_t vandq_s32(int32x4_t a, int32x4_t b) { return a & b; }
+inline uint32x4_t vandq_u32(uint32x4_t a, uint32x4_t b) { return a & b; }
+inline uint8x16_t vandq_u8(uint8x16_t a, uint8x16_t b) { return a & b; }
+inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b) { return a | b; }
+inline uint8x16_t vorrq_u8(uint8x16_t a, uint8x16_t b) { return a | b; }
+inline int32x4_t vshlq_n_s32(int32x4_t a, int n) { return a << n; }
+inline uint8x16_t vshrq_n_u8(uint8x16_t a, int n) { return a >> n; }
+inline int8x16_t vshlq_n_s8(int8x16_t a, int n) { return a << n; }
+inline int8x16_t vshrq_n_s8(int8x16_t a, int n) { return a >> n; }
+
+inline uint32x4_t vceqq_f32(float32x4_t a, float32x4_t b) { return reinterpret_cast<uint32x4_t>(a == b); }
+inline uint32x4_t vcgtq_f32(float32x4_t a, float32x4_t b) { return reinterpret_cast<uint32x4_t>(a > b); }
+inline uint32x4_t vcltq_f32(float32x4_t a, float32x4_t b) { return reinterpret_cast<uint32x4_t>(a < b); }
+inline uint8x16_t vcgtq_u8(uint8x16_t a, uint8x16_t b) { return reinterpret_cast<uint8x16_t>(a > b); }
+
+inline float32x4_t vbslq_f32(uint32x4_t mask, float32x4_t a, float32x4_t b) {
+    uint32x4_t bits = (mask & vreinterpretq_u32_f32(a)) | (~mask & vreinterpretq_u32_f32(b));
+    return vreinterpretq_f32_u32(bits);
+}
+
+// Permutes
+
+inline float32x4x2_t vtrnq_f32(float32x4_t a, float32x4_t b) {
+    float32x4x2_t r;
+    for (int i = 0; i < 2; ++i) {
+        r.val[0][2 * i] = a[2 * i];
+        r.val[0][2 * i + 1] = b[2 * i];
+        r.val[1][2 * i] = a[2 * i + 1];
+        r.val[1][2 * i + 1] = b[2 * i + 1];
+    }
+    return r;
+}
+
+inline float16x8x2_t vtrnq_f16(float16x8_t a, float16x8_t b) {
+    float16x8x2_t r;
+    for (int i = 0; i < 4; ++i) {
+        r.val[0][2 * i] = a[2 * i];
+        r.val[0][2 * i + 1] = b[2 * i];
+        r.val[1][2 * i] = a[2 * i + 1];
+        r.val[1][2 * i + 1] = b[2 * i + 1];
+    }
+    return r;
+}
+
+inline int8x16x2_t vzipq_s8(int8x16_t a, int8x16_t b) {
+    int8x16x2_t r;
+    for (int i = 0; i < 8; ++i) {
+        r.val[0][2 * i] = a[i];
+        r.val[0][2 * i + 1] = b[i];
+        r.val[1][2 * i] = a[i + 8];
+        r.val[1][2 * i + 1] = b[i + 8];
+    }
+    return r;
+}
+
+inline int8x16_t vqtbl4q_s8(int8x16x4_t table, uint8x16_t idx) {
+    int8x16_t r;
+    for (int i = 0; i < 16; ++i) {
+        uint8_t j = idx[i];
+        r[i] = j < 64 ? table.val[j >> 4][j & 15] : int8_t(0);
+    }
+    return r;
+}
+
+#endif
+
+#endif // KERNEL_SIMD_H
@@ -1,12 +1,12 @@
 #ifndef KERNEL_UTILS_H
 #define KERNEL_UTILS_H
 
-#include <arm_neon.h>
+#include "kernel_simd.h"
 #if defined(__APPLE__)
 #include <TargetConditionals.h>
 #include <sys/sysctl.h>
 #endif
-#if defined(__ANDROID__)
+#if defined(__ANDROID__) || (defined(__linux__) && defined(__aarch64__))
 #include <sys/auxv.h>
 #include <asm/hwcap.h>
 #endif
@@ -15,11 +15,12 @@
 #include <thread>
 #include <vector>
 #include <functional>
-#include <queue>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
-#include <future>
+#include <exception>
+#include <cstdint>
 #include <unistd.h>
 #include <unordered_map>
 #include <chrono>
@@ -104,62 +105,382 @@ inline float32x4_t fast_tanh_f32x4(float32x4_t x) {
 
 namespace CactusThreading {
 
-    class ThreadPool {
+    inline void cpu_relax() {
+    #if defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield" ::: "memory");
+    #elif defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+    #else
+        std::this_thread::yield();
+    #endif
+    }
+
+    // Completion state shared by the tasks of one fork. The first exception thrown by any
+    // task is kept and rethrown on the forking thread once every task has finished.
+    struct JoinState {
+        std::atomic<size_t> pending;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+
+        explicit JoinState(size_t count) : pending(count) {}
+
+        void fail(std::exception_ptr e) {
+            if (!failed.exchange(true, std::memory_order_acq_rel)) {
+                error = std::move(e);
+            }
+        }
+
+        void rethrow_if_failed() {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+
+    // A unit of fork/join work. Tasks live on the forking thread's stack and the
+    // fork does not return until every task has run, so nothing is heap allocated.
+    struct Task {
+        void (*invoke)(const void* ctx, size_t start, size_t end);
+        const void* ctx;
+        size_t start;
+        size_t end;
+        JoinState* join;
+
+        void run() {
+            try {
+                invoke(ctx, start, end);
+            } catch (...) {
+                join->fail(std::current_exception());
+            }
+            join->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    };
+
+    // Chase-Lev deque: the owner pushes and pops at the bottom, thieves steal from the top.
+    class alignas(64) WorkDeque {
     private:
+        static constexpr int64_t CAPACITY = 256;
+
+        alignas(64) std::atomic<int64_t> top_{0};
+        alignas(64) std::atomic<int64_t> bottom_{0};
+        std::atomic<Task*> buffer_[CAPACITY];
+
+    public:
+        WorkDeque() {
+            for (auto& slot : buffer_) slot.store(nullptr, std::memory_order_relaxed);
+        }
+
+        bool push(Task* task) {
+            int64_t b = bottom_.load(std::memory_order_relaxed);
+            int64_t t = top_.load(std::memory_order_acquire);
+            if (b - t >= CAPACITY) return false;
+            buffer_[b & (CAPACITY - 1)].store(task, std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        Task* pop() {
+            int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top_.load(std::memory_order_relaxed);
+
+            if (t > b) {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Task* task = buffer_[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    task = nullptr;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        Task* steal() {
+            int64_t t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom_.load(std::memory_order_acquire);
+            if (t >= b) return nullptr;
+
+            Task* task = buffer_[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return task;
+        }
+
+        bool empty() const {
+            return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+        }
+    };
+
+    class ThreadPool {
+    public:
         static constexpr size_t MAX_WORKERS = 16;
+        static constexpr size_t MAX_TASKS = 64;
+
+    private:
+        // Threads outside the pool borrow one of these deques for the duration of a fork.
+        static constexpr size_t EXTERNAL_SLOTS = 4;
+        static constexpr size_t SPIN_ITERATIONS = 4096;
 
         std::vector<std::thread> workers;
-        std::deque<std::function<void()>> tasks;
+        std::unique_ptr<WorkDeque[]> deques_;
+        std::atomic<bool> external_in_use_[EXTERNAL_SLOTS];
+        size_t num_slots_;
 
-        std::mutex mutex;
+        std::mutex park_mutex;
         std::condition_variable work_available;
-        std::condition_variable work_done;
+        std::atomic<uint64_t> work_epoch_{0};
+        std::atomic<size_t> sleepers_{0};
+        std::atomic<bool> stop{false};
+
+        // Persistent parallel region: while active, workers spin on team_epoch_ instead of
+        // parking, and every fork from the region owner runs as one statically partitioned
+        // team job that all workers arrive at before the next one is published.
+        std::atomic<bool> region_active_{false};
+        alignas(64) std::atomic<uint64_t> team_epoch_{0};
+        alignas(64) std::atomic<size_t> team_pending_{0};
+        void (*team_invoke_)(const void* ctx, size_t thread_id, size_t num_threads) = nullptr;
+        const void* team_ctx_ = nullptr;
+        size_t team_threads_ = 0;
+        std::atomic<bool> team_failed_{false};
+        std::exception_ptr team_error_;
 
-        bool stop{false};
-        std::atomic<size_t> pending_tasks{0};
         size_t num_workers_;
 
-        void worker_thread() {
-            while (true) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    work_available.wait(lock, [this] {
-                        return stop || !tasks.empty();
-                    });
-
-                    if (stop && tasks.empty()) {
-                        return;
-                    }
-
-                    task = std::move(tasks.front());
-                    tasks.pop_front();
+        static size_t& current_slot() {
+            static thread_local size_t slot = SIZE_MAX;
+            return slot;
+        }
+
+        static const ThreadPool*& current_pool() {
+            static thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        static const ThreadPool*& region_owner() {
+            static thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        static bool& in_team_job() {
+            static thread_local bool active = false;
+            return active;
+        }
+
+        void fail_team(std::exception_ptr e) {
+            if (!team_failed_.exchange(true, std::memory_order_acq_rel)) {
+                team_error_ = std::move(e);
+            }
+        }
+
+        void run_team_share(size_t thread_id) {
+            if (thread_id < team_threads_) {
+                in_team_job() = true;
+                try {
+                    team_invoke_(team_ctx_, thread_id, team_threads_);
+                } catch (...) {
+                    fail_team(std::current_exception());
+                }
+                in_team_job() = false;
+            }
+            team_pending_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        Task* steal_any(size_t self, uint32_t& seed) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            const size_t first = seed % num_slots_;
+            for (size_t i = 0; i < num_slots_; ++i) {
+                size_t victim = (first + i) % num_slots_;
+                if (victim == self) continue;
+                if (Task* task = deques_[victim].steal()) return task;
+            }
+            return nullptr;
+        }
+
+        void notify_workers() {
+            work_epoch_.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+                std::lock_guard<std::mutex> lock(park_mutex);
+                work_available.notify_all();
+            }
+        }
+
+        void worker_thread(size_t slot) {
+            current_slot() = slot;
+            current_pool() = this;
+            uint32_t seed = static_cast<uint32_t>(slot * 2654435761u + 1);
+            size_t idle = 0;
+            uint64_t seen_team_epoch = 0;
+
+            while (!stop.load(std::memory_order_acquire)) {
+                uint64_t team_epoch = team_epoch_.load(std::memory_order_acquire);
+                if (team_epoch != seen_team_epoch) {
+                    seen_team_epoch = team_epoch;
+                    run_team_share(slot + 1);
+                    idle = 0;
+                    continue;
+                }
+
+                uint64_t epoch = work_epoch_.load(std::memory_order_acquire);
+
+                Task* task = deques_[slot].pop();
+                if (!task) task = steal_any(slot, seed);
+                if (task) {
+                    task->run();
+                    idle = 0;
+                    continue;
+                }
+
+                if (++idle < SPIN_ITERATIONS || region_active_.load(std::memory_order_acquire)) {
+                    cpu_relax();
+                    continue;
                 }
 
-                task();
+                std::unique_lock<std::mutex> lock(park_mutex);
+                sleepers_.fetch_add(1, std::memory_order_seq_cst);
+                work_available.wait(lock, [this, epoch] {
+                    return stop.load(std::memory_order_acquire) ||
+                           region_active_.load(std::memory_order_acquire) ||
+                           work_epoch_.load(std::memory_order_seq_cst) != epoch;
+                });
+                sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                idle = 0;
+            }
+        }
+
+        size_t acquire_slot(bool& external) {
+            if (current_pool() == this) {
+                external = false;
+                return current_slot();
+            }
+            external = true;
+            for (size_t i = 0; i < EXTERNAL_SLOTS; ++i) {
+                bool expected = false;
+                if (!external_in_use_[i].load(std::memory_order_relaxed) &&
+                    external_in_use_[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return (num_workers_ - 1) + i;
+                }
+            }
+            return SIZE_MAX;
+        }
+
+        void release_slot(size_t slot) {
+            external_in_use_[slot - (num_workers_ - 1)].store(false, std::memory_order_release);
+        }
+
+        template<typename F>
+        static void invoke_range(const void* ctx, size_t start, size_t end) {
+            (*static_cast<const F*>(ctx))(start, end);
+        }
+
+        template<typename F>
+        static void invoke_team(const void* ctx, size_t thread_id, size_t num_threads) {
+            (*static_cast<const F*>(ctx))(thread_id, num_threads);
+        }
+
+        bool in_region() const {
+            return region_owner() == this && !in_team_job();
+        }
+
+        template<typename F>
+        void steal_join(size_t total_work, size_t num_tasks, const F& task_func) {
+            bool external = false;
+            const size_t slot = acquire_slot(external);
+            if (slot == SIZE_MAX) {
+                task_func(0, total_work);
+                return;
+            }
+
+            const size_t per_task = total_work / num_tasks;
+            const size_t remainder = total_work % num_tasks;
 
-                if (pending_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    work_done.notify_one();
+            JoinState join(num_tasks);
+            Task tasks[MAX_TASKS];
+            for (size_t t = 0; t < num_tasks; ++t) {
+                size_t start = t * per_task + std::min(t, remainder);
+                size_t end = start + per_task + (t < remainder ? 1 : 0);
+                tasks[t] = Task{&invoke_range<F>, &task_func, start, end, &join};
+            }
+
+            WorkDeque& own = deques_[slot];
+            for (size_t t = num_tasks; t-- > 1;) {
+                if (!own.push(&tasks[t])) {
+                    tasks[t].run();
+                }
+            }
+            notify_workers();
+
+            tasks[0].run();
+
+            uint32_t seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&join) >> 4);
+            while (join.pending.load(std::memory_order_acquire) != 0) {
+                Task* task = own.pop();
+                if (!task) task = steal_any(slot, seed);
+                if (task) {
+                    task->run();
+                } else {
+                    cpu_relax();
                 }
             }
+
+            if (external) release_slot(slot);
+            join.rethrow_if_failed();
+        }
+
+        template<typename F>
+        void team_join(size_t num_threads, const F& task_func) {
+            team_invoke_ = &invoke_team<F>;
+            team_ctx_ = &task_func;
+            team_threads_ = num_threads;
+            team_failed_.store(false, std::memory_order_relaxed);
+            team_error_ = nullptr;
+            team_pending_.store(num_workers_ - 1, std::memory_order_relaxed);
+            team_epoch_.fetch_add(1, std::memory_order_release);
+
+            in_team_job() = true;
+            try {
+                task_func(0, num_threads);
+            } catch (...) {
+                fail_team(std::current_exception());
+            }
+            in_team_job() = false;
+
+            while (team_pending_.load(std::memory_order_acquire) != 0) {
+                cpu_relax();
+            }
+            if (team_error_) {
+                std::exception_ptr error = std::move(team_error_);
+                team_error_ = nullptr;
+                std::rethrow_exception(error);
+            }
         }
 
     public:
-        explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
-            : stop(false), pending_tasks(0) {
+        explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency()) {
             num_workers_ = std::min(num_threads, MAX_WORKERS);
             if (num_workers_ == 0) num_workers_ = 1;
-            workers.reserve(num_workers_);
-            for (size_t i = 0; i < num_workers_; ++i) {
-                workers.emplace_back(&ThreadPool::worker_thread, this);
+            num_slots_ = (num_workers_ - 1) + EXTERNAL_SLOTS;
+            deques_.reset(new WorkDeque[num_slots_]);
+            for (auto& in_use : external_in_use_) in_use.store(false, std::memory_order_relaxed);
+
+            // The forking thread always runs a share of the work itself, so one fewer
+            // background thread keeps the total at num_workers_.
+            workers.reserve(num_workers_ - 1);
+            for (size_t i = 0; i + 1 < num_workers_; ++i) {
+                workers.emplace_back(&ThreadPool::worker_thread, this, i);
             }
         }
 
         ~ThreadPool() {
             {
-                std::lock_guard<std::mutex> lock(mutex);
-                stop = true;
+                std::lock_guard<std::mutex> lock(park_mutex);
+                stop.store(true, std::memory_order_release);
             }
             work_available.notify_all();
             for (auto& worker : workers) {
@@ -169,73 +490,74 @@ namespace CactusThreading {
             }
         }
 
-        template<typename F>
-        auto enqueue(F&& f) -> std::future<decltype(f())> {
-            using return_type = decltype(f());
-
-            auto task = std::make_shared<std::packaged_task<return_type()>>(
-                std::forward<F>(f)
-            );
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
 
-            std::future<return_type> res = task->get_future();
+        // Splits [0, total_work) into num_tasks contiguous ranges, runs them across the pool
+        // and returns once all have finished. The calling thread executes tasks too, and may
+        // call fork_join again from inside a task. If a range throws, the remaining ranges
+        // still run and the first exception is rethrown here after the join.
+        template<typename F>
+        void fork_join(size_t total_work, size_t num_tasks, const F& task_func) {
+            if (total_work == 0 || num_tasks == 0) return;
+            num_tasks = std::min(num_tasks, std::min(total_work, MAX_TASKS));
+            if (num_tasks == 1) {
+                task_func(0, total_work);
+                return;
+            }
 
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                pending_tasks.fetch_add(1, std::memory_order_relaxed);
-                tasks.emplace_back([task](){ (*task)(); });
+            if (in_region()) {
+                num_tasks = std::min(num_tasks, num_workers_);
+                const size_t per_task = total_work / num_tasks;
+                const size_t remainder = total_work % num_tasks;
+                team_join(num_tasks, [&](size_t t, size_t) {
+                    size_t start = t * per_task + std::min(t, remainder);
+                    size_t end = start + per_task + (t < remainder ? 1 : 0);
+                    task_func(start, end);
+                });
+                return;
             }
-            work_available.notify_one();
 
-            return res;
+            steal_join(total_work, num_tasks, task_func);
         }
 
+        // Runs task_func(thread_id, num_threads) once for every thread_id in [0, num_threads).
+        // Inside a parallel region this is a single broadcast to the spinning workers followed
+        // by a barrier; elsewhere the ids are scheduled through the work-stealing deques.
         template<typename F>
-        void enqueue_batch(size_t total_work, F task_func) {
-            if (total_work == 0) return;
-
-            const size_t num_tasks = std::min(num_workers_, total_work);
-            const size_t per_worker = total_work / num_tasks;
-            const size_t remainder = total_work % num_tasks;
-
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                pending_tasks.fetch_add(num_tasks, std::memory_order_relaxed);
+        void run_team(size_t num_threads, const F& task_func) {
+            num_threads = std::max<size_t>(1, std::min(num_threads, num_workers_));
+            if (num_threads == 1) {
+                task_func(0, 1);
+                return;
+            }
 
-                for (size_t w = 0; w < num_tasks; ++w) {
-                    size_t start = w * per_worker + std::min(w, remainder);
-                    size_t end = start + per_worker + (w < remainder ? 1 : 0);
-                    tasks.emplace_back([=]() { task_func(start, end); });
-                }
+            if (in_region()) {
+                team_join(num_threads, task_func);
+                return;
             }
-            work_available.notify_all();
-        }
 
-        void wait_all() {
-            std::unique_lock<std::mutex> lock(mutex);
-            work_done.wait(lock, [this] {
-                return pending_tasks.load(std::memory_order_acquire) == 0;
+            steal_join(num_threads, num_threads, [&](size_t start, size_t end) {
+                for (size_t t = start; t < end; ++t) task_func(t, num_threads);
             });
         }
 
-        template<typename F>
-        void enqueue_n_threads(size_t total_work, size_t num_threads, F task_func) {
-            if (total_work == 0 || num_threads == 0) return;
-
-            num_threads = std::min(num_threads, std::min(num_workers_, total_work));
-            const size_t per_thread = total_work / num_threads;
-            const size_t remainder = total_work % num_threads;
-
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                pending_tasks.fetch_add(num_threads, std::memory_order_relaxed);
-
-                for (size_t t = 0; t < num_threads; ++t) {
-                    size_t start = t * per_thread + std::min(t, remainder);
-                    size_t end = start + per_thread + (t < remainder ? 1 : 0);
-                    tasks.emplace_back([=]() { task_func(start, end); });
-                }
+        // Keeps every worker spinning for the calling thread until end_region(). Returns false
+        // if another region is open or the caller is itself a pool thread.
+        bool begin_region() {
+            if (current_pool() == this || region_owner() != nullptr) return false;
+            bool expected = false;
+            if (!region_active_.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                return false;
             }
-            work_available.notify_all();
+            region_owner() = this;
+            notify_workers();
+            return true;
+        }
+
+        void end_region() {
+            region_owner() = nullptr;
+            region_active_.store(false, std::memory_order_release);
         }
 
         size_t num_workers() const { return num_workers_; }
@@ -245,6 +567,25 @@ namespace CactusThreading {
         static ThreadPool pool;
         return pool;
     }
+
+    class ParallelRegion {
+    public:
+        explicit ParallelRegion(bool enabled = true, ThreadPool& pool = get_thread_pool())
+            : pool_(pool), active_(enabled && pool.begin_region()) {}
+
+        ~ParallelRegion() {
+            if (active_) pool_.end_region();
+        }
+
+        ParallelRegion(const ParallelRegion&) = delete;
+        ParallelRegion& operator=(const ParallelRegion&) = delete;
+
+        bool active() const { return active_; }
+
+    private:
+        ThreadPool& pool_;
+        bool active_;
+    };
     
     struct ParallelConfig {
         size_t min_work_gate;  
@@ -326,82 +667,16 @@ namespace CactusThreading {
         get_gemm_thread_override() = 0;
     }
     
-    class TaskHandle {
-    private:
-        std::vector<std::future<void>> futures_;
-        bool auto_wait_;
-        
-    public:
-        TaskHandle(bool auto_wait = true) : auto_wait_(auto_wait) {}
-        
-        ~TaskHandle() {
-            if (auto_wait_) {
-                wait();
-            }
-        }
-        
-        TaskHandle(TaskHandle&&) = default;
-        TaskHandle& operator=(TaskHandle&&) = default;
-        TaskHandle(const TaskHandle&) = delete;
-        TaskHandle& operator=(const TaskHandle&) = delete;
-        
-        void add_future(std::future<void>&& f) {
-            futures_.push_back(std::move(f));
-        }
-        
-        void wait() {
-            for (auto& f : futures_) {
-                if (f.valid()) {
-                    f.wait();
-                }
-            }
-            futures_.clear();
-        }
-        
-        bool is_ready() const {
-            for (const auto& f : futures_) {
-                if (f.valid() && f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
-                    return false;
-                }
-            }
-            return true;
-        }
-        
-        size_t task_count() const { return futures_.size(); }
-    };
-    
     template<typename WorkFunc>
-    TaskHandle parallel_for(size_t total_work, ParallelConfig config, WorkFunc work_func, bool wait = true) {
+    void parallel_for(size_t total_work, ParallelConfig config, WorkFunc work_func) {
         const size_t num_threads = get_optimal_thread_count(total_work, config);
-        TaskHandle handle(!wait);
 
         if (num_threads == 1) {
-            if (wait) {
-                work_func(0, total_work);
-                return handle;
-            }
-            auto& pool = get_thread_pool();
-            handle.add_future(pool.enqueue([work_func, total_work]() {
-                work_func(0, total_work);
-            }));
-            return handle;
-        }
-
-        auto& pool = get_thread_pool();
-        const size_t work_per_thread = total_work / num_threads;
-
-        for (size_t t = 0; t < num_threads; ++t) {
-            handle.add_future(pool.enqueue([work_func, t, num_threads, work_per_thread, total_work]() {
-                const size_t start_idx = t * work_per_thread;
-                const size_t end_idx = (t == num_threads - 1) ? total_work : (t + 1) * work_per_thread;
-                work_func(start_idx, end_idx);
-            }));
+            work_func(0, total_work);
+            return;
         }
 
-        if (wait) {
-            handle.wait();
-        }
-        return handle;
+        get_thread_pool().fork_join(total_work, num_threads, work_func);
     }
 
     template<typename WorkFunc>
@@ -425,22 +700,20 @@ namespace CactusThreading {
             return work_func(0, total_work);
         }
         
-        auto& pool = get_thread_pool();
-        std::vector<std::future<ResultType>> futures;
         std::vector<ResultType> partial_results(num_threads, init_value);
         const size_t work_per_thread = total_work / num_threads;
         
-        for (size_t t = 0; t < num_threads; ++t) {
-            futures.push_back(pool.enqueue([work_func, t, num_threads, work_per_thread, total_work]() -> ResultType {
+        get_thread_pool().fork_join(num_threads, num_threads, [&](size_t t_start, size_t t_end) {
+            for (size_t t = t_start; t < t_end; ++t) {
                 const size_t start_idx = t * work_per_thread;
                 const size_t end_idx = (t == num_threads - 1) ? total_work : (t + 1) * work_per_thread;
-                return work_func(start_idx, end_idx);
-            }));
-        }
+                partial_results[t] = work_func(start_idx, end_idx);
+            }
+        });
         
         ResultType result = init_value;
-        for (auto& future : futures) {
-            result = combine_func(result, future.get());
+        for (const auto& partial : partial_results) {
+            result = combine_func(result, partial);
         }
         return result;
     }
@@ -458,8 +731,7 @@ namespace CactusThreading {
             return;
         }
 
-        pool.enqueue_n_threads(total_tiles, num_threads, work_func);
-        pool.wait_all();
+        pool.fork_join(total_tiles, num_threads, work_func);
     }
 
 }
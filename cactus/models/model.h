@@ -14,6 +14,8 @@ public:
     explicit QwenModel(const Config& config);
     ~QwenModel() override = default;
 
+    bool supports_batched_decode() const override { return kv_cache_.is_paged(); }
+
 protected:
     size_t build_attention(CactusGraph* gb, size_t normalized_input, uint32_t layer_idx,
                           ComputeBackend backend, bool use_cache = false, size_t position_offset = 0) override;
@@ -36,6 +38,7 @@ private:
             size_t attn_q_weight;
             size_t attn_k_weight;
             size_t attn_v_weight;
+            size_t attn_qkv_weight;
             size_t attn_output_weight;
             size_t input_layernorm_weight;
             size_t attn_q_norm_weight;
@@ -44,6 +47,7 @@ private:
             size_t post_feedforward_layernorm_weight;
             size_t ffn_gate_weight;
             size_t ffn_up_weight;
+            size_t ffn_gate_up_weight;
             size_t ffn_down_weight;
             size_t post_attention_layernorm_weight;
         };
@@ -60,6 +64,8 @@ public:
     explicit GemmaModel(const Config& config);
     ~GemmaModel() override = default;
 
+    bool supports_batched_decode() const override { return kv_cache_.is_paged(); }
+
 protected:
     size_t build_attention(CactusGraph* gb, size_t normalized_input, uint32_t layer_idx,
                           ComputeBackend backend, bool use_cache = false, size_t position_offset = 0) override;
@@ -83,6 +89,7 @@ private:
             size_t attn_q_weight;
             size_t attn_k_weight;
             size_t attn_v_weight;
+            size_t attn_qkv_weight;
             size_t attn_output_weight;
             size_t input_layernorm_weight;
             size_t attn_q_norm_weight;
@@ -91,6 +98,7 @@ private:
             size_t post_feedforward_layernorm_weight;
             size_t ffn_gate_weight;
             size_t ffn_up_weight;
+            size_t ffn_gate_up_weight;
             size_t ffn_down_weight;
             size_t post_attention_layernorm_weight;
         };
@@ -195,6 +203,14 @@ public:
     bool init(CactusGraph* external_graph, const std::string& model_folder, size_t context_size,
               const std::string& system_prompt = "", bool do_warmup = true) override;
 
+    bool save_cache_state(CacheState& state) const override;
+    bool restore_cache_state(const CacheState& state) override;
+    bool can_restore_cache_state(const CacheState& state) const override;
+
+    bool supports_batched_decode() const override { return kv_cache_.is_paged(); }
+    void init_sequence(SequenceState& sequence) const override;
+    bool truncate_cache(size_t tokens) override;
+
 protected:
     using Model::forward;
     size_t build_attention(CactusGraph* gb, size_t normalized_input, uint32_t layer_idx,
@@ -214,7 +230,12 @@ protected:
     size_t forward(CactusGraph* gb, size_t input_embeddings, size_t seq_len, ComputeBackend backend, bool use_cache = false);
     void post_init() override;
     void post_execute_updates(CactusGraph* gb, size_t seq_len) override;
+    void swap_sequence_state(SequenceState& sequence) override;
+    void post_execute_batch_updates(CactusGraph* gb) override;
     void reset_cache() override;
+    bool can_replay_decode_graph() const override;
+    void capture_decode_graph_inputs() override;
+    void patch_decode_graph(CactusGraph* gb) override;
     void load_weights_to_graph(CactusGraph* gb) override;
 
 private:
@@ -227,6 +248,7 @@ private:
         size_t attn_q_weight;
         size_t attn_k_weight;
         size_t attn_v_weight;
+        size_t attn_qkv_weight;
         size_t attn_output_weight;
         size_t attn_q_norm_weight;   
         size_t attn_k_norm_weight;
@@ -239,6 +261,7 @@ private:
         size_t post_attention_layernorm_weight;
         size_t ffn_gate_weight;
         size_t ffn_up_weight;
+        size_t ffn_gate_up_weight;
         size_t ffn_down_weight;
         };
 
@@ -254,6 +277,11 @@ private:
 
     ConvCache conv_cache_;
     std::vector<size_t> conv_cache_bx_nodes_;
+    // Conv window input bound per layer by the last single-sequence build, and the window
+    // inputs and Bx outputs of the captured decode graph.
+    std::vector<size_t> conv_window_nodes_;
+    std::vector<size_t> decode_conv_window_nodes_;
+    std::vector<size_t> decode_conv_bx_nodes_;
     bool last_forward_used_cache_ = false;
 };
 
@@ -428,6 +456,7 @@ private:
             size_t decoder_self_attn_q_weight;
             size_t decoder_self_attn_k_weight;
             size_t decoder_self_attn_v_weight;
+            size_t decoder_self_attn_qkv_weight;
             size_t decoder_self_attn_q_bias;
             size_t decoder_self_attn_v_bias;
             size_t decoder_self_attn_output_weight;
@@ -771,6 +800,10 @@ public:
         float* out_entropy = nullptr) override;
 
     void reset_cache() override;
+    bool save_cache_state(CacheState&) const override { return false; }
+    bool restore_cache_state(const CacheState&) override { return false; }
+    bool can_restore_cache_state(const CacheState&) const override { return false; }
+    bool truncate_cache(size_t) override { return false; }
     std::vector<float> get_image_embeddings(const std::string& image_path) override;
 
 protected:
@@ -35,9 +35,80 @@ void LFM2Model::reset_cache() {
         
     }
 }
+bool LFM2Model::save_cache_state(CacheState& state) const {
+    if (!Model::save_cache_state(state)) {
+        return false;
+    }
+    state.conv = conv_cache_.snapshot();
+    return true;
+}
+bool LFM2Model::restore_cache_state(const CacheState& state) {
+    if (!Model::restore_cache_state(state)) {
+        return false;
+    }
+    conv_cache_.restore(state.conv);
+    return true;
+}
+bool LFM2Model::can_restore_cache_state(const CacheState& state) const {
+    return Model::can_restore_cache_state(state) && conv_cache_.can_restore(state.conv);
+}
+bool LFM2Model::truncate_cache(size_t tokens) {
+    if (!kv_cache_.can_truncate(tokens) || !conv_cache_.can_truncate(tokens)) {
+        return false;
+    }
+    kv_cache_.truncate(tokens);
+    conv_cache_.truncate(tokens);
+    return true;
+}
+void LFM2Model::init_sequence(SequenceState& sequence) const {
+    Model::init_sequence(sequence);
+    sequence.conv_bx_nodes.assign(config_.num_layers, 0);
+    if (conv_cache_.window_size > 0) {
+        sequence.conv_cache.init(conv_cache_.num_layers, conv_cache_.hidden_size, conv_cache_.window_size, conv_cache_.precision);
+    }
+}
+void LFM2Model::swap_sequence_state(SequenceState& sequence) {
+    Model::swap_sequence_state(sequence);
+    std::swap(conv_cache_, sequence.conv_cache);
+}
+void LFM2Model::post_execute_batch_updates(CactusGraph* gb) {
+    for (auto* sequence : batch_) {
+        for (size_t layer_idx = 0; layer_idx < sequence->conv_bx_nodes.size(); ++layer_idx) {
+            sequence->conv_cache.update(gb, layer_idx, sequence->conv_bx_nodes[layer_idx]);
+            sequence->conv_bx_nodes[layer_idx] = 0;
+        }
+    }
+}
 bool LFM2Model::is_cache_empty() const {
     return kv_cache_.is_empty();
 }
+bool LFM2Model::can_replay_decode_graph() const {
+    if (!Model::can_replay_decode_graph()) {
+        return false;
+    }
+    for (uint32_t layer_idx = 0; layer_idx < weight_nodes_.layers.size(); ++layer_idx) {
+        if (weight_nodes_.layers[layer_idx].type == WeightNodeIDs::LayerType::CONV &&
+            conv_cache_.get_window(layer_idx).total_len != conv_cache_.window_size) {
+            return false;
+        }
+    }
+    return true;
+}
+void LFM2Model::capture_decode_graph_inputs() {
+    decode_conv_window_nodes_ = conv_window_nodes_;
+    decode_conv_bx_nodes_ = conv_cache_bx_nodes_;
+}
+void LFM2Model::patch_decode_graph(CactusGraph* gb) {
+    // The window rows start further into the state after each step and after a rollback.
+    for (size_t layer_idx = 0; layer_idx < decode_conv_window_nodes_.size(); ++layer_idx) {
+        if (decode_conv_window_nodes_[layer_idx] != 0) {
+            gb->set_external_input(decode_conv_window_nodes_[layer_idx],
+                                   const_cast<void*>(conv_cache_.get_window(layer_idx).ptr1), conv_cache_.precision);
+        }
+    }
+    conv_cache_bx_nodes_ = decode_conv_bx_nodes_;
+    last_forward_used_cache_ = true;
+}
 bool LFM2Model::init(const std::string& model_folder, size_t context_size, const std::string& system_prompt, bool do_warmup) {
     if (!Model::init(model_folder, context_size, system_prompt, do_warmup)) {
         return false;
@@ -103,9 +174,14 @@ void LFM2Model::load_weights_to_graph(CactusGraph* gb) {
             
         } else {
             layer_entry.type = WeightNodeIDs::LayerType::ATTENTION;
-            layer.attn_q_weight = gb->mmap_weights(layer_prefix + "attn_q.weights");
-            layer.attn_k_weight = gb->mmap_weights(layer_prefix + "attn_k.weights");
-            layer.attn_v_weight = gb->mmap_weights(layer_prefix + "attn_v.weights");
+            if (fuse_projections()) {
+                layer.attn_qkv_weight = gb->mmap_fused_weights({layer_prefix + "attn_q.weights",
+                    layer_prefix + "attn_k.weights", layer_prefix + "attn_v.weights"});
+            } else {
+                layer.attn_q_weight = gb->mmap_weights(layer_prefix + "attn_q.weights");
+                layer.attn_k_weight = gb->mmap_weights(layer_prefix + "attn_k.weights");
+                layer.attn_v_weight = gb->mmap_weights(layer_prefix + "attn_v.weights");
+            }
             layer.attn_output_weight = gb->mmap_weights(layer_prefix + "attn_output.weights");
             layer.attn_q_norm_weight = gb->mmap_weights(layer_prefix + "attn_q_norm.weights");
             layer.attn_k_norm_weight = gb->mmap_weights(layer_prefix + "attn_k_norm.weights");
@@ -113,8 +189,13 @@ void LFM2Model::load_weights_to_graph(CactusGraph* gb) {
         }
         layer.input_layernorm_weight = gb->mmap_weights(layer_prefix + "input_norm.weights");
         layer.post_attention_layernorm_weight = gb->mmap_weights(layer_prefix + "post_attn_norm.weights");
-        layer.ffn_gate_weight = gb->mmap_weights(layer_prefix + "ffn_gate.weights");
-        layer.ffn_up_weight = gb->mmap_weights(layer_prefix + "ffn_up.weights");
+        if (fuse_projections()) {
+            layer.ffn_gate_up_weight = gb->mmap_fused_weights({layer_prefix + "ffn_gate.weights",
+                layer_prefix + "ffn_up.weights"});
+        } else {
+            layer.ffn_gate_weight = gb->mmap_weights(layer_prefix + "ffn_gate.weights");
+            layer.ffn_up_weight = gb->mmap_weights(layer_prefix + "ffn_up.weights");
+        }
         layer.ffn_down_weight = gb->mmap_weights(layer_prefix + "ffn_down.weights");
         
     }
@@ -144,8 +225,9 @@ size_t LFM2Model::build_conv1d(CactusGraph* gb, size_t input, uint32_t layer_idx
     
     X  = gb->reshape(X,  {L, C});
     size_t Bx = gb->multiply(B, X);
-    if (use_cache) {
+    if (use_cache && batch_.empty()) {
         conv_cache_bx_nodes_[layer_idx] = Bx;
+        gb->mark_output(Bx);
         
     } else {
         conv_cache_bx_nodes_[layer_idx] = 0;
@@ -163,44 +245,65 @@ size_t LFM2Model::build_conv1d(CactusGraph* gb, size_t input, uint32_t layer_idx
     }
     K = wbuf.shape.back();
     
-    size_t conv_input_lc = Bx;
-    if (use_cache && conv_cache_.window_size > 0) {
-        auto view = conv_cache_.get_window(layer_idx);
-        std::vector<size_t> segments;
-        if (view.len2 > 0) {
-            size_t left_node = gb->input({view.len2, C}, conv_cache_.precision);
-            gb->set_external_input(left_node, const_cast<void*>(view.ptr2), conv_cache_.precision);
-            segments.push_back(left_node);
+    // Causal conv over the cached window followed by the new rows, keeping the last `rows` outputs.
+    auto causal_conv = [&](const ConvCache& cache, size_t bx, size_t rows) {
+        size_t conv_input_lc = bx;
+        if (use_cache && cache.window_size > 0) {
+            auto view = cache.get_window(layer_idx);
+            std::vector<size_t> segments;
+            if (view.len2 > 0) {
+                size_t left_node = gb->input({view.len2, C}, cache.precision);
+                gb->set_external_input(left_node, const_cast<void*>(view.ptr2), cache.precision);
+                segments.push_back(left_node);
 
-        }
-        if (view.len1 > 0) {
-            size_t right_node = gb->input({view.len1, C}, conv_cache_.precision);
-            gb->set_external_input(right_node, const_cast<void*>(view.ptr1), conv_cache_.precision);
-            segments.push_back(right_node);
-            
-        }
-        if (!segments.empty()) {
-            conv_input_lc = segments[0];
-            for (size_t idx = 1; idx < segments.size(); ++idx) {
-                conv_input_lc = gb->concat(conv_input_lc, segments[idx], 0);
-                
             }
-            conv_input_lc = gb->concat(conv_input_lc, Bx, 0);
-            
+            if (view.len1 > 0) {
+                size_t right_node = gb->input({view.len1, C}, cache.precision);
+                gb->set_external_input(right_node, const_cast<void*>(view.ptr1), cache.precision);
+                segments.push_back(right_node);
+                if (&cache == &conv_cache_ && view.len2 == 0 && layer_idx < conv_window_nodes_.size()) {
+                    conv_window_nodes_[layer_idx] = right_node;
+                }
+
+            }
+            if (!segments.empty()) {
+                conv_input_lc = segments[0];
+                for (size_t idx = 1; idx < segments.size(); ++idx) {
+                    conv_input_lc = gb->concat(conv_input_lc, segments[idx], 0);
+
+                }
+                conv_input_lc = gb->concat(conv_input_lc, bx, 0);
+
+            }
+        }
+
+        const auto& conv_input_buf = gb->get_output_buffer(conv_input_lc);
+        size_t total_len = conv_input_buf.shape[0];
+
+        size_t x_nlc = gb->reshape(conv_input_lc, {static_cast<size_t>(1), total_len, C});
+        const size_t dilation = 1;
+
+        size_t y_nlc = gb->conv1d_causal(x_nlc, conv_w, K, dilation);
+        size_t start = total_len > rows ? total_len - rows : 0;
+        size_t y_slice = gb->slice(y_nlc, 1, start, rows);
+
+        return gb->reshape(y_slice, {rows, C});
+    };
+
+    size_t y_lc;
+    if (use_cache && !batch_.empty()) {
+        // Batched decode: row i continues batch_[i], whose conv window lives in its own cache.
+        y_lc = 0;
+        for (size_t i = 0; i < batch_.size(); ++i) {
+            size_t bx_row = gb->slice(Bx, 0, i, 1);
+            batch_[i]->conv_bx_nodes[layer_idx] = bx_row;
+            gb->mark_output(bx_row);
+            size_t y_row = causal_conv(batch_[i]->conv_cache, bx_row, 1);
+            y_lc = i == 0 ? y_row : gb->concat(y_lc, y_row, 0);
         }
+    } else {
+        y_lc = causal_conv(conv_cache_, Bx, L);
     }
-    
-    const auto& conv_input_buf = gb->get_output_buffer(conv_input_lc);
-    size_t total_len = conv_input_buf.shape[0];
-    
-    size_t x_nlc = gb->reshape(conv_input_lc, {static_cast<size_t>(1), total_len, C});
-    const size_t dilation = 1;
-    
-    size_t y_nlc = gb->conv1d_causal(x_nlc, conv_w, K, dilation); 
-    size_t start = total_len > L ? total_len - L : 0;
-    size_t y_slice = gb->slice(y_nlc, 1, start, L);
-    
-    size_t y_lc = gb->reshape(y_slice, {L, C});
     size_t gated = gb->multiply(Cg, y_lc); 
     size_t projected = gb->matmul(gated, layer.conv_out_proj_weight, true, backend); 
     return projected;
@@ -210,9 +313,17 @@ size_t LFM2Model::build_attention(CactusGraph* gb, size_t normalized_input, uint
                                  ComputeBackend backend, bool use_cache, size_t position_offset) {
     const auto& layer_entry = weight_nodes_.layers[layer_idx];
     const auto& layer = layer_entry.weights;
-    auto q_proj_linear = gb->matmul(normalized_input, layer.attn_q_weight, true, backend);
-    auto k_proj_linear = gb->matmul(normalized_input, layer.attn_k_weight, true, backend);
-    auto v_proj_linear = gb->matmul(normalized_input, layer.attn_v_weight, true, backend);
+    size_t q_proj_linear, k_proj_linear, v_proj_linear;
+    if (fuse_projections()) {
+        auto qkv = gb->fused_matmul(normalized_input, layer.attn_qkv_weight, backend);
+        q_proj_linear = qkv[0];
+        k_proj_linear = qkv[1];
+        v_proj_linear = qkv[2];
+    } else {
+        q_proj_linear = gb->matmul(normalized_input, layer.attn_q_weight, true, backend);
+        k_proj_linear = gb->matmul(normalized_input, layer.attn_k_weight, true, backend);
+        v_proj_linear = gb->matmul(normalized_input, layer.attn_v_weight, true, backend);
+    }
     const auto& q_shape = gb->get_output_buffer(q_proj_linear).shape;
     size_t batch_seq = q_shape[0];
     size_t num_heads = config_.attention_heads;
@@ -235,30 +346,8 @@ size_t LFM2Model::build_attention(CactusGraph* gb, size_t normalized_input, uint
     auto k_proj_4d = gb->reshape(k_proj, {1, seq_len, config_.attention_kv_heads, config_.attention_head_dim});    
     auto v_proj_4d = gb->reshape(v_proj_linear, {1, seq_len, config_.attention_kv_heads, config_.attention_head_dim});
 
-    if (config_.rope_theta > 0) {
-        q_proj_4d = gb->rope(q_proj_4d, config_.rope_theta, position_offset);
-        k_proj_4d = gb->rope(k_proj_4d, config_.rope_theta, position_offset);
-    }
-    if (use_cache) {
-        cache_k_output_nodes_[layer_idx] = k_proj_4d;
-        cache_v_output_nodes_[layer_idx] = v_proj_4d;
-    }
-
-    size_t attn_output_4d;
-
-    if (use_cache && !kv_cache_.is_empty()) {
-        attn_output_4d = gb->attention_int8_hybrid(
-            q_proj_4d, k_proj_4d, v_proj_4d,
-            attention_scale_, position_offset,
-            kv_cache_.get_keys_int8(layer_idx),
-            kv_cache_.get_values_int8(layer_idx),
-            kv_cache_.get_key_scales(layer_idx),
-            kv_cache_.get_value_scales(layer_idx),
-            kv_cache_.current_seq_len, num_kv_heads, head_dim
-        );
-    } else {
-        attn_output_4d = gb->attention(q_proj_4d, k_proj_4d, v_proj_4d, attention_scale_, position_offset);
-    }
+    size_t attn_output_4d = build_cached_attention(gb, q_proj_4d, k_proj_4d, v_proj_4d, layer_idx,
+                                                   config_.rope_theta, use_cache, position_offset);
     auto attn_output = gb->reshape(attn_output_4d, {seq_len, config_.attention_head_dim * config_.attention_heads});
     auto projected = gb->matmul(attn_output, layer.attn_output_weight, true, backend);
     return projected;
@@ -267,8 +356,15 @@ size_t LFM2Model::build_attention(CactusGraph* gb, size_t normalized_input, uint
 size_t LFM2Model::build_mlp(CactusGraph* gb, size_t normalized_h, uint32_t layer_idx, ComputeBackend backend) const {
     const auto& layer_entry = weight_nodes_.layers[layer_idx];
     const auto& layer = layer_entry.weights;
-    auto gate = gb->matmul(normalized_h, layer.ffn_gate_weight, true, backend);
-    auto up = gb->matmul(normalized_h, layer.ffn_up_weight, true, backend);
+    size_t gate, up;
+    if (fuse_projections()) {
+        auto gate_up = gb->fused_matmul(normalized_h, layer.ffn_gate_up_weight, backend);
+        gate = gate_up[0];
+        up = gate_up[1];
+    } else {
+        gate = gb->matmul(normalized_h, layer.ffn_gate_weight, true, backend);
+        up = gb->matmul(normalized_h, layer.ffn_up_weight, true, backend);
+    }
     auto activated = gb->multiply(gb->silu(gate), up);
     
     auto down = gb->matmul(activated, layer.ffn_down_weight, true, backend);
@@ -309,6 +405,7 @@ size_t LFM2Model::forward(CactusGraph* gb, size_t input_embeddings, size_t seq_l
         
     }
     std::fill(conv_cache_bx_nodes_.begin(), conv_cache_bx_nodes_.end(), 0);
+    conv_window_nodes_.assign(config_.num_layers, 0);
     
     last_forward_used_cache_ = use_cache;
     
@@ -543,6 +543,9 @@ uint32_t Lfm2VlModel::decode_with_images(
 
     auto logits_node_id = gb->matmul(final_hidden_node, language_model_.output_weight_node_id_, true, backend);
     auto sampled_token_id = gb->sample(logits_node_id, temperature, top_p, top_k);
+    if (out_entropy) {
+        gb->mark_output(logits_node_id);
+    }
     if (!profile_file.empty()) {
         gb->execute(profile_file);
 
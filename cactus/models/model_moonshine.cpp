@@ -275,6 +275,8 @@ size_t MoonshineModel::build_decoder_self_attention(CactusGraph* gb, size_t inpu
         cache_k_output_nodes_[layer_idx] = k_4d;
         cache_v_output_nodes_[layer_idx] = v_4d;
     }
+    gb->mark_output(cache_k_output_nodes_[layer_idx]);
+    gb->mark_output(cache_v_output_nodes_[layer_idx]);
     auto attn_out_4d = gb->attention(q_4d, final_k, final_v, attention_scale_, position_offset);
     auto attn_out    = gb->reshape(attn_out_4d, {seq_new, num_heads * head_dim});
     auto output = gb->matmul(attn_out, layer.decoder_self_attn_output_weight, true, backend);
@@ -578,6 +580,9 @@ uint32_t MoonshineModel::decode_with_audio(
         logits_node = build_decoder(last_token_vec, true, true);
     }
     size_t sampled_token_id = gb->sample(logits_node, temperature, top_p, top_k);
+    if (out_entropy) {
+        gb->mark_output(logits_node);
+    }
     if (!profile_file.empty()) gb->execute(profile_file);
    	else gb->execute();
     if (out_entropy) {
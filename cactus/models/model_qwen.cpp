@@ -29,15 +29,22 @@ void QwenModel::load_weights_to_graph(CactusGraph* gb) {
     for (uint32_t i = 0; i < config_.num_layers; i++) {
         auto& layer = weight_nodes_.layers[i];
         std::string layer_prefix = model_folder_path_ + "/layer_" + std::to_string(i) + "_";
-        layer.attn_q_weight = gb->mmap_weights(layer_prefix + "attn_q.weights");
-        layer.attn_k_weight = gb->mmap_weights(layer_prefix + "attn_k.weights");
-        layer.attn_v_weight = gb->mmap_weights(layer_prefix + "attn_v.weights");
+        if (fuse_projections()) {
+            layer.attn_qkv_weight = gb->mmap_fused_weights({layer_prefix + "attn_q.weights",
+                layer_prefix + "attn_k.weights", layer_prefix + "attn_v.weights"});
+            layer.ffn_gate_up_weight = gb->mmap_fused_weights({layer_prefix + "ffn_gate.weights",
+                layer_prefix + "ffn_up.weights"});
+        } else {
+            layer.attn_q_weight = gb->mmap_weights(layer_prefix + "attn_q.weights");
+            layer.attn_k_weight = gb->mmap_weights(layer_prefix + "attn_k.weights");
+            layer.attn_v_weight = gb->mmap_weights(layer_prefix + "attn_v.weights");
+            layer.ffn_gate_weight = gb->mmap_weights(layer_prefix + "ffn_gate.weights");
+            layer.ffn_up_weight = gb->mmap_weights(layer_prefix + "ffn_up.weights");
+        }
         layer.attn_output_weight = gb->mmap_weights(layer_prefix + "attn_output.weights");
         layer.input_layernorm_weight = gb->mmap_weights(layer_prefix + "input_norm.weights");
         layer.attn_q_norm_weight = gb->mmap_weights(layer_prefix + "attn_q_norm.weights");
         layer.attn_k_norm_weight = gb->mmap_weights(layer_prefix + "attn_k_norm.weights");
-        layer.ffn_gate_weight = gb->mmap_weights(layer_prefix + "ffn_gate.weights");
-        layer.ffn_up_weight = gb->mmap_weights(layer_prefix + "ffn_up.weights");
         layer.ffn_down_weight = gb->mmap_weights(layer_prefix + "ffn_down.weights");
         layer.post_attention_layernorm_weight = gb->mmap_weights(layer_prefix + "post_attn_norm.weights");
     }
@@ -52,9 +59,17 @@ size_t QwenModel::build_attention(CactusGraph* gb, size_t normalized_input, uint
                                  ComputeBackend backend, bool use_cache, size_t position_offset) {
     const auto& layer = weight_nodes_.layers[layer_idx];
 
-    auto q_proj = gb->matmul(normalized_input, layer.attn_q_weight, true, backend);
-    auto k_proj = gb->matmul(normalized_input, layer.attn_k_weight, true, backend);
-    auto v_proj = gb->matmul(normalized_input, layer.attn_v_weight, true, backend);
+    size_t q_proj, k_proj, v_proj;
+    if (fuse_projections()) {
+        auto qkv = gb->fused_matmul(normalized_input, layer.attn_qkv_weight, backend);
+        q_proj = qkv[0];
+        k_proj = qkv[1];
+        v_proj = qkv[2];
+    } else {
+        q_proj = gb->matmul(normalized_input, layer.attn_q_weight, true, backend);
+        k_proj = gb->matmul(normalized_input, layer.attn_k_weight, true, backend);
+        v_proj = gb->matmul(normalized_input, layer.attn_v_weight, true, backend);
+    }
 
     const auto& q_shape = gb->get_output_buffer(q_proj).shape;
     size_t batch_seq = q_shape[0];
@@ -75,31 +90,8 @@ size_t QwenModel::build_attention(CactusGraph* gb, size_t normalized_input, uint
     auto k_proj_4d = gb->reshape(k_proj, {1, seq_len, config_.attention_kv_heads, config_.attention_head_dim});
     auto v_proj_4d = gb->reshape(v_proj, {1, seq_len, config_.attention_kv_heads, config_.attention_head_dim});
 
-    if (config_.rope_theta > 0) {
-        q_proj_4d = gb->rope(q_proj_4d, config_.rope_theta, position_offset);
-        k_proj_4d = gb->rope(k_proj_4d, config_.rope_theta, position_offset);
-    }
-
-    size_t attn_output_4d;
-
-    if (use_cache) {
-        cache_k_output_nodes_[layer_idx] = k_proj_4d;
-        cache_v_output_nodes_[layer_idx] = v_proj_4d;
-    }
-
-    if (use_cache && !kv_cache_.is_empty()) {
-        attn_output_4d = gb->attention_int8_hybrid(
-            q_proj_4d, k_proj_4d, v_proj_4d,
-            attention_scale_, position_offset,
-            kv_cache_.get_keys_int8(layer_idx),
-            kv_cache_.get_values_int8(layer_idx),
-            kv_cache_.get_key_scales(layer_idx),
-            kv_cache_.get_value_scales(layer_idx),
-            kv_cache_.current_seq_len, num_kv_heads, head_dim
-        );
-    } else {
-        attn_output_4d = gb->attention(q_proj_4d, k_proj_4d, v_proj_4d, attention_scale_, position_offset);
-    }
+    size_t attn_output_4d = build_cached_attention(gb, q_proj_4d, k_proj_4d, v_proj_4d, layer_idx,
+                                                   config_.rope_theta, use_cache, position_offset);
 
     auto attn_output = gb->reshape(attn_output_4d, {seq_len, config_.attention_head_dim * config_.attention_heads});
     return gb->matmul(attn_output, layer.attn_output_weight, true, backend);
@@ -109,8 +101,15 @@ size_t QwenModel::build_attention(CactusGraph* gb, size_t normalized_input, uint
 size_t QwenModel::build_mlp(CactusGraph* gb, size_t normalized_h, uint32_t layer_idx,
                            ComputeBackend backend) const {
     const auto& layer = weight_nodes_.layers[layer_idx];
-    size_t gate_output = gb->matmul(normalized_h, layer.ffn_gate_weight, true, backend);
-    size_t up_output = gb->matmul(normalized_h, layer.ffn_up_weight, true, backend);
+    size_t gate_output, up_output;
+    if (fuse_projections()) {
+        auto gate_up = gb->fused_matmul(normalized_h, layer.ffn_gate_up_weight, backend);
+        gate_output = gate_up[0];
+        up_output = gate_up[1];
+    } else {
+        gate_output = gb->matmul(normalized_h, layer.ffn_gate_weight, true, backend);
+        up_output = gb->matmul(normalized_h, layer.ffn_up_weight, true, backend);
+    }
     size_t gate_silu = gb->silu(gate_output);
     size_t gated = gb->multiply(gate_silu, up_output);
     return gb->matmul(gated, layer.ffn_down_weight, true, backend);
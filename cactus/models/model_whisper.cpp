@@ -94,9 +94,14 @@ void WhisperModel::load_weights_to_graph(CactusGraph* gb) {
         layer.decoder_post_ffn_layernorm_weight = gb->mmap_weights(layer_prefix + "final_norm.weights");
         layer.decoder_post_ffn_layernorm_bias = gb->mmap_weights(layer_prefix + "final_norm.bias");
 
-        layer.decoder_self_attn_k_weight = gb->mmap_weights(layer_prefix + "self_attn_k.weights");
-        layer.decoder_self_attn_q_weight = gb->mmap_weights(layer_prefix + "self_attn_q.weights");
-        layer.decoder_self_attn_v_weight = gb->mmap_weights(layer_prefix + "self_attn_v.weights");
+        if (fuse_projections()) {
+            layer.decoder_self_attn_qkv_weight = gb->mmap_fused_weights({layer_prefix + "self_attn_q.weights",
+                layer_prefix + "self_attn_k.weights", layer_prefix + "self_attn_v.weights"});
+        } else {
+            layer.decoder_self_attn_k_weight = gb->mmap_weights(layer_prefix + "self_attn_k.weights");
+            layer.decoder_self_attn_q_weight = gb->mmap_weights(layer_prefix + "self_attn_q.weights");
+            layer.decoder_self_attn_v_weight = gb->mmap_weights(layer_prefix + "self_attn_v.weights");
+        }
         layer.decoder_self_attn_output_weight = gb->mmap_weights(layer_prefix + "self_attn_output.weights");
         layer.decoder_self_attn_q_bias = gb->mmap_weights(layer_prefix + "self_attn_q.bias");
         layer.decoder_self_attn_v_bias = gb->mmap_weights(layer_prefix + "self_attn_v.bias");
@@ -252,11 +257,18 @@ void WhisperModel::reset_cache() {
 size_t WhisperModel::build_decoder_self_attention(CactusGraph* gb, size_t input, uint32_t layer_idx, ComputeBackend backend, bool use_cache, size_t position_offset){
     const auto& layer = weight_nodes_.layers[layer_idx];
 
-    auto q = gb->matmul(input, layer.decoder_self_attn_q_weight, true, backend);
+    size_t q, k, v;
+    if (fuse_projections()) {
+        auto qkv = gb->fused_matmul(input, layer.decoder_self_attn_qkv_weight, backend);
+        q = qkv[0];
+        k = qkv[1];
+        v = qkv[2];
+    } else {
+        q = gb->matmul(input, layer.decoder_self_attn_q_weight, true, backend);
+        k = gb->matmul(input, layer.decoder_self_attn_k_weight, true, backend);
+        v = gb->matmul(input, layer.decoder_self_attn_v_weight, true, backend);
+    }
     q = gb->add(q, layer.decoder_self_attn_q_bias);
-
-    auto k = gb->matmul(input, layer.decoder_self_attn_k_weight, true, backend);
-    auto v = gb->matmul(input, layer.decoder_self_attn_v_weight, true, backend);
     v = gb->add(v, layer.decoder_self_attn_v_bias);
 
     const auto& q_shape = gb->get_output_buffer(q).shape;
@@ -314,6 +326,8 @@ size_t WhisperModel::build_decoder_self_attention(CactusGraph* gb, size_t input,
         cache_k_output_nodes_[layer_idx] = k_4d;
         cache_v_output_nodes_[layer_idx] = v_4d;
     }
+    gb->mark_output(cache_k_output_nodes_[layer_idx]);
+    gb->mark_output(cache_v_output_nodes_[layer_idx]);
 
     auto attn_out_4d = gb->attention(q_4d, final_k, final_v, attention_scale_, position_offset);
     auto attn_out    = gb->reshape(attn_out_4d, {seq_new, num_heads * head_dim});
@@ -719,6 +733,9 @@ uint32_t WhisperModel::decode_with_audio(
     }
 
     size_t sampled_token_id = gb->sample(logits_node, temperature, top_p, top_k);
+    if (out_entropy) {
+        gb->mark_output(logits_node);
+    }
     if (!profile_file.empty()) gb->execute(profile_file);
     else gb->execute();
 
@@ -5,6 +5,7 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include "../kernel/kernel_simd.h"
 
 namespace cactus {
 namespace npu {
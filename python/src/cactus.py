@@ -87,6 +87,18 @@ _lib.cactus_audio_embed.restype = ctypes.c_int
 _lib.cactus_reset.argtypes = [ctypes.c_void_p]
 _lib.cactus_reset.restype = None
 
+_lib.cactus_session_save.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.cactus_session_save.restype = ctypes.c_int
+
+_lib.cactus_session_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.cactus_session_load.restype = ctypes.c_int
+
+_lib.cactus_truncate.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+_lib.cactus_truncate.restype = ctypes.c_int
+
+_lib.cactus_set_draft_model.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+_lib.cactus_set_draft_model.restype = ctypes.c_int
+
 _lib.cactus_stop.argtypes = [ctypes.c_void_p]
 _lib.cactus_stop.restype = None
 
@@ -105,6 +117,17 @@ _lib.cactus_tokenize.argtypes = [
 ]
 _lib.cactus_tokenize.restype = ctypes.c_int
 
+_lib.cactus_tokenize_batch.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_char_p),
+    ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_size_t),
+    ctypes.POINTER(ctypes.c_size_t),
+]
+_lib.cactus_tokenize_batch.restype = ctypes.c_int
+
 _lib.cactus_score_window.argtypes = [
     ctypes.c_void_p,
     ctypes.POINTER(ctypes.c_uint32),
@@ -401,6 +424,30 @@ def cactus_reset(model):
     _lib.cactus_reset(model)
 
 
+def cactus_session_save(model, path):
+    """Save the conversation state (KV cache and processed tokens) to a file."""
+    if _lib.cactus_session_save(model, path.encode() if isinstance(path, str) else path) != 0:
+        raise RuntimeError(cactus_get_last_error())
+
+
+def cactus_session_load(model, path):
+    """Restore a conversation state saved with cactus_session_save, skipping its prefill."""
+    if _lib.cactus_session_load(model, path.encode() if isinstance(path, str) else path) != 0:
+        raise RuntimeError(cactus_get_last_error())
+
+
+def cactus_truncate(model, num_tokens):
+    """Drop the last num_tokens processed tokens, e.g. to regenerate the last answer."""
+    if _lib.cactus_truncate(model, num_tokens) != 0:
+        raise RuntimeError(cactus_get_last_error())
+
+
+def cactus_set_draft_model(model, draft_model, draft_tokens=0):
+    """Attach a draft model for speculative decoding (None detaches it)."""
+    if _lib.cactus_set_draft_model(model, draft_model, draft_tokens) != 0:
+        raise RuntimeError(cactus_get_last_error())
+
+
 def cactus_stop(model):
     """Stop an ongoing generation (useful with streaming callbacks)."""
     _lib.cactus_stop(model)
@@ -455,6 +502,33 @@ def cactus_tokenize(model, text: str):
     return [arr[i] for i in range(n)]
 
 
+def cactus_tokenize_batch(model, texts):
+    """
+    Tokenize several texts in parallel.
+
+    Args:
+        model: Model handle from cactus_init
+        texts: List of texts to tokenize
+
+    Returns:
+        List of token ID lists, one per text.
+    """
+    encoded = (ctypes.c_char_p * len(texts))(*[t.encode("utf-8") for t in texts])
+    offsets = (ctypes.c_size_t * (len(texts) + 1))()
+    needed = ctypes.c_size_t(0)
+    rc = _lib.cactus_tokenize_batch(model, encoded, len(texts), None, 0, offsets, ctypes.byref(needed))
+    if rc != 0:
+        raise RuntimeError(f"cactus_tokenize_batch length query failed rc={rc}")
+
+    n = needed.value
+    arr = (ctypes.c_uint32 * max(n, 1))()
+    rc = _lib.cactus_tokenize_batch(model, encoded, len(texts), arr, n, offsets, ctypes.byref(needed))
+    if rc != 0:
+        raise RuntimeError(f"cactus_tokenize_batch fetch failed rc={rc}")
+
+    return [arr[offsets[i]:offsets[i + 1]] for i in range(len(texts))]
+
+
 def cactus_score_window(model, tokens, start, end, context):
     """
     Score a window of tokens for perplexity/log probability.
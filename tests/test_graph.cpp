@@ -6,6 +6,8 @@
 #include <cmath>
 #include <iostream>
 #include <cstdio>
+#include <algorithm>
+#include <functional>
 
 bool test_basic_operations() {
     TestUtils::FP16TestFixture fixture("Basic Operations");
@@ -567,6 +569,317 @@ bool test_multiple_outputs() {
            fixture.verify_output(combine_result, expected_combine);
 }
 
+bool test_dead_buffer_release() {
+    TestUtils::FP16TestFixture fixture("Dead Buffer Release");
+    fixture.graph().set_release_dead_buffers(true);
+
+    size_t input_a = fixture.create_input({4, 2});
+    size_t h = fixture.graph().scalar_add(input_a, 1.0f);
+    size_t kept = fixture.graph().scalar_multiply(h, 2.0f);
+    fixture.graph().mark_output(kept);
+    size_t row = fixture.graph().slice(kept, 0, 2, 1);
+    size_t doubled = fixture.graph().add(row, row);
+    for (int i = 0; i < 4; ++i) {
+        doubled = fixture.graph().scalar_add(doubled, 1.0f);
+    }
+
+    std::vector<__fp16> data_a = {1, 2, 3, 4, 5, 6, 7, 8};
+    fixture.set_input_data(input_a, data_a);
+    fixture.execute();
+
+    std::vector<__fp16> expected_kept = {4, 6, 8, 10, 12, 14, 16, 18};
+    std::vector<__fp16> expected_out = {28, 32};
+    return fixture.verify_output(kept, expected_kept) &&
+           fixture.verify_output(doubled, expected_out);
+}
+
+bool test_static_memory_plan() {
+    TestUtils::FP16TestFixture fixture("Static Memory Plan");
+    fixture.graph().set_static_memory_plan(true);
+
+    size_t input_a = fixture.create_input({64, 32});
+    size_t h = input_a;
+    for (int i = 0; i < 6; ++i) {
+        size_t wide = fixture.graph().scalar_add(h, 1.0f);
+        h = fixture.graph().scalar_multiply(wide, 0.5f);
+    }
+    size_t row = fixture.graph().index(h, 3, 0);
+
+    std::vector<__fp16> data_a(64 * 32, static_cast<__fp16>(1.0f));
+    fixture.set_input_data(input_a, data_a);
+    fixture.execute();
+
+    std::vector<__fp16> expected(32, static_cast<__fp16>(1.0f));
+    if (!fixture.verify_output(row, expected)) return false;
+
+    const auto& arena = fixture.graph().activation_arena();
+    if (arena.arena_bytes() == 0 || arena.arena_bytes() >= arena.tensor_bytes()) return false;
+    if (arena.fragmentation() < 0.0f || arena.fragmentation() >= 1.0f) return false;
+
+    size_t planned = arena.arena_bytes();
+    fixture.execute();
+    return arena.arena_bytes() == planned && fixture.verify_output(row, expected);
+}
+
+bool test_operator_fusion() {
+    TestUtils::FP16TestFixture fixture("Operator Fusion");
+    CactusGraph& graph = fixture.graph();
+    graph.set_operator_fusion(true);
+
+    const size_t M = 4, K = 16, N = 8;
+    size_t input_a = fixture.create_input({M, K});
+    size_t input_b = fixture.create_input({M, K});
+    size_t weight = fixture.create_input({K});
+    size_t gate_weight = fixture.create_input({N, K});
+    size_t up_weight = fixture.create_input({N, K});
+
+    size_t sum = graph.add(input_a, input_b);
+    size_t norm = graph.rms_norm(sum, weight);
+    size_t gate = graph.matmul(norm, gate_weight, true);
+    size_t up = graph.matmul(norm, up_weight, true);
+    size_t mlp = graph.multiply(graph.silu(gate), up);
+    size_t residual = graph.add(sum, norm);
+
+    std::vector<__fp16> a(M * K), b(M * K), w(K), wg(N * K), wu(N * K);
+    for (size_t i = 0; i < M * K; ++i) {
+        a[i] = static_cast<__fp16>((static_cast<int>(i % 7) - 3) * 0.25f);
+        b[i] = static_cast<__fp16>((static_cast<int>(i % 5) - 2) * 0.5f);
+    }
+    for (size_t k = 0; k < K; ++k) {
+        w[k] = static_cast<__fp16>(1.0f + 0.05f * k);
+    }
+    for (size_t n = 0; n < N; ++n) {
+        for (size_t k = 0; k < K; ++k) {
+            wg[n * K + k] = static_cast<__fp16>((static_cast<int>((n + k) % 3) - 1) * 0.1f);
+            wu[n * K + k] = static_cast<__fp16>((static_cast<int>((n * k) % 4) - 1.5f) * 0.1f);
+        }
+    }
+    fixture.set_input_data(input_a, a);
+    fixture.set_input_data(input_b, b);
+    fixture.set_input_data(weight, w);
+    fixture.set_input_data(gate_weight, wg);
+    fixture.set_input_data(up_weight, wu);
+    fixture.execute();
+
+    std::vector<float> s(M * K), normed(M * K);
+    std::vector<__fp16> expected_residual(M * K), expected_mlp(M * N);
+    for (size_t m = 0; m < M; ++m) {
+        float sum_squares = 0.0f;
+        for (size_t k = 0; k < K; ++k) {
+            s[m * K + k] = static_cast<float>(a[m * K + k]) + static_cast<float>(b[m * K + k]);
+            sum_squares += s[m * K + k] * s[m * K + k];
+        }
+        float inv_rms = 1.0f / sqrtf(sum_squares / K + 1e-5f);
+        for (size_t k = 0; k < K; ++k) {
+            normed[m * K + k] = s[m * K + k] * inv_rms * static_cast<float>(w[k]);
+            expected_residual[m * K + k] = static_cast<__fp16>(s[m * K + k] + normed[m * K + k]);
+        }
+        for (size_t n = 0; n < N; ++n) {
+            float g = 0.0f, u = 0.0f;
+            for (size_t k = 0; k < K; ++k) {
+                g += normed[m * K + k] * static_cast<float>(wg[n * K + k]);
+                u += normed[m * K + k] * static_cast<float>(wu[n * K + k]);
+            }
+            expected_mlp[m * N + n] = static_cast<__fp16>(g / (1.0f + expf(-g)) * u);
+        }
+    }
+
+    // add -> rms_norm keeps both nodes; gate/up matmul + silu + multiply collapse into one.
+    if (graph.get_node_count() != 9) return false;
+
+    return fixture.verify_output(residual, expected_residual, 0.02f) &&
+           fixture.verify_output(mlp, expected_mlp, 0.02f);
+}
+
+bool test_swiglu_decode_row() {
+    // One decode row over a width that ends in a partial 256-column tile, for separate
+    // gate/up weights and for one [gate | up] weight split by column slices.
+    const size_t K = 32, N = 600;
+    std::vector<__fp16> x(K), w(2 * N * K);
+    for (size_t k = 0; k < K; ++k) {
+        x[k] = static_cast<__fp16>((static_cast<int>(k % 9) - 4) * 0.125f);
+    }
+    for (size_t i = 0; i < w.size(); ++i) {
+        w[i] = static_cast<__fp16>((static_cast<int>((i * 7) % 11) - 5) * 0.05f);
+    }
+
+    std::vector<float> expected(N);
+    for (size_t n = 0; n < N; ++n) {
+        float g = 0.0f, u = 0.0f;
+        for (size_t k = 0; k < K; ++k) {
+            g += static_cast<float>(x[k]) * static_cast<float>(w[n * K + k]);
+            u += static_cast<float>(x[k]) * static_cast<float>(w[(N + n) * K + k]);
+        }
+        expected[n] = g / (1.0f + expf(-g)) * u;
+    }
+
+    for (bool fused_weight : {false, true}) {
+        CactusGraph graph;
+        graph.set_operator_fusion(true);
+        size_t input = graph.input({1, K}, Precision::FP16);
+        graph.set_input(input, x.data(), Precision::FP16);
+
+        size_t gate, up;
+        if (fused_weight) {
+            size_t weight = graph.input({2 * N, K}, Precision::FP16);
+            graph.set_input(weight, w.data(), Precision::FP16);
+            size_t projected = graph.matmul(input, weight, true);
+            gate = graph.slice(projected, 1, 0, N);
+            up = graph.slice(projected, 1, N, N);
+        } else {
+            size_t gate_weight = graph.input({N, K}, Precision::FP16);
+            size_t up_weight = graph.input({N, K}, Precision::FP16);
+            graph.set_input(gate_weight, w.data(), Precision::FP16);
+            graph.set_input(up_weight, w.data() + N * K, Precision::FP16);
+            gate = graph.matmul(input, gate_weight, true);
+            up = graph.matmul(input, up_weight, true);
+        }
+        size_t mlp = graph.multiply(graph.silu(gate), up);
+        graph.execute();
+
+        if (graph.get_node_count() != (fused_weight ? 3u : 4u)) return false;
+        const __fp16* out = static_cast<const __fp16*>(graph.get_output(mlp));
+        for (size_t n = 0; n < N; ++n) {
+            if (std::abs(static_cast<float>(out[n]) - expected[n]) > 0.02f) return false;
+        }
+    }
+    return true;
+}
+
+bool test_lm_head_sample_fusion() {
+    // A grouped INT8 head whose vocabulary is not a whole number of 256-column tiles.
+    const size_t K = 64, N = 1000, group_size = 32, num_groups = K / group_size;
+    std::vector<int8_t> weights(N * K);
+    for (size_t n = 0; n < N; ++n) {
+        for (size_t k = 0; k < K; ++k) {
+            int8_t value = static_cast<int8_t>(static_cast<int>((n * 37 + k * 11 + n * k) % 127) - 63);
+            weights[(n / 4 * (K / 4) + k / 4) * 16 + n % 4 * 4 + k % 4] = value;
+        }
+    }
+    std::vector<__fp16> scales(N * num_groups, static_cast<__fp16>(1.0f / 64.0f));
+    std::vector<__fp16> x(K);
+    for (size_t k = 0; k < K; ++k) {
+        x[k] = static_cast<__fp16>((static_cast<int>(k % 9) - 4) * 0.125f);
+    }
+    // Five rows aligned with x stand well clear of the rest, even after the repetition penalty.
+    const size_t favoured[] = {10, 200, 401, 777, 999};
+    for (size_t j = 0; j < 5; ++j) {
+        const size_t n = favoured[j];
+        for (size_t k = 0; k < K; ++k) {
+            int sign = static_cast<float>(x[k]) < 0.0f ? -1 : 1;
+            weights[(n / 4 * (K / 4) + k / 4) * 16 + n % 4 * 4 + k % 4] = static_cast<int8_t>(sign * (100 + 5 * static_cast<int>(j)));
+        }
+    }
+
+    std::vector<float> logits(N);
+    auto run = [&](bool fusion, float temperature, size_t top_k, float& entropy, size_t& node_count) {
+        CactusGraph graph;
+        graph.set_operator_fusion(fusion);
+        size_t input = graph.input({1, K}, Precision::FP16);
+        size_t head = graph.input({N, K}, Precision::INT8);
+        graph.set_input(head, weights.data(), Precision::INT8);
+        graph.set_grouped_scales(head, group_size, num_groups, scales.data());
+        graph.set_interleaved(head, true, N);
+        graph.set_input(input, x.data(), Precision::FP16);
+
+        size_t projected = graph.matmul(input, head, true);
+        size_t sampled = graph.sample(projected, temperature, 0.0f, top_k, {}, true);
+        if (!fusion) {
+            graph.mark_output(projected);
+        }
+        graph.execute();
+
+        node_count = graph.get_node_count();
+        if (!fusion) {
+            const __fp16* row = static_cast<const __fp16*>(graph.get_output(projected));
+            for (size_t n = 0; n < N; ++n) logits[n] = static_cast<float>(row[n]);
+        }
+        const auto* output = static_cast<const uint32_t*>(graph.get_output(sampled));
+        entropy = reinterpret_cast<const float*>(output)[1];
+        return output[0];
+    };
+
+    float entropy = 0.0f, fused_entropy = 0.0f;
+    size_t nodes = 0, fused_nodes = 0;
+    uint32_t token = run(false, 0.0f, 0, entropy, nodes);
+    uint32_t fused_token = run(true, 0.0f, 0, fused_entropy, fused_nodes);
+    if (nodes != 4 || fused_nodes != 3) return false;
+    if (token != fused_token || token != std::max_element(logits.begin(), logits.end()) - logits.begin()) return false;
+    if (std::abs(entropy - fused_entropy) > 1e-3f || entropy <= 0.0f) return false;
+
+    // With top-k 5, every draw must be one of the favoured rows.
+    std::vector<float> sorted = logits;
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    for (int draw = 0; draw < 8; ++draw) {
+        fused_token = run(true, 1.0f, 5, fused_entropy, fused_nodes);
+        if (fused_token >= N || logits[fused_token] < sorted[4]) return false;
+    }
+    return true;
+}
+
+bool test_parallel_region() {
+    TestUtils::FP16TestFixture fixture("Parallel Region");
+    fixture.graph().set_parallel_region(true);
+
+    const size_t rows = 128, cols = 256;
+    size_t input_a = fixture.create_input({rows, cols});
+    size_t input_b = fixture.create_input({rows, cols});
+    size_t h = fixture.graph().add(input_a, input_b);
+    for (int i = 0; i < 4; ++i) {
+        h = fixture.graph().scalar_multiply(fixture.graph().scalar_add(h, 1.0f), 0.5f);
+    }
+
+    std::vector<__fp16> data_a(rows * cols), data_b(rows * cols);
+    for (size_t i = 0; i < rows * cols; ++i) {
+        data_a[i] = static_cast<__fp16>(static_cast<float>(i % 7));
+        data_b[i] = static_cast<__fp16>(static_cast<float>(i % 5));
+    }
+    fixture.set_input_data(input_a, data_a);
+    fixture.set_input_data(input_b, data_b);
+
+    std::vector<__fp16> expected(rows * cols);
+    for (size_t i = 0; i < rows * cols; ++i) {
+        float v = static_cast<float>(i % 7) + static_cast<float>(i % 5);
+        for (int k = 0; k < 4; ++k) v = (v + 1.0f) * 0.5f;
+        expected[i] = static_cast<__fp16>(v);
+    }
+
+    for (int run = 0; run < 3; ++run) {
+        fixture.execute();
+        if (!fixture.verify_output(h, expected)) return false;
+    }
+    return true;
+}
+
+bool test_inter_op_waves() {
+    TestUtils::FP16TestFixture fixture("Inter-Op Waves");
+    CactusGraph& graph = fixture.graph();
+    graph.set_threading_policy(ThreadingPolicy::INTER_OP);
+    graph.set_static_memory_plan(true);
+    graph.set_release_dead_buffers(true);
+
+    size_t input = fixture.create_input({2, 8});
+    size_t a = graph.scalar_add(input, 1.0f);
+    size_t b = graph.scalar_multiply(input, 2.0f);
+    size_t c = graph.scalar_subtract(input, 3.0f);
+    size_t result = graph.add(graph.add(a, b), c);
+    graph.mark_output(result);
+
+    std::vector<__fp16> data(16);
+    std::vector<__fp16> expected(16);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<__fp16>(static_cast<float>(i) * 0.25f);
+        expected[i] = static_cast<__fp16>(static_cast<float>(i) - 2.0f);
+    }
+    fixture.set_input_data(input, data);
+
+    for (int run = 0; run < 2; ++run) {
+        fixture.execute();
+        if (!fixture.verify_output(result, expected)) return false;
+    }
+    return true;
+}
+
 bool test_graph_reset() {
     CactusGraph graph;
 
@@ -775,6 +1088,112 @@ bool test_mmap_gather() {
     return passed;
 }
 
+bool test_fused_weights() {
+    CactusGraph graph;
+
+    const size_t K = 4;
+    std::vector<__fp16> w0 = {1, 0, 0, 0,  0, 1, 0, 0};
+    std::vector<__fp16> w1 = {0, 0, 1, 0,  0, 0, 0, 1,  1, 1, 1, 1};
+
+    size_t temp_w0 = graph.input({2, K}, Precision::FP16);
+    size_t temp_w1 = graph.input({3, K}, Precision::FP16);
+    graph.set_input(temp_w0, w0.data(), Precision::FP16);
+    graph.set_input(temp_w1, w1.data(), Precision::FP16);
+
+    const std::string file0 = "test_fused_w0.bin";
+    const std::string file1 = "test_fused_w1.bin";
+    GraphFile::save_node(graph, temp_w0, file0);
+    GraphFile::save_node(graph, temp_w1, file1);
+
+    graph.hard_reset();
+
+    size_t fused = graph.mmap_fused_weights({file0, file1});
+    bool passed = graph.mmap_fused_weights({file0, file1}) == fused &&
+                  graph.get_output_buffer(fused).shape == std::vector<size_t>{5, K};
+
+    size_t x = graph.input({1, K}, Precision::FP16);
+    auto parts = graph.fused_matmul(x, fused);
+    passed = passed && parts.size() == 2;
+
+    std::vector<__fp16> x_data = {1, 2, 3, 4};
+    graph.set_input(x, x_data.data(), Precision::FP16);
+    graph.execute();
+
+    std::vector<float> expected0 = {1, 2};
+    std::vector<float> expected1 = {3, 4, 10};
+    const __fp16* out0 = static_cast<__fp16*>(graph.get_output(parts[0]));
+    const __fp16* out1 = static_cast<__fp16*>(graph.get_output(parts[1]));
+    for (size_t i = 0; passed && i < expected0.size(); i++) {
+        passed = std::abs(static_cast<float>(out0[i]) - expected0[i]) < 0.01f;
+    }
+    for (size_t i = 0; passed && i < expected1.size(); i++) {
+        passed = std::abs(static_cast<float>(out1[i]) - expected1[i]) < 0.01f;
+    }
+
+    graph.hard_reset();
+    std::remove(file0.c_str());
+    std::remove(file1.c_str());
+    if (!passed) return false;
+
+    // An interleaved part padded to a multiple of 4 rows cannot be stacked, so the parts stay
+    // separate weights and fused_matmul runs one matmul for each.
+    const size_t QK = 32;
+    auto interleaved = [&](size_t offset, size_t rows) {
+        std::vector<int8_t> weights(4 * QK, 0);
+        for (size_t n = 0; n < rows; ++n) {
+            size_t k = n + offset;
+            weights[(n / 4 * (QK / 4) + k / 4) * 16 + n % 4 * 4 + k % 4] = 64;
+        }
+        return weights;
+    };
+    std::vector<int8_t> q0 = interleaved(0, 4);
+    std::vector<int8_t> q1 = interleaved(4, 3);
+    std::vector<__fp16> scales(4, static_cast<__fp16>(1.0f / 64.0f));
+
+    size_t temp_q0 = graph.input({4, QK}, Precision::INT8);
+    size_t temp_q1 = graph.input({4, QK}, Precision::INT8);
+    graph.set_input(temp_q0, q0.data(), Precision::INT8);
+    graph.set_input(temp_q1, q1.data(), Precision::INT8);
+    graph.set_grouped_scales(temp_q0, QK, 1, scales.data());
+    graph.set_grouped_scales(temp_q1, QK, 1, scales.data());
+    graph.set_interleaved(temp_q0, true, 4);
+    graph.set_interleaved(temp_q1, true, 3);
+    GraphFile::save_node(graph, temp_q0, file0);
+    GraphFile::save_node(graph, temp_q1, file1);
+
+    graph.hard_reset();
+
+    size_t split = graph.mmap_fused_weights({file0, file1});
+    passed = graph.mmap_fused_weights({file0, file1}) == split &&
+             graph.get_output_buffer(split).shape == std::vector<size_t>{4, QK};
+
+    size_t qx = graph.input({1, QK}, Precision::FP16);
+    auto split_parts = graph.fused_matmul(qx, split);
+    passed = passed && split_parts.size() == 2;
+
+    std::vector<__fp16> qx_data(QK);
+    for (size_t k = 0; k < QK; ++k) {
+        qx_data[k] = static_cast<__fp16>((k + 1) / 8.0f);
+    }
+    graph.set_input(qx, qx_data.data(), Precision::FP16);
+    graph.execute();
+
+    passed = passed && graph.get_output_buffer(split_parts[1]).shape == std::vector<size_t>{1, 3};
+    const __fp16* split0 = static_cast<__fp16*>(graph.get_output(split_parts[0]));
+    const __fp16* split1 = static_cast<__fp16*>(graph.get_output(split_parts[1]));
+    for (size_t n = 0; passed && n < 4; n++) {
+        passed = std::abs(static_cast<float>(split0[n]) - (n + 1) / 8.0f) < 0.05f;
+    }
+    for (size_t n = 0; passed && n < 3; n++) {
+        passed = std::abs(static_cast<float>(split1[n]) - (n + 5) / 8.0f) < 0.05f;
+    }
+
+    graph.hard_reset();
+    std::remove(file0.c_str());
+    std::remove(file1.c_str());
+    return passed;
+}
+
 bool test_embedding_operation() {
     CactusGraph graph;
 
@@ -936,12 +1355,20 @@ int main() {
     runner.run_test("Graph Save/Load", test_graph_save_load());
     runner.run_test("Complex Graph Structure", test_complex_graph_structure());
     runner.run_test("Multiple Outputs", test_multiple_outputs());
+    runner.run_test("Dead Buffer Release", test_dead_buffer_release());
+    runner.run_test("Static Memory Plan", test_static_memory_plan());
+    runner.run_test("Operator Fusion", test_operator_fusion());
+    runner.run_test("SwiGLU Decode Row", test_swiglu_decode_row());
+    runner.run_test("LM Head Sample Fusion", test_lm_head_sample_fusion());
+    runner.run_test("Parallel Region", test_parallel_region());
+    runner.run_test("Inter-Op Waves", test_inter_op_waves());
     runner.run_test("Graph Reset", test_graph_reset());
     runner.run_test("Gather Operation", test_gather_operation());
     runner.run_test("Gather 1D Tensor", test_gather_1d_tensor());
     runner.run_test("Gather 3D Tensor", test_gather_3d_tensor());
     runner.run_test("Gather FP16", test_gather_fp16());
     runner.run_test("Memory-Mapped Gather", test_mmap_gather());
+    runner.run_test("Fused Weights", test_fused_weights());
     runner.run_test("Embedding Operation", test_embedding_operation());
     runner.run_test("Embedding from File", test_embedding_from_file());
 
@@ -3,6 +3,10 @@
 #include <cmath>
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <stdexcept>
 
 bool test_neon_add_fp16_correctness() {
     const size_t size = 16;
@@ -321,6 +325,127 @@ bool test_neon_attention_fp16_correctness() {
     return has_non_zero;
 }
 
+bool test_sample_probs_match_full_vocab_reference() {
+    const size_t vocab_size = 4099;
+    const float temperature = 0.7f, top_p = 0.9f;
+    const size_t top_k = 40;
+    const float min_p = 0.15f;
+
+    std::mt19937 gen(7);
+    std::normal_distribution<float> dis(0.0f, 0.5f);
+    std::vector<float> logits(vocab_size);
+    for (auto& logit : logits) logit = dis(gen);
+    // Lifts an ordinary token to just under the best one, so the bias decides whether it is kept.
+    const uint32_t bias_index = 11;
+    const float bias_value = *std::max_element(logits.begin(), logits.end()) - logits[bias_index] - 0.1f;
+
+    // Reference: every filter applied over the whole vocabulary, in the sampler's order.
+    std::vector<float> scaled(vocab_size);
+    for (size_t i = 0; i < vocab_size; ++i) scaled[i] = (logits[i] + (i == bias_index ? bias_value : 0.0f)) / temperature;
+    std::vector<float> sorted = scaled;
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    const float best = sorted[0];
+    std::vector<bool> kept(vocab_size);
+    for (size_t i = 0; i < vocab_size; ++i) {
+        kept[i] = scaled[i] >= sorted[top_k - 1] && std::exp(scaled[i] - best) >= min_p;
+    }
+    std::vector<size_t> order;
+    float sum = 0.0f;
+    for (size_t i = 0; i < vocab_size; ++i) {
+        if (kept[i]) { order.push_back(i); sum += std::exp(scaled[i] - best); }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scaled[a] > scaled[b]; });
+    float cumulative = 0.0f;
+    for (size_t i = 0; i < order.size(); ++i) {
+        cumulative += std::exp(scaled[order[i]] - best) / sum;
+        if (cumulative > top_p && i > 0) {
+            for (size_t j = i; j < order.size(); ++j) kept[order[j]] = false;
+            break;
+        }
+    }
+    std::vector<float> expected(vocab_size, 0.0f);
+    float kept_sum = 0.0f;
+    for (size_t i = 0; i < vocab_size; ++i) if (kept[i]) kept_sum += std::exp(scaled[i] - best);
+    for (size_t i = 0; i < vocab_size; ++i) if (kept[i]) expected[i] = std::exp(scaled[i] - best) / kept_sum;
+
+    std::vector<float> probs(vocab_size);
+    if (!cactus_sample_probs_f32(logits.data(), probs.data(), vocab_size, temperature, top_p, top_k,
+                                 &bias_value, &bias_index, 1)) {
+        return false;
+    }
+    for (size_t i = 0; i < vocab_size; ++i) {
+        if (std::abs(probs[i] - expected[i]) > 1e-5f) return false;
+    }
+    if (probs[bias_index] <= 0.0f) return false;
+
+    // Whatever is drawn must be a token the filters kept.
+    for (size_t seed = 1; seed <= 32; ++seed) {
+        uint32_t token = 0;
+        cactus_sample_f32(logits.data(), &token, vocab_size, temperature, top_p, top_k, seed, &bias_value, &bias_index, 1);
+        if (token >= vocab_size || !kept[token]) return false;
+    }
+    return true;
+}
+
+bool test_streamed_sampler_matches_full_row() {
+    // Each trial puts the same logits into two regions nothing has been drawn from yet, so the
+    // repetition penalty on earlier draws never touches either copy.
+    const size_t region = 600, vocab_size = region * 24;
+    const size_t splits[] = {0, 1000, 1256, 9000, vocab_size};
+    struct Config { float temperature, top_p; size_t top_k; };
+    const Config configs[] = {{0.7f, 0.9f, 20}, {1.0f, 0.0f, 0}, {0.5f, 0.95f, 0}, {1.3f, 0.0f, 5}};
+
+    std::mt19937 gen(11);
+    std::normal_distribution<float> dis(0.0f, 2.0f);
+    std::vector<CactusSamplePartial> partials(4);
+    auto stream = [&](const std::vector<__fp16>& row, const Config& c, bool with_entropy) {
+        for (size_t p = 0; p < partials.size(); ++p) {
+            partials[p].reset();
+            for (size_t start = splits[p]; start < splits[p + 1]; start += 300) {
+                size_t count = std::min<size_t>(300, splits[p + 1] - start);
+                cactus_sample_tile_f16(row.data() + start, start, count, partials[p],
+                                       c.temperature, c.top_p, c.top_k, nullptr, nullptr, 0, with_entropy);
+            }
+        }
+    };
+
+    for (size_t trial = 0; trial < 8; ++trial) {
+        const Config& c = configs[trial % 4];
+        const size_t full_base = 2 * trial * region, streamed_base = full_base + region;
+        std::vector<__fp16> full(vocab_size, static_cast<__fp16>(-1000.0f));
+        std::vector<__fp16> streamed(vocab_size, static_cast<__fp16>(-1000.0f));
+        for (size_t i = 0; i < region; ++i) {
+            full[full_base + i] = streamed[streamed_base + i] = static_cast<__fp16>(dis(gen));
+        }
+
+        uint32_t expected = 0;
+        cactus_sample_f16(full.data(), &expected, vocab_size, c.temperature, c.top_p, c.top_k, trial + 1);
+        stream(streamed, c, false);
+        uint32_t token = cactus_sample_partials_f16(partials.data(), partials.size(), vocab_size,
+                                                    c.temperature, c.top_p, c.top_k, trial + 1);
+        if (expected < full_base || token != expected - full_base + streamed_base) return false;
+    }
+
+    // Greedy keeps the first maximum; the entropy is checked against a double-precision pass.
+    std::vector<__fp16> row(vocab_size);
+    for (auto& logit : row) logit = static_cast<__fp16>(dis(gen));
+    row[100] = row[13000] = static_cast<__fp16>(20.0f);
+    double max_logit = 20.0, sum_exp = 0.0, entropy = 0.0;
+    for (auto logit : row) sum_exp += std::exp(static_cast<double>(logit) - max_logit);
+    for (auto logit : row) {
+        double log_prob = static_cast<double>(logit) - max_logit - std::log(sum_exp);
+        entropy -= std::exp(log_prob) * log_prob;
+    }
+    const float expected_entropy = static_cast<float>(entropy / std::log(static_cast<double>(vocab_size)));
+
+    stream(row, {0.0f, 0.0f, 0}, true);
+    float streamed_entropy = -1.0f;
+    uint32_t token = cactus_sample_partials_f16(partials.data(), partials.size(), vocab_size, 0.0f, 0.0f, 0, 1,
+                                                &streamed_entropy);
+    return token == 100 && std::abs(streamed_entropy - expected_entropy) < 1e-3f &&
+           std::abs(cactus_normalized_entropy_f16(row.data(), vocab_size) - expected_entropy) < 1e-3f;
+}
+
 bool test_matmul_int8_grouped_correctness() {
     const size_t M = 2, K = 128, N = 4;
     const size_t group_size = 32;
@@ -439,6 +564,89 @@ bool test_matmul_int8_grouped_correctness() {
     return max_abs_error < 0.1f;
 }
 
+bool test_matmul_int4_matches_int8() {
+    const size_t K = 128, N = 8;
+    const size_t group_size = 32;
+    const size_t num_groups = K / group_size;
+
+    std::vector<int8_t> B_interleaved(N * K);
+    for (size_t i = 0; i < N * K; ++i) {
+        B_interleaved[i] = static_cast<int8_t>((rand() % 16) - 8);
+    }
+
+    std::vector<uint8_t> B_packed(N * K / 2);
+    for (size_t i = 0; i < B_packed.size(); ++i) {
+        uint8_t low = static_cast<uint8_t>(B_interleaved[2 * i]) & 0x0F;
+        uint8_t high = static_cast<uint8_t>(B_interleaved[2 * i + 1]) & 0x0F;
+        B_packed[i] = static_cast<uint8_t>(low | (high << 4));
+    }
+
+    std::vector<__fp16> B_scales(N * num_groups);
+    for (auto& scale : B_scales) {
+        scale = static_cast<__fp16>(0.01f + static_cast<float>(rand()) / RAND_MAX * 0.05f);
+    }
+
+    for (size_t M : {size_t(1), size_t(5)}) {
+        std::vector<int8_t> A(M * K);
+        std::vector<float> A_scales(M);
+        for (auto& a : A) a = static_cast<int8_t>((rand() % 255) - 127);
+        for (auto& scale : A_scales) scale = 0.001f + static_cast<float>(rand()) / RAND_MAX * 0.01f;
+
+        std::vector<__fp16> C_int8(M * N);
+        std::vector<__fp16> C_int4(M * N);
+        cactus_matmul_int8(A.data(), A_scales.data(), B_interleaved.data(),
+                           B_scales.data(), C_int8.data(), M, K, N, group_size);
+        cactus_matmul_int4(A.data(), A_scales.data(), B_packed.data(),
+                           B_scales.data(), C_int4.data(), M, K, N, group_size);
+
+        for (size_t i = 0; i < M * N; ++i) {
+            if (static_cast<float>(C_int8[i]) != static_cast<float>(C_int4[i])) return false;
+        }
+    }
+    return true;
+}
+
+bool test_thread_pool_propagates_task_exception() {
+    CactusThreading::ThreadPool pool(4);
+
+    auto fork_throwing = [&](std::atomic<size_t>& completed) {
+        try {
+            pool.fork_join(64, 8, [&](size_t start, size_t end) {
+                if (start <= 37 && 37 < end) throw std::runtime_error("task failed");
+                completed.fetch_add(1);
+            });
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    std::atomic<size_t> completed{0};
+    if (!fork_throwing(completed) || completed.load() != 7) return false;
+
+    std::atomic<size_t> total{0};
+    pool.fork_join(64, 8, [&](size_t start, size_t end) { total.fetch_add(end - start); });
+    if (total.load() != 64) return false;
+
+    CactusThreading::ParallelRegion region(true, pool);
+    if (!region.active()) return false;
+    std::atomic<size_t> team_completed{0};
+    bool team_threw = false;
+    try {
+        pool.run_team(4, [&](size_t thread_id, size_t) {
+            if (thread_id == 2) throw std::runtime_error("team share failed");
+            team_completed.fetch_add(1);
+        });
+    } catch (const std::runtime_error&) {
+        team_threw = true;
+    }
+    if (!team_threw || team_completed.load() != 3) return false;
+
+    std::atomic<size_t> team_total{0};
+    pool.run_team(4, [&](size_t, size_t) { team_total.fetch_add(1); });
+    return team_total.load() == 4;
+}
+
 int main() {
     TestUtils::TestRunner runner("Kernel Backend Tests");
 
@@ -457,7 +665,11 @@ int main() {
     runner.run_test("Kernel Softmax Correctness", test_neon_softmax_correctness());
     runner.run_test("Kernel RoPE Correctness", test_neon_rope_correctness());
     runner.run_test("Kernel Attention FP16 Correctness", test_neon_attention_fp16_correctness());
+    runner.run_test("Kernel Sampler Matches Full-Vocab Filters", test_sample_probs_match_full_vocab_reference());
+    runner.run_test("Kernel Streamed Sampler Matches Full Row", test_streamed_sampler_matches_full_row());
     runner.run_test("Kernel Grouped INT8 MatMul Correctness", test_matmul_int8_grouped_correctness());
+    runner.run_test("Kernel Packed INT4 MatMul Matches INT8", test_matmul_int4_matches_int8());
+    runner.run_test("Kernel Thread Pool Propagates Task Exception", test_thread_pool_propagates_task_exception());
 
     runner.print_summary();
     return runner.all_passed() ? 0 : 1;
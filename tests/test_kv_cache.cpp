@@ -253,12 +253,605 @@ bool test_large_window() {
     return true;
 }
 
+bool test_paged_blocks() {
+    const size_t num_kv_heads = 2;
+    const size_t head_dim = 32;
+    const size_t window_size = 40;
+    const size_t sink_size = 4;
+    const size_t num_tokens = 150;
+    const size_t elements = num_kv_heads * head_dim;
+
+    KVCache cache;
+    cache.init(1, 2048, num_kv_heads, head_dim, Precision::INT8);
+    cache.set_window_size(window_size, sink_size);
+    const size_t free_after_init = cache.block_pool->free_count();
+    // A window bounds the address space reserved: one window for the owner and each shared sequence.
+    assert(cache.block_pool->max_blocks() == cache.block_pool->num_blocks() * (1 + KVCache::MAX_SHARED_SEQUENCES));
+
+    CactusGraph graph;
+    size_t peak_blocks = 0;
+    for (size_t token = 0; token < num_tokens; token++) {
+        size_t k_node = graph.input({1, num_kv_heads, head_dim}, Precision::FP16);
+        size_t v_node = graph.input({1, num_kv_heads, head_dim}, Precision::FP16);
+
+        vector<uint8_t> k_data, v_data;
+        fill_fp16(k_data, elements, float(token % 50) + 1.0f);
+        fill_fp16(v_data, elements, -float(token % 50) - 1.0f);
+        graph.set_input(k_node, k_data.data(), Precision::FP16);
+        graph.set_input(v_node, v_data.data(), Precision::FP16);
+
+        graph.execute();
+        cache.update_from_graph(&graph, {k_node}, {v_node}, 1, 1, num_kv_heads, head_dim);
+        peak_blocks = max(peak_blocks, free_after_init - cache.block_pool->free_count());
+    }
+
+    assert(cache.get_effective_seq_len() == window_size);
+    assert(peak_blocks <= window_size / KVCache::DEFAULT_BLOCK_TOKENS + 3);
+
+    CactusKVBlocks blocks = cache.get_blocks(0);
+    const int8_t* keys = cache.get_keys_int8(0);
+    const int8_t* values = cache.get_values_int8(0);
+    const float* key_scales = cache.get_key_scales(0);
+    const float* value_scales = cache.get_value_scales(0);
+
+    vector<int8_t> contiguous_keys(window_size * elements), contiguous_values(window_size * elements);
+    vector<float> contiguous_key_scales(window_size * num_kv_heads), contiguous_value_scales(window_size * num_kv_heads);
+    for (size_t pos = 0; pos < window_size; pos++) {
+        size_t row = pos < blocks.gap_start ? pos : pos + blocks.gap_rows;
+        size_t pool_row = blocks.block_table[row / blocks.block_tokens] * blocks.block_tokens + row % blocks.block_tokens;
+        size_t token = pos < sink_size ? pos : num_tokens - window_size + pos;
+
+        float key = keys[pool_row * elements] * key_scales[pool_row * num_kv_heads];
+        assert(std::abs(key - (float(token % 50) + 1.0f)) < 0.5f);
+
+        memcpy(&contiguous_keys[pos * elements], keys + pool_row * elements, elements);
+        memcpy(&contiguous_values[pos * elements], values + pool_row * elements, elements);
+        memcpy(&contiguous_key_scales[pos * num_kv_heads], key_scales + pool_row * num_kv_heads, num_kv_heads * sizeof(float));
+        memcpy(&contiguous_value_scales[pos * num_kv_heads], value_scales + pool_row * num_kv_heads, num_kv_heads * sizeof(float));
+    }
+
+    const size_t num_q_heads = 4;
+    vector<__fp16> query(num_q_heads * head_dim), key_new(elements), value_new(elements);
+    for (size_t i = 0; i < query.size(); i++) query[i] = static_cast<__fp16>(0.01f * float(i % 17));
+    for (size_t i = 0; i < elements; i++) {
+        key_new[i] = static_cast<__fp16>(0.5f);
+        value_new[i] = static_cast<__fp16>(2.0f);
+    }
+
+    vector<__fp16> paged_out(num_q_heads * head_dim), contiguous_out(num_q_heads * head_dim);
+    const float scale = 1.0f / std::sqrt(float(head_dim));
+    cactus_attention_hybrid_int8_fp16(query.data(), keys, values, key_scales, value_scales,
+                                      key_new.data(), value_new.data(), paged_out.data(),
+                                      1, 1, window_size, 1, num_q_heads, num_kv_heads, head_dim,
+                                      scale, num_tokens, true, 0, KV_QUANT_GROUP_SIZE, blocks);
+    cactus_attention_hybrid_int8_fp16(query.data(), contiguous_keys.data(), contiguous_values.data(),
+                                      contiguous_key_scales.data(), contiguous_value_scales.data(),
+                                      key_new.data(), value_new.data(), contiguous_out.data(),
+                                      1, 1, window_size, 1, num_q_heads, num_kv_heads, head_dim,
+                                      scale, num_tokens, true, 0);
+    assert(memcmp(paged_out.data(), contiguous_out.data(), paged_out.size() * sizeof(__fp16)) == 0);
+
+    cache.reset();
+    assert(cache.block_pool->free_count() == free_after_init);
+
+    return true;
+}
+
+bool test_unwindowed_pool_growth() {
+    const size_t num_layers = 2;
+    const size_t num_kv_heads = 2;
+    const size_t head_dim = 32;
+    const size_t max_seq = 64;
+    const size_t chunk = 5;
+    const size_t num_tokens = 300;
+    const size_t elements = num_kv_heads * head_dim;
+
+    // Without a window nothing is evicted, so the cache must hold far more than max_seq tokens.
+    KVCache cache;
+    cache.init(num_layers, max_seq, num_kv_heads, head_dim, Precision::INT8);
+    cache.set_window_size(0, 0);
+    const size_t initial_blocks = cache.block_pool->num_blocks();
+    assert(num_tokens > max_seq + 2 * cache.block_pool->block_tokens());
+    const int8_t* keys_before = cache.block_pool->keys();
+
+    CactusGraph graph;
+    for (size_t first = 0; first < num_tokens; first += chunk) {
+        vector<__fp16> k_data(chunk * elements), v_data(chunk * elements);
+        for (size_t i = 0; i < k_data.size(); i++) {
+            float token = float(first + i / elements);
+            k_data[i] = static_cast<__fp16>(std::fmod(token, 50.0f) + 1.0f);
+            v_data[i] = static_cast<__fp16>(-std::fmod(token, 50.0f) - 1.0f);
+        }
+        vector<size_t> k_nodes, v_nodes;
+        for (size_t layer = 0; layer < num_layers; layer++) {
+            k_nodes.push_back(graph.input({chunk, num_kv_heads, head_dim}, Precision::FP16));
+            v_nodes.push_back(graph.input({chunk, num_kv_heads, head_dim}, Precision::FP16));
+            graph.set_input(k_nodes.back(), k_data.data(), Precision::FP16);
+            graph.set_input(v_nodes.back(), v_data.data(), Precision::FP16);
+        }
+        graph.execute();
+        cache.update_from_graph(&graph, k_nodes, v_nodes, chunk, num_layers, num_kv_heads, head_dim);
+    }
+
+    assert(cache.get_effective_seq_len() == num_tokens && cache.get_total_seq_len() == num_tokens);
+    assert(cache.block_pool->num_blocks() > initial_blocks);
+    // Growth commits more of the reserved range; rows never move.
+    assert(cache.get_keys_int8(0) == keys_before);
+
+    KVCache::Snapshot snapshot = cache.snapshot();
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        assert(snapshot.keys[layer].size() == num_tokens * elements);
+        for (size_t token = 0; token < num_tokens; token++) {
+            float key = snapshot.keys[layer][token * elements] * snapshot.key_scales[layer][token * num_kv_heads];
+            float value = snapshot.values[layer][token * elements] * snapshot.value_scales[layer][token * num_kv_heads];
+            assert(std::abs(key - (float(token % 50) + 1.0f)) < 0.5f);
+            assert(std::abs(value + (float(token % 50) + 1.0f)) < 0.5f);
+        }
+    }
+
+    cache.reset();
+    assert(cache.block_pool->free_count() == cache.block_pool->num_blocks());
+    return true;
+}
+
+bool test_truncate_rollback() {
+    const size_t num_kv_heads = 2;
+    const size_t head_dim = 32;
+    const size_t window_size = 40;
+    const size_t sink_size = 4;
+    const size_t hidden = 16;
+    const size_t conv_window = 3;
+    const size_t elements = num_kv_heads * head_dim;
+
+    KVCache rolled, reference;
+    ConvCache rolled_conv, reference_conv;
+    for (KVCache* cache : {&rolled, &reference}) {
+        cache->init(1, 2048, num_kv_heads, head_dim, Precision::INT8);
+        cache->set_window_size(window_size, sink_size);
+    }
+    rolled_conv.init(1, hidden, conv_window, Precision::FP16);
+    reference_conv.init(1, hidden, conv_window, Precision::FP16);
+    const size_t free_after_init = rolled.block_pool->free_count();
+
+    CactusGraph graph;
+    auto append = [&](KVCache& cache, ConvCache& conv, size_t first, size_t count) {
+        vector<__fp16> k_data(count * elements), v_data(count * elements), bx_data(count * hidden);
+        for (size_t i = 0; i < k_data.size(); i++) {
+            float token = float(first + i / elements);
+            k_data[i] = static_cast<__fp16>(std::fmod(token, 50.0f) + 1.0f);
+            v_data[i] = static_cast<__fp16>(-std::fmod(token, 50.0f) - 1.0f);
+        }
+        for (size_t i = 0; i < bx_data.size(); i++) {
+            bx_data[i] = static_cast<__fp16>(float(first + i / hidden) * 0.5f);
+        }
+        size_t k_node = graph.input({count, num_kv_heads, head_dim}, Precision::FP16);
+        size_t v_node = graph.input({count, num_kv_heads, head_dim}, Precision::FP16);
+        size_t bx_node = graph.input({count, hidden}, Precision::FP16);
+        graph.set_input(k_node, k_data.data(), Precision::FP16);
+        graph.set_input(v_node, v_data.data(), Precision::FP16);
+        graph.set_input(bx_node, bx_data.data(), Precision::FP16);
+        graph.execute();
+        cache.update_from_graph(&graph, {k_node}, {v_node}, count, 1, num_kv_heads, head_dim);
+        conv.update(&graph, 0, bx_node);
+    };
+
+    // The reference never sees the drafts, so after every rollback both must hold the same rows.
+    auto matches_reference = [&]() {
+        KVCache::Snapshot expected = reference.snapshot();
+        KVCache::Snapshot actual = rolled.snapshot();
+        return rolled.get_total_seq_len() == reference.get_total_seq_len() &&
+               rolled.get_effective_seq_len() == reference.get_effective_seq_len() &&
+               actual.keys[0] == expected.keys[0] && actual.values[0] == expected.values[0] &&
+               actual.key_scales[0] == expected.key_scales[0] && actual.value_scales[0] == expected.value_scales[0] &&
+               rolled_conv.snapshot() == reference_conv.snapshot();
+    };
+
+    // Drafts first while the window is still filling, then once it has slid.
+    size_t next_token = 0;
+    for (size_t steps : {size_t(30), size_t(70)}) {
+        for (size_t i = 0; i < steps; i++, next_token++) {
+            append(rolled, rolled_conv, next_token, 1);
+            append(reference, reference_conv, next_token, 1);
+        }
+        for (size_t drafts : {size_t(3), size_t(9), ConvCache::ROLLBACK_ROWS}) {
+            // Drafts that get rejected: appended in one pass, then rolled back.
+            append(rolled, rolled_conv, 1000, drafts);
+            assert(rolled.can_truncate(drafts) && rolled_conv.can_truncate(drafts));
+            rolled.truncate(drafts);
+            rolled_conv.truncate(drafts);
+            assert(matches_reference());
+
+            // Fewer accepted tokens than the rejected drafts evicted.
+            append(rolled, rolled_conv, next_token, 2);
+            append(reference, reference_conv, next_token, 2);
+            next_token += 2;
+            assert(matches_reference());
+        }
+    }
+
+    append(rolled, rolled_conv, next_token, 12);
+    append(reference, reference_conv, next_token, 12);
+    assert(matches_reference());
+
+    // Sink rows and rows older than the retained history cannot be rolled back.
+    assert(!rolled.can_truncate(window_size - sink_size + 1));
+    assert(!rolled_conv.can_truncate(ConvCache::ROLLBACK_ROWS + 1));
+    bool rejected = false;
+    try {
+        rolled.truncate(window_size);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    rolled.reset();
+    assert(rolled.block_pool->free_count() == free_after_init);
+    return true;
+}
+
+bool test_prompt_lookup() {
+    // The longest n-gram wins over a more recent shorter match.
+    vector<uint32_t> tokens = {5, 1, 2, 3, 4, 9, 9, 3, 8, 7, 1, 2, 3};
+    assert((Model::lookup_proposals(tokens, 3, 4) == vector<uint32_t>{4, 9, 9, 3}));
+    assert((Model::lookup_proposals(tokens, 3, 2) == vector<uint32_t>{4, 9}));
+    assert((Model::lookup_proposals(tokens, 1, 4) == vector<uint32_t>{8, 7, 1, 2}));
+
+    // Proposals stop at the end of the context.
+    tokens = {6, 7, 6};
+    assert((Model::lookup_proposals(tokens, 3, 8) == vector<uint32_t>{7, 6}));
+
+    tokens = {1, 2, 3};
+    assert(Model::lookup_proposals(tokens, 3, 4).empty());
+    assert(Model::lookup_proposals({}, 3, 4).empty());
+    return true;
+}
+
+bool test_prefix_cache() {
+    const size_t num_kv_heads = 2;
+    const size_t head_dim = 32;
+    const size_t elements = num_kv_heads * head_dim;
+    const size_t prompt_len = 150;
+
+    KVCache cache;
+    cache.init(1, 2048, num_kv_heads, head_dim, Precision::INT8);
+    cache.set_window_size(100, 4);
+
+    CactusGraph graph;
+    size_t k_node = graph.input({prompt_len, num_kv_heads, head_dim}, Precision::FP16);
+    size_t v_node = graph.input({prompt_len, num_kv_heads, head_dim}, Precision::FP16);
+    vector<__fp16> k_data(prompt_len * elements), v_data(prompt_len * elements);
+    for (size_t i = 0; i < k_data.size(); i++) {
+        k_data[i] = static_cast<__fp16>(float(i % 97) * 0.1f);
+        v_data[i] = static_cast<__fp16>(float(i % 89) * -0.1f);
+    }
+    graph.set_input(k_node, k_data.data(), Precision::FP16);
+    graph.set_input(v_node, v_data.data(), Precision::FP16);
+    graph.execute();
+    cache.update_from_graph(&graph, {k_node}, {v_node}, prompt_len, 1, num_kv_heads, head_dim);
+
+    Model::CacheState state;
+    state.kv = cache.snapshot();
+    assert(state.kv.seq_len == 100 && state.kv.total_seq_len == prompt_len);
+
+    KVCache restored;
+    restored.init(1, 2048, num_kv_heads, head_dim, Precision::INT8);
+    restored.set_window_size(100, 4);
+    restored.restore(state.kv);
+    assert(restored.get_effective_seq_len() == 100 && restored.get_total_seq_len() == prompt_len);
+
+    KVCache::Snapshot round_trip = restored.snapshot();
+    assert(round_trip.keys[0] == state.kv.keys[0] && round_trip.value_scales[0] == state.kv.value_scales[0]);
+
+    vector<uint32_t> system_prompt(3 * PrefixCache::BLOCK_TOKENS + 10);
+    for (size_t i = 0; i < system_prompt.size(); i++) system_prompt[i] = static_cast<uint32_t>(i * 7 + 1);
+    vector<uint32_t> first = system_prompt, second = system_prompt;
+    first.insert(first.end(), {1, 2, 3});
+    second.insert(second.end(), {4, 5, 6});
+
+    PrefixCache prefix_cache(state.byte_size() * 2);
+    assert(!prefix_cache.lookup(first, first.size() - 1).state);
+
+    prefix_cache.insert(first, 3 * PrefixCache::BLOCK_TOKENS, state);
+    auto match = prefix_cache.lookup(second, second.size() - 1);
+    assert(match.state && match.state_tokens == 3 * PrefixCache::BLOCK_TOKENS);
+    assert(match.state->kv.keys[0] == state.kv.keys[0]);
+
+    second[PrefixCache::BLOCK_TOKENS + 1] ^= 1;
+    match = prefix_cache.lookup(second, second.size() - 1);
+    assert(!match.state && match.shared_tokens == PrefixCache::BLOCK_TOKENS);
+
+    prefix_cache.insert(second, PrefixCache::BLOCK_TOKENS, state);
+    prefix_cache.insert(vector<uint32_t>(PrefixCache::BLOCK_TOKENS, 9), PrefixCache::BLOCK_TOKENS, state);
+    assert(prefix_cache.size_bytes() <= state.byte_size() * 2);
+    assert(!prefix_cache.lookup(first, first.size() - 1).state ||
+           prefix_cache.lookup(first, first.size() - 1).state_tokens == PrefixCache::BLOCK_TOKENS);
+
+    return true;
+}
+
+class SessionModel : public Model {
+public:
+    KVCache& cache() { return kv_cache_; }
+
+protected:
+    using Model::forward;
+    size_t forward(const vector<uint32_t>&, bool) override { return 0; }
+    void load_weights_to_graph(CactusGraph*) override {}
+    size_t build_attention(CactusGraph*, size_t, uint32_t, ComputeBackend, bool, size_t) override { return 0; }
+    size_t build_mlp(CactusGraph*, size_t, uint32_t, ComputeBackend) const override { return 0; }
+    size_t build_transformer_block(CactusGraph*, size_t, uint32_t, ComputeBackend, bool, size_t) override { return 0; }
+};
+
+bool test_session_file() {
+    const size_t num_layers = 2;
+    const size_t num_kv_heads = 2;
+    const size_t head_dim = 64;
+    const size_t seq_len = 70;
+
+    SessionModel saved;
+    saved.cache().init(num_layers, 2048, num_kv_heads, head_dim, Precision::INT8);
+    saved.cache().set_window_size(512, 4);
+
+    CactusGraph graph;
+    vector<size_t> k_nodes, v_nodes;
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        vector<__fp16> k_data(seq_len * num_kv_heads * head_dim), v_data(k_data.size());
+        for (size_t i = 0; i < k_data.size(); i++) {
+            k_data[i] = static_cast<__fp16>(float((i + layer) % 31) * 0.25f);
+            v_data[i] = static_cast<__fp16>(float((i * 3 + layer) % 29) * -0.25f);
+        }
+        k_nodes.push_back(graph.input({seq_len, num_kv_heads, head_dim}, Precision::FP16));
+        v_nodes.push_back(graph.input({seq_len, num_kv_heads, head_dim}, Precision::FP16));
+        graph.set_input(k_nodes.back(), k_data.data(), Precision::FP16);
+        graph.set_input(v_nodes.back(), v_data.data(), Precision::FP16);
+    }
+    graph.execute();
+    saved.cache().update_from_graph(&graph, k_nodes, v_nodes, seq_len, num_layers, num_kv_heads, head_dim);
+
+    const string path = "/tmp/cactus_test_session.bin";
+    vector<uint32_t> tokens(seq_len);
+    for (size_t i = 0; i < seq_len; i++) tokens[i] = static_cast<uint32_t>(i * 13);
+    assert(saved.save_session(path, tokens));
+
+    SessionModel loaded;
+    loaded.cache().init(num_layers, 2048, num_kv_heads, head_dim, Precision::INT8);
+    loaded.cache().set_window_size(512, 4);
+    vector<uint32_t> loaded_tokens;
+    assert(loaded.load_session(path, loaded_tokens));
+    assert(loaded_tokens == tokens);
+    assert(loaded.cache().get_effective_seq_len() == seq_len);
+    assert(loaded.cache().get_total_seq_len() == seq_len);
+
+    KVCache::Snapshot expected = saved.cache().snapshot();
+    KVCache::Snapshot actual = loaded.cache().snapshot();
+    for (size_t layer = 0; layer < num_layers; layer++) {
+        assert(actual.keys[layer] == expected.keys[layer] && actual.values[layer] == expected.values[layer]);
+        assert(actual.key_scales[layer] == expected.key_scales[layer] && actual.value_scales[layer] == expected.value_scales[layer]);
+    }
+
+    SessionModel mismatched;
+    mismatched.cache().init(num_layers, 2048, num_kv_heads, head_dim, Precision::INT8);
+    mismatched.cache().set_window_size(256, 4);
+    bool rejected = false;
+    try {
+        mismatched.load_session(path, loaded_tokens);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    std::remove(path.c_str());
+    return true;
+}
+
+// Stands in for a model's forward pass: every sequence continues with next_token + 1.
+class BatchModel : public SessionModel {
+public:
+    bool supports_batched_decode() const override { return true; }
+    void init_sequence(SequenceState&) const override {}
+    void prefill_sequence(SequenceState&, const vector<uint32_t>& tokens) override {
+        prefilled_tokens += tokens.size();
+    }
+    vector<uint32_t> decode_batch(const vector<SequenceState*>& sequences) override {
+        batch_sizes.push_back(sequences.size());
+        vector<uint32_t> next;
+        for (auto* sequence : sequences) {
+            sequence->next_token += 1;
+            next.push_back(sequence->next_token);
+        }
+        return next;
+    }
+
+    size_t prefilled_tokens = 0;
+    vector<size_t> batch_sizes;
+};
+
+bool test_batch_scheduler() {
+    BatchModel model;
+    BatchScheduler scheduler(model, 2);
+
+    BatchScheduler::Request first;
+    first.prompt = {10, 11};
+    first.max_tokens = 3;
+    BatchScheduler::Request stopped;
+    stopped.prompt = {20};
+    stopped.stop_tokens = {23};
+    BatchScheduler::Request queued;
+    queued.prompt = {30};
+    queued.max_tokens = 2;
+
+    uint64_t first_id = scheduler.submit(first);
+    uint64_t stopped_id = scheduler.submit(stopped);
+    uint64_t queued_id = scheduler.submit(queued);
+
+    size_t steps = 0;
+    while (scheduler.step()) {
+        assert(scheduler.active_count() <= 2);
+        steps++;
+    }
+
+    assert(steps == 4);
+    assert((model.batch_sizes == vector<size_t>{2, 2, 2, 1, 1}));
+    assert(model.prefilled_tokens == 1);
+    assert(scheduler.is_finished(first_id) && scheduler.is_finished(stopped_id) && scheduler.is_finished(queued_id));
+    assert((scheduler.take_output(first_id) == vector<uint32_t>{12, 13, 14}));
+    assert((scheduler.take_output(stopped_id) == vector<uint32_t>{21, 22}));
+    assert((scheduler.take_output(queued_id) == vector<uint32_t>{31, 32}));
+    assert(!scheduler.is_finished(first_id));
+    return true;
+}
+
+// Exposes the shared attention builder with a one-layer config so batched rows can be checked
+// against the same sequences attended one at a time.
+class AttentionModel : public SessionModel {
+public:
+    AttentionModel(size_t heads, size_t kv_heads, size_t head_dim) {
+        config_.num_layers = 1;
+        config_.attention_heads = heads;
+        config_.attention_kv_heads = kv_heads;
+        config_.attention_head_dim = head_dim;
+        attention_scale_ = 1.0f / std::sqrt(static_cast<float>(head_dim));
+        cache_k_output_nodes_.assign(1, 0);
+        cache_v_output_nodes_.assign(1, 0);
+        kv_cache_.init(1, 2048, kv_heads, head_dim, Precision::INT8);
+    }
+
+    size_t attend_batch(CactusGraph* gb, size_t q, size_t k, size_t v, const vector<SequenceState*>& batch) {
+        batch_ = batch;
+        size_t out = build_cached_attention(gb, q, k, v, 0, 10000.0f, true, 0);
+        batch_.clear();
+        return out;
+    }
+
+    KVCache& cache() { return kv_cache_; }
+
+    size_t attend_one(CactusGraph* gb, size_t q, size_t k, size_t v, SequenceState& sequence) {
+        swap_sequence_state(sequence);
+        size_t out = build_cached_attention(gb, q, k, v, 0, 10000.0f, true, kv_cache_.get_total_seq_len());
+        swap_sequence_state(sequence);
+        return out;
+    }
+};
+
+bool test_batched_attention() {
+    const size_t heads = 2;
+    const size_t kv_heads = 1;
+    const size_t head_dim = 64;
+    const size_t q_width = heads * head_dim;
+    const size_t kv_width = kv_heads * head_dim;
+    const vector<size_t> cached_lens = {5, 9};
+
+    AttentionModel model(heads, kv_heads, head_dim);
+    vector<SequenceState> sequences(cached_lens.size());
+    for (size_t s = 0; s < sequences.size(); s++) {
+        model.init_sequence(sequences[s]);
+        CactusGraph prefill;
+        vector<__fp16> k_data(cached_lens[s] * kv_width), v_data(k_data.size());
+        for (size_t i = 0; i < k_data.size(); i++) {
+            k_data[i] = static_cast<__fp16>(float((i * 7 + s) % 23) * 0.1f - 1.0f);
+            v_data[i] = static_cast<__fp16>(float((i * 5 + s * 3) % 19) * 0.1f - 0.9f);
+        }
+        vector<size_t> k_nodes = {prefill.input({cached_lens[s], kv_heads, head_dim}, Precision::FP16)};
+        vector<size_t> v_nodes = {prefill.input({cached_lens[s], kv_heads, head_dim}, Precision::FP16)};
+        prefill.set_input(k_nodes[0], k_data.data(), Precision::FP16);
+        prefill.set_input(v_nodes[0], v_data.data(), Precision::FP16);
+        prefill.execute();
+        sequences[s].kv_cache.update_from_graph(&prefill, k_nodes, v_nodes, cached_lens[s], 1, kv_heads, head_dim);
+    }
+
+    const size_t rows = sequences.size();
+    vector<__fp16> q_data(rows * q_width), k_data(rows * kv_width), v_data(rows * kv_width);
+    for (size_t i = 0; i < q_data.size(); i++) q_data[i] = static_cast<__fp16>(float(i % 17) * 0.1f - 0.8f);
+    for (size_t i = 0; i < k_data.size(); i++) k_data[i] = static_cast<__fp16>(float(i % 13) * 0.1f - 0.6f);
+    for (size_t i = 0; i < v_data.size(); i++) v_data[i] = static_cast<__fp16>(float(i % 11) * 0.1f - 0.5f);
+
+    CactusGraph gb;
+    size_t q = gb.input({1, rows, heads, head_dim}, Precision::FP16);
+    size_t k = gb.input({1, rows, kv_heads, head_dim}, Precision::FP16);
+    size_t v = gb.input({1, rows, kv_heads, head_dim}, Precision::FP16);
+    gb.set_input(q, q_data.data(), Precision::FP16);
+    gb.set_input(k, k_data.data(), Precision::FP16);
+    gb.set_input(v, v_data.data(), Precision::FP16);
+    size_t batched = model.attend_batch(&gb, q, k, v, {&sequences[0], &sequences[1]});
+
+    vector<size_t> singles;
+    for (size_t s = 0; s < rows; s++) {
+        size_t q_s = gb.input({1, 1, heads, head_dim}, Precision::FP16);
+        size_t k_s = gb.input({1, 1, kv_heads, head_dim}, Precision::FP16);
+        size_t v_s = gb.input({1, 1, kv_heads, head_dim}, Precision::FP16);
+        gb.set_input(q_s, q_data.data() + s * q_width, Precision::FP16);
+        gb.set_input(k_s, k_data.data() + s * kv_width, Precision::FP16);
+        gb.set_input(v_s, v_data.data() + s * kv_width, Precision::FP16);
+        singles.push_back(model.attend_one(&gb, q_s, k_s, v_s, sequences[s]));
+    }
+    gb.execute();
+
+    const __fp16* batched_out = static_cast<const __fp16*>(gb.get_output(batched));
+    for (size_t s = 0; s < rows; s++) {
+        const __fp16* single_out = static_cast<const __fp16*>(gb.get_output(singles[s]));
+        for (size_t i = 0; i < q_width; i++) {
+            if (std::abs(float(batched_out[s * q_width + i]) - float(single_out[i])) > 1e-3f) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool test_sequences_share_block_pool() {
+    const size_t kv_heads = 1;
+    const size_t head_dim = 64;
+    AttentionModel model(2, kv_heads, head_dim);
+    auto& pool = *model.cache().block_pool;
+
+    auto append = [&](KVCache& cache, size_t tokens) {
+        CactusGraph graph;
+        vector<__fp16> data(tokens * kv_heads * head_dim, static_cast<__fp16>(0.5f));
+        vector<size_t> k_nodes = {graph.input({tokens, kv_heads, head_dim}, Precision::FP16)};
+        vector<size_t> v_nodes = {graph.input({tokens, kv_heads, head_dim}, Precision::FP16)};
+        graph.set_input(k_nodes[0], data.data(), Precision::FP16);
+        graph.set_input(v_nodes[0], data.data(), Precision::FP16);
+        graph.execute();
+        cache.update_from_graph(&graph, k_nodes, v_nodes, tokens, 1, kv_heads, head_dim);
+    };
+
+    const size_t free_before = pool.free_count();
+    append(model.cache(), 10);
+    SequenceState kept;
+    model.init_sequence(kept);
+    assert(kept.kv_cache.block_pool == model.cache().block_pool);
+    append(kept.kv_cache, 40);
+    {
+        SequenceState finished;
+        model.init_sequence(finished);
+        append(finished.kv_cache, 70);
+        assert(pool.free_count() == free_before - 1 - 2 - 3);
+    }
+    // A finished sequence returns its blocks; resetting the model's cache returns only its own.
+    assert(pool.free_count() == free_before - 1 - 2);
+    model.reset_cache();
+    assert(pool.free_count() == free_before - 2);
+    assert(kept.kv_cache.get_total_seq_len() == 40 && kept.kv_cache.snapshot().keys[0].size() == 40 * kv_heads * head_dim);
+    kept.kv_cache.reset();
+    assert(pool.free_count() == free_before);
+    return true;
+}
+
 int main() {
     TestUtils::TestRunner runner("KV Cache Sliding Window Tests");
     runner.run_test("Basic Sliding Window", test_sliding_window_basic());
     runner.run_test("Incremental Updates", test_incremental_updates());
     runner.run_test("Reset Functionality", test_reset_functionality());
     runner.run_test("Large Window (512 tokens)", test_large_window());
+    runner.run_test("Paged Blocks Follow Window", test_paged_blocks());
+    runner.run_test("Unwindowed Pool Grows Past Context", test_unwindowed_pool_growth());
+    runner.run_test("Truncate Rolls Back Rejected Tokens", test_truncate_rollback());
+    runner.run_test("Prompt Lookup Proposes Copied Spans", test_prompt_lookup());
+    runner.run_test("Prefix Cache Restores Shared Prompt", test_prefix_cache());
+    runner.run_test("Session File Round Trip", test_session_file());
+    runner.run_test("Batched Attention Matches Per Sequence", test_batched_attention());
+    runner.run_test("Sequences Share The Model Block Pool", test_sequences_share_block_pool());
+    runner.run_test("Batch Scheduler Admits And Retires", test_batch_scheduler());
 
     cout << "────────────────────────────────────────────────────────────────────────────────────────\n";
     runner.print_summary();
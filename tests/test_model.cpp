@@ -0,0 +1,430 @@
+#include "../cactus/cactus.h"
+#include "../cactus/ffi/cactus_utils.h"
+#include "test_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace cactus::engine;
+
+namespace {
+
+constexpr uint32_t TEST_HIDDEN_DIM = 64;
+constexpr uint32_t TEST_FFN_DIM = 128;
+constexpr uint32_t TEST_HEADS = 4;
+constexpr uint32_t TEST_KV_HEADS = 2;
+constexpr uint32_t TEST_HEAD_DIM = 16;
+constexpr uint32_t TEST_LAYERS = 2;
+// LFM2 models make layer 0 a short convolution of this many taps.
+constexpr uint32_t TEST_CONV_KERNEL = 3;
+const std::vector<std::string> TEST_SPECIAL_TOKENS = {"<|endoftext|>", "<|im_start|>", "<|im_end|>"};
+constexpr uint32_t TEST_VOCAB_SIZE = 256 + 3;
+
+// The printable stand-in a byte-level BPE vocabulary uses for each byte.
+std::string byte_token(uint8_t byte) {
+    auto utf8 = [](uint32_t point) {
+        std::string text;
+        text += static_cast<char>(0xC0 | (point >> 6));
+        text += static_cast<char>(0x80 | (point & 0x3F));
+        return text;
+    };
+    if (byte >= 33 && byte <= 126) return std::string(1, static_cast<char>(byte));
+    if (byte >= 161) return utf8(byte);
+    uint32_t point = 256;
+    for (uint32_t b = 0; b < byte; ++b) {
+        if (b <= 32 || b == 127 || (b >= 128 && b <= 160)) ++point;
+    }
+    return utf8(point);
+}
+
+// A tiny model with random FP16 weights, written the way the converter lays out a real one.
+// model_type "lfm2" swaps the first attention layer for a convolution layer.
+class TestModel {
+public:
+    TestModel(const std::string& dir, const std::string& model_type, uint32_t seed = 1234,
+              const std::vector<std::string>& extra_config = {})
+        : dir_(dir), gen_(seed) {
+        mkdir(dir_.c_str(), 0755);
+
+        std::vector<std::string> vocab;
+        for (int byte = 0; byte < 256; ++byte) vocab.push_back(byte_token(static_cast<uint8_t>(byte)));
+        vocab.insert(vocab.end(), TEST_SPECIAL_TOKENS.begin(), TEST_SPECIAL_TOKENS.end());
+        write_lines("vocab.txt", vocab);
+        write_lines("merges.txt", {"#version: 0.2", "a b"});
+        write_lines("tokenizer_config.txt", {"eos_token_id=258", "bos_token_id=256"});
+
+        const bool lfm2 = model_type == "lfm2";
+        std::vector<std::string> config = {
+            "vocab_size=" + std::to_string(TEST_VOCAB_SIZE), "bos_token_id=256", "eos_token_id=258",
+            "num_layers=" + std::to_string(TEST_LAYERS), "hidden_dim=" + std::to_string(TEST_HIDDEN_DIM),
+            "ffn_intermediate_dim=" + std::to_string(TEST_FFN_DIM),
+            "attention_heads=" + std::to_string(TEST_HEADS), "attention_kv_heads=" + std::to_string(TEST_KV_HEADS),
+            "attention_head_dim=" + std::to_string(TEST_HEAD_DIM), "layer_norm_eps=0.00001", "rope_theta=10000",
+            "tie_word_embeddings=true", "precision=FP16", "model_type=" + model_type};
+        if (lfm2) {
+            config.push_back("layer_types=conv,full_attention");
+            config.push_back("conv_L_cache=" + std::to_string(TEST_CONV_KERNEL));
+        }
+        config.insert(config.end(), extra_config.begin(), extra_config.end());
+        write_lines("config.txt", config);
+
+        write_weights("token_embeddings.weights", {TEST_VOCAB_SIZE, TEST_HIDDEN_DIM}, 1.0f);
+        write_norm("output_norm.weights", TEST_HIDDEN_DIM);
+        const size_t q_dim = TEST_HEADS * TEST_HEAD_DIM;
+        const size_t kv_dim = TEST_KV_HEADS * TEST_HEAD_DIM;
+        for (uint32_t i = 0; i < TEST_LAYERS; ++i) {
+            const std::string prefix = "layer_" + std::to_string(i) + "_";
+            if (lfm2 && i == 0) {
+                write_weights(prefix + "conv_in_proj.weights", {3 * TEST_HIDDEN_DIM, TEST_HIDDEN_DIM}, 0.2f);
+                write_weights(prefix + "conv_out_proj.weights", {TEST_HIDDEN_DIM, TEST_HIDDEN_DIM}, 0.2f);
+                write_weights(prefix + "conv_depthwise.weights", {TEST_HIDDEN_DIM, TEST_CONV_KERNEL}, 0.5f);
+            } else {
+                write_weights(prefix + "attn_q.weights", {q_dim, TEST_HIDDEN_DIM}, 0.2f);
+                write_weights(prefix + "attn_k.weights", {kv_dim, TEST_HIDDEN_DIM}, 0.2f);
+                write_weights(prefix + "attn_v.weights", {kv_dim, TEST_HIDDEN_DIM}, 0.2f);
+                write_weights(prefix + "attn_output.weights", {TEST_HIDDEN_DIM, q_dim}, 0.2f);
+                write_norm(prefix + "attn_q_norm.weights", TEST_HEAD_DIM);
+                write_norm(prefix + "attn_k_norm.weights", TEST_HEAD_DIM);
+            }
+            write_norm(prefix + "input_norm.weights", TEST_HIDDEN_DIM);
+            write_norm(prefix + "post_attn_norm.weights", TEST_HIDDEN_DIM);
+            write_weights(prefix + "ffn_gate.weights", {TEST_FFN_DIM, TEST_HIDDEN_DIM}, 0.2f);
+            write_weights(prefix + "ffn_up.weights", {TEST_FFN_DIM, TEST_HIDDEN_DIM}, 0.2f);
+            write_weights(prefix + "ffn_down.weights", {TEST_HIDDEN_DIM, TEST_FFN_DIM}, 0.2f);
+        }
+    }
+
+    ~TestModel() {
+        for (const auto& file : files_) std::remove(file.c_str());
+        rmdir(dir_.c_str());
+    }
+
+    const std::string& path() const { return dir_; }
+
+private:
+    std::string dir_;
+    std::mt19937 gen_;
+    std::vector<std::string> files_;
+
+    void write_lines(const std::string& name, const std::vector<std::string>& lines) {
+        files_.push_back(dir_ + "/" + name);
+        std::ofstream out(files_.back());
+        for (const auto& line : lines) out << line << "\n";
+    }
+
+    void write_node(const std::string& name, const std::vector<size_t>& shape, const std::vector<__fp16>& data) {
+        files_.push_back(dir_ + "/" + name);
+        CactusGraph graph;
+        size_t node = graph.input(shape, Precision::FP16);
+        graph.set_input(node, data.data(), Precision::FP16);
+        GraphFile::save_node(graph, node, files_.back());
+    }
+
+    void write_weights(const std::string& name, const std::vector<size_t>& shape, float scale) {
+        std::uniform_real_distribution<float> dist(-scale, scale);
+        std::vector<__fp16> data(shape[0] * shape[1]);
+        for (auto& value : data) value = static_cast<__fp16>(dist(gen_));
+        write_node(name, shape, data);
+    }
+
+    void write_norm(const std::string& name, size_t dim) {
+        std::uniform_real_distribution<float> dist(0.8f, 1.2f);
+        std::vector<__fp16> data(dim);
+        for (auto& value : data) value = static_cast<__fp16>(dist(gen_));
+        write_node(name, {dim}, data);
+    }
+};
+
+std::vector<uint32_t> test_tokens(size_t count, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<uint32_t> dist(0, 255);
+    std::vector<uint32_t> tokens(count);
+    for (auto& token : tokens) token = dist(gen);
+    return tokens;
+}
+
+// Caches filled in different chunks round a little differently, so logits agree to 1% of the largest.
+bool logits_match(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.size() != b.size() || a.empty()) return false;
+    float scale = 0.0f;
+    for (float value : b) scale = std::max(scale, std::abs(value));
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::abs(a[i] - b[i]) > 0.01f * scale) return false;
+    }
+    return true;
+}
+
+}
+
+bool test_truncate_refills_past_the_window() {
+    TestModel files("./test_model_truncate", "qwen");
+    setenv("CACTUS_KV_WINDOW_SIZE", "32", 1);
+    auto* handle = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+    auto* reference = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+    unsetenv("CACTUS_KV_WINDOW_SIZE");
+    if (!handle || !reference) {
+        cactus_destroy(handle);
+        cactus_destroy(reference);
+        return false;
+    }
+
+    // Next-token logits of a cache built from only the kept tokens.
+    auto expected_logits = [&](const std::vector<uint32_t>& kept, uint32_t next) {
+        reference->model->reset_cache();
+        reference->model->prefill(kept, 256);
+        return reference->model->forward_logits({next});
+    };
+
+    const std::vector<uint32_t> tokens = test_tokens(60, 7);
+    bool passed = true;
+
+    // A completion leaves its last token out of the cache; truncating nothing feeds it.
+    handle->model->prefill({tokens.begin(), tokens.begin() + 19}, 256);
+    handle->processed_tokens.assign(tokens.begin(), tokens.begin() + 20);
+    passed = passed && cactus_truncate(handle, 0) == 0 && handle->model->get_cached_tokens() == 20 &&
+             handle->processed_tokens.size() == 20;
+    passed = passed && logits_match(handle->model->forward_logits({tokens[20]}),
+                                    expected_logits({tokens.begin(), tokens.begin() + 20}, tokens[20]));
+    handle->processed_tokens.push_back(tokens[20]);
+
+    // Inside the window the cache is rolled back in place.
+    passed = passed && cactus_truncate(handle, 6) == 0 && handle->model->get_cached_tokens() == 15 &&
+             handle->processed_tokens.size() == 15;
+    passed = passed && logits_match(handle->model->forward_logits({tokens[15]}),
+                                    expected_logits({tokens.begin(), tokens.begin() + 15}, tokens[15]));
+
+    // 60 tokens slide a 32-token window; dropping 40 needs evicted rows, so the kept 20 are refilled.
+    handle->model->reset_cache();
+    handle->model->prefill(tokens, 256);
+    handle->processed_tokens = tokens;
+    passed = passed && !handle->model->truncate_cache(40);
+    passed = passed && cactus_truncate(handle, 40) == 0 && handle->model->get_cached_tokens() == 20 &&
+             handle->processed_tokens.size() == 20;
+    passed = passed && logits_match(handle->model->forward_logits({tokens[20]}),
+                                    expected_logits({tokens.begin(), tokens.begin() + 20}, tokens[20]));
+
+    passed = passed && cactus_truncate(handle, 100) == -1;
+
+    cactus_destroy(handle);
+    cactus_destroy(reference);
+    return passed;
+}
+
+bool test_session_load_checks_before_restoring() {
+    TestModel files("./test_model_session", "qwen");
+    TestModel other_files("./test_model_session_other", "qwen", 99);
+    auto* saved = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+    auto* loaded = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+    auto* other = static_cast<CactusModelHandle*>(cactus_init(other_files.path().c_str(), nullptr, false));
+    const std::string path = "test_model.session";
+    const std::string damaged_path = "test_model_damaged.session";
+    bool passed = saved && loaded && other;
+
+    const std::vector<uint32_t> tokens = test_tokens(24, 11);
+    if (passed) {
+        saved->model->prefill(tokens, 256);
+        saved->processed_tokens = tokens;
+        passed = cactus_session_save(saved, path.c_str()) == 0;
+
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ofstream(damaged_path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size() / 2));
+    }
+
+    // Same cache layout, different weights: rejected without touching the conversation.
+    if (passed) {
+        other->model->prefill({tokens.begin(), tokens.begin() + 10}, 256);
+        other->processed_tokens.assign(tokens.begin(), tokens.begin() + 10);
+        passed = cactus_session_load(other, path.c_str()) == -1 &&
+                 other->model->get_cached_tokens() == 10 && other->processed_tokens.size() == 10;
+    }
+
+    if (passed) {
+        passed = cactus_session_load(loaded, path.c_str()) == 0 && loaded->processed_tokens == tokens &&
+                 loaded->model->get_cached_tokens() == tokens.size();
+        std::vector<float> expected = saved->model->forward_logits({tokens[3]});
+        passed = passed && logits_match(loaded->model->forward_logits({tokens[3]}), expected);
+        // A damaged file fails before the restored conversation is reset.
+        passed = passed && cactus_session_load(loaded, damaged_path.c_str()) == -1 &&
+                 loaded->model->get_cached_tokens() == tokens.size() + 1 &&
+                 loaded->processed_tokens == tokens;
+    }
+
+    std::remove(path.c_str());
+    std::remove(damaged_path.c_str());
+    cactus_destroy(saved);
+    cactus_destroy(loaded);
+    cactus_destroy(other);
+    return passed;
+}
+
+bool test_tokenize_batch_ffi() {
+    TestModel files("./test_model_tokenize", "qwen");
+    auto* handle = cactus_init(files.path().c_str(), nullptr, false);
+    if (!handle) return false;
+
+    const char* texts[] = {"hello world", "", "ab ab ab", "<|im_start|>user\nhi<|im_end|>"};
+    const size_t num_texts = 4;
+    std::vector<std::vector<uint32_t>> expected(num_texts);
+    size_t total = 0;
+    bool passed = true;
+    for (size_t i = 0; i < num_texts; ++i) {
+        size_t len = 0;
+        expected[i].resize(64);
+        passed = passed && cactus_tokenize(handle, texts[i], expected[i].data(), expected[i].size(), &len) == 0;
+        expected[i].resize(len);
+        total += len;
+    }
+
+    // A NULL buffer only reports the sizes.
+    size_t out_len = 0;
+    std::vector<size_t> offsets(num_texts + 1, 999);
+    passed = passed && cactus_tokenize_batch(handle, texts, num_texts, nullptr, 0, offsets.data(), &out_len) == 0 &&
+             out_len == total && offsets[0] == 0 && offsets[num_texts] == total;
+
+    // A short buffer fails with -2 but still reports the sizes.
+    std::vector<uint32_t> tokens(total, 0);
+    out_len = 0;
+    passed = passed && cactus_tokenize_batch(handle, texts, num_texts, tokens.data(), total - 1, offsets.data(), &out_len) == -2 &&
+             out_len == total;
+
+    passed = passed && cactus_tokenize_batch(handle, texts, num_texts, tokens.data(), total, offsets.data(), &out_len) == 0;
+    for (size_t i = 0; passed && i < num_texts; ++i) {
+        passed = std::vector<uint32_t>(tokens.begin() + offsets[i], tokens.begin() + offsets[i + 1]) == expected[i];
+    }
+
+    passed = passed && cactus_tokenize_batch(handle, nullptr, 1, tokens.data(), total, nullptr, &out_len) == -1;
+
+    cactus_destroy(handle);
+    return passed;
+}
+
+// Every prompt of a batch must come out as it does decoded on its own, greedily: the rows share
+// one M=N forward pass, the LM head is sliced per row and each row is sampled by itself. LFM2
+// keeps a convolution window per sequence as well.
+bool test_decode_batch_matches_single_decodes() {
+    const std::vector<std::string> greedy = {"default_temperature=0", "default_top_p=0", "default_top_k=0"};
+    const size_t max_tokens = 8;
+    std::vector<std::vector<uint32_t>> prompts = {test_tokens(5, 21), test_tokens(12, 22), test_tokens(1, 23), test_tokens(9, 24)};
+    bool passed = true;
+
+    for (const char* model_type : {"qwen", "lfm2"}) {
+        TestModel files(std::string("./test_model_batch_") + model_type, model_type, 1234, greedy);
+        auto* handle = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+        if (!handle) return false;
+        const uint32_t eos = handle->model->get_tokenizer()->get_eos_token();
+        passed = passed && handle->model->get_config().default_top_k == 0;
+
+        std::vector<uint32_t> flat;
+        std::vector<size_t> prompt_offsets = {0};
+        std::vector<uint32_t> expected;
+        std::vector<size_t> expected_offsets = {0};
+        for (const auto& prompt : prompts) {
+            flat.insert(flat.end(), prompt.begin(), prompt.end());
+            prompt_offsets.push_back(flat.size());
+
+            handle->model->reset_cache();
+            if (prompt.size() > 1) {
+                handle->model->prefill({prompt.begin(), prompt.end() - 1}, 256);
+            }
+            uint32_t next = prompt.back();
+            for (size_t step = 0; step < max_tokens; ++step) {
+                next = handle->model->decode({next});
+                if (next == eos) break;
+                expected.push_back(next);
+            }
+            expected_offsets.push_back(expected.size());
+        }
+        handle->model->reset_cache();
+
+        // The conversation is left alone: a token cached before the batch is still the only one after it.
+        handle->model->prefill({prompts[0][0]}, 256);
+        const std::string options = "{\"max_tokens\": " + std::to_string(max_tokens) + "}";
+        std::vector<uint32_t> tokens(prompts.size() * max_tokens);
+        std::vector<size_t> offsets(prompts.size() + 1);
+        size_t total = 0;
+        // Size queries and short buffers are answered before anything is decoded.
+        passed = passed && cactus_decode_batch(handle, flat.data(), prompt_offsets.data(), prompts.size(), options.c_str(),
+                                               nullptr, 0, nullptr, &total) == 0 && total == tokens.size();
+        total = 0;
+        passed = passed && cactus_decode_batch(handle, flat.data(), prompt_offsets.data(), prompts.size(), options.c_str(),
+                                               tokens.data(), tokens.size() - 1, offsets.data(), &total) == -2 &&
+                 total == tokens.size() && offsets == std::vector<size_t>(prompts.size() + 1);
+        passed = passed && cactus_decode_batch(handle, flat.data(), prompt_offsets.data(), prompts.size(), options.c_str(),
+                                               tokens.data(), tokens.size(), offsets.data(), &total) == 0;
+        tokens.resize(total);
+        passed = passed && tokens == expected && offsets == expected_offsets &&
+                 handle->model->get_cached_tokens() == 1;
+
+        cactus_destroy(handle);
+    }
+    return passed;
+}
+
+// Replayed single-token graphs must match graphs rebuilt every step, while the position
+// offset advances, the KV cache crosses block boundaries and (with a window) slides.
+bool test_decode_replay_matches_rebuild() {
+    bool passed = true;
+
+    // Prompts both shorter and longer than the LFM2 conv window, so replay starts while the
+    // conv rows still move; a rollback mid-way moves them again.
+    for (const char* model_type : {"qwen", "lfm2"}) {
+        TestModel files(std::string("./test_model_replay_") + model_type, model_type);
+        TestModel rebuilt_files(std::string("./test_model_rebuild_") + model_type, model_type, 1234, {"decode_graph_replay=false"});
+
+        for (size_t prompt_len : {size_t(1), size_t(20)}) {
+            const std::vector<uint32_t> prompt = test_tokens(prompt_len, 5);
+            for (const char* window : {"", "32"}) {
+                if (*window) setenv("CACTUS_KV_WINDOW_SIZE", window, 1);
+                auto* replayed = static_cast<CactusModelHandle*>(cactus_init(files.path().c_str(), nullptr, false));
+                auto* rebuilt = static_cast<CactusModelHandle*>(cactus_init(rebuilt_files.path().c_str(), nullptr, false));
+                unsetenv("CACTUS_KV_WINDOW_SIZE");
+                passed = passed && replayed && rebuilt;
+
+                if (passed) {
+                    replayed->model->prefill(prompt, 256);
+                    rebuilt->model->prefill(prompt, 256);
+                    uint32_t next = prompt.back();
+                    for (size_t step = 0; passed && step < 40; ++step) {
+                        uint32_t token = replayed->model->decode_step({next}, 0.0f, 0.0f, 0);
+                        passed = token == rebuilt->model->decode_step({next}, 0.0f, 0.0f, 0) &&
+                                 !rebuilt->model->has_decode_graph();
+                        next = token;
+                    }
+                    passed = passed && replayed->model->has_decode_graph();
+                    passed = passed && replayed->model->truncate_cache(3) && rebuilt->model->truncate_cache(3);
+                    for (size_t step = 0; passed && step < 40; ++step) {
+                        std::vector<float> logits = replayed->model->forward_logits({next});
+                        passed = logits == rebuilt->model->forward_logits({next});
+                        next = static_cast<uint32_t>(std::max_element(logits.begin(), logits.end()) - logits.begin());
+                    }
+                    passed = passed && replayed->model->has_decode_graph();
+                }
+
+                cactus_destroy(replayed);
+                cactus_destroy(rebuilt);
+            }
+        }
+    }
+    return passed;
+}
+
+int main() {
+    TestUtils::TestRunner runner("Model Tests");
+    runner.run_test("truncate_refills_past_the_window", test_truncate_refills_past_the_window());
+    runner.run_test("session_load_checks_before_restoring", test_session_load_checks_before_restoring());
+    runner.run_test("decode_replay_matches_rebuild", test_decode_replay_matches_rebuild());
+    runner.run_test("tokenize_batch_ffi", test_tokenize_batch_ffi());
+    runner.run_test("decode_batch_matches_single_decodes", test_decode_batch_matches_single_decodes());
+    runner.print_summary();
+    return runner.all_passed() ? 0 : 1;
+}
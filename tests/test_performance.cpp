@@ -9,6 +9,11 @@
 #include <random>
 #include <filesystem>
 #include <fstream>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
+#include <condition_variable>
 
 struct BenchmarkConfig {
     std::vector<size_t> dimensions = {1024};
@@ -956,6 +961,103 @@ void benchmark_gemm_f16_direct(TestUtils::TestRunner& runner, const BenchmarkCon
     }
 }
 
+// Reference mutex + deque pool with a packaged_task per chunk, kept to compare dispatch cost.
+class MutexQueuePool {
+public:
+    explicit MutexQueuePool(size_t num_threads) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back([this]() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~MutexQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    template<typename F>
+    void parallel_for(size_t total_work, size_t num_tasks, F func) {
+        std::vector<std::future<void>> futures;
+        const size_t per_task = total_work / num_tasks;
+        for (size_t t = 0; t < num_tasks; ++t) {
+            size_t start = t * per_task;
+            size_t end = (t == num_tasks - 1) ? total_work : start + per_task;
+            auto task = std::make_shared<std::packaged_task<void()>>([=]() { func(start, end); });
+            futures.push_back(task->get_future());
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.emplace_back([task]() { (*task)(); });
+            }
+            cv_.notify_one();
+        }
+        for (auto& f : futures) f.wait();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+void benchmark_thread_pool_dispatch(TestUtils::TestRunner& runner, const BenchmarkConfig& config) {
+    auto& pool = CactusThreading::get_thread_pool();
+    const size_t num_tasks = pool.num_workers();
+    MutexQueuePool reference(num_tasks);
+    const int dispatches = 2000 * config.iterations;
+
+    std::vector<size_t> sizes = {0, 1024, 16384};
+    for (size_t num_elements : sizes) {
+        std::vector<__fp16> A(num_elements), B(num_elements), C(num_elements);
+        setup_random_data(A);
+        setup_random_data(B);
+        const size_t total_work = std::max(num_elements, num_tasks);
+
+        auto work = [&](size_t start, size_t end) {
+            if (num_elements == 0) return;
+            end = std::min(end, num_elements);
+            if (start < end) {
+                cactus_add_f16(A.data() + start, B.data() + start, C.data() + start, end - start);
+            }
+        };
+
+        double serial_ms = time_operation<__fp16>([&]() {
+            work(0, total_work);
+        }, dispatches);
+        double stealing_ms = time_operation<__fp16>([&]() {
+            pool.fork_join(total_work, num_tasks, work);
+        }, dispatches);
+        double mutex_ms = time_operation<__fp16>([&]() {
+            reference.parallel_for(total_work, num_tasks, work);
+        }, dispatches);
+
+        std::ostringstream details;
+        details << std::fixed << std::setprecision(2)
+                << "serial " << serial_ms * 1000.0 / dispatches << "us, "
+                << "work-stealing " << stealing_ms * 1000.0 / dispatches << "us, "
+                << "mutex queue " << mutex_ms * 1000.0 / dispatches << "us";
+        runner.log_performance("Pool Dispatch " + std::to_string(num_tasks) + " tasks, " +
+                               std::to_string(num_elements) + " elements", details.str());
+    }
+}
+
 bool test_gemm_f16_direct_performance(TestUtils::TestRunner& runner) {
     BenchmarkConfig config;
     benchmark_gemm_f16_direct(runner, config);
@@ -1045,6 +1147,12 @@ bool test_gather_operations_performance(TestUtils::TestRunner& runner) {
     return true;
 }
 
+bool test_thread_pool_performance(TestUtils::TestRunner& runner) {
+    BenchmarkConfig config;
+    benchmark_thread_pool_dispatch(runner, config);
+    return true;
+}
+
 bool test_signals_performance(TestUtils::TestRunner& runner) {
     BenchmarkConfig config;
 
@@ -1073,6 +1181,7 @@ int main() {
     runner.run_test("Engine Operations", test_engine_operations_performance(runner));
     runner.run_test("Gather Operations", test_gather_operations_performance(runner));
     runner.run_test("Signals Operations", test_signals_performance(runner));
+    runner.run_test("Thread Pool Dispatch", test_thread_pool_performance(runner));
 
     runner.print_summary();
     return runner.all_passed() ? 0 : 1;
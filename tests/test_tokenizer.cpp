@@ -0,0 +1,314 @@
+#include "../cactus/cactus.h"
+#include "test_utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cactus::engine;
+
+namespace {
+
+const char* g_assets_path = std::getenv("CACTUS_TEST_ASSETS");
+
+void write_lines(const std::string& path, const std::vector<std::string>& lines) {
+    std::ofstream out(path);
+    for (const auto& line : lines) out << line << "\n";
+}
+
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+}
+
+bool test_bpe_merge_order() {
+    const std::string vocab_file = "test_tokenizer_vocab.txt";
+    const std::string merges_file = "test_tokenizer_merges.txt";
+    // ids:             0        1    2    3    4     5     6      7
+    write_lines(vocab_file, {"<unk>", "a", "b", "c", "aa", "ab", "bc", "abc"});
+    // "ab c" and "a bc" produce the same string, so the second pair must not pick up the first's merge.
+    write_lines(merges_file, {"#version: 0.2", "b c", "ab c", "a b", "a a"});
+
+    BPETokenizer tokenizer;
+    bool passed = tokenizer.load_vocabulary_mmap(vocab_file, merges_file);
+
+    auto encode = [&](const std::string& text) { return tokenizer.encode(text); };
+    for (int pass = 0; passed && pass < 2; ++pass) {
+        // "b c" outranks "a b", leaving (a, bc), which has no merge.
+        passed = passed && encode("abc") == std::vector<uint32_t>{1, 6};
+        // Equal ranks merge leftmost first.
+        passed = passed && encode("aaa") == std::vector<uint32_t>{4, 1};
+        passed = passed && encode("abab") == std::vector<uint32_t>{5, 5};
+        // Bytes outside the vocabulary stay separate <unk> symbols.
+        passed = passed && encode("xy") == std::vector<uint32_t>{0, 0};
+        passed = passed && encode("axyb") == std::vector<uint32_t>{1, 0, 0, 2};
+    }
+    passed = passed && tokenizer.decode({1, 6}) == "abc";
+
+    std::remove(vocab_file.c_str());
+    std::remove(merges_file.c_str());
+    return passed;
+}
+
+// Each record of split_words_corpus.txt is "<byte length>\n<text>\n" followed by the word lengths
+// the reference regex produces for the single-digit pattern, then for the three-digit one.
+bool test_split_words_corpus() {
+    if (!g_assets_path) {
+        std::cout << "⊘ SKIP │ CACTUS_TEST_ASSETS not set\n";
+        return true;
+    }
+    std::ifstream corpus(std::string(g_assets_path) + "/split_words_corpus.txt", std::ios::binary);
+    if (!corpus.is_open()) return false;
+
+    size_t records = 0;
+    size_t length = 0;
+    std::vector<std::string_view> words;
+    while (corpus >> length) {
+        corpus.get();
+        std::string text(length, '\0');
+        corpus.read(text.data(), static_cast<std::streamsize>(length));
+        corpus.get();
+        for (size_t max_digits : {size_t(1), size_t(3)}) {
+            std::string line;
+            std::getline(corpus, line);
+            std::istringstream expected_stream(line);
+            std::vector<size_t> expected;
+            for (size_t word_length; expected_stream >> word_length;) expected.push_back(word_length);
+
+            words.clear();
+            cactus::engine::split_words(text, max_digits, words);
+            if (words.size() != expected.size()) return false;
+            for (size_t i = 0; i < words.size(); ++i) {
+                if (words[i].size() != expected[i]) return false;
+            }
+        }
+        ++records;
+    }
+    return records == 4008;
+}
+
+bool test_bpe_split_pattern_detection() {
+    const std::string vocab_file = "./test_tokenizer_vocab.txt";
+    const std::string merges_file = "./test_tokenizer_merges.txt";
+    const std::string config_file = "./test_tokenizer_config.txt";
+    const std::string tokenizer_json = "./tokenizer.json";
+    write_lines(vocab_file, {"<unk>", "a", "b", "1", "b1", "ab"});
+    write_lines(merges_file, {"b 1", "a b"});
+    write_lines(config_file, {"unk_token_id=0"});
+
+    const std::string qwen = R"re((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)re";
+    const std::string llama = R"re((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)re";
+    const std::string gpt2 = R"re('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)re";
+
+    // "ab1" is one segment to a tokenizer that does not pre-tokenize, so "b 1" merges first.
+    auto encode_with = [&](const std::string& pattern) {
+        write_lines(tokenizer_json, {"{\"pre_tokenizer\": {\"type\": \"Split\", \"pattern\": {\"Regex\": \"" +
+                                     json_escape(pattern) + "\"}}, \"decoder\": null}"});
+        BPETokenizer tokenizer;
+        if (!tokenizer.load_vocabulary_with_config(vocab_file, merges_file, config_file)) return std::vector<uint32_t>{};
+        return tokenizer.encode("ab1");
+    };
+    bool passed = encode_with(qwen) == std::vector<uint32_t>{5, 3};
+    passed = passed && encode_with(llama) == std::vector<uint32_t>{5, 3};
+    passed = passed && encode_with(gpt2) == std::vector<uint32_t>{1, 4};
+    passed = passed && encode_with(qwen + "|x") == std::vector<uint32_t>{1, 4};
+
+    std::remove(vocab_file.c_str());
+    std::remove(merges_file.c_str());
+    std::remove(config_file.c_str());
+    std::remove(tokenizer_json.c_str());
+    return passed;
+}
+
+bool test_encode_batch_matches_encode() {
+    const std::string vocab_file = "./test_tokenizer_vocab.txt";
+    const std::string merges_file = "./test_tokenizer_merges.txt";
+    const std::string config_file = "./test_tokenizer_config.txt";
+    const std::string tokenizer_json = "./tokenizer.json";
+    // The byte-level stand-in for a space.
+    const std::string sp = "\xC4\xA0";
+    // ids:                    0        1    2    3    4   5    6     7     8       9
+    write_lines(vocab_file, {"<unk>", "a", "b", "c", "d", sp, "ab", "cd", "abcd", sp + "a"});
+    write_lines(merges_file, {"#version: 0.2", "a b", "c d", "ab cd", sp + " a"});
+    write_lines(config_file, {"unk_token_id=0"});
+    const std::string qwen = R"re((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)re";
+    write_lines(tokenizer_json, {"{\"pre_tokenizer\": {\"type\": \"Split\", \"pattern\": {\"Regex\": \"" +
+                                 json_escape(qwen) + "\"}}, \"decoder\": null}"});
+
+    // More distinct words than the word cache holds, so shards evict while threads share them.
+    std::vector<std::string> texts;
+    uint32_t state = 12345;
+    for (size_t t = 0; t < 600; ++t) {
+        std::string text;
+        for (size_t w = 0; w < 20; ++w) {
+            if (w > 0) text += ' ';
+            state = state * 1103515245u + 12345u;
+            for (size_t len = 1 + (state >> 16) % 8, i = 0; i < len; ++i) {
+                state = state * 1103515245u + 12345u;
+                text += static_cast<char>('a' + (state >> 16) % 4);
+            }
+        }
+        texts.push_back(text);
+    }
+    texts.push_back("");
+
+    BPETokenizer batched, reference;
+    bool passed = batched.load_vocabulary_with_config(vocab_file, merges_file, config_file) &&
+                  reference.load_vocabulary_with_config(vocab_file, merges_file, config_file);
+    passed = passed && reference.encode("ab abcd a") == std::vector<uint32_t>{6, 5, 8, 9};
+
+    std::vector<std::vector<uint32_t>> expected;
+    for (const auto& text : texts) expected.push_back(reference.encode(text));
+    // Once cold, once with the cache filled by the first pass.
+    for (int pass = 0; passed && pass < 2; ++pass) {
+        passed = batched.encode_batch(texts) == expected;
+    }
+    passed = passed && batched.encode_batch({}).empty();
+
+    std::remove(vocab_file.c_str());
+    std::remove(merges_file.c_str());
+    std::remove(config_file.c_str());
+    std::remove(tokenizer_json.c_str());
+    return passed;
+}
+
+bool test_trie_longest_prefix() {
+    DoubleArrayTrie trie;
+    // "ab" appears twice; the later id wins. Empty keys are skipped.
+    trie.build({"a", "ab", "abc", "", "b", "ab", "\xE2\x96\x81x"});
+
+    auto match = [&](const std::string& text) { return trie.longest_prefix(text.data(), text.size()); };
+    using Match = std::pair<size_t, int32_t>;
+    return match("abcd") == Match{3, 2} &&
+           match("abd") == Match{2, 5} &&
+           match("a") == Match{1, 0} &&
+           match("ba") == Match{1, 4} &&
+           match("c") == Match{0, -1} &&
+           match("") == Match{0, -1} &&
+           match("\xE2\x96\x81xy") == Match{4, 6} &&
+           match("\xE2\x96") == Match{0, -1};
+}
+
+bool test_trie_save_load_round_trip() {
+    const std::string path = "test_tokenizer.trie";
+    const std::vector<std::string> keys = {"<unk>", "he", "hell", "hello", "w", "world"};
+    DoubleArrayTrie built;
+    built.build(keys);
+    bool passed = built.save(path, 42);
+
+    DoubleArrayTrie loaded;
+    passed = passed && loaded.load(path, 42, keys.size()) && loaded.num_units() == built.num_units();
+    for (const std::string text : {"hello world", "help", "worlds", "x", "hel"}) {
+        passed = passed && loaded.longest_prefix(text.data(), text.size()) == built.longest_prefix(text.data(), text.size());
+    }
+
+    // A trie saved for another vocabulary is stale.
+    DoubleArrayTrie stale;
+    passed = passed && !stale.load(path, 43, keys.size()) && !stale.load(path, 42, keys.size() + 1);
+
+    // Damage the id stored for "hello"; the match falls back to "hell" rather than returning it.
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const size_t header_size = bytes.size() - built.num_units() * sizeof(DoubleArrayTrie::Unit);
+        for (size_t offset = header_size; offset < bytes.size(); offset += sizeof(DoubleArrayTrie::Unit)) {
+            DoubleArrayTrie::Unit unit;
+            std::memcpy(&unit, bytes.data() + offset, sizeof(unit));
+            if (unit.value == 3) {
+                unit.value = 1000;
+                file.seekp(static_cast<std::streamoff>(offset));
+                file.write(reinterpret_cast<const char*>(&unit), sizeof(unit));
+            }
+        }
+    }
+    DoubleArrayTrie damaged;
+    passed = passed && damaged.load(path, 42, keys.size());
+    const std::string hello = "hello";
+    passed = passed && damaged.longest_prefix(hello.data(), hello.size()) == std::pair<size_t, int32_t>{4, 2};
+
+    std::remove(path.c_str());
+    return passed;
+}
+
+bool test_sp_tokenizer_rebuilds_stale_trie() {
+    const std::string vocab_file = "./test_sp_vocab.txt";
+    const std::string config_file = "./test_sp_config.txt";
+    const std::string trie_file = "./vocab.trie";
+    write_lines(config_file, {"unk_token_id=0"});
+
+    write_lines(vocab_file, {"<unk>", "a", "b", "ab"});
+    SPTokenizer first;
+    bool passed = first.load_vocabulary_with_config(vocab_file, "", config_file) &&
+                  first.encode("ab") == std::vector<uint32_t>{3};
+    passed = passed && std::ifstream(trie_file).good();
+
+    // Same size, different keys: the cached trie must not be reused.
+    write_lines(vocab_file, {"<unk>", "a", "b", "c"});
+    SPTokenizer second;
+    passed = passed && second.load_vocabulary_with_config(vocab_file, "", config_file) &&
+             second.encode("abc") == std::vector<uint32_t>{1, 2, 3};
+
+    SPTokenizer cached;
+    passed = passed && cached.load_vocabulary_with_config(vocab_file, "", config_file) &&
+             cached.encode("cab") == std::vector<uint32_t>{3, 1, 2};
+
+    std::remove(vocab_file.c_str());
+    std::remove(config_file.c_str());
+    std::remove(trie_file.c_str());
+    return passed;
+}
+
+bool test_streaming_detokenizer_split_character() {
+    const std::string vocab_file = "test_tokenizer_vocab.txt";
+    const std::string merges_file = "test_tokenizer_merges.txt";
+    // Byte-level pieces: "ðŁĺ" is F0 9F 98, the first three bytes of U+1F600, and "Ģ" is its last byte 80.
+    write_lines(vocab_file, {"<unk>", "a", "\u00F0\u0141\u013A", "\u0122", "\u00F0"});
+    write_lines(merges_file, {"#version: 0.2"});
+
+    BPETokenizer tokenizer;
+    bool passed = tokenizer.load_vocabulary_mmap(vocab_file, merges_file);
+
+    StreamingDetokenizer stream(tokenizer);
+    passed = passed && stream.push(1) == "a";
+    passed = passed && stream.push(2).empty();
+    passed = passed && stream.push(3) == "\xF0\x9F\x98\x80";
+    passed = passed && stream.push(1) == "a";
+    passed = passed && stream.flush().empty();
+
+    // A character still open when generation ends comes out of flush, and the stream starts clean.
+    passed = passed && stream.push(2).empty();
+    passed = passed && stream.flush() == "\xF0\x9F\x98";
+    passed = passed && stream.push(1) == "a";
+    passed = passed && stream.push(4).empty();
+    passed = passed && stream.push(1) == "\xF0" "a";
+
+    std::remove(vocab_file.c_str());
+    std::remove(merges_file.c_str());
+    return passed;
+}
+
+int main() {
+    TestUtils::TestRunner runner("Tokenizer Tests");
+
+    runner.run_test("BPE Merge Order", test_bpe_merge_order());
+    runner.run_test("Split Words Matches Reference Corpus", test_split_words_corpus());
+    runner.run_test("BPE Split Pattern Detection", test_bpe_split_pattern_detection());
+    runner.run_test("Encode Batch Matches Encode", test_encode_batch_matches_encode());
+    runner.run_test("Trie Longest Prefix", test_trie_longest_prefix());
+    runner.run_test("Trie Save/Load Round Trip", test_trie_save_load_round_trip());
+    runner.run_test("SP Tokenizer Rebuilds Stale Trie", test_sp_tokenizer_rebuilds_stale_trie());
+    runner.run_test("Streaming Detokenizer Split Character", test_streaming_detokenizer_split_character());
+
+    runner.print_summary();
+    return runner.all_passed() ? 0 : 1;
+}